@@ -0,0 +1,277 @@
+#include "benchharness.h"
+#include <QCommandLineParser>
+#include <QMap>
+#include <QRegularExpression>
+
+#define BENCH_COMPARE_THRESHOLD 5.0 // 默认的回归阈值（百分比），中位数变化超过阈值才可能判为回归
+#define BENCH_COMPARE_MAD_FACTOR 3.0 // 变化量还须超过噪声：两边MAD中较大者的倍数
+#define BENCH_COMPARE_FORMAT "aims-bench-baseline" // 基线文件的格式标识
+
+#define EXIT_REGRESSION 1 // 有用例回归或缺失
+#define EXIT_INPUT_ERROR 2 // 输入文件无法读取、格式不认识或过滤表达式无效
+
+// 比较基准测试结果与基线：输入可以是基准测试的 --json 输出（benchharness.h）、LoadGen 的报告或基线文件，
+// 同名指标的多次运行合并为一组样本，按中位数和MAD判断变化是否超出噪声
+namespace BenchCompare {
+
+    class Metric {
+    public:
+        QString Unit; // 样本的单位，如 ns、ms、req/s
+        bool LowerIsBetter = true; // 耗时越低越好，吞吐量越高越好
+        QVector<double> Samples; // 所有运行的样本
+    };
+
+    typedef QMap<QString, Metric> Metrics;
+
+    class Comparison {
+    public:
+        QString Name;
+        double Baseline = 0; // 基线中位数
+        double Current = 0; // 本次中位数
+        double Change = 0; // 变差的百分比，为负表示变好
+        double Noise = 0; // 噪声占基线的百分比
+        QString Verdict; // ok、regressed、improved、new、missing
+    };
+
+    double mad(const QVector<double> &values, double center) {
+        QVector<double> deviations;
+        for (double value: values) {
+            deviations.append(qAbs(value - center));
+        }
+        return Bench::median(deviations);
+    }
+
+    void addSamples(Metrics &metrics, const QString &name, const QString &unit, bool lowerIsBetter,
+                    const QJsonArray &samples) {
+        Metric &metric = metrics[name];
+        metric.Unit = unit;
+        metric.LowerIsBetter = lowerIsBetter;
+        for (const auto &sample: samples) {
+            metric.Samples.append(sample.toDouble());
+        }
+    }
+
+    // 基准测试的每个用例保留全部采样；LoadGen 的每个路由每次运行只有一个值，多次运行的值组成样本
+    bool load(const QString &path, Metrics &metrics) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            qWarning() << "BenchCompare | cannot read" << path << file.errorString();
+            return false;
+        }
+        QJsonParseError error;
+        QJsonObject object = QJsonDocument::fromJson(file.readAll(), &error).object();
+        if (error.error != QJsonParseError::NoError) {
+            qWarning() << "BenchCompare |" << path << error.errorString();
+            return false;
+        }
+
+        if (object["format"].toString() == BENCH_COMPARE_FORMAT) {
+            QJsonObject items = object["metrics"].toObject();
+            for (auto it = items.begin(); it != items.end(); ++it) {
+                QJsonObject item = it.value().toObject();
+                addSamples(metrics, it.key(), item["unit"].toString(), item["lowerIsBetter"].toBool(true),
+                           item["samples"].toArray());
+            }
+            return true;
+        }
+        if (object.contains("results")) {
+            QString suite = object["suite"].toString();
+            QString unit = object["unit"].toString("ns");
+            for (const auto &value: object["results"].toArray()) {
+                QJsonObject item = value.toObject();
+                QJsonArray samples = item["samples"].toArray();
+                if (samples.isEmpty()) {
+                    samples.append(item["median"].toDouble());
+                }
+                addSamples(metrics, suite + ": " + item["name"].toString(), unit, true, samples);
+            }
+            return true;
+        }
+        if (object.contains("routes")) {
+            QString prefix = "LoadGen " + object["scenario"].toString() + ": ";
+            QJsonObject routes = object["routes"].toObject();
+            for (auto it = routes.begin(); it != routes.end(); ++it) {
+                QJsonObject route = it.value().toObject();
+                for (const char *key: {"p50", "p99"}) {
+                    addSamples(metrics, prefix + it.key() + " " + key, "ms", true,
+                               QJsonArray{route.value(QLatin1StringView(key))});
+                }
+                addSamples(metrics, prefix + it.key() + " throughput", "req/s", false,
+                           QJsonArray{route.value("throughput")});
+                // 错误率越高越差，没有请求的路由不计
+                double count = route["count"].toDouble();
+                if (count > 0) {
+                    addSamples(metrics, prefix + it.key() + " error rate", "%", true,
+                               QJsonArray{100.0 * route["errors"].toDouble() / count});
+                }
+            }
+            return true;
+        }
+        qWarning() << "BenchCompare | unknown result format:" << path;
+        return false;
+    }
+
+    bool save(const QString &path, const Metrics &metrics) {
+        QJsonObject items;
+        for (auto it = metrics.cbegin(); it != metrics.cend(); ++it) {
+            QJsonArray samples;
+            for (double value: it->Samples) {
+                samples.append(value);
+            }
+            QJsonObject item;
+            item["unit"] = it->Unit;
+            item["lowerIsBetter"] = it->LowerIsBetter;
+            item["samples"] = samples;
+            items[it.key()] = item;
+        }
+        QJsonObject object;
+        object["format"] = BENCH_COMPARE_FORMAT;
+        object["metrics"] = items;
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qWarning() << "BenchCompare | cannot write" << path << file.errorString();
+            return false;
+        }
+        file.write(QJsonDocument(object).toJson(QJsonDocument::Indented));
+        return true;
+    }
+
+    // 变化超过阈值且超过两边噪声时才判为回归或改进，单次运行的指标（MAD为0）只看阈值
+    QVector<Comparison> compare(const Metrics &baseline, const Metrics &current, double threshold,
+                                double madFactor) {
+        QVector<Comparison> comparisons;
+        for (auto it = current.cbegin(); it != current.cend(); ++it) {
+            Comparison comparison;
+            comparison.Name = it.key();
+            if (it->Samples.isEmpty()) {
+                continue;
+            }
+            comparison.Current = Bench::median(it->Samples);
+            auto base = baseline.constFind(it.key());
+            if (base == baseline.cend() || base->Samples.isEmpty()) {
+                comparison.Verdict = "new";
+                comparisons.append(comparison);
+                continue;
+            }
+            comparison.Baseline = Bench::median(base->Samples);
+            double noise = madFactor * qMax(mad(base->Samples, comparison.Baseline),
+                                            mad(it->Samples, comparison.Current));
+            double delta = it->LowerIsBetter ? comparison.Current - comparison.Baseline
+                                             : comparison.Baseline - comparison.Current;
+            double scale = qMax(qAbs(comparison.Baseline), 1e-12);
+            comparison.Change = 100.0 * delta / scale;
+            comparison.Noise = 100.0 * noise / scale;
+            if (qAbs(comparison.Change) <= threshold || qAbs(delta) <= noise) {
+                comparison.Verdict = "ok";
+            } else {
+                comparison.Verdict = delta > 0 ? "regressed" : "improved";
+            }
+            comparisons.append(comparison);
+        }
+        for (auto it = baseline.cbegin(); it != baseline.cend(); ++it) {
+            if (!current.contains(it.key()) && !it->Samples.isEmpty()) {
+                Comparison comparison;
+                comparison.Name = it.key();
+                comparison.Baseline = Bench::median(it->Samples);
+                comparison.Verdict = "missing";
+                comparisons.append(comparison);
+            }
+        }
+        return comparisons;
+    }
+
+    void print(const QVector<Comparison> &comparisons, const Metrics &current, const Metrics &baseline) {
+        QTextStream out(stdout);
+        out << qSetFieldWidth(56) << Qt::left << "benchmark" << qSetFieldWidth(14) << Qt::right
+            << "baseline" << "current" << "change" << "noise" << qSetFieldWidth(0) << "  verdict" << Qt::endl;
+        for (const auto &comparison: comparisons) {
+            QString unit = current.contains(comparison.Name) ? current[comparison.Name].Unit
+                                                             : baseline[comparison.Name].Unit;
+            out << qSetFieldWidth(56) << Qt::left << comparison.Name << qSetFieldWidth(14) << Qt::right
+                << (comparison.Verdict == "new" ? "-" : QString::number(comparison.Baseline, 'f', 1) + unit)
+                << (comparison.Verdict == "missing" ? "-" : QString::number(comparison.Current, 'f', 1) + unit)
+                << (comparison.Verdict == "new" || comparison.Verdict == "missing" ? "-" :
+                    QString::asprintf("%+.1f%%", comparison.Change))
+                << (comparison.Verdict == "new" || comparison.Verdict == "missing" ? "-" :
+                    QString::asprintf("%.1f%%", comparison.Noise))
+                << qSetFieldWidth(0) << "  " << (comparison.Verdict == "regressed" ? "REGRESSED" : comparison.Verdict)
+                << Qt::endl;
+        }
+    }
+
+} // BenchCompare
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("BenchCompare");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+            "Compares benchmark results (bench --json output, LoadGen reports) against a stored baseline.\n"
+            "Repeated runs of the same benchmark are merged; a metric regresses when its median gets worse by "
+            "more than the threshold and by more than the noise (MAD) of either side.\n"
+            "Metrics of the baseline missing from the current results count as failures.\n"
+            "Exit code: 0 no regression, 1 regression or missing metric, 2 unreadable input or invalid filter.");
+    parser.addHelpOption();
+    QCommandLineOption baselineOption("baseline", "Baseline file; may be repeated to merge runs.", "file");
+    QCommandLineOption thresholdOption("threshold", "Regression threshold in percent.", "percent",
+                                       QString::number(BENCH_COMPARE_THRESHOLD));
+    QCommandLineOption madFactorOption("mad-factor", "Change must also exceed this many MADs.", "factor",
+                                       QString::number(BENCH_COMPARE_MAD_FACTOR));
+    QCommandLineOption filterOption("filter", "Only fail on metrics matching this regular expression.", "regex");
+    QCommandLineOption saveOption("save", "Write the merged current results as a new baseline file.", "file");
+    parser.addOptions({baselineOption, thresholdOption, madFactorOption, filterOption, saveOption});
+    parser.addPositionalArgument("results", "Current result files, one per run.", "<results>...");
+    parser.process(app);
+
+    if (parser.positionalArguments().isEmpty()) {
+        parser.showHelp(EXIT_INPUT_ERROR);
+    }
+    BenchCompare::Metrics current;
+    for (const auto &path: parser.positionalArguments()) {
+        if (!BenchCompare::load(path, current)) {
+            return EXIT_INPUT_ERROR;
+        }
+    }
+    if (parser.isSet(saveOption) && !BenchCompare::save(parser.value(saveOption), current)) {
+        return EXIT_INPUT_ERROR;
+    }
+    if (!parser.isSet(baselineOption)) {
+        return 0;
+    }
+    BenchCompare::Metrics baseline;
+    for (const auto &path: parser.values(baselineOption)) {
+        if (!BenchCompare::load(path, baseline)) {
+            return EXIT_INPUT_ERROR;
+        }
+    }
+
+    QRegularExpression filter(parser.value(filterOption));
+    if (!filter.isValid()) {
+        qWarning() << "BenchCompare | invalid --filter:" << filter.errorString();
+        return EXIT_INPUT_ERROR;
+    }
+
+    QVector<BenchCompare::Comparison> comparisons = BenchCompare::compare(
+            baseline, current, parser.value(thresholdOption).toDouble(), parser.value(madFactorOption).toDouble());
+    BenchCompare::print(comparisons, current, baseline);
+
+    // 基线中有而本次没有的指标也算失败，避免用例被删除或改名后回归被漏掉
+    int regressions = 0;
+    int missing = 0;
+    for (const auto &comparison: comparisons) {
+        if (!filter.match(comparison.Name).hasMatch()) {
+            continue;
+        }
+        if (comparison.Verdict == "regressed") {
+            regressions++;
+        } else if (comparison.Verdict == "missing") {
+            missing++;
+        }
+    }
+    if (regressions > 0 || missing > 0) {
+        QTextStream(stderr) << regressions << " benchmark(s) regressed, " << missing << " missing" << Qt::endl;
+        return EXIT_REGRESSION;
+    }
+    return 0;
+}
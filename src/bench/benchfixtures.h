@@ -0,0 +1,90 @@
+#ifndef BENCHFIXTURES_H
+#define BENCHFIXTURES_H
+
+#include "../server/serializer.h"
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+// 序列化相关基准测试共用的数据：固定内容的学生、课程列表，以及与服务器相同写法的列表响应
+namespace Bench {
+
+    inline QVector<Student> makeStudents(int rows) {
+        QVector<Student> students;
+        for (int i = 0; i < rows; i++) {
+            Student student;
+            student.Id = QString::number(2021000000 + i);
+            student.Name = "学生" + QString::number(i);
+            student.Sex = i % 2 == 0 ? "男" : "女";
+            student.College = "计算机学院";
+            student.Major = "计算机科学与技术";
+            student.Class = "2021-" + QString::number(i % 40 + 1);
+            student.Age = 18 + i % 5;
+            student.PhoneNumber = QString::number(13800000000LL + i);
+            student.DormitoryArea = "东区";
+            student.DormitoryNum = QString::number(100 + i % 600);
+            for (int j = 0; j < 6; j++) {
+                student.ChosenLessons.append("CS" + QString::number(1000 + (i + j * 7) % 300));
+            }
+            students.append(student);
+        }
+        return students;
+    }
+
+    inline QVector<Lesson> makeLessons(int rows) {
+        QVector<Lesson> lessons;
+        for (int i = 0; i < rows; i++) {
+            Lesson lesson;
+            lesson.Id = "CS" + QString::number(100000 + i);
+            lesson.LessonName = "程序设计 \"" + QString::number(i) + "\"";
+            lesson.TeacherId = "T" + QString::number(i % 500);
+            lesson.LessonCredits = 1 + i % 4;
+            lesson.LessonCapacity = 120;
+            lesson.LessonSemester = "2023-2024-1";
+            lesson.LessonArea = "主校区";
+            lesson.LessonTimeAndLocations.insert("1-" + QString::number(i % 12 + 1), {"教学楼A" + QString::number(i % 30)});
+            lesson.LessonTimeAndLocations.insert("3-" + QString::number(i % 12 + 1), {"教学楼B" + QString::number(i % 30)});
+            for (int j = 0; j < 40; j++) {
+                lesson.LessonStudents.append(QString::number(2021000000 + (i * 13 + j) % 50000));
+            }
+            lesson.LessonStudentCount = int(lesson.LessonStudents.size());
+            lessons.append(lesson);
+        }
+        return lessons;
+    }
+
+    // 与服务器 listStudents、listLessons 中的写法相同
+    template<typename Writer, typename Row, typename Function>
+    QByteArray listByWriter(const QVector<Row> &rows, const char *name, Function write) {
+        Writer writer(SERIALIZER_RESERVE + rows.size() * SERIALIZER_ROW_RESERVE);
+        writer.beginObject();
+        writer.field("success", true);
+        writer.field("total", int(rows.size()));
+        writer.field("totalPages", 1);
+        writer.key(name);
+        writer.beginArray();
+        for (const auto &row: rows) {
+            write(writer, row);
+        }
+        writer.endArray();
+        writer.endObject();
+        return writer.data();
+    }
+
+    template<typename Writer>
+    QByteArray studentsByWriter(const QVector<Student> &students) {
+        return listByWriter<Writer>(students, "students", [](Writer &writer, const Student &student) {
+            Serializer::writeObject(writer, student);
+        });
+    }
+
+    template<typename Writer>
+    QByteArray lessonsByWriter(const QVector<Lesson> &lessons) {
+        return listByWriter<Writer>(lessons, "lessons", [](Writer &writer, const Lesson &lesson) {
+            Serializer::writeObject(writer, lesson);
+        });
+    }
+
+} // Bench
+
+#endif //BENCHFIXTURES_H
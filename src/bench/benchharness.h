@@ -0,0 +1,215 @@
+#ifndef BENCHHARNESS_H
+#define BENCHHARNESS_H
+
+#include "perfcounters.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+#include <QTextStream>
+#include <algorithm>
+
+#define BENCH_SAMPLES 15 // 每个用例的采样次数
+#define BENCH_MIN_SAMPLE_TIME 20000000 // 每次采样的最短时间（纳秒），不足时自动增加迭代次数
+
+namespace Bench {
+
+    class Result {
+    public:
+        QString Name; // 用例名称
+        qint64 Iterations; // 每次采样的迭代次数
+        double Median; // 每次操作耗时的中位数（纳秒）
+        double Min; // 每次操作耗时的最小值（纳秒）
+        double Mad; // 中位数绝对偏差（纳秒）
+        QVector<double> Samples; // 每次采样的单次操作耗时（纳秒）
+        Counters Hardware; // 每次操作的硬件计数，未启用 --counters 时不可用
+    };
+
+    inline double median(QVector<double> values) {
+        std::sort(values.begin(), values.end());
+        qsizetype n = values.size();
+        return n % 2 == 1 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2.0;
+    }
+
+    // 防止编译器把被测代码的结果优化掉
+    template<typename T>
+    inline void doNotOptimize(const T &value) {
+        asm volatile("" : : "m"(value) : "memory");
+    }
+
+    inline Result summarize(const QString &name, qint64 iterations, const QVector<double> &samples) {
+        Result result;
+        result.Name = name;
+        result.Iterations = iterations;
+        result.Median = median(samples);
+        result.Min = *std::min_element(samples.begin(), samples.end());
+        QVector<double> deviations;
+        for (double value: samples) {
+            deviations.append(qAbs(value - result.Median));
+        }
+        result.Mad = median(deviations);
+        result.Samples = samples;
+        return result;
+    }
+
+    // 先通过预热确定迭代次数，再采样BENCH_SAMPLES次，统计每次操作的耗时
+    template<typename Function>
+    Result run(const QString &name, Function function) {
+        QElapsedTimer timer;
+        qint64 iterations = 1;
+        while (true) {
+            timer.start();
+            for (qint64 i = 0; i < iterations; i++) {
+                function();
+            }
+            if (timer.nsecsElapsed() >= BENCH_MIN_SAMPLE_TIME || iterations >= (qint64(1) << 30)) {
+                break;
+            }
+            iterations *= 2;
+        }
+
+        counters &hardware = counters::instance();
+        QVector<double> samples;
+        for (int sample = 0; sample < BENCH_SAMPLES; sample++) {
+            hardware.start();
+            timer.start();
+            for (qint64 i = 0; i < iterations; i++) {
+                function();
+            }
+            samples.append(double(timer.nsecsElapsed()) / double(iterations));
+            hardware.stop();
+        }
+
+        Result result = summarize(name, iterations, samples);
+        result.Hardware = hardware.take(iterations * BENCH_SAMPLES);
+        return result;
+    }
+
+    // 每次调用单独计时，setup不计入耗时，用于会修改数据、不能重复执行的操作（如删除课程）
+    template<typename Setup, typename Function>
+    Result runEach(const QString &name, int samples, Setup setup, Function function) {
+        counters &hardware = counters::instance();
+        QElapsedTimer timer;
+        QVector<double> times;
+        for (int sample = 0; sample < samples; sample++) {
+            setup();
+            hardware.start();
+            timer.start();
+            function();
+            times.append(double(timer.nsecsElapsed()));
+            hardware.stop();
+        }
+        Result result = summarize(name, 1, times);
+        result.Hardware = hardware.take(samples);
+        return result;
+    }
+
+    inline QString formatCounter(double value, int precision) {
+        return value >= 0 ? QString::number(value, 'f', precision) : QString("-");
+    }
+
+    // 启用硬件计数器时在耗时之后输出每次操作的周期数、IPC、缓存未命中和分支预测失败
+    inline void print(const QVector<Result> &results) {
+        bool hardware = std::any_of(results.begin(), results.end(), [](const Result &result) {
+            return result.Hardware.available();
+        });
+        QTextStream out(stdout);
+        out << qSetFieldWidth(40) << Qt::left << "benchmark" << qSetFieldWidth(16) << Qt::right
+            << "median(ns)" << "min(ns)" << "mad(ns)" << "iterations";
+        if (hardware) {
+            out << "cycles/op" << "ipc" << "cache-miss/op" << "branch-miss/op";
+        }
+        out << qSetFieldWidth(0) << Qt::endl;
+        for (const auto &result: results) {
+            out << qSetFieldWidth(40) << Qt::left << result.Name << qSetFieldWidth(16) << Qt::right
+                << QString::number(result.Median, 'f', 1) << QString::number(result.Min, 'f', 1)
+                << QString::number(result.Mad, 'f', 1) << result.Iterations;
+            if (hardware) {
+                const Counters &values = result.Hardware;
+                out << formatCounter(values.Values[BENCH_COUNTER_CYCLES], 0) << formatCounter(values.ipc(), 2)
+                    << formatCounter(values.Values[BENCH_COUNTER_CACHE_MISSES], 2)
+                    << formatCounter(values.Values[BENCH_COUNTER_BRANCH_MISSES], 2);
+            }
+            out << qSetFieldWidth(0) << Qt::endl;
+        }
+    }
+
+    // 机器可读的结果，按用例名称比较不同提交的结果
+    inline QJsonObject toJson(const QVector<Result> &results) {
+        QJsonArray items;
+        for (const auto &result: results) {
+            QJsonArray samples;
+            for (double value: result.Samples) {
+                samples.append(value);
+            }
+            QJsonObject item;
+            item["name"] = result.Name;
+            item["iterations"] = result.Iterations;
+            item["median"] = result.Median;
+            item["min"] = result.Min;
+            item["mad"] = result.Mad;
+            item["samples"] = samples;
+            if (result.Hardware.available()) {
+                // 每次操作的平均计数，不可用的计数器为-1
+                QJsonObject hardware;
+                hardware["cycles"] = result.Hardware.Values[BENCH_COUNTER_CYCLES];
+                hardware["instructions"] = result.Hardware.Values[BENCH_COUNTER_INSTRUCTIONS];
+                hardware["cacheMisses"] = result.Hardware.Values[BENCH_COUNTER_CACHE_MISSES];
+                hardware["branchMisses"] = result.Hardware.Values[BENCH_COUNTER_BRANCH_MISSES];
+                hardware["ipc"] = result.Hardware.ipc();
+                item["counters"] = hardware;
+            }
+            items.append(item);
+        }
+        QJsonObject object;
+        object["suite"] = QCoreApplication::applicationName();
+        object["unit"] = "ns";
+        object["results"] = items;
+        return object;
+    }
+
+    // 命令行中 --json 指定的输出文件，为空时只输出表格
+    inline QString &jsonPath() {
+        static QString path;
+        return path;
+    }
+
+    // 各基准测试共用的命令行选项，程序自己的选项之外再调用
+    inline void addOptions(QCommandLineParser &parser) {
+        parser.addOption(QCommandLineOption("json", "Also write the results as JSON.", "file"));
+        parser.addOption(QCommandLineOption("counters", "Collect hardware counters (Linux perf_event)."));
+    }
+
+    // 在 parser.process 之后调用：记录JSON输出文件，按需打开硬件计数器
+    inline void init(const QCommandLineParser &parser) {
+        jsonPath() = parser.value("json");
+        if (parser.isSet("counters")) {
+            counters::instance().open();
+        }
+    }
+
+    // 输出表格；带 --json <文件> 时同时把结果写入JSON文件
+    inline bool report(const QVector<Result> &results) {
+        print(results);
+        const QString &path = jsonPath();
+        if (path.isEmpty()) {
+            return true;
+        }
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qWarning() << "Bench | cannot write" << path;
+            return false;
+        }
+        file.write(QJsonDocument(toJson(results)).toJson(QJsonDocument::Indented));
+        return true;
+    }
+
+} // Bench
+
+#endif //BENCHHARNESS_H
@@ -0,0 +1,116 @@
+#include "benchfixtures.h"
+#include "benchharness.h"
+#include "../server/database.h"
+#include "../server/wireformat.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QCborMap>
+#include <QCborStreamReader>
+#include <QCborValue>
+#include <QJsonArray>
+#include <QJsonObject>
+
+#define CBOR_BENCH_ROWS 10000 // 列表的行数
+
+namespace {
+
+    // 客户端原来的解析方式：构造完整的文档再逐个取字段
+    QVector<Student> decodeJson(const QByteArray &data) {
+        QVector<Student> students;
+        QJsonObject docJson = QJsonDocument::fromJson(data).object();
+        for (auto &&i: docJson["students"].toArray()) {
+            QJsonObject studentObject = i.toObject();
+            Student student;
+            student.Id = studentObject["Id"].toString();
+            student.Name = studentObject["Name"].toString();
+            student.Sex = studentObject["Sex"].toString();
+            student.College = studentObject["College"].toString();
+            student.Major = studentObject["Major"].toString();
+            student.Class = studentObject["Class"].toString();
+            student.Age = studentObject["Age"].toInt();
+            student.PhoneNumber = studentObject["PhoneNumber"].toString();
+            student.DormitoryArea = studentObject["DormitoryArea"].toString();
+            student.DormitoryNum = studentObject["DormitoryNum"].toString();
+            for (auto &&j: studentObject["ChosenLessons"].toArray()) {
+                student.ChosenLessons.append(j.toString());
+            }
+            students.append(student);
+        }
+        return students;
+    }
+
+    // 客户端现在的解析方式：与 readCborListReply 相同，流式读取外层结构，每行交给 Entity::readCbor
+    QVector<Student> decodeCbor(const QByteArray &data) {
+        QVector<Student> students;
+        QCborStreamReader reader(data);
+        if (!reader.isMap()) {
+            return students;
+        }
+        reader.enterContainer();
+        while (reader.lastError() == QCborError::NoError && reader.hasNext()) {
+            QString key;
+            Entity::fromCbor(reader, key);
+            if (key != "students" || !reader.isArray()) {
+                reader.next();
+                continue;
+            }
+            reader.enterContainer();
+            while (reader.lastError() == QCborError::NoError && reader.hasNext()) {
+                Entity::readCbor(reader, students.emplace_back());
+            }
+            reader.leaveContainer();
+        }
+        return students;
+    }
+
+}
+
+// 对比10000行学生列表在JSON和CBOR下的编码、解码耗时和响应大小
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks encoding and decoding a student list as JSON and CBOR.");
+    parser.addHelpOption();
+    Bench::addOptions(parser);
+    parser.process(app);
+    Bench::init(parser);
+
+    QVector<Student> students = Bench::makeStudents(CBOR_BENCH_ROWS);
+    QByteArray json = Bench::studentsByWriter<Serializer::jsonWriter>(students);
+    QJsonObject studentList = QJsonDocument::fromJson(json).object();
+    QByteArray cbor = WireFormat::toCbor(json);
+    QVector<Student> decoded = decodeCbor(cbor);
+    if (decoded.size() != CBOR_BENCH_ROWS || decodeJson(json).size() != CBOR_BENCH_ROWS ||
+        decoded.last().Id != students.last().Id || decoded.last().ChosenLessons != students.last().ChosenLessons) {
+        qDebug() << "Debug | cborbench.cpp: main error: decoded rows mismatch";
+        return 1;
+    }
+
+    QVector<Bench::Result> results;
+    results.append(Bench::run("json encode", [&]() {
+        Bench::doNotOptimize(QJsonDocument(studentList).toJson(QJsonDocument::Compact));
+    }));
+    results.append(Bench::run("cbor encode", [&]() {
+        Bench::doNotOptimize(QCborMap::fromJsonObject(studentList).toCborValue().toCbor());
+    }));
+    results.append(Bench::run("cbor transcode from json (server)", [&]() {
+        Bench::doNotOptimize(WireFormat::toCbor(json));
+    }));
+    results.append(Bench::run("json decode", [&]() {
+        Bench::doNotOptimize(decodeJson(json));
+    }));
+    results.append(Bench::run("cbor stream decode (client)", [&]() {
+        Bench::doNotOptimize(decodeCbor(cbor));
+    }));
+    if (!Bench::report(results)) {
+        return 1;
+    }
+
+    QTextStream out(stdout);
+    out << Qt::endl << "payload size for " << CBOR_BENCH_ROWS << " rows" << Qt::endl;
+    out << "json: " << json.size() << " bytes" << Qt::endl;
+    out << "cbor: " << cbor.size() << " bytes ("
+        << QString::number(100.0 * double(cbor.size()) / double(json.size()), 'f', 1) << "% of json)" << Qt::endl;
+    return 0;
+}
@@ -0,0 +1,325 @@
+#include "benchharness.h"
+#include "../datagen/datagen.h"
+#include "../server/database.h"
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <memory>
+
+#define DATABASE_BENCH_SIZES "1000,10000" // 默认的数据规模（学生数），逗号分隔
+#define DATABASE_BENCH_CASCADE_STUDENTS 100 // 删除课程时级联修改的选课学生数
+#define DATABASE_BENCH_SLOW_SAMPLES 3 // 全库检查等慢操作的采样次数
+#define DATABASE_BENCH_LESSON "BENCH" // 基准测试新建课程的编号前缀，不与 DataGen 生成的编号冲突
+#define DATABASE_BENCH_STARTUP_STUDENTS 100000 // --startup 使用的数据规模（学生数）
+#define DATABASE_BENCH_STARTUP_TARGET 100 // Server 打开数据库的目标耗时（毫秒）
+
+// 在不同规模的 DataGen 数据集上测量 Database::database 的公开接口，用例名称为 "接口/学生数"；
+// 任何用例返回失败的状态时中止，不输出结果
+namespace {
+
+    DataGen::Options datasetOptions(const QString &path, int students, quint64 seed) {
+        DataGen::Options options;
+        options.Output = path;
+        options.Force = true;
+        options.Students = students;
+        options.Teachers = qMax(students / 20, 10);
+        options.Lessons = qMax(students / 10, 40);
+        options.Seed = seed;
+        return options;
+    }
+
+    Lesson benchLesson(const QString &id, const QString &teacherId) {
+        Lesson lesson;
+        lesson.Id = id;
+        lesson.LessonName = "基准测试";
+        lesson.TeacherId = teacherId;
+        lesson.LessonCredits = 1;
+        lesson.LessonCapacity = 0;
+        lesson.LessonSemester = "2099-2100-1";
+        lesson.LessonArea = "东区";
+        return lesson;
+    }
+
+    // 计时前先执行一次并检查状态，失败说明数据集与用例不符，测量结果没有意义
+    template<typename Function>
+    bool bench(QVector<Bench::Result> &results, const QString &name, Function function) {
+        Status status = function();
+        if (status != Success) {
+            qWarning() << "DatabaseBench |" << name << "failed with status" << status;
+            return false;
+        }
+        results.append(Bench::run(name, [&function]() {
+            Bench::doNotOptimize(function());
+        }));
+        return true;
+    }
+
+    // 每次调用单独计时的用例，准备和被测操作的状态都要检查
+    template<typename Setup, typename Function>
+    bool benchEach(QVector<Bench::Result> &results, const QString &name, int samples, Setup setup,
+                   Function function) {
+        Status failed = Success;
+        Bench::Result result = Bench::runEach(name, samples, [&]() {
+            Status status = setup();
+            if (status != Success) {
+                failed = status;
+            }
+        }, [&]() {
+            Status status = function();
+            if (status != Success) {
+                failed = status;
+            }
+        });
+        if (failed != Success) {
+            qWarning() << "DatabaseBench |" << name << "failed with status" << failed;
+            return false;
+        }
+        results.append(result);
+        return true;
+    }
+
+    // Server 启动时打开数据库的耗时：建立连接、initializeDatabase（表结构指纹一致时只初始化版本号计数器）
+    // 和判断是否需要后台检查，不包括后台检查本身
+    bool benchStartup(const DataGen::Options &options, QVector<Bench::Result> &results) {
+        QString name = "startup/" + QString::number(options.Students);
+        {
+            // DataGen 生成的数据库已记录表结构指纹并标记为已检查，否则测到的不是启动的快速路径
+            Database::database database(options.Output, name);
+            if (database.needsCheck()) {
+                qWarning() << "DatabaseBench |" << name << "generated database still needs a check";
+                return false;
+            }
+        }
+        QSqlDatabase::removeDatabase(name);
+
+        std::unique_ptr<Database::database> opened;
+        QString connection;
+        int sample = 0;
+        Bench::Result result = Bench::runEach(name, BENCH_SAMPLES, [&]() {
+            // 关闭上一次打开的连接，不计入耗时
+            opened.reset();
+            if (!connection.isEmpty()) {
+                QSqlDatabase::removeDatabase(connection);
+            }
+            connection = name + "/" + QString::number(sample++);
+        }, [&]() {
+            opened = std::make_unique<Database::database>(options.Output, connection);
+            Bench::doNotOptimize(opened->needsCheck());
+        });
+        opened.reset();
+        QSqlDatabase::removeDatabase(connection);
+
+        double median = result.Median / 1e6;
+        QTextStream(stdout) << name << ": median " << QString::number(median, 'f', 1) << " ms, target < "
+                            << DATABASE_BENCH_STARTUP_TARGET << " ms"
+                            << (median < DATABASE_BENCH_STARTUP_TARGET ? "" : " (over target)") << Qt::endl;
+        results.append(result);
+        return true;
+    }
+
+    bool benchDataset(const DataGen::Options &options, QVector<Bench::Result> &results) {
+        QString suffix = "/" + QString::number(options.Students);
+        Database::database database(options.Output, "bench" + suffix);
+        QString teacherId = DataGen::makeId(options.TeacherPrefix, 1);
+
+        // 选课人数最多的课程，代表最重的名单读写
+        QVector<Lesson> lessons;
+        if (database.listLessons(lessons, options.Lessons, 1, Entity::defaultMask<Lesson>(true)) != Success ||
+            lessons.isEmpty()) {
+            qWarning() << "DatabaseBench | cannot list the generated lessons";
+            return false;
+        }
+        QString popularLesson = lessons.first().Id;
+        int popularCount = 0;
+        for (const auto &lesson: lessons) {
+            if (lesson.LessonStudentCount > popularCount) {
+                popularLesson = lesson.Id;
+                popularCount = lesson.LessonStudentCount;
+            }
+        }
+        // 成绩相关的用例只使用选了该课程的学生
+        Lesson popular;
+        Student firstStudent;
+        Teacher firstTeacher;
+        if (database.getLessonById(popularLesson, popular) != Success || popular.LessonStudents.isEmpty() ||
+            database.getStudentById(DataGen::makeId(options.StudentPrefix, 1), firstStudent) != Success ||
+            database.getTeacherById(teacherId, firstTeacher) != Success) {
+            qWarning() << "DatabaseBench | cannot read the generated students and lessons";
+            return false;
+        }
+        QVector<QString> preferences;
+        for (int i = 0; i < qMin(MAX_PREFERENCES, int(lessons.size())); i++) {
+            preferences.append(lessons[i].Id);
+        }
+
+        int next = 0;
+        auto nextStudent = [&]() {
+            return DataGen::makeId(options.StudentPrefix, next++ % options.Students + 1);
+        };
+        auto nextEnrolled = [&]() {
+            return popular.LessonStudents[next++ % popular.LessonStudents.size()];
+        };
+        int lastPage = (options.Lessons + DATAGEN_PAGE_SIZE - 1) / DATAGEN_PAGE_SIZE;
+
+        bool ok = bench(results, "getStudentById" + suffix, [&]() {
+            Student student;
+            return database.getStudentById(nextStudent(), student);
+        }) && bench(results, "getTeacherById" + suffix, [&]() {
+            Teacher teacher;
+            return database.getTeacherById(teacherId, teacher);
+        }) && bench(results, "getLessonById" + suffix, [&]() {
+            Lesson lesson;
+            return database.getLessonById(popularLesson, lesson);
+        }) && bench(results, "getStudentByClass" + suffix, [&]() {
+            QVector<Student> students;
+            return database.getStudentByClass(firstStudent.Class, students, Entity::defaultMask<Student>(true));
+        }) && bench(results, "getStudentLessonGrade" + suffix, [&]() {
+            Grade grade;
+            return database.getStudentLessonGrade(nextEnrolled(), popularLesson, grade);
+        }) && bench(results, "getAccount" + suffix, [&]() {
+            Auth auth;
+            return database.getAccount(nextStudent(), auth);
+        }) && bench(results, "listLessons first page" + suffix, [&]() {
+            QVector<Lesson> page;
+            return database.listLessons(page, DATAGEN_PAGE_SIZE, 1);
+        }) && bench(results, "listLessons last page" + suffix, [&]() {
+            QVector<Lesson> page;
+            return database.listLessons(page, DATAGEN_PAGE_SIZE, lastPage);
+        }) && bench(results, "listLessons list fields" + suffix, [&]() {
+            QVector<Lesson> page;
+            return database.listLessons(page, DATAGEN_PAGE_SIZE, 1, Entity::defaultMask<Lesson>(true));
+        }) && bench(results, "listStudents first page" + suffix, [&]() {
+            QVector<Student> page;
+            return database.listStudents(page, DATAGEN_PAGE_SIZE, 1);
+        }) && bench(results, "listTeachers first page" + suffix, [&]() {
+            QVector<Teacher> page;
+            return database.listTeachers(page, DATAGEN_PAGE_SIZE, 1);
+        }) && bench(results, "listLessonClasses" + suffix, [&]() {
+            QVector<QString> classes;
+            return database.listLessonClasses(popularLesson, classes);
+        }) && bench(results, "listChanges" + suffix, [&]() {
+            QVector<Change> changes;
+            qint64 latest = 0;
+            bool reset = false;
+            return database.listChanges(0, DATAGEN_PAGE_SIZE, changes, latest, reset);
+        }) && bench(results, "getLessonSeat" + suffix, [&]() {
+            int capacity = 0;
+            int enrolled = 0;
+            return database.getLessonSeat(popularLesson, capacity, enrolled);
+        }) && bench(results, "checkChooseLesson" + suffix, [&]() {
+            // 时间冲突、学分超限和已选都是正常的检查结果
+            Status status = database.checkChooseLesson(nextStudent(), popularLesson);
+            return status == TIME_CONFLICT || status == CREDIT_EXCEEDED || status == DUPLICATE ? Success : status;
+        });
+
+        // 写操作写回读到的数据，不改变数据集，每次都会提交一个事务
+        ok = ok && bench(results, "updateStudent" + suffix, [&]() {
+            return database.updateStudent(firstStudent);
+        }) && bench(results, "updateTeacher" + suffix, [&]() {
+            return database.updateTeacher(firstTeacher);
+        }) && bench(results, "updateStudentLessonGrade" + suffix, [&]() {
+            Grade grade{nextEnrolled(), popularLesson, 80, 90, 85, NOT_RETAKE, {}, {}};
+            return database.updateStudentLessonGrade(grade);
+        }) && bench(results, "updatePreferences" + suffix, [&]() {
+            return database.updatePreferences(nextStudent(), preferences);
+        }) && database.clearPreferences() == Success;
+
+        // 选课和退课在不限人数的新课程上成对执行，每次只计其中一个操作的耗时
+        QString enrollLesson = QString(DATABASE_BENCH_LESSON) + "0";
+        ok = ok && database.updateLessonInformation(benchLesson(enrollLesson, teacherId)) == Success;
+        next = 0;
+        ok = ok && benchEach(results, "addChosenLesson" + suffix, BENCH_SAMPLES * 4, [&]() {
+            next = next % options.Students + 1;
+            return Success;
+        }, [&]() {
+            return database.addChosenLesson(DataGen::makeId(options.StudentPrefix, next), enrollLesson);
+        });
+        next = 0;
+        ok = ok && benchEach(results, "deleteChosenLesson" + suffix, BENCH_SAMPLES * 4, [&]() {
+            next = next % options.Students + 1;
+            return Success;
+        }, [&]() {
+            return database.deleteChosenLesson(DataGen::makeId(options.StudentPrefix, next), enrollLesson);
+        });
+
+        // 删除课程需要级联修改每个选课学生的选课列表，每次先新建一门有选课学生的课程
+        int cascade = 0;
+        QString cascadeLesson;
+        ok = ok && benchEach(results, "deleteLesson cascade" + suffix, BENCH_SAMPLES, [&]() {
+            cascadeLesson = QString(DATABASE_BENCH_LESSON) + QString::number(++cascade);
+            Status status = database.updateLessonInformation(benchLesson(cascadeLesson, teacherId));
+            if (status != Success) {
+                return status;
+            }
+            QVector<Enrollment> enrollments;
+            for (int i = 0; i < qMin(DATABASE_BENCH_CASCADE_STUDENTS, options.Students); i++) {
+                enrollments.append(Enrollment{DataGen::makeId(options.StudentPrefix, i + 1), cascadeLesson});
+            }
+            int added = 0;
+            return database.addChosenLessons(enrollments, DATABASE_BENCH_CASCADE_STUDENTS, added);
+        }, [&]() {
+            return database.deleteLesson(cascadeLesson);
+        });
+        ok = ok && database.deleteLesson(enrollLesson) == Success;
+
+        ok = ok && benchEach(results, "checkDatabase" + suffix, DATABASE_BENCH_SLOW_SAMPLES, []() {
+            return Success;
+        }, [&]() {
+            return database.checkDatabase();
+        });
+        if (!ok) {
+            qWarning() << "DatabaseBench | aborted on the dataset with" << options.Students << "students";
+        }
+        return ok;
+    }
+
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("DatabaseBench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks Database::database against generated datasets.");
+    parser.addHelpOption();
+    QCommandLineOption sizesOption("sizes", "Comma separated dataset sizes (students).", "list",
+                                   DATABASE_BENCH_SIZES);
+    QCommandLineOption seedOption("seed", "Random seed of the generated datasets.", "seed", "1");
+    QCommandLineOption startupOption("startup", "Only measure opening a database the way the server does at startup.");
+    QCommandLineOption startupStudentsOption("startup-students", "Dataset size (students) for --startup.", "students",
+                                             QString::number(DATABASE_BENCH_STARTUP_STUDENTS));
+    parser.addOptions({sizesOption, seedOption, startupOption, startupStudentsOption});
+    Bench::addOptions(parser);
+    parser.process(app);
+    Bench::init(parser);
+
+    QTemporaryDir directory;
+    if (!directory.isValid()) {
+        qWarning() << "DatabaseBench | cannot create temporary directory";
+        return 1;
+    }
+
+    QVector<Bench::Result> results;
+    if (parser.isSet(startupOption)) {
+        int students = qMax(parser.value(startupStudentsOption).toInt(), 1);
+        DataGen::Options options = datasetOptions(directory.filePath(QString("startup_%1.sqlite").arg(students)),
+                                                  students, parser.value(seedOption).toULongLong());
+        DataGen::generator generator(options);
+        if (!generator.run() || !benchStartup(options, results)) {
+            return 1;
+        }
+        return Bench::report(results) ? 0 : 1;
+    }
+    for (const auto &size: parser.value(sizesOption).split(',', Qt::SkipEmptyParts)) {
+        int students = qMax(size.trimmed().toInt(), 1);
+        DataGen::Options options = datasetOptions(directory.filePath(QString("bench_%1.sqlite").arg(students)),
+                                                  students, parser.value(seedOption).toULongLong());
+        DataGen::generator generator(options);
+        if (!generator.run()) {
+            return 1;
+        }
+        if (!benchDataset(options, results)) {
+            return 1;
+        }
+    }
+    return Bench::report(results) ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+#include "benchfixtures.h"
+#include "benchharness.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#define JSON_BENCH_ROWS 10000 // 列表的行数
+
+namespace {
+
+    // 服务器原来的写法：每行构造QJsonObject，再经QJsonDocument和QString转换为UTF-8
+    QByteArray studentsByJsonObject(const QVector<Student> &students) {
+        QJsonObject responseJsonObject;
+        responseJsonObject["success"] = true;
+        responseJsonObject["total"] = int(students.size());
+        responseJsonObject["totalPages"] = 1;
+        QJsonArray studentsArray;
+        for (const auto &student: students) {
+            QJsonObject studentObject;
+            studentObject["Id"] = student.Id;
+            studentObject["Name"] = student.Name;
+            studentObject["Sex"] = student.Sex;
+            studentObject["College"] = student.College;
+            studentObject["Major"] = student.Major;
+            studentObject["Class"] = student.Class;
+            studentObject["Age"] = student.Age;
+            studentObject["PhoneNumber"] = student.PhoneNumber;
+            studentObject["DormitoryArea"] = student.DormitoryArea;
+            studentObject["DormitoryNum"] = student.DormitoryNum;
+            QJsonArray chosenLessonsArray;
+            for (const auto &lesson: student.ChosenLessons) {
+                chosenLessonsArray.append(lesson);
+            }
+            studentObject["ChosenLessons"] = chosenLessonsArray;
+            studentsArray.append(studentObject);
+        }
+        responseJsonObject["students"] = studentsArray;
+        QJsonDocument responseDoc(responseJsonObject);
+        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
+        return responseString.toUtf8();
+    }
+
+    QByteArray lessonsByJsonObject(const QVector<Lesson> &lessons) {
+        QJsonObject responseJsonObject;
+        responseJsonObject["success"] = true;
+        responseJsonObject["total"] = int(lessons.size());
+        responseJsonObject["totalPages"] = 1;
+        QJsonArray lessonsArray;
+        for (const auto &lesson: lessons) {
+            QJsonObject lessonObject;
+            lessonObject["Id"] = lesson.Id;
+            lessonObject["LessonName"] = lesson.LessonName;
+            lessonObject["TeacherId"] = lesson.TeacherId;
+            lessonObject["LessonCredits"] = lesson.LessonCredits;
+            lessonObject["LessonCapacity"] = lesson.LessonCapacity;
+            lessonObject["LessonSemester"] = lesson.LessonSemester;
+            lessonObject["LessonArea"] = lesson.LessonArea;
+            QJsonObject lessonTimeAndLocationsObj;
+            for (auto it = lesson.LessonTimeAndLocations.cbegin(); it != lesson.LessonTimeAndLocations.cend(); ++it) {
+                QJsonArray jsonArray;
+                for (const auto &str: it.value()) {
+                    jsonArray.append(QJsonValue(str));
+                }
+                lessonTimeAndLocationsObj.insert(it.key(), jsonArray);
+            }
+            lessonObject["LessonTimeAndLocations"] = lessonTimeAndLocationsObj;
+            QJsonArray lessonStudentsArray;
+            for (const auto &lessonStudent: lesson.LessonStudents) {
+                lessonStudentsArray.append(lessonStudent);
+            }
+            lessonObject["LessonStudents"] = lessonStudentsArray;
+            lessonObject["LessonStudentCount"] = lesson.LessonStudentCount;
+            lessonsArray.append(lessonObject);
+        }
+        responseJsonObject["lessons"] = lessonsArray;
+        QJsonDocument responseDoc(responseJsonObject);
+        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
+        return responseString.toUtf8();
+    }
+
+}
+
+// 对比每行构造QJsonObject的原写法与直接写入缓冲区的写入器
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks response serialization: QJsonObject against the direct writers.");
+    parser.addHelpOption();
+    Bench::addOptions(parser);
+    parser.process(app);
+    Bench::init(parser);
+
+    QVector<Student> students = Bench::makeStudents(JSON_BENCH_ROWS);
+    QVector<Lesson> lessons = Bench::makeLessons(JSON_BENCH_ROWS);
+
+    // 两种写法解析后的文档必须相同
+    if (QJsonDocument::fromJson(studentsByJsonObject(students)) !=
+        QJsonDocument::fromJson(Bench::studentsByWriter<Serializer::jsonWriter>(students)) ||
+        QJsonDocument::fromJson(lessonsByJsonObject(lessons)) !=
+        QJsonDocument::fromJson(Bench::lessonsByWriter<Serializer::jsonWriter>(lessons))) {
+        qDebug() << "Debug | jsonbench.cpp: main error: writer output differs from QJsonDocument";
+        return 1;
+    }
+
+    QVector<Bench::Result> results;
+    results.append(Bench::run("students, QJsonObject + toJson", [&]() {
+        Bench::doNotOptimize(studentsByJsonObject(students));
+    }));
+    results.append(Bench::run("students, jsonWriter", [&]() {
+        Bench::doNotOptimize(Bench::studentsByWriter<Serializer::jsonWriter>(students));
+    }));
+    results.append(Bench::run("students, cborWriter", [&]() {
+        Bench::doNotOptimize(Bench::studentsByWriter<Serializer::cborWriter>(students));
+    }));
+    results.append(Bench::run("lessons, QJsonObject + toJson", [&]() {
+        Bench::doNotOptimize(lessonsByJsonObject(lessons));
+    }));
+    results.append(Bench::run("lessons, jsonWriter", [&]() {
+        Bench::doNotOptimize(Bench::lessonsByWriter<Serializer::jsonWriter>(lessons));
+    }));
+    results.append(Bench::run("lessons, cborWriter", [&]() {
+        Bench::doNotOptimize(Bench::lessonsByWriter<Serializer::cborWriter>(lessons));
+    }));
+    return Bench::report(results) ? 0 : 1;
+}
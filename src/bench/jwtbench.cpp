@@ -0,0 +1,62 @@
+#include "benchharness.h"
+#include "../server/jwtcache.h"
+#include <QCoreApplication>
+
+#define SECRET_KEY "AIMS"
+#define ISSUER "AIMS"
+
+// 对比 verifyJwt 的原始路径、复用verifier的路径和带缓存的路径
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks JWT verification: fresh verifier, shared verifier and token cache.");
+    parser.addHelpOption();
+    Bench::addOptions(parser);
+    parser.process(app);
+    Bench::init(parser);
+
+    // 与服务器 generateJwt 生成的令牌格式相同
+    QByteArray token = QByteArray::fromStdString(
+            jwt::create()
+                    .set_issuer(ISSUER)
+                    .set_type("JWT")
+                    .set_payload_claim("Account", jwt::claim(std::string("2021000001")))
+                    .set_payload_claim("AccountType", jwt::claim(std::string("1")))
+                    .set_payload_claim("IsSuper", jwt::claim(std::string("0")))
+                    .sign(jwt::algorithm::hs256{SECRET_KEY}));
+
+    // 模拟大量会话时，缓存命中率和分片竞争对性能的影响
+    QVector<QByteArray> sessionTokens;
+    for (int i = 0; i < 4096; i++) {
+        sessionTokens.append(QByteArray::fromStdString(
+                jwt::create()
+                        .set_issuer(ISSUER)
+                        .set_type("JWT")
+                        .set_payload_claim("Account", jwt::claim(std::to_string(2021000000 + i)))
+                        .set_payload_claim("AccountType", jwt::claim(std::string("1")))
+                        .set_payload_claim("IsSuper", jwt::claim(std::string("0")))
+                        .sign(jwt::algorithm::hs256{SECRET_KEY})));
+    }
+
+    JwtCache::verifier verifier(SECRET_KEY, ISSUER);
+    QVector<Bench::Result> results;
+
+    results.append(Bench::run("uncached (new verifier per call)", [&]() {
+        Bench::doNotOptimize(JwtCache::verifyUncached(token, SECRET_KEY, ISSUER));
+    }));
+    results.append(Bench::run("reused verifier, no cache", [&]() {
+        qint64 expireTime;
+        Bench::doNotOptimize(verifier.verifyToken(token, expireTime));
+    }));
+    results.append(Bench::run("cached, same session", [&]() {
+        Bench::doNotOptimize(verifier.verify(token));
+    }));
+    int next = 0;
+    results.append(Bench::run("cached, 4096 rotating sessions", [&]() {
+        Bench::doNotOptimize(verifier.verify(sessionTokens[next]));
+        next = (next + 1) % sessionTokens.size();
+    }));
+
+    return Bench::report(results) ? 0 : 1;
+}
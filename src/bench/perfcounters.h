@@ -0,0 +1,160 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <QDebug>
+
+#ifdef Q_OS_LINUX
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define BENCH_COUNTER_CYCLES 0 // CPU周期
+#define BENCH_COUNTER_INSTRUCTIONS 1 // 执行的指令
+#define BENCH_COUNTER_CACHE_MISSES 2 // 最后一级缓存未命中
+#define BENCH_COUNTER_BRANCH_MISSES 3 // 分支预测失败
+#define BENCH_COUNTERS 4
+
+namespace Bench {
+
+    // 每次操作的硬件计数，-1表示该计数器不可用
+    class Counters {
+    public:
+        double Values[BENCH_COUNTERS] = {-1, -1, -1, -1};
+
+        bool available() const {
+            return Values[BENCH_COUNTER_CYCLES] >= 0;
+        }
+
+        // 每周期指令数
+        double ipc() const {
+            return Values[BENCH_COUNTER_CYCLES] > 0 && Values[BENCH_COUNTER_INSTRUCTIONS] >= 0
+                   ? Values[BENCH_COUNTER_INSTRUCTIONS] / Values[BENCH_COUNTER_CYCLES] : -1;
+        }
+    };
+
+    // 通过 perf_event_open 统计当前线程在用户态的硬件计数。四个计数器以CPU周期为组长组成一组，
+    // 同时调度、一次读出，派生的IPC等比值来自同一段运行时间。由 Bench::init 在带 --counters 时打开；
+    // 非Linux、容器中没有权限（perf_event_paranoid）或虚拟机没有PMU时打印一次提示，只报告耗时
+    class counters {
+    public:
+        static counters &instance() {
+            static counters hardwareCounters;
+            return hardwareCounters;
+        }
+
+        bool enabled() const {
+            return leader >= 0;
+        }
+
+        // 打开计数器组，组长（CPU周期）不可用时整组不可用，其余计数器不可用时只缺少该项
+        void open() {
+#ifdef Q_OS_LINUX
+            if (enabled()) {
+                return;
+            }
+            const quint64 events[BENCH_COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+            for (int i = 0; i < BENCH_COUNTERS; i++) {
+                perf_event_attr attr;
+                std::memset(&attr, 0, sizeof(attr));
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.size = sizeof(attr);
+                attr.config = events[i];
+                // 只有组长初始为停止状态，组员随组长一起启停
+                attr.disabled = i == BENCH_COUNTER_CYCLES ? 1 : 0;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                // 只统计当前线程，不限CPU
+                fds[i] = int(syscall(SYS_perf_event_open, &attr, 0, -1, i == BENCH_COUNTER_CYCLES ? -1 : leader, 0));
+                if (fds[i] < 0) {
+                    if (i == BENCH_COUNTER_CYCLES) {
+                        qWarning().noquote() << "Bench | hardware counters unavailable:" << std::strerror(errno)
+                                             << "- reporting wall-clock time only";
+                        return;
+                    }
+                    continue;
+                }
+                if (i == BENCH_COUNTER_CYCLES) {
+                    leader = fds[i];
+                }
+                // 组读取的结果按加入顺序排列
+                members[memberCount++] = i;
+            }
+#else
+            qWarning() << "Bench | hardware counters are only supported on Linux";
+#endif
+        }
+
+        void start() {
+#ifdef Q_OS_LINUX
+            if (enabled()) {
+                ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+                ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            }
+#endif
+        }
+
+        // 停止计数并把本段的计数累加到总数，整组被复用（多路复用）时按实际运行时间放大
+        void stop() {
+#ifdef Q_OS_LINUX
+            if (!enabled()) {
+                return;
+            }
+            ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            // 成员数、启用时间、实际运行时间，然后是各成员的计数
+            quint64 values[3 + BENCH_COUNTERS] = {};
+            ssize_t size = ssize_t(sizeof(quint64) * (3 + memberCount));
+            if (read(leader, values, size_t(size)) != size || values[0] != quint64(memberCount) || values[2] == 0) {
+                return;
+            }
+            double scale = double(values[1]) / double(values[2]);
+            for (int i = 0; i < memberCount; i++) {
+                totals[members[i]] += double(values[3 + i]) * scale;
+            }
+#endif
+        }
+
+        // 返回自上次取出以来每次操作的平均计数，并清零总数
+        Counters take(qint64 operations) {
+            Counters result;
+            for (int i = 0; i < BENCH_COUNTERS; i++) {
+                if (fds[i] >= 0 && operations > 0) {
+                    result.Values[i] = totals[i] / double(operations);
+                }
+                totals[i] = 0;
+            }
+            return result;
+        }
+
+        ~counters() {
+#ifdef Q_OS_LINUX
+            for (int fd: fds) {
+                if (fd >= 0) {
+                    close(fd);
+                }
+            }
+#endif
+        }
+
+        counters(const counters &) = delete;
+
+        counters &operator=(const counters &) = delete;
+
+    private:
+        int fds[BENCH_COUNTERS] = {-1, -1, -1, -1};
+        int leader = -1; // 组长（CPU周期）的文件描述符
+        int members[BENCH_COUNTERS] = {}; // 组内第i个成员对应的计数器
+        int memberCount = 0;
+        double totals[BENCH_COUNTERS] = {};
+
+        counters() = default;
+    };
+
+} // Bench
+
+#endif //PERFCOUNTERS_H
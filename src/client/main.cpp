@@ -6,16 +6,23 @@
 #include <QJsonObject>
 #include <QEventLoop>
 #include <QTimer>
+#include <QUuid>
 #include <QtNetwork/QNetworkAccessManager>
 #include <QtNetwork/QNetworkReply>
+#include <QWebSocket>
 #include <QJsonArray>
+#include <QCborStreamReader>
 #include "ui_AIMSMainWindow.h"
 #include "ui_LoginForm.h"
 #include "ui_StudentList.h"
 #include "ui_ChangePasswordForm.h"
 #include "../server/database.h"
+#include "../server/entityversion.h"
 
 #define SALT "AIMS"
+#define CHANGE_SYNC_INTERVAL 10000 // 定期同步服务器变更的间隔（毫秒）
+#define CHANGE_SYNC_INTERVAL_PUSH 60000 // 推送连接正常时的同步间隔（毫秒），只用于补齐推送范围之外的变更
+#define PUSH_RECONNECT_INTERVAL 5000 // 推送连接断开后重连的间隔（毫秒）
 
 class ChangePasswordForm : public QMainWindow, public Ui::ChangePasswordForm {
 Q_OBJECT
@@ -233,11 +240,35 @@ public:
     int currentYear{};
     QMap<QPair<QString, QString>, Grade> localGradesTemp;
     QMap<QString, QVector<QString>> localLessonClassesTemp;
+    // 按URL保存服务器返回的ETag和响应内容，本地缓存清空后仍可用条件请求避免重复下载
+    mutable QMap<QString, QByteArray> responseETags;
+    mutable QMap<QString, QByteArray> responseSnapshots;
+    // 已同步到的服务器变更序号，-1表示尚未同步
+    qint64 changeSeq = -1;
+    QTimer changeSyncTimer;
+    // 接收服务器推送的失效通知，与自己相关的变更不必等待定时同步
+    QWebSocket pushSocket;
 
     explicit AIMSMainWindow(QMainWindow *parent = nullptr) : QMainWindow(parent) {
         setupUi(this);
         calculateCurrentSemester();
         connect(&loginForm, &LoginForm::LoginSuccess, this, &AIMSMainWindow::onLoginSuccess);
+        changeSyncTimer.setInterval(CHANGE_SYNC_INTERVAL);
+        connect(&changeSyncTimer, &QTimer::timeout, this, &AIMSMainWindow::syncChanges);
+        connect(&pushSocket, &QWebSocket::connected, this, [this]() {
+            // 连接后第一条消息发送JWT完成订阅
+            QJsonObject json;
+            json.insert("jwt", JWT);
+            pushSocket.sendTextMessage(QJsonDocument(json).toJson(QJsonDocument::Compact));
+        });
+        connect(&pushSocket, &QWebSocket::textMessageReceived, this, &AIMSMainWindow::onPushMessage);
+        connect(&pushSocket, &QWebSocket::disconnected, this, [this]() {
+            // 推送断开期间恢复较短的同步间隔，稍后重连
+            changeSyncTimer.setInterval(CHANGE_SYNC_INTERVAL);
+            if (isLogin) {
+                QTimer::singleShot(PUSH_RECONNECT_INTERVAL, this, &AIMSMainWindow::connectPush);
+            }
+        });
     }
 
     void calculateCurrentSemester() {
@@ -470,6 +501,94 @@ public:
         fillTableWidget_Super_Lesson_Assign();
     }
 
+    // 发送写请求并等待回复：附带Idempotency-Key，超时后以同一个Key重试一次，
+    // 服务器对重复的Key直接返回首次执行的结果，不会重复选课或修改成绩。两次均超时返回nullptr
+    QNetworkReply *postIdempotent(QNetworkAccessManager &manager, QNetworkRequest &request, const QByteArray &data) {
+        request.setRawHeader("Idempotency-Key", QUuid::createUuid().toByteArray(QUuid::WithoutBraces));
+        for (int attempt = 0; attempt < 2; attempt++) {
+            QNetworkReply *reply = manager.post(request, data);
+
+            // 创建一个事件循环，直到收到回复为止
+            QEventLoop loop;
+            QTimer timer;
+            timer.setSingleShot(true);
+            connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
+            connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
+            timer.start(3000);  // 3秒超时
+            loop.exec();
+
+            if (timer.isActive()) {
+                timer.stop();
+                return reply;
+            }
+            disconnect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
+            reply->abort();
+            reply->deleteLater();
+        }
+        return nullptr;
+    }
+
+    // 已保存该URL的ETag时附带 If-None-Match
+    void setIfNoneMatch(QNetworkRequest &request) const {
+        QString URL = request.url().toString();
+        if (responseETags.contains(URL)) {
+            request.setRawHeader("If-None-Match", responseETags[URL]);
+        }
+    }
+
+    // 读取条件请求的回复：304时返回本地保存的内容，否则保存新的ETag和内容
+    QByteArray readConditionalReply(QNetworkReply *reply) const {
+        QString URL = reply->request().url().toString();
+        if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 304) {
+            return responseSnapshots.value(URL);
+        }
+        QByteArray responseData = reply->readAll();
+        QByteArray etag = reply->rawHeader("ETag");
+        if (!etag.isEmpty()) {
+            responseETags.insert(URL, etag);
+            responseSnapshots.insert(URL, responseData);
+        } else {
+            responseETags.remove(URL);
+            responseSnapshots.remove(URL);
+        }
+        return responseData;
+    }
+
+    // 服务器按 Accept 返回CBOR，列表类请求用流式读取，不需要先构造完整的文档；
+    // 读取 {"success", "message", listKey: [...]} 形式的回复，列表中的每一项交给readItem读取
+    template<typename Function>
+    static bool readCborListReply(const QByteArray &data, const QString &listKey, QString &message,
+                                  Function readItem) {
+        QCborStreamReader reader(data);
+        if (!reader.isMap()) {
+            return false;
+        }
+        bool success = false;
+        reader.enterContainer();
+        while (reader.lastError() == QCborError::NoError && reader.hasNext()) {
+            QString key;
+            Entity::fromCbor(reader, key);
+            if (key == "success") {
+                Entity::fromCbor(reader, success);
+            } else if (key == "message") {
+                Entity::fromCbor(reader, message);
+            } else if (key == listKey && reader.isArray()) {
+                reader.enterContainer();
+                while (reader.lastError() == QCborError::NoError && reader.hasNext()) {
+                    readItem(reader);
+                }
+                reader.leaveContainer();
+            } else {
+                reader.next();
+            }
+        }
+        if (reader.lastError() != QCborError::NoError) {
+            message = reader.lastError().toString();
+            return false;
+        }
+        return success;
+    }
+
     void updateStudentLessonGrade(const Grade &grade) {
         QNetworkAccessManager manager;
         QNetworkRequest request;
@@ -491,29 +610,17 @@ public:
 
         QJsonDocument doc(json);
         QByteArray data = doc.toJson();
-        QNetworkReply *reply = manager.post(request, data);
-
-        // 创建一个事件循环，直到收到回复为止
-        QEventLoop loop;
-        QTimer timer;
-        timer.setSingleShot(true);
-        connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
-        connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-        timer.start(3000);  // 3秒超时
-        loop.exec();
+        QNetworkReply *reply = postIdempotent(manager, request, data);
+        applyChange(ENTITY_GRADE, grade.StudentId + "/" + grade.LessonId);
 
         // 检查错误
-        if (timer.isActive()) {
+        if (reply != nullptr) {
             // 请求在3秒内完成
-            timer.stop();
             if (reply->error() != QNetworkReply::NoError && reply->error() != QNetworkReply::ContentNotFoundError) {
                 QMessageBox::warning((QWidget *) this, "警告", "请求失败：" + QVariant::fromValue(reply->error()).toString());
             }
         } else {
-            // 请求在3秒内未完成
-            disconnect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-            reply->abort();
-            reply->deleteLater();
+            // 重试一次后仍未完成
             QMessageBox::warning((QWidget *) this, "警告", "请求超时");
         }
     }
@@ -593,6 +700,7 @@ public:
         QString URL = serverURL + "/api/getLessonInformation/" + Id;
         request.setUrl(QUrl(URL));
         request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+        setIfNoneMatch(request);
 
         // 发送GET请求
         QNetworkReply *reply = manager.get(request);
@@ -622,35 +730,13 @@ public:
         }
 
         // 解析回复
-        QByteArray responseData = reply->readAll();
+        QByteArray responseData = readConditionalReply(reply);
         QJsonDocument doc = QJsonDocument::fromJson(responseData);
         QJsonObject json = doc.object();
 
         if (json["success"].toBool()) {
             // 使用回复中的数据填充课程对象
-            lesson.Id = json["Id"].toString();
-            lesson.LessonArea = json["LessonArea"].toString();
-            lesson.LessonCredits = json["LessonCredits"].toInt();
-            lesson.LessonSemester = json["LessonSemester"].toString();
-            lesson.LessonName = json["LessonName"].toString();
-            lesson.TeacherId = json["TeacherId"].toString();
-
-            // 将选课学生的JSON数组转换为QVector
-            QJsonArray lessonStudentsArray = json["LessonStudents"].toArray();
-            for (auto &&i: lessonStudentsArray) {
-                lesson.LessonStudents.append(i.toString());
-            }
-
-            // 将课程时间和地点的JSON对象转换为QMap
-            QJsonObject lessonTimeAndLocationsObject = json["LessonTimeAndLocations"].toObject();
-            for (auto &&i: lessonTimeAndLocationsObject.keys()) {
-                QJsonArray timeAndLocationArray = lessonTimeAndLocationsObject[i].toArray();
-                QVector<QString> timeAndLocation;
-                for (auto &&j: timeAndLocationArray) {
-                    timeAndLocation.append(j.toString());
-                }
-                lesson.LessonTimeAndLocations.insert(i, timeAndLocation);
-            }
+            Entity::readJson(json, lesson);
         } else {
             // 请求失败，获取并显示错误消息
             QString message = json["message"].toString();
@@ -666,6 +752,7 @@ public:
         QString URL = serverURL + "/api/getTeacherInformation/" + id;
         request.setUrl(QUrl(URL));
         request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+        setIfNoneMatch(request);
 
         // 发送GET请求
         QNetworkReply *reply = manager.get(request);
@@ -695,21 +782,13 @@ public:
         }
 
         // 解析回复
-        QByteArray responseData = reply->readAll();
+        QByteArray responseData = readConditionalReply(reply);
         QJsonDocument doc = QJsonDocument::fromJson(responseData);
         QJsonObject json = doc.object();
 
         if (json["success"].toBool()) {
             // 使用回复中的数据填充教师对象
-            teacher.Id = json["Id"].toString();
-            teacher.Name = json["Name"].toString();
-            teacher.Unit = json["Unit"].toString();
-
-            // 将教授课程的JSON数组转换为QVector
-            QJsonArray teachingLessonsArray = json["TeachingLessons"].toArray();
-            for (auto &&i: teachingLessonsArray) {
-                teacher.TeachingLessons.append(i.toString());
-            }
+            Entity::readJson(json, teacher);
         } else {
             // 请求失败，获取并显示错误消息
             QString message = json["message"].toString();
@@ -744,29 +823,17 @@ public:
 
         QJsonDocument doc(json);
         QByteArray data = doc.toJson();
-        QNetworkReply *reply = manager.post(request, data);
-
-        // 创建一个事件循环，直到收到回复为止
-        QEventLoop loop;
-        QTimer timer;
-        timer.setSingleShot(true);
-        connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
-        connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-        timer.start(3000);  // 3秒超时
-        loop.exec();
+        QNetworkReply *reply = postIdempotent(manager, request, data);
+        applyChange(auth.AccountType == STUDENT ? ENTITY_STUDENT : ENTITY_TEACHER, auth.Account);
 
         // 检查错误
-        if (timer.isActive()) {
+        if (reply != nullptr) {
             // 请求在3秒内完成
-            timer.stop();
             if (reply->error() != QNetworkReply::NoError && reply->error() != QNetworkReply::ContentNotFoundError) {
                 QMessageBox::warning((QWidget *) this, "警告", "请求失败：" + QVariant::fromValue(reply->error()).toString());
             }
         } else {
-            // 请求在3秒内未完成
-            disconnect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-            reply->abort();
-            reply->deleteLater();
+            // 重试一次后仍未完成
             QMessageBox::warning((QWidget *) this, "警告", "请求超时");
         }
     }
@@ -796,29 +863,17 @@ public:
 
         QJsonDocument doc(json);
         QByteArray data = doc.toJson();
-        QNetworkReply *reply = manager.post(request, data);
-
-        // 创建一个事件循环，直到收到回复为止
-        QEventLoop loop;
-        QTimer timer;
-        timer.setSingleShot(true);
-        connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
-        connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-        timer.start(3000);  // 3秒超时
-        loop.exec();
+        QNetworkReply *reply = postIdempotent(manager, request, data);
+        applyChange(ENTITY_STUDENT, student.Id);
 
         // 检查错误
-        if (timer.isActive()) {
+        if (reply != nullptr) {
             // 请求在3秒内完成
-            timer.stop();
             if (reply->error() != QNetworkReply::NoError && reply->error() != QNetworkReply::ContentNotFoundError) {
                 QMessageBox::warning((QWidget *) this, "警告", "请求失败：" + QVariant::fromValue(reply->error()).toString());
             }
         } else {
-            // 请求在3秒内未完成
-            disconnect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-            reply->abort();
-            reply->deleteLater();
+            // 重试一次后仍未完成
             QMessageBox::warning((QWidget *) this, "警告", "请求超时");
         }
     }
@@ -841,29 +896,17 @@ public:
 
         QJsonDocument doc(json);
         QByteArray data = doc.toJson();
-        QNetworkReply *reply = manager.post(request, data);
-
-        // 创建一个事件循环，直到收到回复为止
-        QEventLoop loop;
-        QTimer timer;
-        timer.setSingleShot(true);
-        connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
-        connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-        timer.start(3000);  // 3秒超时
-        loop.exec();
+        QNetworkReply *reply = postIdempotent(manager, request, data);
+        applyChange(ENTITY_TEACHER, teacher.Id);
 
         // 检查错误
-        if (timer.isActive()) {
+        if (reply != nullptr) {
             // 请求在3秒内完成
-            timer.stop();
             if (reply->error() != QNetworkReply::NoError && reply->error() != QNetworkReply::ContentNotFoundError) {
                 QMessageBox::warning((QWidget *) this, "警告", "请求失败：" + QVariant::fromValue(reply->error()).toString());
             }
         } else {
-            // 请求在3秒内未完成
-            disconnect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-            reply->abort();
-            reply->deleteLater();
+            // 重试一次后仍未完成
             QMessageBox::warning((QWidget *) this, "警告", "请求超时");
         }
     }
@@ -885,29 +928,17 @@ public:
 
         QJsonDocument doc(json);
         QByteArray data = doc.toJson();
-        QNetworkReply *reply = manager.post(request, data);
-
-        // 创建一个事件循环，直到收到回复为止
-        QEventLoop loop;
-        QTimer timer;
-        timer.setSingleShot(true);
-        connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
-        connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-        timer.start(3000);  // 3秒超时
-        loop.exec();
+        QNetworkReply *reply = postIdempotent(manager, request, data);
+        applyChange(ENTITY_TEACHER, teacherId);
 
         // 检查错误
-        if (timer.isActive()) {
+        if (reply != nullptr) {
             // 请求在3秒内完成
-            timer.stop();
             if (reply->error() != QNetworkReply::NoError && reply->error() != QNetworkReply::ContentNotFoundError) {
                 QMessageBox::warning((QWidget *) this, "警告", "请求失败：" + QVariant::fromValue(reply->error()).toString());
             }
         } else {
-            // 请求在3秒内未完成
-            disconnect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-            reply->abort();
-            reply->deleteLater();
+            // 重试一次后仍未完成
             QMessageBox::warning((QWidget *) this, "警告", "请求超时");
         }
     }
@@ -929,29 +960,23 @@ public:
 
         QJsonDocument doc(json);
         QByteArray data = doc.toJson();
-        QNetworkReply *reply = manager.post(request, data);
-
-        // 创建一个事件循环，直到收到回复为止
-        QEventLoop loop;
-        QTimer timer;
-        timer.setSingleShot(true);
-        connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
-        connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-        timer.start(3000);  // 3秒超时
-        loop.exec();
+        QNetworkReply *reply = postIdempotent(manager, request, data);
+        // 删除学生会修改其所选课程的名单
+        if (localStudentsTemp.contains(studentId)) {
+            for (auto &&lessonId: localStudentsTemp[studentId].ChosenLessons) {
+                applyChange(ENTITY_LESSON, lessonId);
+            }
+        }
+        applyChange(ENTITY_STUDENT, studentId);
 
         // 检查错误
-        if (timer.isActive()) {
+        if (reply != nullptr) {
             // 请求在3秒内完成
-            timer.stop();
             if (reply->error() != QNetworkReply::NoError && reply->error() != QNetworkReply::ContentNotFoundError) {
                 QMessageBox::warning((QWidget *) this, "警告", "请求失败：" + QVariant::fromValue(reply->error()).toString());
             }
         } else {
-            // 请求在3秒内未完成
-            disconnect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-            reply->abort();
-            reply->deleteLater();
+            // 重试一次后仍未完成
             QMessageBox::warning((QWidget *) this, "警告", "请求超时");
         }
     }
@@ -996,29 +1021,17 @@ public:
 
         QJsonDocument doc(json);
         QByteArray data = doc.toJson();
-        QNetworkReply *reply = manager.post(request, data);
-
-        // 创建一个事件循环，直到收到回复为止
-        QEventLoop loop;
-        QTimer timer;
-        timer.setSingleShot(true);
-        connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
-        connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-        timer.start(3000);  // 3秒超时
-        loop.exec();
+        QNetworkReply *reply = postIdempotent(manager, request, data);
+        applyChange(auth.AccountType == STUDENT ? ENTITY_STUDENT : ENTITY_TEACHER, auth.Account);
 
         // 检查错误
-        if (timer.isActive()) {
+        if (reply != nullptr) {
             // 请求在3秒内完成
-            timer.stop();
             if (reply->error() != QNetworkReply::NoError && reply->error() != QNetworkReply::ContentNotFoundError) {
                 QMessageBox::warning((QWidget *) this, "警告", "请求失败：" + QVariant::fromValue(reply->error()).toString());
             }
         } else {
-            // 请求在3秒内未完成
-            disconnect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-            reply->abort();
-            reply->deleteLater();
+            // 重试一次后仍未完成
             QMessageBox::warning((QWidget *) this, "警告", "请求超时");
         }
     }
@@ -1088,29 +1101,17 @@ public:
 
         QJsonDocument doc(json);
         QByteArray data = doc.toJson();
-        QNetworkReply *reply = manager.post(request, data);
-
-        // 创建一个事件循环，直到收到回复为止
-        QEventLoop loop;
-        QTimer timer;
-        timer.setSingleShot(true);
-        connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
-        connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-        timer.start(3000);  // 3秒超时
-        loop.exec();
+        QNetworkReply *reply = postIdempotent(manager, request, data);
+        applyChange(ENTITY_LESSON, lesson.Id);
 
         // 检查错误
-        if (timer.isActive()) {
+        if (reply != nullptr) {
             // 请求在3秒内完成
-            timer.stop();
             if (reply->error() != QNetworkReply::NoError && reply->error() != QNetworkReply::ContentNotFoundError) {
                 QMessageBox::warning((QWidget *) this, "警告", "请求失败：" + QVariant::fromValue(reply->error()).toString());
             }
         } else {
-            // 请求在3秒内未完成
-            disconnect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-            reply->abort();
-            reply->deleteLater();
+            // 重试一次后仍未完成
             QMessageBox::warning((QWidget *) this, "警告", "请求超时");
         }
     }
@@ -1138,29 +1139,26 @@ public:
 
         QJsonDocument doc(json);
         QByteArray data = doc.toJson();
-        QNetworkReply *reply = manager.post(request, data);
-
-        // 创建一个事件循环，直到收到回复为止
-        QEventLoop loop;
-        QTimer timer;
-        timer.setSingleShot(true);
-        connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
-        connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-        timer.start(3000);  // 3秒超时
-        loop.exec();
+        QNetworkReply *reply = postIdempotent(manager, request, data);
+        // 名单变化的学生包括原名单和新名单中的学生
+        if (localLessonsTemp.contains(lesson.Id)) {
+            for (auto &&studentId: localLessonsTemp[lesson.Id].LessonStudents) {
+                applyChange(ENTITY_STUDENT, studentId);
+            }
+        }
+        for (auto &&studentId: lesson.LessonStudents) {
+            applyChange(ENTITY_STUDENT, studentId);
+        }
+        applyChange(ENTITY_LESSON, lesson.Id);
 
         // 检查错误
-        if (timer.isActive()) {
+        if (reply != nullptr) {
             // 请求在3秒内完成
-            timer.stop();
             if (reply->error() != QNetworkReply::NoError && reply->error() != QNetworkReply::ContentNotFoundError) {
                 QMessageBox::warning((QWidget *) this, "警告", "请求失败：" + QVariant::fromValue(reply->error()).toString());
             }
         } else {
-            // 请求在3秒内未完成
-            disconnect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-            reply->abort();
-            reply->deleteLater();
+            // 重试一次后仍未完成
             QMessageBox::warning((QWidget *) this, "警告", "请求超时");
         }
     }
@@ -1182,29 +1180,18 @@ public:
 
         QJsonDocument doc(json);
         QByteArray data = doc.toJson();
-        QNetworkReply *reply = manager.post(request, data);
-
-        // 创建一个事件循环，直到收到回复为止
-        QEventLoop loop;
-        QTimer timer;
-        timer.setSingleShot(true);
-        connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
-        connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-        timer.start(3000);  // 3秒超时
-        loop.exec();
+        QNetworkReply *reply = postIdempotent(manager, request, data);
+        applyChange(ENTITY_STUDENT, studentId);
+        applyChange(ENTITY_LESSON, lessonId);
 
         // 检查错误
-        if (timer.isActive()) {
+        if (reply != nullptr) {
             // 请求在3秒内完成
-            timer.stop();
             if (reply->error() != QNetworkReply::NoError && reply->error() != QNetworkReply::ContentNotFoundError) {
                 QMessageBox::warning((QWidget *) this, "警告", "请求失败：" + QVariant::fromValue(reply->error()).toString());
             }
         } else {
-            // 请求在3秒内未完成
-            disconnect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-            reply->abort();
-            reply->deleteLater();
+            // 重试一次后仍未完成
             QMessageBox::warning((QWidget *) this, "警告", "请求超时");
         }
     }
@@ -1231,29 +1218,19 @@ public:
 
         QJsonDocument doc(json);
         QByteArray data = doc.toJson();
-        QNetworkReply *reply = manager.post(request, data);
-
-        // 创建一个事件循环，直到收到回复为止
-        QEventLoop loop;
-        QTimer timer;
-        timer.setSingleShot(true);
-        connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
-        connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-        timer.start(3000);  // 3秒超时
-        loop.exec();
+        QNetworkReply *reply = postIdempotent(manager, request, data);
+        applyChange(ENTITY_STUDENT, studentId);
+        applyChange(ENTITY_LESSON, needRetakeLessonId);
+        applyChange(ENTITY_LESSON, retakeLessonId);
 
         // 检查错误
-        if (timer.isActive()) {
+        if (reply != nullptr) {
             // 请求在3秒内完成
-            timer.stop();
             if (reply->error() != QNetworkReply::NoError && reply->error() != QNetworkReply::ContentNotFoundError) {
                 QMessageBox::warning((QWidget *) this, "警告", "请求失败：" + QVariant::fromValue(reply->error()).toString());
             }
         } else {
-            // 请求在3秒内未完成
-            disconnect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-            reply->abort();
-            reply->deleteLater();
+            // 重试一次后仍未完成
             QMessageBox::warning((QWidget *) this, "警告", "请求超时");
         }
     }
@@ -1275,30 +1252,77 @@ public:
 
         QJsonDocument doc(json);
         QByteArray data = doc.toJson();
-        QNetworkReply *reply = manager.post(request, data);
-
-        // 创建一个事件循环，直到收到回复为止
-        QEventLoop loop;
-        QTimer timer;
-        timer.setSingleShot(true);
-        connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
-        connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-        timer.start(3000);  // 3秒超时
-        loop.exec();
+        QNetworkReply *reply = postIdempotent(manager, request, data);
+        applyChange(ENTITY_STUDENT, studentId);
+        applyChange(ENTITY_LESSON, lessonId);
 
         // 检查错误
-        if (timer.isActive()) {
+        if (reply != nullptr) {
             // 请求在3秒内完成
-            timer.stop();
             if (reply->error() != QNetworkReply::NoError && reply->error() != QNetworkReply::ContentNotFoundError) {
                 QMessageBox::warning((QWidget *) this, "警告", "请求失败：" + QVariant::fromValue(reply->error()).toString());
             }
         } else {
-            // 请求在3秒内未完成
-            disconnect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-            reply->abort();
-            reply->deleteLater();
+            // 重试一次后仍未完成
+            QMessageBox::warning((QWidget *) this, "警告", "请求超时");
+        }
+    }
+
+    // 在一次请求中执行多个操作，operations中每项为 {"route": 接口名, "body": 请求body}
+    void batch(const QJsonArray &operations) {
+        QNetworkAccessManager manager;
+        QNetworkRequest request;
+
+        // 设置请求的URL
+        QString URL = serverURL + "/api/batch/";
+        request.setUrl(QUrl(URL));
+        request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+        request.setRawHeader("Authorization", ("Bearer " + JWT).toUtf8());
+
+        // 发送POST请求
+        QJsonObject json;
+        json.insert("operations", operations);
+
+        QJsonDocument doc(json);
+        QByteArray data = doc.toJson(QJsonDocument::Compact);
+        QNetworkReply *reply = postIdempotent(manager, request, data);
+        for (auto &&operation: operations) {
+            QJsonObject body = operation.toObject()["body"].toObject();
+            if (body.contains("studentId")) {
+                applyChange(ENTITY_STUDENT, body["studentId"].toString());
+            }
+            if (body.contains("lessonId")) {
+                applyChange(ENTITY_LESSON, body["lessonId"].toString());
+            }
+        }
+
+        // 检查错误
+        if (reply == nullptr) {
+            // 重试一次后仍未完成
             QMessageBox::warning((QWidget *) this, "警告", "请求超时");
+            return;
+        }
+        if (reply->error() != QNetworkReply::NoError && reply->error() != QNetworkReply::ContentNotFoundError) {
+            QMessageBox::warning((QWidget *) this, "警告", "请求失败：" + QVariant::fromValue(reply->error()).toString());
+        }
+
+        // 解析回复，汇总失败的操作
+        QJsonObject docJson = QJsonDocument::fromJson(reply->readAll()).object();
+        if (!docJson["success"].toBool()) {
+            QMessageBox::warning((QWidget *) this, "警告", "批量操作失败：" + docJson["message"].toString());
+            return;
+        }
+        QJsonArray results = docJson["results"].toArray();
+        QStringList failures;
+        for (int i = 0; i < results.size(); i++) {
+            QJsonObject result = results[i].toObject();
+            if (!result["success"].toBool()) {
+                QJsonObject body = operations[i].toObject()["body"].toObject();
+                failures.append(body["studentId"].toString() + "：" + result["message"].toString());
+            }
+        }
+        if (!failures.isEmpty()) {
+            QMessageBox::warning((QWidget *) this, "警告", "部分操作失败：\n" + failures.join("\n"));
         }
     }
 
@@ -1318,29 +1342,23 @@ public:
 
         QJsonDocument doc(json);
         QByteArray data = doc.toJson();
-        QNetworkReply *reply = manager.post(request, data);
-
-        // 创建一个事件循环，直到收到回复为止
-        QEventLoop loop;
-        QTimer timer;
-        timer.setSingleShot(true);
-        connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
-        connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-        timer.start(3000);  // 3秒超时
-        loop.exec();
+        QNetworkReply *reply = postIdempotent(manager, request, data);
+        // 删除课程会修改其选课学生的选课列表
+        if (localLessonsTemp.contains(lessonId)) {
+            for (auto &&studentId: localLessonsTemp[lessonId].LessonStudents) {
+                applyChange(ENTITY_STUDENT, studentId);
+            }
+        }
+        applyChange(ENTITY_LESSON, lessonId);
 
         // 检查错误
-        if (timer.isActive()) {
+        if (reply != nullptr) {
             // 请求在3秒内完成
-            timer.stop();
             if (reply->error() != QNetworkReply::NoError && reply->error() != QNetworkReply::ContentNotFoundError) {
                 QMessageBox::warning((QWidget *) this, "警告", "请求失败：" + QVariant::fromValue(reply->error()).toString());
             }
         } else {
-            // 请求在3秒内未完成
-            disconnect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-            reply->abort();
-            reply->deleteLater();
+            // 重试一次后仍未完成
             QMessageBox::warning((QWidget *) this, "警告", "请求超时");
         }
     }
@@ -1372,29 +1390,16 @@ public:
 
         QJsonDocument doc(json);
         QByteArray data = doc.toJson();
-        QNetworkReply *reply = manager.post(request, data);
-
-        // 创建一个事件循环，直到收到回复为止
-        QEventLoop loop;
-        QTimer timer;
-        timer.setSingleShot(true);
-        connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
-        connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-        timer.start(3000);  // 3秒超时
-        loop.exec();
+        QNetworkReply *reply = postIdempotent(manager, request, data);
 
         // 检查错误
-        if (timer.isActive()) {
+        if (reply != nullptr) {
             // 请求在3秒内完成
-            timer.stop();
             if (reply->error() != QNetworkReply::NoError && reply->error() != QNetworkReply::ContentNotFoundError) {
                 QMessageBox::warning((QWidget *) this, "警告", "请求失败：" + QVariant::fromValue(reply->error()).toString());
             }
         } else {
-            // 请求在3秒内未完成
-            disconnect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-            reply->abort();
-            reply->deleteLater();
+            // 重试一次后仍未完成
             QMessageBox::warning((QWidget *) this, "警告", "请求超时");
         }
         doLogout();
@@ -1408,6 +1413,7 @@ public:
         QString URL = serverURL + "/api/getStudentInformation/" + id;
         request.setUrl(QUrl(URL));
         request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+        setIfNoneMatch(request);
 
         // 发送GET请求
         QNetworkReply *reply = manager.get(request);
@@ -1437,27 +1443,13 @@ public:
         }
 
         // 解析回复
-        QByteArray responseData = reply->readAll();
+        QByteArray responseData = readConditionalReply(reply);
         QJsonDocument doc = QJsonDocument::fromJson(responseData);
         QJsonObject json = doc.object();
 
         // 使用回复中的数据填充学生对象
-        student.Id = json["Id"].toString();
-        student.Name = json["Name"].toString();
-        student.Sex = json["Sex"].toString();
-        student.College = json["College"].toString();
-        student.Major = json["Major"].toString();
-        student.Class = json["Class"].toString();
-        student.Age = json["Age"].toInt();
-        student.PhoneNumber = json["PhoneNumber"].toString();
-        student.DormitoryArea = json["DormitoryArea"].toString();
-        student.DormitoryNum = json["DormitoryNum"].toString();
-
-        // 将已选课程的JSON数组转换为QVector
-        QJsonArray chosenLessonsArray = json["ChosenLessons"].toArray();
-        for (auto &&i: chosenLessonsArray) {
-            student.ChosenLessons.append(i.toString());
-        }
+        Entity::readJson(json, student);
+    }
     }
 
     void resizeWidget() {
@@ -1765,6 +1757,7 @@ public:
         request.setUrl(QUrl(URL));
         request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
         request.setRawHeader("Authorization", ("Bearer " + JWT).toUtf8());
+        request.setRawHeader("Accept", "application/cbor");
 
         // 发送POST请求
         QNetworkReply *reply = manager.post(request, "");
@@ -1795,43 +1788,14 @@ public:
 
         // 解析回复
         QByteArray responseData = reply->readAll();
-        QJsonDocument doc = QJsonDocument::fromJson(responseData);
-        QJsonObject docJson = doc.object();
-
-        if (docJson["success"].toBool()) {
+        QString message;
+        bool success = readCborListReply(responseData, "lessons", message, [&lessons](QCborStreamReader &reader) {
             // 使用回复中的数据填充课程对象
-            QJsonArray lessonsArray = docJson["lessons"].toArray();
-            for (auto &&i: lessonsArray) {
-                Lesson lesson;
-                QJsonObject lessonObject = i.toObject();
-                lesson.Id = lessonObject["Id"].toString();
-                lesson.LessonArea = lessonObject["LessonArea"].toString();
-                lesson.LessonCredits = lessonObject["LessonCredits"].toInt();
-                lesson.LessonSemester = lessonObject["LessonSemester"].toString();
-                lesson.LessonName = lessonObject["LessonName"].toString();
-                lesson.TeacherId = lessonObject["TeacherId"].toString();
-
-                // 将选课学生的JSON数组转换为QVector
-                QJsonArray lessonStudentsArray = lessonObject["LessonStudents"].toArray();
-                for (auto &&j: lessonStudentsArray) {
-                    lesson.LessonStudents.append(j.toString());
-                }
+            Entity::readCbor(reader, lessons.emplace_back());
+        });
 
-                // 将课程时间和地点的JSON对象转换为QMap
-                QJsonObject lessonTimeAndLocationsObject = lessonObject["LessonTimeAndLocations"].toObject();
-                for (auto &&j: lessonTimeAndLocationsObject.keys()) {
-                    QJsonArray timeAndLocationArray = lessonTimeAndLocationsObject[j].toArray();
-                    QVector<QString> timeAndLocation;
-                    for (auto &&k: timeAndLocationArray) {
-                        timeAndLocation.append(k.toString());
-                    }
-                    lesson.LessonTimeAndLocations.insert(j, timeAndLocation);
-                }
-                lessons.append(lesson);
-            }
-        } else {
-            // 请求失败，获取并显示错误消息
-            QString message = docJson["message"].toString();
+        if (!success) {
+            // 请求失败，显示错误消息
             QMessageBox::warning((QWidget *) this, "警告", "获取课程信息失败：" + message);
         }
     }
@@ -1902,16 +1866,7 @@ public:
             QJsonArray teachersArray = docJson["teachers"].toArray();
             for (auto &&i: teachersArray) {
                 Teacher teacher;
-                QJsonObject teacherObject = i.toObject();
-                teacher.Id = teacherObject["Id"].toString();
-                teacher.Name = teacherObject["Name"].toString();
-                teacher.Unit = teacherObject["Unit"].toString();
-
-                // 将教授课填入QVector
-                QJsonArray teachingLessonsArray = teacherObject["TeachingLessons"].toArray();
-                for (auto &&j: teachingLessonsArray) {
-                    teacher.TeachingLessons.append(j.toString());
-                }
+                Entity::readJson(i.toObject(), teacher);
                 teachers.append(teacher);
             }
         } else {
@@ -1930,6 +1885,7 @@ public:
         request.setUrl(QUrl(URL));
         request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
         request.setRawHeader("Authorization", ("Bearer " + JWT).toUtf8());
+        request.setRawHeader("Accept", "application/cbor");
 
         // 发送POST请求
         QNetworkReply *reply = manager.post(request, "");
@@ -1960,36 +1916,14 @@ public:
 
         // 解析回复
         QByteArray responseData = reply->readAll();
-        QJsonDocument doc = QJsonDocument::fromJson(responseData);
-        QJsonObject docJson = doc.object();
-
-        if (docJson["success"].toBool()) {
+        QString message;
+        bool success = readCborListReply(responseData, "students", message, [&students](QCborStreamReader &reader) {
             // 使用回复中的数据填充学生对象
-            QJsonArray studentsArray = docJson["students"].toArray();
-            for (auto &&i: studentsArray) {
-                Student student;
-                QJsonObject studentObject = i.toObject();
-                student.Id = studentObject["Id"].toString();
-                student.Name = studentObject["Name"].toString();
-                student.Sex = studentObject["Sex"].toString();
-                student.College = studentObject["College"].toString();
-                student.Major = studentObject["Major"].toString();
-                student.Class = studentObject["Class"].toString();
-                student.Age = studentObject["Age"].toInt();
-                student.PhoneNumber = studentObject["PhoneNumber"].toString();
-                student.DormitoryArea = studentObject["DormitoryArea"].toString();
-                student.DormitoryNum = studentObject["DormitoryNum"].toString();
-
-                // 将已选课程的JSON数组转换为QVector
-                QJsonArray chosenLessonsArray = studentObject["ChosenLessons"].toArray();
-                for (auto &&j: chosenLessonsArray) {
-                    student.ChosenLessons.append(j.toString());
-                }
-                students.append(student);
-            }
-        } else {
-            // 请求失败，获取并显示错误消息
-            QString message = docJson["message"].toString();
+            Entity::readCbor(reader, students.emplace_back());
+        });
+
+        if (!success) {
+            // 请求失败，显示错误消息
             QMessageBox::warning((QWidget *) this, "警告", "获取学生信息失败：" + message);
         }
     }
@@ -2003,6 +1937,8 @@ public slots:
 
     void doLogout() {
         isLogin = false;
+        changeSyncTimer.stop();
+        pushSocket.close();
         currentStudent.Id = "";
         currentTeacher.Id = "";
         clearCache();
@@ -2020,6 +1956,11 @@ public slots:
         updateWelcomeWidget(auth.Account, auth.AccountType);
         stackedWidget->setCurrentIndex(0);
         show();
+        // 从服务器当前的变更序号开始同步
+        changeSeq = -1;
+        syncChanges();
+        changeSyncTimer.start();
+        connectPush();
     }
 
     void fillTableWidget_Teacher_Schedule() {
@@ -2229,17 +2170,133 @@ public slots:
         tableWidget_Chosen->resizeRowsToContents();
     }
 
-    void clearCache() {
+    void clearLocalCache() {
         localTeachersTemp.clear();
         localLessonsTemp.clear();
         localGradesTemp.clear();
         localStudentsTemp.clear();
         localLessonClassesTemp.clear();
         localLessonsListTemp.clear();
+        localStudentsListTemp.clear();
         localTeachersListTemp.clear();
+    }
+
+    void clearCache() {
+        clearLocalCache();
         QMessageBox::information(this, "提示", "缓存已清除");
     }
 
+    // 根据一条变更移除受影响的本地缓存。其他客户端的写入来自变更同步和推送；
+    // 自己的写入由各写请求在发出后直接调用，不等待同步，请求失败时多移除一次也无妨
+    void applyChange(int entity, const QString &id) {
+        if (entity == ENTITY_STUDENT) {
+            localStudentsTemp.remove(id);
+            localStudentsListTemp.clear();
+            // 选课或退课会增删该学生的成绩记录
+            for (auto it = localGradesTemp.begin(); it != localGradesTemp.end();) {
+                if (it.key().first == id) {
+                    it = localGradesTemp.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        } else if (entity == ENTITY_TEACHER) {
+            localTeachersTemp.remove(id);
+            localTeachersListTemp.clear();
+        } else if (entity == ENTITY_LESSON) {
+            localLessonsTemp.remove(id);
+            localLessonsListTemp.clear();
+            localLessonClassesTemp.remove(id);
+        } else if (entity == ENTITY_GRADE) {
+            QStringList parts = id.split('/');
+            if (parts.size() == 2) {
+                localGradesTemp.remove({parts[0], parts[1]});
+            }
+        }
+    }
+
+    void connectPush() {
+        if (!isLogin || pushSocket.state() != QAbstractSocket::UnconnectedState) {
+            return;
+        }
+        QUrl url(serverURL + "/api/push/");
+        url.setScheme(url.scheme() == "https" ? "wss" : "ws");
+        pushSocket.open(url);
+    }
+
+    void onPushMessage(const QString &message) {
+        QJsonObject json = QJsonDocument::fromJson(message.toUtf8()).object();
+        if (json["subscribed"].toBool()) {
+            // 订阅成功后先补齐连接前的变更，之后依靠推送
+            changeSyncTimer.setInterval(CHANGE_SYNC_INTERVAL_PUSH);
+            syncChanges();
+        } else if (json["reset"].toBool()) {
+            clearLocalCache();
+        } else {
+            for (auto &&i: json["changes"].toArray()) {
+                QJsonArray change = i.toArray();
+                applyChange(change[0].toInt(), change[1].toString());
+            }
+        }
+    }
+
+    // 拉取上次同步之后的服务器变更，只移除发生变化的缓存
+    void syncChanges() {
+        if (!isLogin) {
+            return;
+        }
+        bool more = true;
+        while (more) {
+            more = false;
+            QNetworkAccessManager manager;
+            QNetworkRequest request;
+
+            // 设置请求的URL
+            QString URL = serverURL + "/api/changes/?since=" + QString::number(changeSeq);
+            request.setUrl(QUrl(URL));
+            request.setRawHeader("Authorization", ("Bearer " + JWT).toUtf8());
+
+            // 发送GET请求
+            QNetworkReply *reply = manager.get(request);
+
+            // 创建一个事件循环，直到收到回复为止
+            QEventLoop loop;
+            QTimer timer;
+            timer.setSingleShot(true);
+            connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
+            connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
+            timer.start(3000);  // 3秒超时
+            loop.exec();
+
+            if (!timer.isActive() || reply->error() != QNetworkReply::NoError) {
+                // 同步失败时保留缓存，下次定时同步再重试
+                disconnect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
+                reply->abort();
+                reply->deleteLater();
+                return;
+            }
+            timer.stop();
+
+            // 解析回复
+            QByteArray responseData = reply->readAll();
+            reply->deleteLater();
+            QJsonObject json = QJsonDocument::fromJson(responseData).object();
+            if (!json["success"].toBool()) {
+                return;
+            }
+            if (json["reset"].toBool()) {
+                // 第一次同步或变更记录已被清理，无法判断哪些缓存失效
+                clearLocalCache();
+            }
+            for (auto &&i: json["changes"].toArray()) {
+                QJsonArray change = i.toArray();
+                applyChange(change[0].toInt(), change[1].toString());
+            }
+            changeSeq = json["next"].toInteger();
+            more = json["more"].toBool();
+        }
+    }
+
     void fillTableWidget_Grade() {
         tableWidget_Grade->setRowCount(0);
         int CreditSum = 0;
@@ -2652,7 +2709,7 @@ public slots:
             classString.chop(1);
             auto *item5 = new QTableWidgetItem(classString);
             item5->setTextAlignment(Qt::AlignCenter);
-            auto *item6 = new QTableWidgetItem(QString::number(lesson.LessonStudents.size()));
+            auto *item6 = new QTableWidgetItem(QString::number(lesson.LessonStudentCount));
             item6->setTextAlignment(Qt::AlignCenter);
             auto *label = new QLabel();
             label->setText(QString("<a href='%1'>选课管理</a>").arg(lesson.Id));
@@ -2708,12 +2765,10 @@ public slots:
             }
             lesson.LessonTimeAndLocations = timeAndLocations;
             updateLessonInformation(lesson);
-            localLessonsListTemp.clear();
             fillTableWidget_Super_Lesson();
         } else if (operation == "DELETE") {
             if (QMessageBox::question(this, "确认", "确定删除该课程吗？") == QMessageBox::Yes) {
                 deleteLesson(lessonId);
-                localLessonsListTemp.clear();
                 tableWidget_Super_Lesson->removeRow(row);
             }
         }
@@ -2787,7 +2842,7 @@ public slots:
             classString.chop(1);
             auto *item5 = new QTableWidgetItem(classString);
             item5->setTextAlignment(Qt::AlignCenter);
-            auto *item6 = new QTableWidgetItem(QString::number(lesson.LessonStudents.size()));
+            auto *item6 = new QTableWidgetItem(QString::number(lesson.LessonStudentCount));
             item6->setTextAlignment(Qt::AlignCenter);
             auto *label = new QLabel();
             label->setText(QString("<a href='%1'>查录成绩</a>").arg(lesson.Id));
@@ -2983,7 +3038,6 @@ public slots:
                 auth.IsSuper = 0;
             }
             updateAccount(auth);
-            localTeachersListTemp.clear();
             fillTableWidget_Super_Teacher();
         } else if (operation == "DELETE") {
             QMessageBox::StandardButton reply;
@@ -2992,7 +3046,6 @@ public slots:
             if (reply == QMessageBox::Yes) {
                 deleteTeacher(teacherId);
                 QMessageBox::information(this, "提示", "删除成功");
-                localTeachersListTemp.clear();
                 fillTableWidget_Super_Teacher();
             }
         }
@@ -3035,7 +3088,6 @@ public slots:
             }
             lesson.LessonTimeAndLocations = timeAndLocations;
             updateLessonInformation(lesson);
-            localLessonsListTemp.clear();
             fillTableWidget_Super_Lesson();
         } else if (operation == "CANCEL") {
             tableWidget_Super_Lesson->removeRow(row);
@@ -3085,7 +3137,6 @@ public slots:
                 auth.IsSuper = 0;
             }
             addAccount(auth, teacher.Id);
-            localTeachersListTemp.clear();
             fillTableWidget_Super_Teacher();
         } else if (operation == "CANCEL") {
             tableWidget_Super_Teacher->removeRow(row);
@@ -3139,7 +3190,6 @@ public slots:
             }
             auth.IsSuper = 0;
             addAccount(auth, student.Id);
-            localStudentsListTemp.clear();
             fillTableWidget_Super_Student();
         } else if (operation == "CANCEL") {
             tableWidget_Super_Student->removeRow(row);
@@ -3169,7 +3219,6 @@ public slots:
             student.DormitoryArea = tableWidget_Super_Student->item(row, 8)->text();
             student.DormitoryNum = tableWidget_Super_Student->item(row, 9)->text();
             updateStudentInformation(student);
-            localStudentsListTemp.clear();
             fillTableWidget_Super_Student();
         } else if (operation == "DELETE") {
             QMessageBox::StandardButton reply;
@@ -3178,7 +3227,6 @@ public slots:
             if (reply == QMessageBox::Yes) {
                 deleteStudent(studentId);
                 QMessageBox::information(this, "提示", "删除成功");
-                localStudentsListTemp.clear();
                 fillTableWidget_Super_Student();
             }
         }
@@ -3394,7 +3442,6 @@ void StudentListForm::doCheckAndSendGrade() {
 
     auto *parentAIMSMainWindow = (AIMSMainWindow *) this->parentWidget();
     parentAIMSMainWindow->updateStudentLessonGrade(localGrade);
-    parentAIMSMainWindow->localGradesTemp.clear();
 }
 
 void ChangePasswordForm::changePassword() {
@@ -3431,13 +3478,18 @@ void StudentListForm::fillTableWidget_LessonChosen() {
 void StudentListForm::finishChoosing() {
     qDebug() << "finishChoosing";
     auto *parentAIMSMainWindow = (AIMSMainWindow *) this->parentWidget();
-    for (int i = 0; i < tableWidget_LessonChosenStudent->rowCount(); i++) {
-        QString studentId = tableWidget_LessonChosenStudent->item(i, 0)->text();
-        if (!lessonStudentList.contains(studentId)) {
-            parentAIMSMainWindow->addChosenLesson(studentId, currentLessonId);
-        }
-    }
-    //在lessonStudentList中的学生不在tableWidget_LessonChosenStudent中，删除
+    // 所有增删合并为一个批量请求，一次往返完成
+    QJsonArray operations;
+    auto addOperation = [&operations, this](const QString &route, const QString &studentId) {
+        QJsonObject body;
+        body.insert("studentId", studentId);
+        body.insert("lessonId", currentLessonId);
+        QJsonObject operation;
+        operation.insert("route", route);
+        operation.insert("body", body);
+        operations.append(operation);
+    };
+    //在lessonStudentList中的学生不在tableWidget_LessonChosenStudent中，删除；先退课再选课，课程已满时替换学生不会因为名额不足失败
     for (auto &i: lessonStudentList) {
         bool isExist = false;
         for (int j = 0; j < tableWidget_LessonChosenStudent->rowCount(); j++) {
@@ -3447,12 +3499,19 @@ void StudentListForm::finishChoosing() {
             }
         }
         if (!isExist) {
-            parentAIMSMainWindow->deleteChosenLesson(i, currentLessonId);
+            addOperation("deleteChosenLesson", i);
         }
     }
-    parentAIMSMainWindow->localLessonsListTemp.clear();
-    parentAIMSMainWindow->localLessonClassesTemp.clear();
-    parentAIMSMainWindow->localLessonsTemp.clear();
+    //在tableWidget_LessonChosenStudent中的学生不在lessonStudentList中，添加
+    for (int i = 0; i < tableWidget_LessonChosenStudent->rowCount(); i++) {
+        QString studentId = tableWidget_LessonChosenStudent->item(i, 0)->text();
+        if (!lessonStudentList.contains(studentId)) {
+            addOperation("addChosenLesson", studentId);
+        }
+    }
+    if (!operations.isEmpty()) {
+        parentAIMSMainWindow->batch(operations);
+    }
     parentAIMSMainWindow->fillTableWidget_Super_Lesson_Assign();
     close();
 
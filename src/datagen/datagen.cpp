@@ -0,0 +1,409 @@
+#include "datagen.h"
+#include "../server/database.h"
+#include "../server/entitysql.h"
+#include "../server/password.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSet>
+#include <QStringList>
+#include <QtSql/QSqlError>
+#include <QtSql/QSqlQuery>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <type_traits>
+
+namespace DataGen {
+
+    const QStringList SURNAMES = {"王", "李", "张", "刘", "陈", "杨", "黄", "赵", "吴", "周", "徐", "孙", "马", "朱",
+                                  "胡", "郭", "何", "高", "林", "罗"};
+
+    const QStringList GIVEN_NAMES = {"伟", "芳", "娜", "敏", "静", "丽", "强", "磊", "军", "洋", "勇", "艳", "杰",
+                                     "娟", "涛", "明", "超", "秀", "霞", "平", "刚", "桂", "英", "华", "宇", "欣",
+                                     "浩", "晨", "雪", "琳"};
+
+    const QStringList COLLEGES = {"计算机学院", "数学学院", "物理学院", "经济管理学院", "外国语学院", "机械工程学院"};
+
+    const QStringList MAJORS = {"计算机科学与技术", "软件工程", "数学与应用数学", "统计学", "应用物理学", "光电信息",
+                                "经济学", "工商管理", "英语", "日语", "机械设计", "车辆工程"};
+
+    const QStringList COURSES = {"高等数学", "线性代数", "概率论与数理统计", "大学物理", "大学英语", "程序设计基础",
+                                 "数据结构", "操作系统", "计算机网络", "数据库原理", "编译原理", "离散数学",
+                                 "微观经济学", "管理学", "机械制图", "形势与政策"};
+
+    const QStringList AREAS = {"东区", "西区", "南区", "北区"};
+
+    const QStringList DORMITORY_AREAS = {"东苑", "西苑", "南苑", "北苑"};
+
+    // 与 EntitySql::isWritable 不同，选课名单等由专门操作维护的列也直接写入；
+    // 版本号使用默认值，由表达式计算的列（如选课人数）不写入
+    template<typename FieldType>
+    bool isStored(const FieldType &field) {
+        return field.Column != nullptr && !QLatin1StringView(field.Column).contains('(') &&
+               !(field.has(FIELD_MANAGED) && field.has(FIELD_INTERNAL));
+    }
+
+    template<typename Class>
+    QString insertStatement(const QString &table) {
+        QStringList names;
+        QStringList placeholders;
+        Entity::forEachField<Class>([&names, &placeholders](const auto &field) {
+            if (isStored(field)) {
+                names.append(QString::fromLatin1(field.Column));
+                placeholders.append("?");
+            }
+        });
+        return QString("INSERT INTO %1 (%2) VALUES (%3)").arg(table, names.join(", "), placeholders.join(", "));
+    }
+
+    template<typename Class>
+    void bindRow(QSqlQuery &query, const Class &row) {
+        Entity::forEachField<Class>([&query, &row](const auto &field) {
+            if (!isStored(field)) {
+                return;
+            }
+            const auto &value = row.*(field.Member);
+            using Type = std::decay_t<decltype(value)>;
+            if constexpr (std::is_same_v<Type, double>) {
+                // 尚未录入的成绩写入NULL
+                if (field.has(FIELD_NULLABLE) && value < 0) {
+                    query.addBindValue(QVariant(QMetaType(QMetaType::Double)));
+                    return;
+                }
+            }
+            query.addBindValue(EntitySql::toColumn(value, field.Flags));
+        });
+    }
+
+    template<typename Class>
+    bool insertRows(QSqlDatabase &db, const QString &table, const QVector<Class> &rows) {
+        QSqlQuery query(db);
+        if (!query.prepare(insertStatement<Class>(table))) {
+            qWarning() << "DataGen | prepare error:" << table << query.lastError();
+            return false;
+        }
+        for (const auto &row: rows) {
+            bindRow(query, row);
+            if (!query.exec()) {
+                qWarning() << "DataGen | insert error:" << table << query.lastError();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    generator::generator(const Options &options) : options(options), random(options.Seed) {
+        for (int i = 0; i < options.Semesters; i++) {
+            int year = DATAGEN_FIRST_YEAR + i / 2;
+            semesters.append(QString("%1-%2-%3").arg(year).arg(year + 1).arg(i % 2 + 1));
+        }
+    }
+
+    int generator::uniform(int low, int high) {
+        return std::uniform_int_distribution<int>(low, high)(random);
+    }
+
+    double generator::normal(double mean, double stddev) {
+        return std::normal_distribution<double>(mean, stddev)(random);
+    }
+
+    bool generator::chance(double probability) {
+        return std::bernoulli_distribution(probability)(random);
+    }
+
+    QString generator::makeName() {
+        QString name = SURNAMES[uniform(0, int(SURNAMES.size()) - 1)];
+        int length = chance(0.6) ? 2 : 1;
+        for (int i = 0; i < length; i++) {
+            name += GIVEN_NAMES[uniform(0, int(GIVEN_NAMES.size()) - 1)];
+        }
+        return name;
+    }
+
+    void generator::generateTeachers() {
+        teachers.resize(options.Teachers);
+        for (int i = 0; i < options.Teachers; i++) {
+            Teacher &teacher = teachers[i];
+            teacher.Id = makeId(options.TeacherPrefix, i + 1);
+            teacher.Name = makeName();
+            teacher.Unit = COLLEGES[uniform(0, int(COLLEGES.size()) - 1)];
+        }
+    }
+
+    void generator::generateLessons() {
+        // 课程按 科目 x 学期 排列，同一科目由同一名教师在各学期开设，不及格的学生可以在之后的学期重修
+        int courseCount = (options.Lessons + options.Semesters - 1) / options.Semesters;
+        QVector<int> courseTeachers(courseCount);
+        QVector<int> courseCredits(courseCount);
+        for (int i = 0; i < courseCount; i++) {
+            courseTeachers[i] = uniform(0, options.Teachers - 1);
+            courseCredits[i] = std::discrete_distribution<int>({1, 3, 4, 2, 1})(random) + 1;
+        }
+
+        lessons.resize(options.Lessons);
+        lessonCourses.resize(options.Lessons);
+        lessonSemesters.resize(options.Lessons);
+        lessonTimeSlots.resize(options.Lessons);
+        grades.resize(options.Lessons);
+        for (int i = 0; i < options.Lessons; i++) {
+            int course = i / options.Semesters;
+            int semester = i % options.Semesters;
+            Lesson &lesson = lessons[i];
+            lesson.Id = makeId(options.LessonPrefix, i + 1);
+            lesson.LessonName = COURSES[course % COURSES.size()];
+            if (course >= COURSES.size()) {
+                lesson.LessonName += QString::number(course / COURSES.size() + 1);
+            }
+            lesson.TeacherId = teachers[courseTeachers[course]].Id;
+            lesson.LessonCredits = courseCredits[course];
+            lesson.LessonCapacity = chance(DATAGEN_UNLIMITED_RATE) ? 0 : uniform(3, 20) * 10;
+            lesson.LessonSemester = semesters[semester];
+            lesson.LessonArea = AREAS[uniform(0, int(AREAS.size()) - 1)];
+
+            // 每周一到两次课，每次连续两节，如 "40809节" 表示星期四第8、9节
+            int day = uniform(1, 5);
+            int period = uniform(0, 4) * 2 + 1;
+            QString room = QString::number(uniform(1, 9)) + QString::number(uniform(101, 599));
+            lesson.LessonTimeAndLocations["1-16周"] = {
+                    QString("%1%2%3节").arg(day).arg(period, 2, 10, QChar('0')).arg(period + 1, 2, 10, QChar('0')),
+                    room};
+            if (lesson.LessonCredits >= 3) {
+                int secondDay = day % 5 + 1;
+                lesson.LessonTimeAndLocations["1-8周"] = {
+                        QString("%1%2%3节").arg(secondDay).arg(period, 2, 10, QChar('0'))
+                                .arg(period + 1, 2, 10, QChar('0')), room};
+            }
+            lessonCourses[i] = course;
+            lessonSemesters[i] = semester;
+            lessonTimeSlots[i] = Timetable::parseTimeAndLocations(lesson.LessonTimeAndLocations);
+            teachers[courseTeachers[course]].TeachingLessons.append(lesson.Id);
+        }
+    }
+
+    void generator::generateStudents() {
+        students.resize(options.Students);
+        for (int i = 0; i < options.Students; i++) {
+            Student &student = students[i];
+            int major = uniform(0, int(MAJORS.size()) - 1);
+            int year = DATAGEN_FIRST_YEAR - uniform(0, 3);
+            student.Id = makeId(options.StudentPrefix, i + 1);
+            student.Name = makeName();
+            student.Sex = chance(0.5) ? "男" : "女";
+            student.College = COLLEGES[major / 2];
+            student.Major = MAJORS[major];
+            student.Class = MAJORS[major] + QString("%1%2").arg(year % 100, 2, 10, QChar('0')).arg(uniform(1, 4), 2, 10,
+                                                                                                     QChar('0'));
+            student.Age = DATAGEN_FIRST_YEAR - year + uniform(18, 20);
+            student.PhoneNumber = "1" + QString::number(uniform(30, 99)) +
+                                  QString("%1").arg(uniform(0, 99999999), 8, 10, QChar('0'));
+            student.DormitoryArea = DORMITORY_AREAS[uniform(0, int(DORMITORY_AREAS.size()) - 1)];
+            student.DormitoryNum = QString::number(uniform(1, 30)) + "-" + QString::number(uniform(101, 699));
+        }
+    }
+
+    void generator::generateGrade(Grade &grade) {
+        // 平时成绩集中在高分段，考试成绩分布更宽，总评按 3:7 计算
+        grade.RegularGrade = qBound(0.0, std::round(normal(82, 8)), 100.0);
+        grade.ExamGrade = qBound(0.0, std::round(normal(72, 15)), 100.0);
+        grade.TotalGrade = std::round((grade.RegularGrade * 0.3 + grade.ExamGrade * 0.7) * 10) / 10;
+    }
+
+    bool generator::tryEnroll(int student, int lesson, int &credits, QVector<Timetable::TimeSlot> &timeSlots,
+                              int retake) {
+        Lesson &target = lessons[lesson];
+        if (target.LessonCapacity > 0 && target.LessonStudents.size() >= target.LessonCapacity) {
+            return false;
+        }
+        if (credits + target.LessonCredits > MAX_SEMESTER_CREDITS) {
+            return false;
+        }
+        if (Timetable::isConflict(timeSlots, lessonTimeSlots[lesson])) {
+            return false;
+        }
+        credits += target.LessonCredits;
+        timeSlots += lessonTimeSlots[lesson];
+        target.LessonStudents.append(students[student].Id);
+        students[student].ChosenLessons.append(target.Id);
+
+        Grade grade;
+        grade.StudentId = students[student].Id;
+        grade.LessonId = target.Id;
+        grade.ExamGrade = -1;
+        grade.RegularGrade = -1;
+        grade.TotalGrade = -1;
+        grade.Retake = retake;
+        // 最后一个学期为当前学期，成绩尚未录入
+        if (lessonSemesters[lesson] + 1 < options.Semesters) {
+            generateGrade(grade);
+        }
+        grades[lesson].append(grade);
+        return true;
+    }
+
+    void generator::enroll() {
+        // 各学期的课程按热度抽样，热度为随机排名的 Zipf 分布
+        QVector<QVector<int>> semesterLessons(options.Semesters);
+        for (int i = 0; i < options.Lessons; i++) {
+            semesterLessons[lessonSemesters[i]].append(i);
+        }
+        std::vector<std::discrete_distribution<int>> popularity;
+        for (auto &candidates: semesterLessons) {
+            std::vector<double> weights(candidates.size());
+            std::vector<int> ranks(candidates.size());
+            std::iota(ranks.begin(), ranks.end(), 1);
+            std::shuffle(ranks.begin(), ranks.end(), random);
+            for (size_t i = 0; i < weights.size(); i++) {
+                weights[i] = 1.0 / std::pow(double(ranks[i]), DATAGEN_POPULARITY_EXPONENT);
+            }
+            popularity.emplace_back(weights.begin(), weights.end());
+        }
+
+        QVector<QSet<int>> takenCourses(options.Students);
+        QVector<QVector<PendingRetake>> retakes(options.Semesters);
+        for (int semester = 0; semester < options.Semesters; semester++) {
+            if (semesterLessons[semester].isEmpty()) {
+                continue;
+            }
+            // 重修按学生排序，遍历学生时顺序取出
+            QVector<PendingRetake> &pending = retakes[semester];
+            std::stable_sort(pending.begin(), pending.end(), [](const PendingRetake &a, const PendingRetake &b) {
+                return a.Student < b.Student;
+            });
+            int next = 0;
+            for (int student = 0; student < options.Students; student++) {
+                int credits = 0;
+                QVector<Timetable::TimeSlot> timeSlots;
+
+                // 先安排本学期的重修，重修课程标记为2，原课程标记为1并记录重修的课程和学期
+                for (; next < pending.size() && pending[next].Student == student; next++) {
+                    const PendingRetake &retake = pending[next];
+                    int lesson = retake.Course * options.Semesters + semester;
+                    if (lesson >= options.Lessons || !tryEnroll(student, lesson, credits, timeSlots, RETAKEN)) {
+                        continue;
+                    }
+                    Grade &original = grades[retake.Lesson][retake.Grade];
+                    original.Retake = RETAKE;
+                    original.RetakeLessonId.append(lessons[lesson].Id);
+                    original.RetakeSemesters.append(semesters[semester]);
+                }
+
+                int target = qBound(1, int(std::lround(normal(DATAGEN_LESSONS_PER_SEMESTER, DATAGEN_LESSONS_STDDEV))),
+                                    MAX_PREFERENCES);
+                int chosen = 0;
+                for (int attempt = 0; attempt < target * 4 && chosen < target; attempt++) {
+                    int lesson = semesterLessons[semester][popularity[semester](random)];
+                    if (takenCourses[student].contains(lessonCourses[lesson])) {
+                        continue;
+                    }
+                    if (!tryEnroll(student, lesson, credits, timeSlots, NOT_RETAKE)) {
+                        continue;
+                    }
+                    takenCourses[student].insert(lessonCourses[lesson]);
+                    chosen++;
+
+                    const Grade &grade = grades[lesson].last();
+                    if (grade.TotalGrade >= 0 && grade.TotalGrade < 60 && semester + 1 < options.Semesters &&
+                        chance(DATAGEN_RETAKE_RATE)) {
+                        int retakeSemester = uniform(semester + 1, options.Semesters - 1);
+                        retakes[retakeSemester].append(
+                                {student, lessonCourses[lesson], lesson, int(grades[lesson].size()) - 1});
+                    }
+                }
+            }
+        }
+    }
+
+    void generator::generateAuths() {
+        // PBKDF2 计算很慢，同类账号共用一个密钥，生成十万个账号也只需计算三次
+        // 保存的是客户端发送的密钥的哈希，生成的账号可以直接用客户端登录
+        QString studentSecret = Password::hash(clientSecret(options.StudentSecret));
+        QString teacherSecret = Password::hash(clientSecret(options.TeacherSecret));
+        auths.append(Auth{options.Admin, Password::hash(clientSecret(options.AdminSecret)), TEACHER, 1});
+        for (const auto &teacher: teachers) {
+            auths.append(Auth{teacher.Id, teacherSecret, TEACHER, 0});
+        }
+        for (const auto &student: students) {
+            auths.append(Auth{student.Id, studentSecret, STUDENT, 0});
+        }
+    }
+
+    bool generator::write() {
+        if (QFile::exists(options.Output)) {
+            if (!options.Force) {
+                qWarning() << "DataGen |" << options.Output << "already exists, use --force to overwrite";
+                return false;
+            }
+            for (const auto &suffix: {"", "-wal", "-shm"}) {
+                QFile::remove(options.Output + suffix);
+            }
+        }
+
+        // 由 Server 的建表逻辑创建数据库，表结构与服务器完全一致
+        QString connection = QString(DATAGEN_CONNECTION) + ":" + options.Output;
+        Database::database database(options.Output, connection);
+        QSqlDatabase db = QSqlDatabase::database(connection, false);
+        if (!db.isOpen()) {
+            return false;
+        }
+        // 生成的数据可以重新生成，写入时不等待落盘
+        QSqlQuery(db).exec("PRAGMA synchronous=OFF");
+
+        // 所有数据在一个事务中写入
+        if (!database.transaction()) {
+            return false;
+        }
+        bool ok = insertRows(db, "teacher_information", teachers) &&
+                  insertRows(db, "lesson_information", lessons) &&
+                  insertRows(db, "student_information", students) &&
+                  insertRows(db, "auth", auths);
+        for (int i = 0; ok && i < lessons.size(); i++) {
+            QString table = "lesson_" + lessons[i].Id;
+            ok = database.createTableIfNotExists(table) == Success && insertRows(db, table, grades[i]);
+        }
+        if (!ok) {
+            database.rollback();
+            return false;
+        }
+        if (!database.commit()) {
+            database.rollback();
+            return false;
+        }
+        // 生成的数据本身一致，Server 启动时不需要再做全库检查
+        database.markChecked();
+        QSqlQuery(db).exec("ANALYZE");
+        return true;
+    }
+
+    bool generator::run() {
+        QElapsedTimer timer;
+        timer.start();
+        generateTeachers();
+        generateLessons();
+        generateStudents();
+        enroll();
+        qint64 enrollTime = timer.restart();
+        generateAuths();
+        qint64 hashTime = timer.restart();
+        if (!write()) {
+            return false;
+        }
+        qint64 writeTime = timer.elapsed();
+
+        qint64 enrollments = 0;
+        qint64 retakes = 0;
+        for (const auto &lessonGrades: grades) {
+            enrollments += lessonGrades.size();
+            for (const auto &grade: lessonGrades) {
+                retakes += grade.Retake == RETAKEN ? 1 : 0;
+            }
+        }
+        qInfo().noquote() << QString("DataGen | %1 students, %2 teachers, %3 lessons, %4 semesters, %5 enrollments, "
+                                     "%6 retakes")
+                .arg(students.size()).arg(teachers.size()).arg(lessons.size()).arg(semesters.size())
+                .arg(enrollments).arg(retakes);
+        qInfo().noquote() << QString("DataGen | generate %1 ms, hash %2 ms, write %3 ms -> %4")
+                .arg(enrollTime).arg(hashTime).arg(writeTime).arg(options.Output);
+        return true;
+    }
+
+} // DataGen
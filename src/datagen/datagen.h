@@ -0,0 +1,113 @@
+#ifndef DATAGEN_H
+#define DATAGEN_H
+
+#include "../server/entity.h"
+#include "../server/timetable.h"
+#include <QCryptographicHash>
+#include <QString>
+#include <QVector>
+#include <random>
+
+#define DATAGEN_OUTPUT "AIMS.sqlite" // 默认输出的数据库文件，与 Server 使用的文件相同
+#define DATAGEN_CONNECTION "datagen" // 数据库连接名前缀，后接输出文件名
+#define DATAGEN_ID_WIDTH 6 // 学号、工号和课程编号中数字部分的位数
+#define DATAGEN_PAGE_SIZE 50 // LoadGen 列表场景和 DatabaseBench 分页用例每页的记录数
+#define DATAGEN_SECRET_SALT "AIMS" // 客户端由密码计算密钥时使用的盐，即客户端的 SALT
+#define DATAGEN_FIRST_YEAR 2022 // 第一个学期所在的学年
+#define DATAGEN_LESSONS_PER_SEMESTER 5.0 // 每名学生每学期平均选课数
+#define DATAGEN_LESSONS_STDDEV 1.5 // 每学期选课数的标准差
+#define DATAGEN_POPULARITY_EXPONENT 0.8 // 课程热度服从 Zipf 分布的指数，越大热门课程越集中
+#define DATAGEN_UNLIMITED_RATE 0.1 // 不限人数的课程比例
+#define DATAGEN_RETAKE_RATE 0.5 // 不及格的学生在之后的学期重修的比例
+
+namespace DataGen {
+
+    // 学号、工号和课程编号：前缀加补零的序号，序号从1开始，如 S000001；LoadGen 按同样的规则生成请求
+    inline QString makeId(const QString &prefix, int index) {
+        return prefix + QString("%1").arg(index, DATAGEN_ID_WIDTH, 10, QChar('0'));
+    }
+
+    // 客户端登录时由密码计算出的密钥 md5(md5(密码) + 盐)，服务器保存和验证的都是它。
+    // DataGen 用它生成账号，LoadGen 用它登录，与在客户端输入同一密码的效果相同
+    inline QString clientSecret(const QString &password) {
+        return QCryptographicHash::hash(
+                QCryptographicHash::hash(password.toUtf8(), QCryptographicHash::Md5).toHex() + DATAGEN_SECRET_SALT,
+                QCryptographicHash::Md5).toHex();
+    }
+
+    class Options {
+    public:
+        QString Output = DATAGEN_OUTPUT; // 输出的数据库文件
+        bool Force = false; // 输出文件已存在时覆盖
+        int Students = 10000; // 学生数
+        int Teachers = 500; // 教师数
+        int Lessons = 800; // 课程数，平均分布在各学期
+        int Semesters = 4; // 学期数，最后一个学期为当前学期，没有成绩
+        quint64 Seed = 1; // 随机数种子，相同的参数和种子生成相同的数据
+        QString StudentPrefix = "S"; // 学号前缀
+        QString TeacherPrefix = "T"; // 工号前缀
+        QString LessonPrefix = "L"; // 课程编号前缀
+        QString StudentSecret = "123456"; // 所有学生账号的密码
+        QString TeacherSecret = "123456"; // 所有教师账号的密码
+        QString Admin = "admin"; // 管理员账号
+        QString AdminSecret = "admin"; // 管理员密码
+    };
+
+    // 按参数生成学生、教师、课程、选课和成绩，直接写入数据库文件，DatabaseBench 也用它生成测试数据
+    class generator {
+    public:
+        explicit generator(const Options &options);
+
+        // 生成数据并写入数据库，失败时返回false
+        bool run();
+
+    private:
+        // 等待重修的成绩：学生下标、科目、不及格的课程下标和该课程中的成绩下标
+        class PendingRetake {
+        public:
+            int Student;
+            int Course;
+            int Lesson;
+            int Grade;
+        };
+
+        Options options;
+        std::mt19937_64 random;
+        QVector<QString> semesters;
+        QVector<Teacher> teachers;
+        QVector<Lesson> lessons;
+        QVector<int> lessonCourses; // 每门课程对应的科目，同一科目在每个学期各开设一门课程
+        QVector<int> lessonSemesters; // 每门课程所在的学期下标
+        QVector<QVector<Timetable::TimeSlot>> lessonTimeSlots;
+        QVector<QVector<Grade>> grades; // 每门课程的成绩，写入对应的 lesson_课程编号 表
+        QVector<Student> students;
+        QVector<Auth> auths;
+
+        int uniform(int low, int high);
+
+        double normal(double mean, double stddev);
+
+        bool chance(double probability);
+
+        QString makeName();
+
+        void generateTeachers();
+
+        void generateLessons();
+
+        void generateStudents();
+
+        void generateGrade(Grade &grade);
+
+        bool tryEnroll(int student, int lesson, int &credits, QVector<Timetable::TimeSlot> &timeSlots, int retake);
+
+        void enroll();
+
+        void generateAuths();
+
+        bool write();
+    };
+
+} // DataGen
+
+#endif //DATAGEN_H
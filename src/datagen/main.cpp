@@ -0,0 +1,53 @@
+#include "datagen.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("DataGen");
+
+    const DataGen::Options defaults;
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Generates a deterministic synthetic AIMS database for performance tests.");
+    parser.addHelpOption();
+    QCommandLineOption outputOption("output", "Database file to write.", "file", defaults.Output);
+    QCommandLineOption forceOption("force", "Overwrite the output file if it exists.");
+    QCommandLineOption studentsOption("students", "Number of students.", "n", QString::number(defaults.Students));
+    QCommandLineOption teachersOption("teachers", "Number of teachers.", "n", QString::number(defaults.Teachers));
+    QCommandLineOption lessonsOption("lessons", "Number of lessons across all semesters.", "n", QString::number(defaults.Lessons));
+    QCommandLineOption semestersOption("semesters", "Number of semesters; the last one has no grades yet.", "n",
+                                       QString::number(defaults.Semesters));
+    QCommandLineOption seedOption("seed", "Random seed.", "seed", QString::number(defaults.Seed));
+    QCommandLineOption studentPrefixOption("student-prefix", "Student id prefix.", "prefix", defaults.StudentPrefix);
+    QCommandLineOption teacherPrefixOption("teacher-prefix", "Teacher id prefix.", "prefix", defaults.TeacherPrefix);
+    QCommandLineOption lessonPrefixOption("lesson-prefix", "Lesson id prefix.", "prefix", defaults.LessonPrefix);
+    QCommandLineOption studentSecretOption("student-secret", "Password of every student account.", "secret",
+                                           defaults.StudentSecret);
+    QCommandLineOption teacherSecretOption("teacher-secret", "Password of every teacher account.", "secret",
+                                           defaults.TeacherSecret);
+    QCommandLineOption adminOption("admin", "SUPER account.", "account", defaults.Admin);
+    QCommandLineOption adminSecretOption("admin-secret", "Password of the SUPER account.", "secret", defaults.AdminSecret);
+    parser.addOptions({outputOption, forceOption, studentsOption, teachersOption, lessonsOption, semestersOption,
+                       seedOption, studentPrefixOption, teacherPrefixOption, lessonPrefixOption, studentSecretOption,
+                       teacherSecretOption, adminOption, adminSecretOption});
+    parser.process(app);
+
+    DataGen::Options options;
+    options.Output = parser.value(outputOption);
+    options.Force = parser.isSet(forceOption);
+    options.Students = qMax(parser.value(studentsOption).toInt(), 1);
+    options.Teachers = qMax(parser.value(teachersOption).toInt(), 1);
+    options.Lessons = qMax(parser.value(lessonsOption).toInt(), 1);
+    options.Semesters = qMax(parser.value(semestersOption).toInt(), 1);
+    options.Seed = parser.value(seedOption).toULongLong();
+    options.StudentPrefix = parser.value(studentPrefixOption);
+    options.TeacherPrefix = parser.value(teacherPrefixOption);
+    options.LessonPrefix = parser.value(lessonPrefixOption);
+    options.StudentSecret = parser.value(studentSecretOption);
+    options.TeacherSecret = parser.value(teacherSecretOption);
+    options.Admin = parser.value(adminOption);
+    options.AdminSecret = parser.value(adminSecretOption);
+
+    DataGen::generator generator(options);
+    return generator.run() ? 0 : 1;
+}
@@ -0,0 +1,419 @@
+#include "../datagen/datagen.h"
+#include "../server/metrics.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QTextStream>
+#include <QTimer>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+
+#define LOADGEN_URL "http://127.0.0.1:49425" // 默认压测的服务器地址
+#define LOADGEN_CONNECTIONS 64 // 默认并发连接数，每个连接同一时刻只有一个请求
+#define LOADGEN_DURATION 30 // 默认压测时长（秒）
+#define LOADGEN_CONNECTIONS_PER_MANAGER 6 // QNetworkAccessManager 对同一主机最多保持的连接数
+#define LOADGEN_HOT_LESSONS 10 // 选课场景中被集中抢选的课程数
+
+#define SCENARIO_LOGIN "login" // 大量学生同时登录
+#define SCENARIO_SELECT "select" // 集中抢选少数热门课程，选中后退课继续抢
+#define SCENARIO_GRADE "grade" // 集中录入已选课程的成绩
+#define SCENARIO_LIST "list" // 管理员翻页浏览学生和课程列表
+
+namespace LoadGen {
+
+    class Options {
+    public:
+        QString Url; // 服务器地址
+        QString Scenario; // 压测场景
+        int Connections; // 并发连接数
+        int Duration; // 压测时长（秒）
+        QString Admin; // 管理员账号，选课、成绩和列表场景使用
+        QString AdminSecret; // 管理员的密钥，由密码按客户端的方式计算
+        QString StudentPrefix; // 学号前缀
+        int Students; // 学生数
+        QString StudentSecret; // 学生的密钥，由密码按客户端的方式计算
+        QString LessonPrefix; // 课程编号前缀
+        int Lessons; // 课程数
+        quint64 Seed; // 随机数种子
+        QString Output; // 结果输出文件，为空时输出到标准输出
+    };
+
+    // 单个路由的统计，压测在主线程的事件循环中进行，不需要加锁
+    class RouteStats {
+    public:
+        Metrics::histogram Latency; // 请求耗时（微秒）
+        qint64 Count = 0; // 完成的请求数
+        qint64 Errors = 0; // 网络错误或状态码不低于400的请求数
+        QMap<int, qint64> Statuses; // 各状态码的请求数，网络错误记为0
+    };
+
+    // 每个连接的状态，连接之间互不影响
+    class Connection {
+    public:
+        QNetworkAccessManager *Manager; // 所属的连接管理器
+        QString Token; // 登录后获得的JWT
+        QString StudentId; // 登录或录入成绩的学生
+        QVector<QString> ChosenLessons; // 成绩场景中该学生已选的课程
+        QString PendingLesson; // 选课场景中已选上、下一步要退掉的课程
+        int Page = 1; // 列表场景的当前页
+        int Step = 0; // 场景内部的步骤计数
+    };
+
+    class Response {
+    public:
+        int StatusCode; // HTTP状态码，网络错误时为0
+        QJsonObject Body; // 解析后的响应body
+    };
+
+    class runner {
+    public:
+        explicit runner(const Options &options);
+
+        void start();
+
+    private:
+        Options options;
+        std::vector<std::unique_ptr<QNetworkAccessManager>> managers;
+        QVector<Connection> connections;
+        std::map<QString, std::unique_ptr<RouteStats>> routes;
+        std::mt19937_64 generator;
+        QElapsedTimer clock;
+        bool running = false;
+        qint64 measuredTime = 0; // 实际压测时长（纳秒），不含结束后等待在途请求的时间
+        int active = 0;
+        int pendingSetup = 0;
+
+        QString studentId(int index) const;
+
+        QString lessonId(int index) const;
+
+        int random(int bound);
+
+        // 发送请求并记录耗时，route为统计时使用的路由名；setup阶段的请求不计入统计
+        void send(Connection &connection, const QString &route, const QString &path, const QJsonObject &body,
+                  bool post, bool measure, const std::function<void(const Response &)> &done);
+
+        void setup(int index);
+
+        void setupDone();
+
+        void next(int index);
+
+        void finish();
+
+        QJsonObject report() const;
+    };
+
+    runner::runner(const Options &options) : options(options), generator(options.Seed) {
+        int managerCount = (options.Connections + LOADGEN_CONNECTIONS_PER_MANAGER - 1) / LOADGEN_CONNECTIONS_PER_MANAGER;
+        for (int i = 0; i < managerCount; i++) {
+            managers.push_back(std::make_unique<QNetworkAccessManager>());
+        }
+        connections.resize(options.Connections);
+        for (int i = 0; i < options.Connections; i++) {
+            connections[i].Manager = managers[i / LOADGEN_CONNECTIONS_PER_MANAGER].get();
+        }
+    }
+
+    QString runner::studentId(int index) const {
+        return DataGen::makeId(options.StudentPrefix, index);
+    }
+
+    QString runner::lessonId(int index) const {
+        return DataGen::makeId(options.LessonPrefix, index);
+    }
+
+    int runner::random(int bound) {
+        return int(std::uniform_int_distribution<int>(0, qMax(bound, 1) - 1)(generator));
+    }
+
+    void runner::send(Connection &connection, const QString &route, const QString &path, const QJsonObject &body,
+                      bool post, bool measure, const std::function<void(const Response &)> &done) {
+        QNetworkRequest request(QUrl(options.Url + path));
+        request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+        if (!connection.Token.isEmpty()) {
+            request.setRawHeader("Authorization", "Bearer " + connection.Token.toUtf8());
+        }
+        QNetworkReply *reply = post
+                               ? connection.Manager->post(request, QJsonDocument(body).toJson(QJsonDocument::Compact))
+                               : connection.Manager->get(request);
+        qint64 startTime = clock.nsecsElapsed();
+        QObject::connect(reply, &QNetworkReply::finished, reply, [this, reply, route, measure, startTime, done]() {
+            qint64 micros = (clock.nsecsElapsed() - startTime) / 1000;
+            Response response;
+            response.StatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+            response.Body = QJsonDocument::fromJson(reply->readAll()).object();
+            reply->deleteLater();
+            if (measure && running) {
+                std::unique_ptr<RouteStats> &stats = routes[route];
+                if (!stats) {
+                    stats = std::make_unique<RouteStats>();
+                }
+                stats->Latency.record(quint64(micros));
+                stats->Count++;
+                stats->Statuses[response.StatusCode]++;
+                if (response.StatusCode == 0 || response.StatusCode >= 400) {
+                    stats->Errors++;
+                }
+            }
+            done(response);
+        });
+    }
+
+    void runner::start() {
+        clock.start();
+        pendingSetup = int(connections.size());
+        for (int i = 0; i < connections.size(); i++) {
+            setup(i);
+        }
+    }
+
+    void runner::setup(int index) {
+        Connection &connection = connections[index];
+        if (options.Scenario == SCENARIO_LOGIN) {
+            // 登录场景本身就是登录请求，不需要预先取得令牌
+            setupDone();
+            return;
+        }
+
+        QJsonObject body;
+        body["Account"] = options.Admin;
+        body["Secret"] = options.AdminSecret;
+        send(connection, "/api/login/", "/api/login/", body, true, false, [this, index](const Response &response) {
+            Connection &connection = connections[index];
+            connection.Token = response.Body["jwt"].toString();
+            if (connection.Token.isEmpty()) {
+                qWarning() << "LoadGen | admin login failed with status" << response.StatusCode;
+            }
+            if (options.Scenario != SCENARIO_GRADE) {
+                setupDone();
+                return;
+            }
+            // 成绩场景只为已选课程录入成绩，先读取该连接负责的学生的选课列表
+            connection.StudentId = studentId(index % qMax(options.Students, 1) + 1);
+            send(connection, "", "/api/getStudentInformation/" + connection.StudentId + "?fields=ChosenLessons",
+                 QJsonObject(), false, false, [this, index](const Response &response) {
+                        for (const auto &lesson: response.Body["ChosenLessons"].toArray()) {
+                            connections[index].ChosenLessons.append(lesson.toString());
+                        }
+                        setupDone();
+                    });
+        });
+    }
+
+    void runner::setupDone() {
+        if (--pendingSetup > 0) {
+            return;
+        }
+        // 所有连接准备好之后同时开始，压测时长从这里开始计算
+        running = true;
+        active = int(connections.size());
+        clock.restart();
+        QTimer::singleShot(options.Duration * 1000, [this]() {
+            // 之后完成的请求不再计入统计，各连接的在途请求完成后退出
+            running = false;
+            measuredTime = clock.nsecsElapsed();
+        });
+        for (int i = 0; i < connections.size(); i++) {
+            next(i);
+        }
+    }
+
+    void runner::next(int index) {
+        if (!running) {
+            if (--active == 0) {
+                finish();
+            }
+            return;
+        }
+        Connection &connection = connections[index];
+        auto again = [this, index](const Response &) {
+            next(index);
+        };
+
+        if (options.Scenario == SCENARIO_LOGIN) {
+            QJsonObject body;
+            body["Account"] = studentId(random(options.Students) + 1);
+            body["Secret"] = options.StudentSecret;
+            send(connection, "/api/login/", "/api/login/", body, true, true, again);
+        } else if (options.Scenario == SCENARIO_SELECT) {
+            if (!connection.PendingLesson.isEmpty()) {
+                // 退掉上一次选上的课程，让名额重新参与争抢
+                QJsonObject body;
+                body["studentId"] = connection.StudentId;
+                body["lessonId"] = connection.PendingLesson;
+                connection.PendingLesson.clear();
+                send(connection, "/api/deleteChosenLesson/", "/api/deleteChosenLesson/", body, true, true, again);
+                return;
+            }
+            QString student = studentId(random(options.Students) + 1);
+            QString lesson = lessonId(random(qMin(options.Lessons, LOADGEN_HOT_LESSONS)) + 1);
+            QJsonObject body;
+            body["studentId"] = student;
+            body["lessonId"] = lesson;
+            send(connection, "/api/addChosenLesson/", "/api/addChosenLesson/", body, true, true,
+                 [this, index, student, lesson](const Response &response) {
+                     if (response.Body["success"].toBool()) {
+                         connections[index].StudentId = student;
+                         connections[index].PendingLesson = lesson;
+                     }
+                     next(index);
+                 });
+        } else if (options.Scenario == SCENARIO_GRADE) {
+            if (connection.ChosenLessons.isEmpty()) {
+                // 该学生没有选课，改为读取学生信息，保持连接上的负载
+                send(connection, "/api/getStudentInformation/", "/api/getStudentInformation/" + connection.StudentId,
+                     QJsonObject(), false, true, again);
+                return;
+            }
+            QJsonObject body;
+            body["StudentId"] = connection.StudentId;
+            body["LessonId"] = connection.ChosenLessons[connection.Step++ % connection.ChosenLessons.size()];
+            body["RegularGrade"] = random(41) + 60;
+            body["ExamGrade"] = random(41) + 60;
+            send(connection, "/api/updateStudentLessonGrade/", "/api/updateStudentLessonGrade/", body, true, true,
+                 again);
+        } else {
+            // 学生列表和课程列表交替翻页，翻到末尾后从第一页重新开始
+            bool lessons = connection.Step++ % 2 == 1;
+            int total = lessons ? options.Lessons : options.Students;
+            int pages = qMax((total + DATAGEN_PAGE_SIZE - 1) / DATAGEN_PAGE_SIZE, 1);
+            QJsonObject body;
+            body["Maximum"] = DATAGEN_PAGE_SIZE;
+            body["Page"] = (connection.Page - 1) % pages + 1;
+            if (lessons) {
+                connection.Page++;
+            }
+            QString path = lessons ? "/api/listLessons/" : "/api/listStudents/";
+            send(connection, path, path, body, true, true, again);
+        }
+    }
+
+    QJsonObject runner::report() const {
+        double seconds = double(qMax(measuredTime, qint64(1))) / 1e9;
+        QJsonObject routesObject;
+        qint64 total = 0;
+        qint64 errors = 0;
+        for (const auto &[route, stats]: routes) {
+            Metrics::histogram::Snapshot snapshot = stats->Latency.snapshot();
+            QJsonObject statuses;
+            for (auto it = stats->Statuses.cbegin(); it != stats->Statuses.cend(); ++it) {
+                statuses[QString::number(it.key())] = it.value();
+            }
+            QJsonObject routeObject;
+            routeObject["count"] = stats->Count;
+            routeObject["errors"] = stats->Errors;
+            routeObject["throughput"] = double(stats->Count) / seconds;
+            // 耗时单位为毫秒
+            routeObject["p50"] = double(snapshot.quantile(0.5)) / 1000.0;
+            routeObject["p99"] = double(snapshot.quantile(0.99)) / 1000.0;
+            routeObject["p999"] = double(snapshot.quantile(0.999)) / 1000.0;
+            routeObject["max"] = double(snapshot.Max) / 1000.0;
+            routeObject["mean"] = snapshot.Count > 0 ? double(snapshot.Sum) / double(snapshot.Count) / 1000.0 : 0.0;
+            routeObject["statuses"] = statuses;
+            routesObject[route] = routeObject;
+            total += stats->Count;
+            errors += stats->Errors;
+        }
+
+        QJsonObject result;
+        result["scenario"] = options.Scenario;
+        result["url"] = options.Url;
+        result["connections"] = options.Connections;
+        result["duration"] = seconds;
+        result["requests"] = total;
+        result["errors"] = errors;
+        result["throughput"] = double(total) / seconds;
+        result["routes"] = routesObject;
+        return result;
+    }
+
+    void runner::finish() {
+        QByteArray json = QJsonDocument(report()).toJson(QJsonDocument::Indented);
+        if (options.Output.isEmpty()) {
+            QTextStream(stdout) << json;
+        } else {
+            QFile file(options.Output);
+            if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+                qWarning() << "LoadGen | cannot write" << options.Output << file.errorString();
+            } else {
+                file.write(json);
+            }
+        }
+        QCoreApplication::quit();
+    }
+
+} // LoadGen
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("LoadGen");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+            "Replays AIMS workloads against a running Server and reports per-route latency as JSON.\n"
+            "Scenarios: login, select, grade, list. Server-side rate limits (RATE_LIMIT_*) apply to the "
+            "load generator as well; raise them for throughput tests.");
+    parser.addHelpOption();
+    QCommandLineOption urlOption("url", "Server URL.", "url", LOADGEN_URL);
+    QCommandLineOption scenarioOption("scenario", "login | select | grade | list.", "name", SCENARIO_LOGIN);
+    QCommandLineOption connectionsOption("connections", "Concurrent keep-alive connections.", "n",
+                                         QString::number(LOADGEN_CONNECTIONS));
+    QCommandLineOption durationOption("duration", "Measured duration in seconds.", "seconds",
+                                      QString::number(LOADGEN_DURATION));
+    // 账号、密码和编号前缀默认与 DataGen 生成的数据一致
+    const DataGen::Options defaults;
+    QCommandLineOption adminOption("admin", "SUPER account used by select, grade and list.", "account",
+                                   defaults.Admin);
+    QCommandLineOption adminSecretOption("admin-secret", "Password of the SUPER account.", "secret",
+                                         defaults.AdminSecret);
+    QCommandLineOption studentPrefixOption("student-prefix", "Student id prefix.", "prefix", defaults.StudentPrefix);
+    QCommandLineOption studentsOption("students", "Number of students.", "n", "1000");
+    QCommandLineOption studentSecretOption("student-secret", "Password of every student account.", "secret",
+                                           defaults.StudentSecret);
+    QCommandLineOption lessonPrefixOption("lesson-prefix", "Lesson id prefix.", "prefix", defaults.LessonPrefix);
+    QCommandLineOption lessonsOption("lessons", "Number of lessons.", "n", "100");
+    QCommandLineOption seedOption("seed", "Random seed.", "seed", "1");
+    QCommandLineOption outputOption("output", "Write the JSON report to a file instead of stdout.", "file");
+    parser.addOptions({urlOption, scenarioOption, connectionsOption, durationOption, adminOption, adminSecretOption,
+                       studentPrefixOption, studentsOption, studentSecretOption, lessonPrefixOption, lessonsOption,
+                       seedOption, outputOption});
+    parser.process(app);
+
+    LoadGen::Options options;
+    options.Url = parser.value(urlOption);
+    options.Scenario = parser.value(scenarioOption);
+    options.Connections = qMax(parser.value(connectionsOption).toInt(), 1);
+    options.Duration = qMax(parser.value(durationOption).toInt(), 1);
+    options.Admin = parser.value(adminOption);
+    // 与客户端一样发送由密码计算出的密钥
+    options.AdminSecret = DataGen::clientSecret(parser.value(adminSecretOption));
+    options.StudentPrefix = parser.value(studentPrefixOption);
+    options.Students = qMax(parser.value(studentsOption).toInt(), 1);
+    options.StudentSecret = DataGen::clientSecret(parser.value(studentSecretOption));
+    options.LessonPrefix = parser.value(lessonPrefixOption);
+    options.Lessons = qMax(parser.value(lessonsOption).toInt(), 1);
+    options.Seed = parser.value(seedOption).toULongLong();
+    options.Output = parser.value(outputOption);
+
+    const QStringList scenarios = {SCENARIO_LOGIN, SCENARIO_SELECT, SCENARIO_GRADE, SCENARIO_LIST};
+    if (!scenarios.contains(options.Scenario)) {
+        qWarning() << "LoadGen | unknown scenario" << options.Scenario;
+        return 1;
+    }
+
+    LoadGen::runner runner(options);
+    runner.start();
+    return QCoreApplication::exec();
+}
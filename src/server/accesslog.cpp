@@ -0,0 +1,205 @@
+#include "accesslog.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QVariant>
+#include <cstring>
+
+static_assert((ACCESS_LOG_CAPACITY & (ACCESS_LOG_CAPACITY - 1)) == 0, "ACCESS_LOG_CAPACITY must be a power of two");
+static_assert(ACCESS_LOG_TEXT_SIZE <= 255, "TextLength is stored in one byte");
+
+namespace AccessLog {
+
+    namespace {
+
+        // 截断时不拆开多字节字符
+        void copyText(Record &record, const QByteArray &text) {
+            qsizetype length = qMin(text.size(), qsizetype(ACCESS_LOG_TEXT_SIZE));
+            while (length < text.size() && length > 0 && (text[length] & 0xC0) == 0x80) {
+                length--;
+            }
+            record.TextLength = quint8(length);
+            std::memcpy(record.Text, text.constData(), size_t(length));
+        }
+
+    }
+
+    ring::ring() : slots(new Slot[ACCESS_LOG_CAPACITY]) {
+        for (quint64 i = 0; i < ACCESS_LOG_CAPACITY; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ring::~ring() {
+        delete[] slots;
+    }
+
+    bool ring::push(const Record &record) {
+        quint64 position = tail.load(std::memory_order_relaxed);
+        Slot *slot;
+        while (true) {
+            slot = &slots[position & (ACCESS_LOG_CAPACITY - 1)];
+            quint64 sequence = slot->sequence.load(std::memory_order_acquire);
+            auto difference = qint64(sequence - position);
+            if (difference == 0) {
+                // 槽位空闲，抢占这个写入位置
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                // 消费者还没有取走上一轮写入的记录
+                return false;
+            } else {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+        slot->record = record;
+        slot->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool ring::pop(Record &record) {
+        Slot &slot = slots[head & (ACCESS_LOG_CAPACITY - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != head + 1) {
+            return false;
+        }
+        record = slot.record;
+        // 槽位在下一轮的同一位置重新可写
+        slot.sequence.store(head + ACCESS_LOG_CAPACITY, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+    drainer::drainer(const QString &path, ring &buffer, const std::atomic<quint64> &dropped)
+            : path(path), buffer(buffer), dropped(dropped) {
+    }
+
+    drainer::~drainer() {
+        // 线程退出时写出缓冲区中剩余的记录
+        drain();
+    }
+
+    void drainer::start() {
+        open();
+        flushTimer = new QTimer(this);
+        flushTimer->setInterval(ACCESS_LOG_FLUSH_INTERVAL);
+        QObject::connect(flushTimer, &QTimer::timeout, this, [this]() {
+            drain();
+        });
+        flushTimer->start();
+    }
+
+    bool drainer::open() {
+        file.setFileName(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+            qDebug() << "Debug | accesslog.cpp: open error:" << file.errorString();
+            return false;
+        }
+        return true;
+    }
+
+    void drainer::rotate() {
+        file.close();
+        // AIMS.access.log.(n-1) -> AIMS.access.log.n，最旧的文件被覆盖
+        QFile::remove(path + "." + QString::number(ACCESS_LOG_KEEP_FILES));
+        for (int i = ACCESS_LOG_KEEP_FILES - 1; i >= 1; i--) {
+            QFile::rename(path + "." + QString::number(i), path + "." + QString::number(i + 1));
+        }
+        QFile::rename(path, path + ".1");
+        open();
+    }
+
+    void drainer::drain() {
+        QByteArray batch;
+        Record record;
+        while (buffer.pop(record)) {
+            if (record.Kind != ACCESS_LOG_REQUEST) {
+                batch.append(QDateTime::fromMSecsSinceEpoch(record.Time).toString("yyyy-MM-dd hh:mm:ss").toUtf8());
+                batch.append(record.Kind == ACCESS_LOG_SLOW_QUERY ? " Slow | " :
+                             record.Kind == ACCESS_LOG_TRACE ? " Trace | " : " | ");
+                batch.append(record.Text, record.TextLength);
+                batch.append('\n');
+                continue;
+            }
+            QHostAddress address = record.IsIPv4 ? QHostAddress(record.IPv4) : QHostAddress(record.IPv6);
+            batch.append(QDateTime::fromMSecsSinceEpoch(record.Time).toString("yyyy-MM-dd hh:mm:ss").toUtf8());
+            batch.append(' ');
+            batch.append(address.toString().toUtf8());
+            batch.append(':');
+            batch.append(QByteArray::number(record.Port));
+            batch.append(' ');
+            batch.append(QVariant::fromValue(record.Method).toString().toUtf8());
+            batch.append(' ');
+            batch.append(record.Text, record.TextLength);
+            batch.append(' ');
+            batch.append(QByteArray::number(record.StatusCode));
+            batch.append('\n');
+        }
+
+        quint64 droppedNow = dropped.load(std::memory_order_relaxed);
+        if (droppedNow != reportedDropped) {
+            batch.append(QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss").toUtf8());
+            batch.append(" access log buffer full, dropped ");
+            batch.append(QByteArray::number(droppedNow - reportedDropped));
+            batch.append(" records\n");
+            reportedDropped = droppedNow;
+        }
+
+        if (batch.isEmpty() || !file.isOpen()) {
+            return;
+        }
+        file.write(batch);
+        file.flush();
+        if (file.size() >= ACCESS_LOG_MAX_SIZE) {
+            rotate();
+        }
+    }
+
+    service::service(const QString &path) {
+        worker = new drainer(path, buffer, droppedCount);
+        worker->moveToThread(&thread);
+        QObject::connect(&thread, &QThread::finished, worker, &QObject::deleteLater);
+        thread.start();
+        QMetaObject::invokeMethod(worker, [this]() {
+            worker->start();
+        }, Qt::QueuedConnection);
+    }
+
+    service::~service() {
+        thread.quit();
+        thread.wait();
+    }
+
+    void service::append(const QHttpServerRequest &request, int statusCode) {
+        Record record;
+        record.Kind = ACCESS_LOG_REQUEST;
+        record.Time = QDateTime::currentMSecsSinceEpoch();
+        QHostAddress address = request.remoteAddress();
+        record.IsIPv4 = address.protocol() == QAbstractSocket::IPv4Protocol;
+        record.IPv4 = record.IsIPv4 ? address.toIPv4Address() : 0;
+        record.IPv6 = record.IsIPv4 ? Q_IPV6ADDR() : address.toIPv6Address();
+        record.Port = request.remotePort();
+        record.StatusCode = quint16(statusCode);
+        record.Method = request.method();
+
+        copyText(record, request.url().path().toUtf8());
+
+        if (!buffer.push(record)) {
+            droppedCount.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void service::message(quint8 kind, const QString &text) {
+        Record record;
+        record.Kind = kind;
+        record.Time = QDateTime::currentMSecsSinceEpoch();
+        copyText(record, text.toUtf8());
+        if (!buffer.push(record)) {
+            droppedCount.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    quint64 service::dropped() const {
+        return droppedCount.load(std::memory_order_relaxed);
+    }
+
+} // AccessLog
@@ -0,0 +1,118 @@
+#ifndef ACCESSLOG_H
+#define ACCESSLOG_H
+
+#include <QFile>
+#include <QHostAddress>
+#include <QHttpServerRequest>
+#include <QObject>
+#include <QThread>
+#include <QTimer>
+#include <atomic>
+
+#define ACCESS_LOG_PATH "AIMS.access.log" // 访问日志文件
+#define ACCESS_LOG_CAPACITY 8192 // 环形缓冲区的记录数，必须是2的幂
+#define ACCESS_LOG_TEXT_SIZE 255 // 每条记录保存的请求路径或消息的最大字节数，超出部分截断
+#define ACCESS_LOG_FLUSH_INTERVAL 200 // 后台线程取出记录并写入文件的间隔（毫秒）
+#define ACCESS_LOG_MAX_SIZE (64 * 1024 * 1024) // 单个日志文件的大小上限（字节），超过后轮转
+#define ACCESS_LOG_KEEP_FILES 5 // 轮转后保留的旧日志文件数，如 AIMS.access.log.1 ~ AIMS.access.log.5
+
+#define ACCESS_LOG_REQUEST 0 // 请求记录
+#define ACCESS_LOG_SLOW_QUERY 1 // 慢查询，见 queryprofile.h
+#define ACCESS_LOG_TRACE 2 // 抽样的请求耗时明细，见 tracing.h
+
+namespace AccessLog {
+
+    // 定长的二进制记录，请求线程只做拷贝，格式化在后台线程进行
+    class Record {
+    public:
+        quint8 Kind; // 记录类型，见 ACCESS_LOG_*，除请求记录外只使用Time和Text
+        qint64 Time; // 响应时间（毫秒时间戳）
+        quint32 IPv4; // IPv4地址，IsIPv4为false时使用IPv6
+        Q_IPV6ADDR IPv6; // IPv6地址
+        bool IsIPv4;
+        quint16 Port; // 客户端端口
+        quint16 StatusCode; // 响应状态码
+        QHttpServerRequest::Method Method; // 请求方法
+        quint8 TextLength; // Text中的有效字节数
+        char Text[ACCESS_LOG_TEXT_SIZE]; // UTF-8编码的请求路径或消息，不以\0结尾
+    };
+
+    // 多生产者单消费者的有界无锁环形缓冲区：每个槽位带序号，
+    // 生产者用CAS抢占写入位置，写完后发布序号，消费者按序号判断槽位是否可读
+    class ring {
+    public:
+        ring();
+
+        ~ring();
+
+        ring(const ring &) = delete;
+
+        ring &operator=(const ring &) = delete;
+
+        // 缓冲区已满时返回false，不等待
+        bool push(const Record &record);
+
+        // 只能由一个线程调用，没有可读记录时返回false
+        bool pop(Record &record);
+
+    private:
+        class Slot {
+        public:
+            std::atomic<quint64> sequence;
+            Record record;
+        };
+
+        Slot *slots;
+        alignas(64) std::atomic<quint64> tail{0}; // 下一个写入位置，生产者共享
+        alignas(64) quint64 head = 0; // 下一个读取位置，只有消费者访问
+    };
+
+    // 运行在后台线程中，定期取出缓冲区中的记录，格式化后批量写入文件
+    class drainer : public QObject {
+    public:
+        drainer(const QString &path, ring &buffer, const std::atomic<quint64> &dropped);
+
+        ~drainer() override;
+
+        void start();
+
+        void drain();
+
+    private:
+        QString path;
+        ring &buffer;
+        const std::atomic<quint64> &dropped;
+        quint64 reportedDropped = 0;
+        QFile file;
+        QTimer *flushTimer = nullptr;
+
+        bool open();
+
+        void rotate();
+    };
+
+    // 请求线程使用的接口，只向缓冲区写入记录，不做任何格式化和I/O
+    class service {
+    public:
+        explicit service(const QString &path);
+
+        ~service();
+
+        // 缓冲区满时丢弃记录并计数，不阻塞请求
+        void append(const QHttpServerRequest &request, int statusCode);
+
+        // 写入一行其他类型的日志，同样只拷贝到缓冲区，可以在任意线程调用
+        void message(quint8 kind, const QString &text);
+
+        quint64 dropped() const;
+
+    private:
+        ring buffer;
+        std::atomic<quint64> droppedCount{0};
+        QThread thread;
+        drainer *worker;
+    };
+
+} // AccessLog
+
+#endif //ACCESSLOG_H
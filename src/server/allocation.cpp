@@ -0,0 +1,286 @@
+#include "allocation.h"
+#include "timetable.h"
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSet>
+#include <QtConcurrent>
+#include <algorithm>
+#include <climits>
+#include <numeric>
+#include <random>
+
+namespace Allocation {
+
+    namespace {
+
+        class LessonInfo {
+        public:
+            int Capacity; // 剩余名额，不限人数时为INT_MAX
+            int Credits; // 课程学分
+            QString Semester; // 课程学期
+            QVector<Timetable::TimeSlot> TimeSlots; // 上课时间
+        };
+
+        class StudentState {
+        public:
+            QString Id; // 学生学号
+            int Lottery; // 抽签序号，越小越优先
+            int Credits; // 已选课程总学分
+            QVector<QString> Preferences; // 按志愿顺序排列的课程编号
+            QSet<QString> ChosenLessons; // 已选课程编号
+            QHash<QString, int> SemesterCredits; // 各学期已选学分
+            QHash<QString, QVector<Timetable::TimeSlot>> SemesterTimeSlots; // 各学期已占用的上课时间
+        };
+
+        int findRoot(QVector<int> &parent, int x) {
+            while (parent[x] != x) {
+                parent[x] = parent[parent[x]];
+                x = parent[x];
+            }
+            return x;
+        }
+
+        bool tryAllocate(StudentState &student, const QString &lessonId, const LessonInfo &lesson,
+                         QHash<QString, int> &remaining) {
+            if (student.ChosenLessons.contains(lessonId)) {
+                return false;
+            }
+            auto seat = remaining.find(lessonId);
+            if (seat == remaining.end()) {
+                seat = remaining.insert(lessonId, lesson.Capacity);
+            }
+            if (*seat <= 0) {
+                return false;
+            }
+            if (student.SemesterCredits.value(lesson.Semester) + lesson.Credits > MAX_SEMESTER_CREDITS) {
+                return false;
+            }
+            QVector<Timetable::TimeSlot> &timeSlots = student.SemesterTimeSlots[lesson.Semester];
+            if (Timetable::isConflict(timeSlots, lesson.TimeSlots)) {
+                return false;
+            }
+
+            (*seat)--;
+            student.ChosenLessons.insert(lessonId);
+            student.SemesterCredits[lesson.Semester] += lesson.Credits;
+            timeSlots += lesson.TimeSlots;
+            return true;
+        }
+
+        // 在一个课程组内轮流分配：每轮按顺序让每名学生获得其剩余志愿中排名最高的可选课程
+        QVector<Enrollment> allocateGroup(QVector<StudentState> &students, const QHash<QString, LessonInfo> &lessons,
+                                          QVector<int> group, int mode) {
+            std::sort(group.begin(), group.end(), [&students, mode](int a, int b) {
+                if (mode == ALLOCATION_PRIORITY && students[a].Credits != students[b].Credits) {
+                    return students[a].Credits < students[b].Credits;
+                }
+                return students[a].Lottery < students[b].Lottery;
+            });
+
+            QVector<Enrollment> enrollments;
+            QHash<QString, int> remaining;
+            QVector<int> next(group.size(), 0);
+            bool progress = true;
+            while (progress) {
+                progress = false;
+                for (int i = 0; i < group.size(); i++) {
+                    StudentState &student = students[group[i]];
+                    while (next[i] < student.Preferences.size()) {
+                        const QString &lessonId = student.Preferences[next[i]++];
+                        if (tryAllocate(student, lessonId, *lessons.constFind(lessonId), remaining)) {
+                            enrollments.append({student.Id, lessonId});
+                            progress = true;
+                            break;
+                        }
+                    }
+                }
+            }
+            return enrollments;
+        }
+
+    }
+
+    Status run(Database::database &database, quint64 seed, int mode, Result &result) {
+        QElapsedTimer timer;
+        timer.start();
+
+        QMap<QString, QVector<QString>> preferences;
+        Status status = database.listPreferences(preferences);
+        if (status != Success) {
+            return status;
+        }
+        if (preferences.isEmpty()) {
+            return Success;
+        }
+
+        // 读取全部课程，预先解析上课时间
+        QVector<Lesson> lessonList;
+        int lessonCount = database.getLessonCount();
+        if (lessonCount > 0) {
+            status = database.listLessons(lessonList, lessonCount, 1);
+            if (status != Success) {
+                return status;
+            }
+        }
+        QHash<QString, LessonInfo> lessons;
+        QHash<QString, int> lessonIndex;
+        for (const auto &lesson: lessonList) {
+            LessonInfo info;
+            info.Capacity = lesson.LessonCapacity > 0 ? qMax(lesson.LessonCapacity - int(lesson.LessonStudents.size()), 0)
+                                                      : INT_MAX;
+            info.Credits = lesson.LessonCredits;
+            info.Semester = lesson.LessonSemester;
+            info.TimeSlots = Timetable::parseTimeAndLocations(lesson.LessonTimeAndLocations);
+            lessons.insert(lesson.Id, info);
+            lessonIndex.insert(lesson.Id, int(lessonIndex.size()));
+        }
+
+        // 一次读出提交志愿的学生当前已选的课程
+        QMap<QString, QVector<QString>> chosenLessons;
+        status = database.listPreferenceChosenLessons(chosenLessons);
+        if (status != Success) {
+            return status;
+        }
+        QVector<StudentState> students;
+        students.reserve(preferences.size());
+        for (auto it = preferences.cbegin(); it != preferences.cend(); ++it) {
+            auto chosen = chosenLessons.constFind(it.key());
+            if (chosen == chosenLessons.cend()) {
+                continue;
+            }
+            StudentState state;
+            state.Id = it.key();
+            state.Lottery = 0;
+            state.Credits = 0;
+            for (const auto &lessonId: it.value()) {
+                if (lessons.contains(lessonId)) {
+                    state.Preferences.append(lessonId);
+                }
+            }
+            for (const auto &lessonId: *chosen) {
+                auto lesson = lessons.constFind(lessonId);
+                if (lesson == lessons.cend()) {
+                    continue;
+                }
+                state.ChosenLessons.insert(lessonId);
+                state.Credits += lesson->Credits;
+                state.SemesterCredits[lesson->Semester] += lesson->Credits;
+                state.SemesterTimeSlots[lesson->Semester] += lesson->TimeSlots;
+            }
+            result.Preferences += int(state.Preferences.size());
+            students.append(state);
+        }
+        result.Students = int(students.size());
+
+        // 以相同的种子抽签，学生按学号排序后打乱，保证结果可复现
+        QVector<int> order(students.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::mt19937_64 generator(seed);
+        std::shuffle(order.begin(), order.end(), generator);
+        for (int i = 0; i < order.size(); i++) {
+            students[order[i]].Lottery = i;
+        }
+
+        // 同一学生的志愿课程属于同一组，不同组之间没有共同的学生和课程，可以并行分配
+        QVector<int> parent(lessonIndex.size());
+        std::iota(parent.begin(), parent.end(), 0);
+        for (const auto &student: students) {
+            for (int i = 1; i < student.Preferences.size(); i++) {
+                int a = findRoot(parent, lessonIndex[student.Preferences[0]]);
+                int b = findRoot(parent, lessonIndex[student.Preferences[i]]);
+                if (a != b) {
+                    parent[b] = a;
+                }
+            }
+        }
+        QHash<int, QVector<int>> groupMap;
+        for (int i = 0; i < students.size(); i++) {
+            if (!students[i].Preferences.isEmpty()) {
+                groupMap[findRoot(parent, lessonIndex[students[i].Preferences[0]])].append(i);
+            }
+        }
+        QList<QVector<int>> groups = groupMap.values();
+        result.Groups = int(groups.size());
+
+        QList<QVector<Enrollment>> groupEnrollments = QtConcurrent::blockingMapped(
+                groups, [&students, &lessons, mode](const QVector<int> &group) {
+                    return allocateGroup(students, lessons, group, mode);
+                });
+
+        QVector<Enrollment> enrollments;
+        for (const auto &groupEnrollment: groupEnrollments) {
+            enrollments += groupEnrollment;
+        }
+        // 按学号排序，使同一学生的记录落在同一批事务中
+        std::sort(enrollments.begin(), enrollments.end(), [](const Enrollment &a, const Enrollment &b) {
+            return a.StudentId < b.StudentId;
+        });
+        result.AllocateTime = timer.restart();
+
+        // 分配期间其他连接仍可选课，写入时在每批的事务中重新检查余量，已满的课程放弃分配结果
+        status = database.addChosenLessons(enrollments, ALLOCATION_CHUNK_SIZE, result.Allocated);
+        result.Rejected = int(enrollments.size()) - result.Allocated;
+        if (status != Success) {
+            return status;
+        }
+        status = database.clearPreferences();
+        result.WriteTime = timer.elapsed();
+        return status;
+    }
+
+    worker::worker(const QString &path) : path(path) {
+    }
+
+    worker::~worker() = default;
+
+    Status worker::run(quint64 seed, int mode, Result &result) {
+        // 数据库连接必须在使用它的线程中创建
+        if (!database) {
+            database = std::make_unique<Database::database>(path, "allocation");
+        }
+        return Allocation::run(*database, seed, mode, result);
+    }
+
+    service::service(const QString &path) {
+        runner = new worker(path);
+        runner->moveToThread(&thread);
+        QObject::connect(&thread, &QThread::finished, runner, &QObject::deleteLater);
+        thread.start();
+    }
+
+    service::~service() {
+        thread.quit();
+        thread.wait();
+    }
+
+    bool service::start(quint64 seed, int mode) {
+        {
+            QMutexLocker locker(&mutex);
+            if (current.Running) {
+                return false;
+            }
+            current.Running = true;
+            current.Seed = seed;
+            current.Mode = mode;
+            current.StartTime = QDateTime::currentMSecsSinceEpoch();
+        }
+        // 在后台线程中分配和写入，请求线程立即返回
+        QMetaObject::invokeMethod(runner, [this, seed, mode]() {
+            Result result;
+            Status status = runner->run(seed, mode, result);
+            QMutexLocker locker(&mutex);
+            current.Running = false;
+            current.Finished = true;
+            current.RunStatus = status;
+            current.RunResult = result;
+        }, Qt::QueuedConnection);
+        return true;
+    }
+
+    Progress service::progress() const {
+        QMutexLocker locker(&mutex);
+        return current;
+    }
+
+} // Allocation
@@ -0,0 +1,77 @@
+#ifndef ALLOCATION_H
+#define ALLOCATION_H
+
+#include "database.h"
+#include <QMutex>
+#include <QObject>
+#include <QThread>
+#include <memory>
+
+#define ALLOCATION_LOTTERY 0 // 按抽签顺序轮流分配
+#define ALLOCATION_PRIORITY 1 // 已选学分少的学生优先，同学分按抽签顺序
+#define ALLOCATION_CHUNK_SIZE 2000 // 写入结果时每个事务包含的选课记录数
+
+namespace Allocation {
+
+    class Result {
+    public:
+        int Students = 0; // 提交志愿的学生数
+        int Preferences = 0; // 志愿总数
+        int Allocated = 0; // 分配成功并写入的选课数
+        int Rejected = 0; // 写入时课程已被其他选课占满而放弃的选课数
+        int Groups = 0; // 互不相交的课程组数
+        qint64 AllocateTime = 0; // 分配耗时（毫秒）
+        qint64 WriteTime = 0; // 写入数据库耗时（毫秒）
+    };
+
+    // 读取全部志愿，按抽签或优先级分批分配课程名额，并通过批量选课写入数据库
+    Status run(Database::database &database, quint64 seed, int mode, Result &result);
+
+    // 分配任务的进度，由后台线程写入，请求线程读取快照
+    class Progress {
+    public:
+        bool Running = false; // 是否正在分配
+        bool Finished = false; // 是否已有分配完成
+        Status RunStatus = Success; // 最近一次完成的分配的结果
+        quint64 Seed = 0; // 抽签种子
+        int Mode = ALLOCATION_LOTTERY; // 分配方式
+        qint64 StartTime = 0; // 开始时间（毫秒时间戳）
+        Result RunResult; // 最近一次完成的分配的统计
+    };
+
+    // 运行在后台线程中的分配执行者，使用独立的数据库连接
+    class worker : public QObject {
+    public:
+        explicit worker(const QString &path);
+
+        ~worker() override;
+
+        Status run(quint64 seed, int mode, Result &result);
+
+    private:
+        QString path;
+        std::unique_ptr<Database::database> database;
+    };
+
+    // 请求线程使用的接口：投递分配任务后立即返回，通过 progress 查询进度
+    class service {
+    public:
+        explicit service(const QString &path);
+
+        ~service();
+
+        // 已有分配正在进行时返回false
+        bool start(quint64 seed, int mode);
+
+        Progress progress() const;
+
+    private:
+        mutable QMutex mutex;
+        Progress current;
+        QThread thread;
+        worker *runner;
+    };
+
+} // Allocation
+
+#endif //ALLOCATION_H
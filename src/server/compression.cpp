@@ -0,0 +1,112 @@
+#include "compression.h"
+#include <QList>
+#include <array>
+
+namespace Compression {
+
+    namespace {
+
+        // qCompress的输出为 4字节原始长度 + 2字节zlib头 + deflate数据 + 4字节Adler-32
+        constexpr qsizetype QCOMPRESS_PREFIX_SIZE = 4;
+        constexpr qsizetype ZLIB_HEADER_SIZE = 2;
+        constexpr qsizetype ZLIB_TRAILER_SIZE = 4;
+
+        std::array<quint32, 256> makeCrcTable() {
+            std::array<quint32, 256> table{};
+            for (quint32 i = 0; i < 256; i++) {
+                quint32 crc = i;
+                for (int bit = 0; bit < 8; bit++) {
+                    crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+                }
+                table[i] = crc;
+            }
+            return table;
+        }
+
+        quint32 crc32(const QByteArray &data) {
+            static const std::array<quint32, 256> table = makeCrcTable();
+            quint32 crc = 0xFFFFFFFFu;
+            for (char c: data) {
+                crc = table[(crc ^ static_cast<unsigned char>(c)) & 0xFF] ^ (crc >> 8);
+            }
+            return crc ^ 0xFFFFFFFFu;
+        }
+
+        void appendLittleEndian(QByteArray &out, quint32 value) {
+            for (int i = 0; i < 4; i++) {
+                out.append(char((value >> (8 * i)) & 0xFF));
+            }
+        }
+
+        bool accepted(const QByteArray &coding) {
+            // 形如 gzip;q=0.5，q为0时表示不接受
+            QList<QByteArray> params = coding.split(';');
+            for (qsizetype i = 1; i < params.size(); i++) {
+                QByteArray param = params[i].trimmed();
+                if (param.startsWith("q=")) {
+                    return param.mid(2).toDouble() > 0;
+                }
+            }
+            return true;
+        }
+
+    }
+
+    int negotiate(const QByteArray &acceptEncoding) {
+        bool gzip = false;
+        bool deflate = false;
+        for (const auto &item: acceptEncoding.split(',')) {
+            QByteArray coding = item.trimmed();
+            QByteArray name = coding.left(coding.indexOf(';')).trimmed().toLower();
+            if (name == "gzip" || name == "x-gzip") {
+                gzip = accepted(coding);
+            } else if (name == "deflate") {
+                deflate = accepted(coding);
+            }
+        }
+        if (gzip) {
+            return ENCODING_GZIP;
+        }
+        if (deflate) {
+            return ENCODING_DEFLATE;
+        }
+        return ENCODING_IDENTITY;
+    }
+
+    QByteArray compress(const QByteArray &data, int encoding, int level) {
+        if (encoding == ENCODING_IDENTITY) {
+            return {};
+        }
+        QByteArray compressed = qCompress(data, level);
+        if (compressed.size() <= QCOMPRESS_PREFIX_SIZE + ZLIB_HEADER_SIZE + ZLIB_TRAILER_SIZE) {
+            return {};
+        }
+        if (encoding == ENCODING_DEFLATE) {
+            // HTTP的deflate即zlib格式，去掉Qt添加的长度前缀即可
+            return compressed.mid(QCOMPRESS_PREFIX_SIZE);
+        }
+
+        // gzip = 10字节头 + deflate数据 + CRC32 + 原始长度
+        QByteArray out;
+        out.reserve(compressed.size() + 10);
+        static const char header[10] = {'\x1f', '\x8b', '\x08', 0, 0, 0, 0, 0, 0, '\x03'};
+        out.append(header, sizeof(header));
+        out.append(compressed.constData() + QCOMPRESS_PREFIX_SIZE + ZLIB_HEADER_SIZE,
+                   compressed.size() - QCOMPRESS_PREFIX_SIZE - ZLIB_HEADER_SIZE - ZLIB_TRAILER_SIZE);
+        appendLittleEndian(out, crc32(data));
+        appendLittleEndian(out, quint32(data.size()));
+        return out;
+    }
+
+    const char *encodingName(int encoding) {
+        switch (encoding) {
+            case ENCODING_GZIP:
+                return "gzip";
+            case ENCODING_DEFLATE:
+                return "deflate";
+            default:
+                return "identity";
+        }
+    }
+
+} // Compression
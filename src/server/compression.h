@@ -0,0 +1,25 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <QByteArray>
+
+#define COMPRESSION_THRESHOLD 1024 // 响应body小于该字节数时不压缩
+#define COMPRESSION_LEVEL 6 // zlib压缩级别，1最快，9压缩率最高
+
+#define ENCODING_IDENTITY 0 // 不压缩
+#define ENCODING_GZIP 1 // gzip
+#define ENCODING_DEFLATE 2 // deflate（zlib格式）
+
+namespace Compression {
+
+    // 根据 Accept-Encoding 选择编码，优先gzip，q=0 表示客户端拒绝该编码
+    int negotiate(const QByteArray &acceptEncoding);
+
+    // 按选定的编码压缩，返回空表示不压缩
+    QByteArray compress(const QByteArray &data, int encoding, int level = COMPRESSION_LEVEL);
+
+    const char *encodingName(int encoding);
+
+} // Compression
+
+#endif //COMPRESSION_H
@@ -2,66 +2,160 @@
 #pragma ide diagnostic ignored "readability-convert-member-functions-to-static"
 
 #include "database.h"
+#include "timetable.h"
+#include "entityversion.h"
+#include "entitysql.h"
+#include "metrics.h"
+#include "tracing.h"
+#include "queryprofile.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QElapsedTimer>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QtSql/QSqlError>
 #include <QtSql/QSqlQuery>
 #include <QtSql/QSqlRecord>
 #include <QJsonObject>
+#include <QSet>
 
 namespace Database {
-    database::database(const QString &path) {
-        db = QSqlDatabase::addDatabase("QSQLITE");
+    database::database(const QString &path, const QString &connectionName) {
+        db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
         db.setDatabaseName(path);
+        // 候补线程使用独立连接写入同一数据库，遇到锁时等待而不是立即失败
+        db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=5000");
 
         if (!db.open()) {
             qDebug() << "Debug | database.cpp: Error: connection with database fail";
         } else {
-            qDebug() << "Debug | database.cpp: 数据库连接成功";
+            QElapsedTimer timer;
+            timer.start();
+            QSqlQuery query(db);
+            exec(query, "PRAGMA journal_mode=WAL");
             initializeDatabase();
+            qInfo() << "Info | database.cpp: 数据库连接成功" << connectionName << "初始化耗时" << timer.elapsed() << "ms";
         }
     }
 
+    bool database::transaction() {
+        if (transactionDepth == 0) {
+            // 立即取得写锁：事务内先读后写（如检查余量再选课）时，其他连接不能在读和写之间插入修改，
+            // 也不会在升级为写事务时因快照过期而失败
+            QSqlQuery query(db);
+            if (!exec(query, "BEGIN IMMEDIATE")) {
+                qDebug() << "Debug | database.cpp: transaction error:" << query.lastError();
+                return false;
+            }
+        } else {
+            // 已在事务中（如批量请求或建表），内层使用保存点，回滚时只撤销自己的修改
+            QSqlQuery query(db);
+            if (!exec(query, QString("SAVEPOINT sp_%1").arg(transactionDepth))) {
+                qDebug() << "Debug | database.cpp: transaction error:" << query.lastError();
+                return false;
+            }
+        }
+        savepointVersions.append(pendingVersions.size());
+        transactionDepth++;
+        return true;
+    }
+
+    bool database::commit() {
+        if (transactionDepth == 0) {
+            return false;
+        }
+        QSqlQuery query(db);
+        if (transactionDepth == 1) {
+            if (!exec(query, "COMMIT")) {
+                // 提交失败时本层事务仍然打开，由调用者rollback()回滚后连接才能继续使用
+                qDebug() << "Debug | database.cpp: commit error:" << query.lastError();
+                return false;
+            }
+            transactionDepth = 0;
+            savepointVersions.removeLast();
+            QVector<PendingVersion> versions;
+            versions.swap(pendingVersions);
+            // 提交成功后才发布新版本号，其他连接读到的版本号总是已提交的数据
+            for (const auto &pending: versions) {
+                publishVersion(pending.Entity, pending.Id, pending.Version, pending.Deleted);
+            }
+            return true;
+        }
+        if (!exec(query, QString("RELEASE sp_%1").arg(transactionDepth - 1))) {
+            qDebug() << "Debug | database.cpp: commit error:" << query.lastError();
+            return false;
+        }
+        transactionDepth--;
+        savepointVersions.removeLast();
+        return true;
+    }
+
+    bool database::rollback() {
+        if (transactionDepth == 0) {
+            return false;
+        }
+        transactionDepth--;
+        // 丢弃本层事务中修改的版本号
+        pendingVersions.resize(savepointVersions.takeLast());
+        QSqlQuery query(db);
+        if (transactionDepth == 0) {
+            return exec(query, "ROLLBACK");
+        }
+        return exec(query, QString("ROLLBACK TO sp_%1").arg(transactionDepth)) &&
+               exec(query, QString("RELEASE sp_%1").arg(transactionDepth));
+    }
+
+    bool database::exec(QSqlQuery &query) {
+        Tracing::scope trace(TRACE_DB);
+        QElapsedTimer timer;
+        timer.start();
+        bool ok = query.exec();
+        recordStatement(query, query.lastQuery(), timer.nsecsElapsed() / 1000);
+        return ok;
+    }
+
+    bool database::exec(QSqlQuery &query, const QString &statement) {
+        Tracing::scope trace(TRACE_DB);
+        QElapsedTimer timer;
+        timer.start();
+        bool ok = query.exec(statement);
+        recordStatement(query, statement, timer.nsecsElapsed() / 1000);
+        return ok;
+    }
+
+    void database::recordStatement(const QSqlQuery &query, const QString &statement, qint64 micros) {
+        Metrics::registry::instance().recordStatement(Metrics::registry::statementKind(statement), micros);
+        // 绑定参数只在写慢查询日志时需要，避免每次执行都复制一份
+        bool slow = micros >= qint64(QUERY_SLOW_THRESHOLD) * 1000;
+        QueryProfile::profiler::instance().record(statement, slow ? query.boundValues() : QVariantList(), micros);
+    }
+
     bool database::ifTableExist(const QString &tableName) {
-        return db.tables().contains(tableName);
+        // 只查一张表；db.tables() 每次都要读出全部表名，有数千张成绩表时很慢
+        QSqlQuery query(db);
+        query.prepare("SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = :name");
+        query.bindValue(":name", tableName);
+        return exec(query) && query.next();
+    }
+
+    bool database::ifColumnExist(const QString &tableName, const QString &columnName) {
+        return db.record(tableName).contains(columnName);
     }
 
-    Status database::getStudentById(const QString &id, Student &student) {
-        QSqlQuery query;
-        query.prepare("SELECT * FROM student_information WHERE StudentId = :id");
+    Status database::getStudentById(const QString &id, Student &student, Entity::FieldMask fields) {
+        QSqlQuery query(db);
+        query.prepare(EntitySql::selectFrom<Student>(fields) + " WHERE StudentId = :id");
         query.bindValue(":id", id);
-        if (query.exec() && query.next()) {
-            QSqlRecord record = query.record();
-            student.Id = record.value("StudentId").toString();
-            student.Name = record.value("StudentName").toString();
-            //根据国标GB/T 2261.1-2003，记录中的 0、1、2、9 对应 未知、男、女、其他
-            student.Sex = record.value("StudentSex").toInt() == 0 ? "未知" :
-                          record.value("StudentSex").toInt() == 1 ? "男" :
-                          record.value("StudentSex").toInt() == 2 ? "女" : "其他";
-            student.College = record.value("StudentCollege").toString();
-            student.Major = record.value("StudentMajor").toString();
-            student.Class = record.value("StudentClass").toString();
-            student.Age = record.value("StudentAge").toInt();
-            student.PhoneNumber = record.value("StudentPhoneNumber").toString();
-            student.DormitoryArea = record.value("DormitoryArea").toString();
-            student.DormitoryNum = record.value("DormitoryNum").toString();
-
-            QString chosenLessonsJson = record.value("ChosenLessons").toString();
-            QJsonParseError jsonError;
-            QJsonDocument doc = QJsonDocument::fromJson(chosenLessonsJson.toUtf8(), &jsonError);
-            QJsonArray array = doc.array();
-
-            student.ChosenLessons.clear();
-            for (auto &&i: array) {
-                student.ChosenLessons.append(i.toString());
-            }
+        if (exec(query) && query.next()) {
+            EntitySql::readRow(query, student, fields);
+            publishVersion(ENTITY_STUDENT, student.Id, student.Version);
             return Success;
         }
         return ERROR;
     }
 
     Status database::initializeDatabase() {
-        QSqlQuery query;
+        QSqlQuery query(db);
         QStringList tableCreationQueries = {
                 R"(
             CREATE TABLE IF NOT EXISTS student_information (
@@ -76,6 +170,7 @@ namespace Database {
                 DormitoryArea TEXT NOT NULL,
                 DormitoryNum TEXT,
                 ChosenLessons TEXT NOT NULL DEFAULT '[]',
+                Version INTEGER NOT NULL DEFAULT 0,
                 PRIMARY KEY(StudentId)
             )
         )",
@@ -89,6 +184,8 @@ namespace Database {
                 LessonArea TEXT,
                 LessonTimeAndLocations TEXT NOT NULL DEFAULT '{}',
                 LessonStudents TEXT NOT NULL DEFAULT '[]',
+                LessonCapacity INTEGER NOT NULL DEFAULT 0,
+                Version INTEGER NOT NULL DEFAULT 0,
                 PRIMARY KEY(LessonId),
                 FOREIGN KEY (TeacherId) REFERENCES teacher_information(TeacherId)
                 ON UPDATE NO ACTION ON DELETE NO ACTION
@@ -100,6 +197,7 @@ namespace Database {
                 TeacherName TEXT NOT NULL,
                 TeacherUnit TEXT,
                 TeachingLessons TEXT NOT NULL DEFAULT '[]',
+                Version INTEGER NOT NULL DEFAULT 0,
                 PRIMARY KEY(TeacherId)
             )
         )",
@@ -111,16 +209,57 @@ namespace Database {
                 IsSuper INTEGER NOT NULL,
                 PRIMARY KEY(Account)
             )
+        )",
+                R"(
+            CREATE TABLE IF NOT EXISTS lesson_waitlist (
+                Seq INTEGER PRIMARY KEY AUTOINCREMENT,
+                LessonId TEXT NOT NULL,
+                StudentId TEXT NOT NULL,
+                EnqueueTime INTEGER NOT NULL,
+                UNIQUE(LessonId, StudentId)
+            )
+        )",
+                R"(
+            CREATE TABLE IF NOT EXISTS lesson_preference (
+                StudentId TEXT NOT NULL,
+                LessonId TEXT NOT NULL,
+                Rank INTEGER NOT NULL,
+                PRIMARY KEY(StudentId, LessonId)
+            )
+        )",
+                R"(
+            CREATE TABLE IF NOT EXISTS change_log (
+                Seq INTEGER PRIMARY KEY AUTOINCREMENT,
+                Entity INTEGER NOT NULL,
+                EntityId TEXT NOT NULL,
+                Version INTEGER NOT NULL
+            )
         )"};
 
         QStringList tableNames = {"student_information", "lesson_information",
-                                  "teacher_information", "auth"};
+                                  "teacher_information", "auth", "lesson_waitlist", "lesson_preference",
+                                  "change_log"};
+
+        // 启动时按版本号初始化版本计数器，取最大值时走索引而不扫描整张表
+        QStringList indexCreationQueries = {
+                "CREATE INDEX IF NOT EXISTS student_information_version ON student_information(Version)",
+                "CREATE INDEX IF NOT EXISTS teacher_information_version ON teacher_information(Version)",
+                "CREATE INDEX IF NOT EXISTS lesson_information_version ON lesson_information(Version)"};
+
+        // 表结构指纹与库中记录的一致时，说明建表和迁移都已完成，跳过所有检查
+        QString fingerprint = QString::fromLatin1(QCryptographicHash::hash(
+                (QString::number(SCHEMA_VERSION) + tableCreationQueries.join(';') +
+                 indexCreationQueries.join(';')).toUtf8(), QCryptographicHash::Sha1).toHex());
+        if (schemaMeta(SCHEMA_FINGERPRINT) == fingerprint) {
+            seedVersions();
+            return Success;
+        }
 
         for (int i = 0; i < tableCreationQueries.size(); i++) {
             if (!ifTableExist(tableNames[i])) {
                 qDebug() << "Debug | database.cpp: 正在创建" << tableNames[i];
 
-                if (!query.exec(tableCreationQueries[i])) {
+                if (!exec(query, tableCreationQueries[i])) {
                     qDebug() << "Debug | database.cpp: Error:" << query.lastError();
                     return ERROR;
                 } else {
@@ -128,101 +267,322 @@ namespace Database {
                 }
             }
         }
+
+        // 旧数据库中没有课程容量字段，补充该字段
+        if (!ifColumnExist("lesson_information", "LessonCapacity")) {
+            qDebug() << "Debug | database.cpp: 正在为 lesson_information 添加 LessonCapacity";
+            if (!exec(query, "ALTER TABLE lesson_information ADD COLUMN LessonCapacity INTEGER NOT NULL DEFAULT 0")) {
+                qDebug() << "Debug | database.cpp: Error:" << query.lastError();
+                return ERROR;
+            }
+        }
+
+        // 旧数据库中没有版本号字段，补充该字段
+        for (const auto &tableName: {"student_information", "teacher_information", "lesson_information"}) {
+            if (!ifColumnExist(tableName, "Version")) {
+                qDebug() << "Debug | database.cpp: 正在为" << tableName << "添加 Version";
+                if (!exec(query, QString("ALTER TABLE %1 ADD COLUMN Version INTEGER NOT NULL DEFAULT 0").arg(tableName))) {
+                    qDebug() << "Debug | database.cpp: Error:" << query.lastError();
+                    return ERROR;
+                }
+            }
+        }
+
+        for (const auto &indexCreationQuery: indexCreationQueries) {
+            if (!exec(query, indexCreationQuery)) {
+                qDebug() << "Debug | database.cpp: Error:" << query.lastError();
+                return ERROR;
+            }
+        }
+
+        // 全部完成后才记录指纹，中途失败时下次启动重新检查
+        if (!exec(query, "CREATE TABLE IF NOT EXISTS schema_meta (Key TEXT NOT NULL PRIMARY KEY, Value TEXT NOT NULL)") ||
+            setSchemaMeta(SCHEMA_FINGERPRINT, fingerprint) != Success) {
+            qDebug() << "Debug | database.cpp: Error:" << query.lastError();
+            return ERROR;
+        }
+        qInfo() << "Info | database.cpp: 表结构已更新，指纹" << fingerprint;
+        seedVersions();
         return Success;
     }
 
-    Status database::checkDatabase() {
-        // 开始事务
-        db.transaction();
+    void database::seedVersions() {
+        QSqlQuery query(db);
+        for (const auto &tableName: {"student_information", "teacher_information", "lesson_information"}) {
+            if (exec(query, QString("SELECT MAX(Version) FROM %1").arg(tableName)) && query.next()) {
+                EntityVersion::registry::instance().seed(query.value(0).toLongLong());
+            }
+        }
+    }
 
-        // 获取所有课程
-        QSqlQuery query;
+    QString database::schemaMeta(const QString &key) {
+        // 旧数据库中没有 schema_meta 表，查询失败按没有记录处理
+        QSqlQuery query(db);
+        query.prepare("SELECT Value FROM schema_meta WHERE Key = :key");
+        query.bindValue(":key", key);
+        if (exec(query) && query.next()) {
+            return query.value(0).toString();
+        }
+        return QString();
+    }
+
+    Status database::setSchemaMeta(const QString &key, const QString &value) {
+        QSqlQuery query(db);
+        query.prepare("INSERT OR REPLACE INTO schema_meta (Key, Value) VALUES (:key, :value)");
+        query.bindValue(":key", key);
+        query.bindValue(":value", value);
+        if (!exec(query)) {
+            qDebug() << "Debug | database.cpp: setSchemaMeta error:" << query.lastError();
+            return ERROR;
+        }
+        return Success;
+    }
+
+    bool database::needsCheck() {
+        return schemaMeta(SCHEMA_CHECKED) != schemaMeta(SCHEMA_FINGERPRINT);
+    }
+
+    Status database::markChecked() {
+        return setSchemaMeta(SCHEMA_CHECKED, schemaMeta(SCHEMA_FINGERPRINT));
+    }
+
+    Status database::bumpVersion(int entity, const QString &id) {
+        static const char *const tableNames[] = {"student_information", "teacher_information", "lesson_information"};
+        static const char *const idColumns[] = {"StudentId", "TeacherId", "LessonId"};
+        EntityVersion::registry &registry = EntityVersion::registry::instance();
+        qint64 version = registry.next();
+        QSqlQuery query(db);
+        query.prepare(QString("UPDATE %1 SET Version = :version WHERE %2 = :id").arg(tableNames[entity], idColumns[entity]));
+        query.bindValue(":version", version);
+        query.bindValue(":id", id);
+        if (!exec(query)) {
+            qDebug() << "Debug | database.cpp: bumpVersion error:" << query.lastError();
+            return ERROR;
+        }
+        publishVersion(entity, id, version);
+        return logChange(entity, id, version);
+    }
+
+    Status database::removeVersion(int entity, const QString &id) {
+        publishVersion(entity, id, EntityVersion::registry::instance().next(), true);
+        return logChange(entity, id, CHANGE_DELETED);
+    }
+
+    void database::publishVersion(int entity, const QString &id, qint64 version, bool deleted) {
+        // 事务中的修改在最外层提交后才对条件请求可见，回滚时丢弃
+        if (transactionDepth > 0) {
+            pendingVersions.append(PendingVersion{entity, id, version, deleted});
+            return;
+        }
+        if (deleted) {
+            EntityVersion::registry::instance().remove(entity, id, version);
+        } else {
+            EntityVersion::registry::instance().update(entity, id, version);
+        }
+    }
+
+    Status database::logChange(int entity, const QString &id, qint64 version) {
+        QSqlQuery query(db);
+        query.prepare("INSERT INTO change_log (Entity, EntityId, Version) VALUES (:entity, :id, :version)");
+        query.bindValue(":entity", entity);
+        query.bindValue(":id", id);
+        query.bindValue(":version", version);
+        if (!exec(query)) {
+            qDebug() << "Debug | database.cpp: logChange error:" << query.lastError();
+            return ERROR;
+        }
+        // 定期删除最旧的记录，只保留最近 CHANGE_LOG_SIZE 条
+        qint64 seq = query.lastInsertId().toLongLong();
+        if (seq % CHANGE_LOG_TRIM_INTERVAL == 0) {
+            query.prepare("DELETE FROM change_log WHERE Seq <= :seq");
+            query.bindValue(":seq", seq - CHANGE_LOG_SIZE);
+            if (!exec(query)) {
+                qDebug() << "Debug | database.cpp: logChange error:" << query.lastError();
+                return ERROR;
+            }
+        }
+        return Success;
+    }
+
+    Status database::listChanges(qint64 since, int maximum, QVector<Change> &changes, qint64 &latest, bool &reset) {
+        QSqlQuery query(db);
+        if (!exec(query, "SELECT MIN(Seq), MAX(Seq) FROM change_log") || !query.next()) {
+            qDebug() << "Debug | database.cpp: listChanges error:" << query.lastError();
+            return ERROR;
+        }
+        qint64 oldest = query.value(0).toLongLong();
+        latest = query.value(1).toLongLong();
+        // 客户端第一次同步、所需的记录已被清理或数据库已重建，客户端需要清空全部缓存后从latest开始同步
+        reset = since < 0 || since > latest || (since < oldest - 1 && since < latest);
+        if (reset) {
+            return Success;
+        }
+
+        query.prepare("SELECT Seq, Entity, EntityId, Version FROM change_log WHERE Seq > :since ORDER BY Seq LIMIT :maximum");
+        query.bindValue(":since", since);
+        query.bindValue(":maximum", maximum);
+        if (!exec(query)) {
+            qDebug() << "Debug | database.cpp: listChanges error:" << query.lastError();
+            return ERROR;
+        }
+        while (query.next()) {
+            Change change;
+            change.Seq = query.value(0).toLongLong();
+            change.Entity = query.value(1).toInt();
+            change.Id = query.value(2).toString();
+            change.Version = query.value(3).toLongLong();
+            changes.append(change);
+        }
+        return Success;
+    }
+
+    Status database::checkDatabase() {
+        // 先在事务外读出需要检查的数据并关闭游标，再逐条在各自的短写事务中重新读取并修正，
+        // 后台检查期间不长时间持有写锁，也不按过期的快照修改请求线程刚写入的数据
+        QSqlQuery query(db);
+        query.setForwardOnly(true);
         query.prepare("SELECT LessonId, TeacherId FROM lesson_information");
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: checkDatabase error:" << query.lastError();
-            db.rollback();
             return ERROR;
         }
-        QMap<QString, QVector<QString>> teacherLessonsMap;
+        QVector<QString> lessonIds;
+        QSet<QString> teacherIds;
         while (query.next()) {
-            QString lessonId = query.value("LessonId").toString();
-            QString teacherId = query.value("TeacherId").toString();
+            lessonIds.append(query.value("LessonId").toString());
+            teacherIds.insert(query.value("TeacherId").toString());
+        }
+        query.finish();
+
+        // 检查对应的lesson_id表是否存在，如果不存在则创建；表名只读取一次
+        QStringList tableList = db.tables();
+        QSet<QString> tables(tableList.begin(), tableList.end());
+        for (const auto &lessonId: lessonIds) {
             QString tableName = "lesson_" + lessonId;
-            // 检查对应的lesson_id表是否存在，如果不存在则创建
-            if (!ifTableExist(tableName)) {
+            if (!tables.contains(tableName)) {
                 Status status = createTableIfNotExists(tableName);
                 if (status != Success) {
-                    db.rollback();
                     return status;
                 }
             }
-
-            // 记录每个教师的授课信息
-            teacherLessonsMap[teacherId].append(lessonId);
         }
 
-        // 更新每个教师的授课信息
-        for (auto it = teacherLessonsMap.begin(); it != teacherLessonsMap.end(); ++it) {
-            Status status = updateTeachingLessons(it.key(), it.value());
-            if (status != Success) {
-                db.rollback();
-                return status;
+        // 更新每个教师的授课信息，在事务中按当前的课程表重新计算，与已有列表相同时不写入
+        QSqlQuery teacherQuery(db);
+        for (const auto &teacherId: teacherIds) {
+            if (!transaction()) {
+                return ERROR;
+            }
+            query.prepare("SELECT LessonId FROM lesson_information WHERE TeacherId = :teacherId");
+            query.bindValue(":teacherId", teacherId);
+            teacherQuery.prepare("SELECT TeachingLessons FROM teacher_information WHERE TeacherId = :teacherId");
+            teacherQuery.bindValue(":teacherId", teacherId);
+            if (!exec(query) || !exec(teacherQuery)) {
+                qDebug() << "Debug | database.cpp: checkDatabase error:" << query.lastError() << teacherQuery.lastError();
+                rollback();
+                return ERROR;
+            }
+            QVector<QString> teachingLessons;
+            while (query.next()) {
+                teachingLessons.append(query.value(0).toString());
+            }
+            QVector<QString> storedLessons;
+            if (teacherQuery.next()) {
+                for (const auto &lessonId: QJsonDocument::fromJson(teacherQuery.value(0).toString().toUtf8()).array()) {
+                    storedLessons.append(lessonId.toString());
+                }
+            }
+            query.finish();
+            teacherQuery.finish();
+            if (QSet<QString>(teachingLessons.begin(), teachingLessons.end()) !=
+                QSet<QString>(storedLessons.begin(), storedLessons.end())) {
+                Status status = updateTeachingLessons(teacherId, teachingLessons);
+                if (status != Success) {
+                    rollback();
+                    return status;
+                }
+            }
+            if (!commit()) {
+                rollback();
+                return ERROR;
             }
         }
 
-        // 检查每个学生的选课信息是否正确
+        // 找出选课列表中有课程、成绩表中却没有记录的学生，游标读完关闭后再修正
         query.prepare("SELECT StudentId, ChosenLessons FROM student_information");
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: checkDatabase error: " << query.lastError();
-            db.rollback();
             return ERROR;
         }
+        QSqlQuery gradeQuery(db);
+        QVector<Enrollment> inconsistencies;
         while (query.next()) {
             QString studentId = query.value("StudentId").toString();
-            QString chosenLessonsJson = query.value("ChosenLessons").toString();
-            QJsonParseError jsonError;
-            QJsonDocument doc = QJsonDocument::fromJson(chosenLessonsJson.toUtf8(), &jsonError);
-            QJsonArray array = doc.array();
-            QVector<QString> chosenLessons;
-            for (auto &&i: array) {
-                chosenLessons.append(i.toString());
-            }
-            // 检查学生的选课信息是否正确，如果不正确则修正
-            for (const auto &lessonId: chosenLessons) {
-                QString tableName = "lesson_" + lessonId;
-                query.prepare("SELECT StudentId FROM " + tableName);
-                if (!query.exec()) {
-                    qDebug() << "Debug | database.cpp: checkDatabase error: " << query.lastError();
-                    db.rollback();
+            QJsonArray array = QJsonDocument::fromJson(query.value("ChosenLessons").toString().toUtf8()).array();
+            for (const auto &lesson: array) {
+                QString lessonId = lesson.toString();
+                // 按主键查找，不读出整张成绩表
+                gradeQuery.prepare("SELECT 1 FROM lesson_" + lessonId + " WHERE StudentId = :studentId");
+                gradeQuery.bindValue(":studentId", studentId);
+                if (!exec(gradeQuery)) {
+                    qDebug() << "Debug | database.cpp: checkDatabase error: " << gradeQuery.lastError();
                     return ERROR;
                 }
-                QVector<QString> lessonStudents;
-                while (query.next()) {
-                    lessonStudents.append(query.value("StudentId").toString());
-                }
-                if (!lessonStudents.contains(studentId)) {
-                    // 如果学生的选课信息不正确，修正它
-                    Status status = deleteChosenLesson(studentId, lessonId);
-                    if (status != Success) {
-                        db.rollback();
-                        return status;
-                    }
-                    break;
+                if (!gradeQuery.next()) {
+                    inconsistencies.append(Enrollment{studentId, lessonId});
                 }
+                gradeQuery.finish();
             }
         }
+        query.finish();
 
-        // 提交事务
-        db.commit();
+        // 逐条在写事务中确认不一致仍然存在后修正，其间已被请求修改的记录保持不变
+        QSqlQuery studentQuery(db);
+        for (const auto &inconsistency: inconsistencies) {
+            if (!transaction()) {
+                return ERROR;
+            }
+            studentQuery.prepare("SELECT ChosenLessons FROM student_information WHERE StudentId = :studentId");
+            studentQuery.bindValue(":studentId", inconsistency.StudentId);
+            gradeQuery.prepare("SELECT 1 FROM lesson_" + inconsistency.LessonId + " WHERE StudentId = :studentId");
+            gradeQuery.bindValue(":studentId", inconsistency.StudentId);
+            if (!exec(studentQuery) || !exec(gradeQuery)) {
+                qDebug() << "Debug | database.cpp: checkDatabase error: " << studentQuery.lastError() << gradeQuery.lastError();
+                rollback();
+                return ERROR;
+            }
+            bool chosen = studentQuery.next() &&
+                          QJsonDocument::fromJson(studentQuery.value(0).toString().toUtf8()).array()
+                                  .contains(inconsistency.LessonId);
+            bool graded = gradeQuery.next();
+            studentQuery.finish();
+            gradeQuery.finish();
+            if (chosen && !graded) {
+                Status status = deleteChosenLesson(inconsistency.StudentId, inconsistency.LessonId);
+                if (status != Success) {
+                    rollback();
+                    return status;
+                }
+            }
+            if (!commit()) {
+                rollback();
+                return ERROR;
+            }
+        }
         return Success;
     }
 
     Status database::deleteChosenLesson(const QString &studentId, const QString &lessonId) {
-        QSqlQuery query;
+        // 读取选课列表前开始事务，读到的列表在写回前不会被其他连接修改
+        if (!transaction()) {
+            return ERROR;
+        }
+        QSqlQuery query(db);
         query.prepare("SELECT ChosenLessons FROM student_information WHERE StudentId = :studentId");
         query.bindValue(":studentId", studentId);
-        if (!query.exec() || !query.next()) {
+        if (!exec(query) || !query.next()) {
             qDebug() << "Debug | database.cpp: deleteChosenLesson error: " << query.lastError();
+            rollback();
             return ERROR;
         }
         QString chosenLessonsJson = query.value("ChosenLessons").toString();
@@ -236,17 +596,21 @@ namespace Database {
                 break;
             }
         }
+        // 学生未选该课程时仍要清理成绩和课程名单
         if (index != -1) {
             array.removeAt(index);
             QJsonDocument newDoc(array);
             QString newChosenLessonsJson(newDoc.toJson(QJsonDocument::Compact));
-            db.transaction();
             query.prepare("UPDATE student_information SET ChosenLessons = :chosenLessons WHERE StudentId = :studentId");
             query.bindValue(":chosenLessons", newChosenLessonsJson);
             query.bindValue(":studentId", studentId);
-            if (!query.exec()) {
+            if (!exec(query)) {
                 qDebug() << "Debug | database.cpp: deleteChosenLesson error: " << query.lastError();
-                db.rollback();
+                rollback();
+                return ERROR;
+            }
+            if (bumpVersion(ENTITY_STUDENT, studentId) != Success) {
+                rollback();
                 return ERROR;
             }
         }
@@ -256,9 +620,9 @@ namespace Database {
 // Check if the record exists
         query.prepare("SELECT COUNT(*) FROM " + tableName + " WHERE StudentId = :studentId");
         query.bindValue(":studentId", studentId);
-        if (!query.exec() || !query.next()) {
+        if (!exec(query) || !query.next()) {
             qDebug() << "Debug | database.cpp: deleteChosenLesson error: " << query.lastError();
-            db.rollback();
+            rollback();
             return ERROR;
         }
         int count = query.value(0).toInt();
@@ -266,9 +630,9 @@ namespace Database {
             // If the record exists, delete it
             query.prepare("DELETE FROM " + tableName + " WHERE StudentId = :studentId");
             query.bindValue(":studentId", studentId);
-            if (!query.exec()) {
+            if (!exec(query)) {
                 qDebug() << "Debug | database.cpp: deleteChosenLesson error: " << query.lastError();
-                db.rollback();
+                rollback();
                 return ERROR;
             }
         }
@@ -276,9 +640,9 @@ namespace Database {
         //删除在lesson下的记录
         query.prepare("SELECT LessonStudents FROM lesson_information WHERE LessonId = :lessonId");
         query.bindValue(":lessonId", lessonId);
-        if (!query.exec() || !query.next()) {
+        if (!exec(query) || !query.next()) {
             qDebug() << "Debug | database.cpp: deleteChosenLesson error: " << query.lastError();
-            db.rollback();
+            rollback();
             return ERROR;
         }
         QString lessonStudentsJson = query.value("LessonStudents").toString();
@@ -298,80 +662,85 @@ namespace Database {
             query.prepare("UPDATE lesson_information SET LessonStudents = :lessonStudents WHERE LessonId = :lessonId");
             query.bindValue(":lessonStudents", newLessonStudentsJson);
             query.bindValue(":lessonId", lessonId);
-            if (!query.exec()) {
+            if (!exec(query)) {
                 qDebug() << "Debug | database.cpp: deleteChosenLesson error: " << query.lastError();
-                db.rollback();
+                rollback();
+                return ERROR;
+            }
+            if (bumpVersion(ENTITY_LESSON, lessonId) != Success) {
+                rollback();
                 return ERROR;
             }
         }
-        db.commit();
+        if (!commit()) {
+            rollback();
+            return ERROR;
+        }
         return Success;
     }
 
     Status database::updateStudent(const Student &student) {
-        db.transaction();
-        QSqlQuery query;
+        if (!transaction()) {
+            return ERROR;
+        }
+        QSqlQuery query(db);
 
         // Check if the student already exists
         query.prepare("SELECT COUNT(*) FROM student_information WHERE StudentId = :id");
         query.bindValue(":id", student.Id);
-        if (!query.exec() || !query.next()) {
+        if (!exec(query) || !query.next()) {
             qDebug() << "Debug | database.cpp: updateStudent error:" << query.lastError();
-            db.rollback();
+            rollback();
             return ERROR;
         }
         int count = query.value(0).toInt();
 
         if (count == 0) {
             // If the student does not exist, insert a new record
-            query.prepare(
-                    "INSERT INTO student_information (StudentId, StudentName, StudentSex, StudentCollege, StudentMajor, StudentClass, StudentAge, StudentPhoneNumber, DormitoryArea, DormitoryNum) "
-                    "VALUES (:id, :name, :sex, :college, :major, :class, :age, :phoneNumber, :dormitoryArea, :dormitoryNum)");
+            query.prepare(EntitySql::insertStatement<Student>());
+            EntitySql::bindInsert(query, student);
         } else {
             // If the student exists, update the record
-            query.prepare(
-                    "UPDATE student_information SET StudentName = :name, StudentSex = :sex, StudentCollege = :college, StudentMajor = :major, StudentClass = :class, StudentAge = :age, StudentPhoneNumber = :phoneNumber, DormitoryArea = :dormitoryArea, DormitoryNum = :dormitoryNum WHERE StudentId = :id");
+            query.prepare(EntitySql::updateStatement<Student>());
+            EntitySql::bindUpdate(query, student);
         }
 
-        query.bindValue(":name", student.Name);
-        query.bindValue(":sex", student.Sex == "男" ? 1 : student.Sex == "女" ? 2 : student.Sex == "其他" ? 9 : 0);
-        query.bindValue(":college", student.College);
-        query.bindValue(":major", student.Major);
-        query.bindValue(":class", student.Class);
-        query.bindValue(":age", student.Age);
-        query.bindValue(":phoneNumber", student.PhoneNumber);
-        query.bindValue(":dormitoryArea", student.DormitoryArea);
-        query.bindValue(":dormitoryNum", student.DormitoryNum);
-
-        query.bindValue(":id", student.Id);
-
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: updateStudent error: " << query.lastError();
-            db.rollback();
+            rollback();
+            return ERROR;
+        }
+        if (bumpVersion(ENTITY_STUDENT, student.Id) != Success) {
+            rollback();
             return ERROR;
         }
 
-        db.commit();
+        if (!commit()) {
+            rollback();
+            return ERROR;
+        }
         return Success;
     }
 
     Status database::updateLessonInformation(const Lesson &lesson) {
-        db.transaction();
-        QSqlQuery query;
+        if (!transaction()) {
+            return ERROR;
+        }
+        QSqlQuery query(db);
 
         //检查教师是否存在
         Status status = ifTeacherExist(lesson.TeacherId);
         if (status != Success) {
-            db.rollback();
+            rollback();
             return status;
         }
 
         // Check if the lesson already exists
         query.prepare("SELECT COUNT(*) FROM lesson_information WHERE LessonId = :id");
         query.bindValue(":id", lesson.Id);
-        if (!query.exec() || !query.next()) {
+        if (!exec(query) || !query.next()) {
             qDebug() << "Debug | database.cpp: updateLessonInformation error: " << query.lastError();
-            db.rollback();
+            rollback();
             return ERROR;
         }
         int count = query.value(0).toInt();
@@ -379,12 +748,16 @@ namespace Database {
         if (count == 0) {
             // If the lesson does not exist, insert a new record
             query.prepare(
-                    "INSERT INTO lesson_information (LessonId, LessonName, TeacherId, LessonCredits, LessonSemester, LessonArea, LessonTimeAndLocations) "
-                    "VALUES (:id, :name, :teacherId, :credits, :semester, :area, :timeAndLocations)");
-        } else {
+                    "INSERT INTO lesson_information (LessonId, LessonName, TeacherId, LessonCredits, LessonSemester, LessonArea, LessonTimeAndLocations, LessonCapacity) "
+                    "VALUES (:id, :name, :teacherId, :credits, :semester, :area, :timeAndLocations, :capacity)");
+        } else if (lesson.LessonCapacity == -1) {
             // If the lesson exists, update the record
             query.prepare(
                     "UPDATE lesson_information SET LessonName = :name, TeacherId = :teacherId, LessonCredits = :credits, LessonSemester = :semester, LessonArea = :area, LessonTimeAndLocations = :timeAndLocations WHERE LessonId = :id");
+        } else {
+            // 同时更新课程容量
+            query.prepare(
+                    "UPDATE lesson_information SET LessonName = :name, TeacherId = :teacherId, LessonCredits = :credits, LessonSemester = :semester, LessonArea = :area, LessonTimeAndLocations = :timeAndLocations, LessonCapacity = :capacity WHERE LessonId = :id");
         }
 
         query.bindValue(":id", lesson.Id);
@@ -393,6 +766,9 @@ namespace Database {
         query.bindValue(":credits", lesson.LessonCredits);
         query.bindValue(":semester", lesson.LessonSemester);
         query.bindValue(":area", lesson.LessonArea);
+        if (count == 0 || lesson.LessonCapacity != -1) {
+            query.bindValue(":capacity", qMax(lesson.LessonCapacity, 0));
+        }
 
         //lesson.LessonTimeAndLocations 是 QMap<QString, QVector<QString>> 类型
         QJsonObject timeAndLocationsObj;
@@ -413,32 +789,39 @@ namespace Database {
         // 绑定到查询
         query.bindValue(":timeAndLocations", timeAndLocationsJson);
 
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: updateLessonInformation error: " << query.lastError();
-            db.rollback();
+            rollback();
+            return ERROR;
+        }
+        if (bumpVersion(ENTITY_LESSON, lesson.Id) != Success) {
+            rollback();
             return ERROR;
         }
         QString tableName = "lesson_" + lesson.Id;
         status = createTableIfNotExists(tableName);
         if (status != Success) {
-            db.rollback();
+            rollback();
             return status;
         }
         //更新老师的教课信息
         status = addTeachingLesson(lesson.TeacherId, lesson.Id);
         if (status != Success) {
-            db.rollback();
+            rollback();
             return status;
         }
-        db.commit();
+        if (!commit()) {
+            rollback();
+            return ERROR;
+        }
         return Success;
     }
 
     Status database::ifTeacherExist(const QString &teacherId) {
-        QSqlQuery query;
+        QSqlQuery query(db);
         query.prepare("SELECT COUNT(*) FROM teacher_information WHERE TeacherId = :id");
         query.bindValue(":id", teacherId);
-        if (!query.exec() || !query.next()) {
+        if (!exec(query) || !query.next()) {
             qDebug() << "Debug | database.cpp: ifTeacherExist error: " << query.lastError();
             return ERROR;
         }
@@ -450,8 +833,10 @@ namespace Database {
     }
 
     Status database::createTableIfNotExists(const QString &tableName) {
-        db.transaction();
-        QSqlQuery query;
+        if (!transaction()) {
+            return ERROR;
+        }
+        QSqlQuery query(db);
         if (!ifTableExist(tableName)) {
             // 如果不存在，创建新表
             qDebug() << "Debug | database.cpp: 正在创建表" << tableName;
@@ -468,64 +853,37 @@ namespace Database {
             ON UPDATE NO ACTION ON DELETE NO ACTION
         )
     )");
-            if (!query.exec()) {
+            if (!exec(query)) {
                 qDebug() << "Debug | database.cpp: Error creating table" << tableName << ":" << query.lastError();
-                db.rollback();
+                rollback();
                 return ERROR;
             }
             qDebug() << "Debug | database.cpp: 表" << tableName << "创建成功";
         }
-        db.commit();
+        if (!commit()) {
+            rollback();
+            return ERROR;
+        }
         return Success;
     }
 
-    Status database::getLessonById(const QString &id, Lesson &lesson) {
-        QSqlQuery query;
-        query.prepare("SELECT * FROM lesson_information WHERE LessonId = :id");
+    Status database::getLessonById(const QString &id, Lesson &lesson, Entity::FieldMask fields) {
+        QSqlQuery query(db);
+        query.prepare(EntitySql::selectFrom<Lesson>(fields) + " WHERE LessonId = :id");
         query.bindValue(":id", id);
-        if (query.exec() && query.next()) {
-            QSqlRecord record = query.record();
-            lesson.Id = record.value("LessonId").toString();
-            lesson.LessonName = record.value("LessonName").toString();
-            lesson.TeacherId = record.value("TeacherId").toString();
-            lesson.LessonCredits = record.value("LessonCredits").toInt();
-            lesson.LessonSemester = record.value("LessonSemester").toString();
-            lesson.LessonArea = record.value("LessonArea").toString();
-
-            QString lessonTimeAndLocationsJson = record.value("LessonTimeAndLocations").toString();
-            QJsonParseError jsonError;
-            QJsonDocument doc = QJsonDocument::fromJson(lessonTimeAndLocationsJson.toUtf8(), &jsonError);
-            //lessonTimeAndLocationsJson格式如下：{"1-6周":["40809节","4501"],"7-10周":["30609节","4601"]}
-
-            QJsonObject obj = doc.object();
-            QMap<QString, QVector<QString>> timeAndLocationsMap;
-
-            for (auto it = obj.begin(); it != obj.end(); ++it) {
-                QJsonArray timeAndLocationArray = it.value().toArray();
-                QVector<QString> timeAndLocation;
-                for (auto &&i: timeAndLocationArray) {
-                    timeAndLocation.append(i.toString());
-                }
-                timeAndLocationsMap.insert(it.key(), timeAndLocation);
-            }
-
-            lesson.LessonTimeAndLocations = timeAndLocationsMap;
-
-            QString lessonStudentsJson = record.value("LessonStudents").toString();
-            doc = QJsonDocument::fromJson(lessonStudentsJson.toUtf8(), &jsonError);
-            QJsonArray array = doc.array();
-            lesson.LessonStudents.clear();
-            for (auto &&i: array) {
-                lesson.LessonStudents.append(i.toString());
-            }
+        if (exec(query) && query.next()) {
+            EntitySql::readRow(query, lesson, fields);
+            publishVersion(ENTITY_LESSON, lesson.Id, lesson.Version);
             return Success;
         }
         return ERROR;
     }
 
     Status database::updateTeachingLessons(const QString &teacherId, const QVector<QString> &teachingLessons) {
-        db.transaction();
-        QSqlQuery query;
+        if (!transaction()) {
+            return ERROR;
+        }
+        QSqlQuery query(db);
         query.prepare("UPDATE teacher_information SET TeachingLessons = :teachingLessons WHERE TeacherId = :teacherId");
         QJsonArray teachingLessonsArray;
         for (const auto &lesson: teachingLessons) {
@@ -535,20 +893,27 @@ namespace Database {
         QString teachingLessonsJson(teachingLessonsDoc.toJson(QJsonDocument::Compact));
         query.bindValue(":teachingLessons", teachingLessonsJson);
         query.bindValue(":teacherId", teacherId);
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: updateTeachingLessons error:" << query.lastError();
-            db.rollback();
+            rollback();
+            return ERROR;
+        }
+        if (bumpVersion(ENTITY_TEACHER, teacherId) != Success) {
+            rollback();
+            return ERROR;
+        }
+        if (!commit()) {
+            rollback();
             return ERROR;
         }
-        db.commit();
         return Success;
     }
 
     Status database::addTeachingLesson(const QString &teacherId, const QString &lessonId) {
-        QSqlQuery query;
+        QSqlQuery query(db);
         query.prepare("SELECT TeachingLessons FROM teacher_information WHERE TeacherId = :teacherId");
         query.bindValue(":teacherId", teacherId);
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: addTeachingLesson error:" << query.lastError();
             return ERROR;
         }
@@ -572,24 +937,33 @@ namespace Database {
         array.append(lessonId);
         QJsonDocument newDoc(array);
         QString newTeachingLessonsJson(newDoc.toJson(QJsonDocument::Compact));
-        db.transaction();
+        if (!transaction()) {
+            return ERROR;
+        }
         query.prepare("UPDATE teacher_information SET TeachingLessons = :teachingLessons WHERE TeacherId = :teacherId");
         query.bindValue(":teachingLessons", newTeachingLessonsJson);
         query.bindValue(":teacherId", teacherId);
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: addTeachingLesson error:" << query.lastError();
-            db.rollback();
+            rollback();
+            return ERROR;
+        }
+        if (bumpVersion(ENTITY_TEACHER, teacherId) != Success) {
+            rollback();
+            return ERROR;
+        }
+        if (!commit()) {
+            rollback();
             return ERROR;
         }
-        db.commit();
         return Success;
     }
 
     Status database::deleteTeachingLesson(const QString &teacherId, const QString &lessonId) {
-        QSqlQuery query;
+        QSqlQuery query(db);
         query.prepare("SELECT TeachingLessons FROM teacher_information WHERE TeacherId = :teacherId");
         query.bindValue(":teacherId", teacherId);
-        if (!query.exec() || !query.next()) {
+        if (!exec(query) || !query.next()) {
             qDebug() << "Debug | database.cpp: deleteTeachingLesson error:" << query.lastError();
             return ERROR;
         }
@@ -605,87 +979,90 @@ namespace Database {
         }
         QJsonDocument newDoc(array);
         QString newTeachingLessonsJson(newDoc.toJson(QJsonDocument::Compact));
-        db.transaction();
+        if (!transaction()) {
+            return ERROR;
+        }
         query.prepare("UPDATE teacher_information SET TeachingLessons = :teachingLessons WHERE TeacherId = :teacherId");
         query.bindValue(":teachingLessons", newTeachingLessonsJson);
         query.bindValue(":teacherId", teacherId);
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: deleteTeachingLesson error:" << query.lastError();
-            db.rollback();
+            rollback();
+            return ERROR;
+        }
+        if (bumpVersion(ENTITY_TEACHER, teacherId) != Success) {
+            rollback();
+            return ERROR;
+        }
+        if (!commit()) {
+            rollback();
             return ERROR;
         }
-        db.commit();
         return Success;
     }
 
-    Status database::getTeacherById(const QString &id, Teacher &teacher) {
-        QSqlQuery query;
-        query.prepare("SELECT * FROM teacher_information WHERE TeacherId = :id");
+    Status database::getTeacherById(const QString &id, Teacher &teacher, Entity::FieldMask fields) {
+        QSqlQuery query(db);
+        query.prepare(EntitySql::selectFrom<Teacher>(fields) + " WHERE TeacherId = :id");
         query.bindValue(":id", id);
-        if (query.exec() && query.next()) {
-            QSqlRecord record = query.record();
-            teacher.Id = record.value("TeacherId").toString();
-            teacher.Name = record.value("TeacherName").toString();
-            teacher.Unit = record.value("TeacherUnit").toString();
-
-            QString teachingLessonsJson = record.value("TeachingLessons").toString();
-            QJsonParseError jsonError;
-            QJsonDocument doc = QJsonDocument::fromJson(teachingLessonsJson.toUtf8(), &jsonError);
-            QJsonArray array = doc.array();
-            teacher.TeachingLessons.clear();
-            for (auto &&i: array) {
-                teacher.TeachingLessons.append(i.toString());
-            }
+        if (exec(query) && query.next()) {
+            EntitySql::readRow(query, teacher, fields);
+            publishVersion(ENTITY_TEACHER, teacher.Id, teacher.Version);
             return Success;
         }
         return ERROR;
     }
 
     Status database::updateTeacher(const Teacher &teacher) {
-        db.transaction();
-        QSqlQuery query;
+        if (!transaction()) {
+            return ERROR;
+        }
+        QSqlQuery query(db);
 
         // Check if the teacher already exists
         query.prepare("SELECT COUNT(*) FROM teacher_information WHERE TeacherId = :id");
         query.bindValue(":id", teacher.Id);
-        if (!query.exec() || !query.next()) {
+        if (!exec(query) || !query.next()) {
             qDebug() << "Debug | database.cpp: updateTeacher error:" << query.lastError();
-            db.rollback();
+            rollback();
             return ERROR;
         }
         int count = query.value(0).toInt();
 
         if (count == 0) {
             // If the teacher does not exist, insert a new record
-            query.prepare(
-                    "INSERT INTO teacher_information (TeacherId, TeacherName, TeacherUnit) VALUES (:id, :name, :unit)");
+            query.prepare(EntitySql::insertStatement<Teacher>());
+            EntitySql::bindInsert(query, teacher);
         } else {
             // If the teacher exists, update the record
-            query.prepare(
-                    "UPDATE teacher_information SET TeacherName = :name, TeacherUnit = :unit WHERE TeacherId = :id");
+            query.prepare(EntitySql::updateStatement<Teacher>());
+            EntitySql::bindUpdate(query, teacher);
         }
 
-        query.bindValue(":id", teacher.Id);
-        query.bindValue(":name", teacher.Name);
-        query.bindValue(":unit", teacher.Unit);
-
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: updateTeacher error:" << query.lastError();
-            db.rollback();
+            rollback();
+            return ERROR;
+        }
+        if (bumpVersion(ENTITY_TEACHER, teacher.Id) != Success) {
+            rollback();
             return ERROR;
         }
 
-        db.commit();
+        if (!commit()) {
+            rollback();
+            return ERROR;
+        }
         return Success;
     }
 
     Status database::deleteStudent(const QString &id) {
-        QSqlQuery query;
+        QSqlQuery query(db);
 
         // Check if the student exists
         query.prepare("SELECT COUNT(*) FROM student_information WHERE StudentId = :id");
         query.bindValue(":id", id);
-        if (!query.exec() || !query.next()) {
+        if (!exec(query) || !query.next()) {
             qDebug() << "Debug | database.cpp: deleteStudent error:" << query.lastError();
             return ERROR;
         }
@@ -696,7 +1073,7 @@ namespace Database {
         // 获取学生的已选课程
         query.prepare("SELECT ChosenLessons FROM student_information WHERE StudentId = :id");
         query.bindValue(":id", id);
-        if (!query.exec() || !query.next()) {
+        if (!exec(query) || !query.next()) {
             qDebug() << "Debug | database.cpp: deleteStudent error:" << query.lastError();
             return ERROR;
         }
@@ -709,14 +1086,16 @@ namespace Database {
             chosenLessons.append(i.toString());
         }
 
-        db.transaction();
+        if (!transaction()) {
+            return ERROR;
+        }
         // 从每个已选课程中删除该学生
         for (const auto &lessonId: chosenLessons) {
             query.prepare("SELECT LessonStudents FROM lesson_information WHERE LessonId = :lessonId");
             query.bindValue(":lessonId", lessonId);
-            if (!query.exec() || !query.next()) {
+            if (!exec(query) || !query.next()) {
                 qDebug() << "Debug | database.cpp: deleteStudent error:" << query.lastError();
-                db.rollback();
+                rollback();
                 return ERROR;
             }
             QString lessonStudentsJson = query.value("LessonStudents").toString();
@@ -733,9 +1112,13 @@ namespace Database {
             query.prepare("UPDATE lesson_information SET LessonStudents = :lessonStudents WHERE LessonId = :lessonId");
             query.bindValue(":lessonStudents", newLessonStudentsJson);
             query.bindValue(":lessonId", lessonId);
-            if (!query.exec()) {
+            if (!exec(query)) {
                 qDebug() << "Debug | database.cpp: deleteStudent error:" << query.lastError();
-                db.rollback();
+                rollback();
+                return ERROR;
+            }
+            if (bumpVersion(ENTITY_LESSON, lessonId) != Success) {
+                rollback();
                 return ERROR;
             }
 
@@ -743,9 +1126,20 @@ namespace Database {
             QString tableName = "lesson_" + lessonId;
             query.prepare("DELETE FROM " + tableName + " WHERE StudentId = :id");
             query.bindValue(":id", id);
-            if (!query.exec()) {
+            if (!exec(query)) {
+                qDebug() << "Debug | database.cpp: deleteStudent error:" << query.lastError();
+                rollback();
+                return ERROR;
+            }
+        }
+
+        // 删除学生的候补记录和选课志愿
+        for (const auto &tableName: {"lesson_waitlist", "lesson_preference"}) {
+            query.prepare(QString("DELETE FROM %1 WHERE StudentId = :id").arg(tableName));
+            query.bindValue(":id", id);
+            if (!exec(query)) {
                 qDebug() << "Debug | database.cpp: deleteStudent error:" << query.lastError();
-                db.rollback();
+                rollback();
                 return ERROR;
             }
         }
@@ -753,25 +1147,33 @@ namespace Database {
         // 删除学生主记录
         query.prepare("DELETE FROM student_information WHERE StudentId = :id");
         query.bindValue(":id", id);
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: deleteStudent error:" << query.lastError();
-            db.rollback();
+            rollback();
             return ERROR;
         }
         Status status = deleteAccount(id);
         if (status != Success) {
+            rollback();
             return status;
         }
-        db.commit();
+        if (removeVersion(ENTITY_STUDENT, id) != Success) {
+            rollback();
+            return ERROR;
+        }
+        if (!commit()) {
+            rollback();
+            return ERROR;
+        }
         return Success;
     }
 
     Status database::deleteLesson(const QString &id) {
-        QSqlQuery query;
+        QSqlQuery query(db);
         // 获取课程的学生列表
         query.prepare("SELECT LessonStudents FROM lesson_information WHERE LessonId = :id");
         query.bindValue(":id", id);
-        if (!query.exec() || !query.next()) {
+        if (!exec(query) || !query.next()) {
             qDebug() << "Debug | database.cpp: deleteLesson error:" << query.lastError();
             return ERROR;
         }
@@ -785,13 +1187,15 @@ namespace Database {
         }
 
         // 从每个学生的已选课程中删除该课程
-        db.transaction();
+        if (!transaction()) {
+            return ERROR;
+        }
         for (const auto &studentId: lessonStudents) {
             query.prepare("SELECT ChosenLessons FROM student_information WHERE StudentId = :studentId");
             query.bindValue(":studentId", studentId);
-            if (!query.exec() || !query.next()) {
+            if (!exec(query) || !query.next()) {
                 qDebug() << "Debug | database.cpp: deleteLesson error:" << query.lastError();
-                db.rollback();
+                rollback();
                 return ERROR;
             }
             QString chosenLessonsJson = query.value("ChosenLessons").toString();
@@ -808,9 +1212,13 @@ namespace Database {
             query.prepare("UPDATE student_information SET ChosenLessons = :chosenLessons WHERE StudentId = :studentId");
             query.bindValue(":chosenLessons", newChosenLessonsJson);
             query.bindValue(":studentId", studentId);
-            if (!query.exec()) {
+            if (!exec(query)) {
                 qDebug() << "Debug | database.cpp: deleteLesson error:" << query.lastError();
-                db.rollback();
+                rollback();
+                return ERROR;
+            }
+            if (bumpVersion(ENTITY_STUDENT, studentId) != Success) {
+                rollback();
                 return ERROR;
             }
         }
@@ -818,23 +1226,35 @@ namespace Database {
         // 删除老师该课程的教课信息
         query.prepare("SELECT TeacherId FROM lesson_information WHERE LessonId = :id");
         query.bindValue(":id", id);
-        if (!query.exec() || !query.next()) {
+        if (!exec(query) || !query.next()) {
             qDebug() << "Debug | database.cpp: deleteLesson error:" << query.lastError();
-            db.rollback();
+            rollback();
             return ERROR;
         }
         QString teacherId = query.value("TeacherId").toString();
         Status status = deleteTeachingLesson(teacherId, id);
         if (status != Success) {
+            rollback();
             return status;
         }
 
+        // 删除课程的候补队列和选课志愿
+        for (const auto &tableName: {"lesson_waitlist", "lesson_preference"}) {
+            query.prepare(QString("DELETE FROM %1 WHERE LessonId = :id").arg(tableName));
+            query.bindValue(":id", id);
+            if (!exec(query)) {
+                qDebug() << "Debug | database.cpp: deleteLesson error:" << query.lastError();
+                rollback();
+                return ERROR;
+            }
+        }
+
         // 删除课程主记录
         query.prepare("DELETE FROM lesson_information WHERE LessonId = :id");
         query.bindValue(":id", id);
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: deleteLesson error:" << query.lastError();
-            db.rollback();
+            rollback();
             return ERROR;
         }
 
@@ -842,21 +1262,28 @@ namespace Database {
         // 删除课程对应的 lesson_id 表
         QString tableName = "lesson_" + id;
         query.prepare("DROP TABLE IF EXISTS " + tableName);
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: deleteLesson error:" << query.lastError();
-            db.rollback();
+            rollback();
+            return ERROR;
+        }
+        if (removeVersion(ENTITY_LESSON, id) != Success) {
+            rollback();
+            return ERROR;
+        }
+        if (!commit()) {
+            rollback();
             return ERROR;
         }
-        db.commit();
         return Success;
     }
 
     Status database::deleteTeacher(const QString &id) {
-        QSqlQuery query;
+        QSqlQuery query(db);
         // 获取老师的教课信息
         query.prepare("SELECT TeachingLessons FROM teacher_information WHERE TeacherId = :id");
         query.bindValue(":id", id);
-        if (!query.exec() || !query.next()) {
+        if (!exec(query) || !query.next()) {
             qDebug() << "Debug | database.cpp: deleteTeacher error:" << query.lastError();
             return ERROR;
         }
@@ -876,95 +1303,65 @@ namespace Database {
         }
 
         // 删除老师主记录
-        db.transaction();
+        if (!transaction()) {
+            return ERROR;
+        }
         query.prepare("DELETE FROM teacher_information WHERE TeacherId = :id");
         query.bindValue(":id", id);
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: deleteTeacher error:" << query.lastError();
-            db.rollback();
+            rollback();
+            return ERROR;
+        }
+        if (removeVersion(ENTITY_TEACHER, id) != Success) {
+            rollback();
+            return ERROR;
+        }
+        if (!commit()) {
+            rollback();
             return ERROR;
         }
-        db.commit();
         return Success;
     }
 
-    Status database::getStudentByClass(const QString &studentClass, QVector<Student> &students) {
-        QSqlQuery query;
-        query.prepare("SELECT * FROM student_information WHERE StudentClass = :studentClass");
+    Status database::getStudentByClass(const QString &studentClass, QVector<Student> &students,
+                                        Entity::FieldMask fields) {
+        QSqlQuery query(db);
+        query.prepare(EntitySql::selectFrom<Student>(fields) + " WHERE StudentClass = :studentClass");
         query.bindValue(":studentClass", studentClass);
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: getStudentByClass error:" << query.lastError();
             return ERROR;
         }
         while (query.next()) {
-            QSqlRecord record = query.record();
             Student student;
-            student.Id = record.value("StudentId").toString();
-            student.Name = record.value("StudentName").toString();
-            student.Sex = record.value("StudentSex").toInt() == 0 ? "未知" :
-                          record.value("StudentSex").toInt() == 1 ? "男" :
-                          record.value("StudentSex").toInt() == 2 ? "女" : "其他";
-            student.College = record.value("StudentCollege").toString();
-            student.Major = record.value("StudentMajor").toString();
-            student.Class = record.value("StudentClass").toString();
-            student.Age = record.value("StudentAge").toInt();
-            student.PhoneNumber = record.value("StudentPhoneNumber").toString();
-            student.DormitoryArea = record.value("DormitoryArea").toString();
-            student.DormitoryNum = record.value("DormitoryNum").toString();
-
-            QString chosenLessonsJson = record.value("ChosenLessons").toString();
-            QJsonParseError jsonError;
-            QJsonDocument doc = QJsonDocument::fromJson(chosenLessonsJson.toUtf8(), &jsonError);
-            QJsonArray array = doc.array();
-            for (auto &&i: array) {
-                student.ChosenLessons.append(i.toString());
-            }
+            EntitySql::readRow(query, student, fields);
             students.append(student);
         }
         return Success;
     }
 
-    Status database::listStudents(QVector<Student> &students, int maximum, int pageNum) {
-        QSqlQuery query;
-        query.prepare("SELECT * FROM student_information LIMIT :maximum OFFSET :offset");
+    Status database::listStudents(QVector<Student> &students, int maximum, int pageNum, Entity::FieldMask fields) {
+        QSqlQuery query(db);
+        query.prepare(EntitySql::selectFrom<Student>(fields) + " LIMIT :maximum OFFSET :offset");
         query.bindValue(":maximum", maximum);
         query.bindValue(":offset", maximum * (pageNum - 1));
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: listStudents error:" << query.lastError();
             return ERROR;
         }
         while (query.next()) {
-            QSqlRecord record = query.record();
             Student student;
-            student.Id = record.value("StudentId").toString();
-            student.Name = record.value("StudentName").toString();
-            student.Sex = record.value("StudentSex").toInt() == 0 ? "未知" :
-                          record.value("StudentSex").toInt() == 1 ? "男" :
-                          record.value("StudentSex").toInt() == 2 ? "女" : "其他";
-            student.College = record.value("StudentCollege").toString();
-            student.Major = record.value("StudentMajor").toString();
-            student.Class = record.value("StudentClass").toString();
-            student.Age = record.value("StudentAge").toInt();
-            student.PhoneNumber = record.value("StudentPhoneNumber").toString();
-            student.DormitoryArea = record.value("DormitoryArea").toString();
-            student.DormitoryNum = record.value("DormitoryNum").toString();
-
-            QString chosenLessonsJson = record.value("ChosenLessons").toString();
-            QJsonParseError jsonError;
-            QJsonDocument doc = QJsonDocument::fromJson(chosenLessonsJson.toUtf8(), &jsonError);
-            QJsonArray array = doc.array();
-            for (auto &&i: array) {
-                student.ChosenLessons.append(i.toString());
-            }
+            EntitySql::readRow(query, student, fields);
             students.append(student);
         }
         return Success;
     }
 
     int database::getStudentCount() {
-        QSqlQuery query;
+        QSqlQuery query(db);
         query.prepare("SELECT COUNT(*) FROM student_information");
-        if (!query.exec() || !query.next()) {
+        if (!exec(query) || !query.next()) {
             qDebug() << "Debug | database.cpp: getStudentCount error:" << query.lastError();
             return -1;
         }
@@ -972,9 +1369,9 @@ namespace Database {
     }
 
     int database::getLessonCount() {
-        QSqlQuery query;
+        QSqlQuery query(db);
         query.prepare("SELECT COUNT(*) FROM lesson_information");
-        if (!query.exec() || !query.next()) {
+        if (!exec(query) || !query.next()) {
             qDebug() << "Debug | database.cpp: getLessonCount error:" << query.lastError();
             return -1;
         }
@@ -982,9 +1379,9 @@ namespace Database {
     }
 
     int database::getTeacherCount() {
-        QSqlQuery query;
+        QSqlQuery query(db);
         query.prepare("SELECT COUNT(*) FROM teacher_information");
-        if (!query.exec() || !query.next()) {
+        if (!exec(query) || !query.next()) {
             qDebug() << "Debug | database.cpp: getTeacherCount error:" << query.lastError();
             return -1;
         }
@@ -992,116 +1389,73 @@ namespace Database {
     }
 
     int database::getAuthCount() {
-        QSqlQuery query;
+        QSqlQuery query(db);
         query.prepare("SELECT COUNT(*) FROM auth");
-        if (!query.exec() || !query.next()) {
+        if (!exec(query) || !query.next()) {
             qDebug() << "Debug | database.cpp: getAuthCount error:" << query.lastError();
             return -1;
         }
         return query.value(0).toInt();
     }
 
-    Status database::listLessons(QVector<Lesson> &lessons, int maximum, int pageNum) {
-        QSqlQuery query;
-        query.prepare("SELECT * FROM lesson_information LIMIT :maximum OFFSET :offset");
+    Status database::listLessons(QVector<Lesson> &lessons, int maximum, int pageNum, Entity::FieldMask fields) {
+        QSqlQuery query(db);
+        query.prepare(EntitySql::selectFrom<Lesson>(fields) + " LIMIT :maximum OFFSET :offset");
         query.bindValue(":maximum", maximum);
         query.bindValue(":offset", maximum * (pageNum - 1));
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: listLessons error:" << query.lastError();
             return ERROR;
         }
         while (query.next()) {
-            QSqlRecord record = query.record();
             Lesson lesson;
-            lesson.Id = record.value("LessonId").toString();
-            lesson.LessonName = record.value("LessonName").toString();
-            lesson.TeacherId = record.value("TeacherId").toString();
-            lesson.LessonCredits = record.value("LessonCredits").toInt();
-            lesson.LessonSemester = record.value("LessonSemester").toString();
-            lesson.LessonArea = record.value("LessonArea").toString();
-
-            QString lessonTimeAndLocationsJson = record.value("LessonTimeAndLocations").toString();
-            QJsonParseError jsonError;
-            QJsonDocument doc = QJsonDocument::fromJson(lessonTimeAndLocationsJson.toUtf8(), &jsonError);
-            QJsonObject obj = doc.object();
-            QMap<QString, QVector<QString>> timeAndLocationsMap;
-            for (auto it = obj.begin(); it != obj.end(); ++it) {
-                QJsonArray timeAndLocationArray = it.value().toArray();
-                QVector<QString> timeAndLocation;
-                for (auto &&i: timeAndLocationArray) {
-                    timeAndLocation.append(i.toString());
-                }
-                timeAndLocationsMap.insert(it.key(), timeAndLocation);
-            }
-            lesson.LessonTimeAndLocations = timeAndLocationsMap;
-
-            QString lessonStudentsJson = record.value("LessonStudents").toString();
-            doc = QJsonDocument::fromJson(lessonStudentsJson.toUtf8(), &jsonError);
-            QJsonArray array = doc.array();
-            for (auto &&i: array) {
-                lesson.LessonStudents.append(i.toString());
-            }
+            EntitySql::readRow(query, lesson, fields);
             lessons.append(lesson);
         }
         return Success;
     }
 
-    Status database::listTeachers(QVector<Teacher> &teachers, int maximum, int pageNum) {
-        QSqlQuery query;
-        query.prepare("SELECT * FROM teacher_information LIMIT :maximum OFFSET :offset");
+    Status database::listTeachers(QVector<Teacher> &teachers, int maximum, int pageNum, Entity::FieldMask fields) {
+        QSqlQuery query(db);
+        query.prepare(EntitySql::selectFrom<Teacher>(fields) + " LIMIT :maximum OFFSET :offset");
         query.bindValue(":maximum", maximum);
         query.bindValue(":offset", maximum * (pageNum - 1));
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: listTeachers error:" << query.lastError();
             return ERROR;
         }
         while (query.next()) {
-            QSqlRecord record = query.record();
             Teacher teacher;
-            teacher.Id = record.value("TeacherId").toString();
-            teacher.Name = record.value("TeacherName").toString();
-            teacher.Unit = record.value("TeacherUnit").toString();
-
-            QString teachingLessonsJson = record.value("TeachingLessons").toString();
-            QJsonParseError jsonError;
-            QJsonDocument doc = QJsonDocument::fromJson(teachingLessonsJson.toUtf8(), &jsonError);
-            QJsonArray array = doc.array();
-            for (auto &&i: array) {
-                teacher.TeachingLessons.append(i.toString());
-            }
+            EntitySql::readRow(query, teacher, fields);
             teachers.append(teacher);
         }
         return Success;
     }
 
     Status database::listAuths(QVector<Auth> &auths, int maximum, int pageNum) {
-        QSqlQuery query;
-        query.prepare("SELECT * FROM auth LIMIT :maximum OFFSET :offset");
+        QSqlQuery query(db);
+        query.prepare(EntitySql::selectFrom<Auth>() + " LIMIT :maximum OFFSET :offset");
         query.bindValue(":maximum", maximum);
         query.bindValue(":offset", maximum * (pageNum - 1));
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: listAuths error:" << query.lastError();
             return ERROR;
         }
         while (query.next()) {
-            QSqlRecord record = query.record();
             Auth auth;
-            auth.Account = record.value("Account").toString();
-            auth.Secret = record.value("Secret").toString();
-            auth.AccountType = record.value("AccountType").toInt();
-            auth.IsSuper = record.value("IsSuper").toInt();
+            EntitySql::readRow(query, auth);
             auths.append(auth);
         }
         return Success;
     }
 
     Status database::createAccount(const Auth &auth) {
-        QSqlQuery query;
+        QSqlQuery query(db);
 
         // Check if the account already exists
         query.prepare("SELECT COUNT(*) FROM auth WHERE Account = :account");
         query.bindValue(":account", auth.Account);
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: createAccount error:" << query.lastError();
             return ERROR;
         }
@@ -1116,7 +1470,7 @@ namespace Database {
         query.bindValue(":secret", auth.Secret);
         query.bindValue(":accountType", auth.AccountType);
         query.bindValue(":isSuper", auth.IsSuper);
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: createAccount error:" << query.lastError();
             return ERROR;
         }
@@ -1124,7 +1478,7 @@ namespace Database {
     }
 
     Status database::updateAccount(const Auth &auth) {
-        QSqlQuery query;
+        QSqlQuery query(db);
         QString updateStatement = "UPDATE auth SET ";
         if (!auth.Secret.isEmpty()) {
             updateStatement += "Secret = :secret, ";
@@ -1149,67 +1503,56 @@ namespace Database {
         if (auth.IsSuper != -1) {
             query.bindValue(":isSuper", auth.IsSuper);
         }
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: updateAccount error:" << query.lastError();
             return ERROR;
         }
         return Success;
     }
 
-    Status database::deleteAccount(const QString &account) {
-        QSqlQuery query;
-        query.prepare("DELETE FROM auth WHERE Account = :account");
+    Status database::migrateSecret(const QString &account, const QString &oldSecret, const QString &newSecret) {
+        QSqlQuery query(db);
+        query.prepare("UPDATE auth SET Secret = :newSecret WHERE Account = :account AND Secret = :oldSecret");
+        query.bindValue(":newSecret", newSecret);
         query.bindValue(":account", account);
-        if (!query.exec()) {
-            qDebug() << "Debug | database.cpp: deleteAccount error:" << query.lastError();
+        query.bindValue(":oldSecret", oldSecret);
+        if (!exec(query)) {
+            qDebug() << "Debug | database.cpp: migrateSecret error:" << query.lastError();
             return ERROR;
         }
         return Success;
     }
 
-    Status database::getAccount(const QString &account, Auth &auth) {
-        QSqlQuery query;
-        query.prepare("SELECT * FROM auth WHERE Account = :account");
+    Status database::deleteAccount(const QString &account) {
+        QSqlQuery query(db);
+        query.prepare("DELETE FROM auth WHERE Account = :account");
         query.bindValue(":account", account);
-        if (!query.exec()) {
-            qDebug() << "Debug | database.cpp: getAccount error:" << query.lastError();
+        if (!exec(query)) {
+            qDebug() << "Debug | database.cpp: deleteAccount error:" << query.lastError();
             return ERROR;
         }
-        if (!query.next()) {
-            return NOT_FOUND;
-        }
-        QSqlRecord record = query.record();
-        auth.Account = record.value("Account").toString();
-        auth.Secret = record.value("Secret").toString();
-        auth.AccountType = record.value("AccountType").toInt();
-        auth.IsSuper = record.value("IsSuper").toInt();
         return Success;
     }
 
-    Status database::verifyAccount(const QString &account, const QString &secret, Auth &auth) {
-        QSqlQuery query;
-        query.prepare("SELECT * FROM auth WHERE Account = :account");
+    Status database::getAccount(const QString &account, Auth &auth) {
+        QSqlQuery query(db);
+        query.prepare(EntitySql::selectFrom<Auth>() + " WHERE Account = :account");
         query.bindValue(":account", account);
-        if (!query.exec()) {
+        if (!exec(query)) {
+            qDebug() << "Debug | database.cpp: getAccount error:" << query.lastError();
             return ERROR;
         }
         if (!query.next()) {
             return NOT_FOUND;
         }
-        QSqlRecord record = query.record();
-        if (record.value("Secret").toString() != secret) {
-            return INVALID;
-        }
-        auth.Account = record.value("Account").toString();
-        auth.AccountType = record.value("AccountType").toInt();
-        auth.IsSuper = record.value("IsSuper").toInt();
+        EntitySql::readRow(query, auth);
         return Success;
     }
 
     Status database::listClass(QVector<QString> &classes) {
-        QSqlQuery query;
+        QSqlQuery query(db);
         query.prepare("SELECT DISTINCT StudentClass FROM student_information");
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: listClass error:" << query.lastError();
             return ERROR;
         }
@@ -1220,9 +1563,9 @@ namespace Database {
     }
 
     Status database::listCollege(QVector<QString> &colleges) {
-        QSqlQuery query;
+        QSqlQuery query(db);
         query.prepare("SELECT DISTINCT StudentCollege FROM student_information");
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: listCollege error:" << query.lastError();
             return ERROR;
         }
@@ -1233,9 +1576,9 @@ namespace Database {
     }
 
     Status database::listMajor(QVector<QString> &majors) {
-        QSqlQuery query;
+        QSqlQuery query(db);
         query.prepare("SELECT DISTINCT StudentMajor FROM student_information");
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: listMajor error:" << query.lastError();
             return ERROR;
         }
@@ -1246,9 +1589,9 @@ namespace Database {
     }
 
     Status database::listLessonArea(QVector<QString> &areas) {
-        QSqlQuery query;
+        QSqlQuery query(db);
         query.prepare("SELECT DISTINCT LessonArea FROM lesson_information");
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: listLessonArea error:" << query.lastError();
             return ERROR;
         }
@@ -1259,9 +1602,9 @@ namespace Database {
     }
 
     Status database::listLessonSemester(QVector<QString> &semesters) {
-        QSqlQuery query;
+        QSqlQuery query(db);
         query.prepare("SELECT DISTINCT LessonSemester FROM lesson_information");
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: listLessonSemester error:" << query.lastError();
             return ERROR;
         }
@@ -1271,73 +1614,44 @@ namespace Database {
         return Success;
     }
 
-    Status database::getStudentLessonGrade(const QString &studentId, const QString &lessonId, Grade &grade) {
+    Status database::getStudentLessonGrade(const QString &studentId, const QString &lessonId, Grade &grade,
+                                            Entity::FieldMask fields) {
         // 检查课程是否存在
-        QSqlQuery lessonQuery;
+        QSqlQuery lessonQuery(db);
         lessonQuery.prepare("SELECT COUNT(*) FROM lesson_information WHERE LessonId = :lessonId");
         lessonQuery.bindValue(":lessonId", lessonId);
-        if (!lessonQuery.exec() || !lessonQuery.next() || lessonQuery.value(0).toInt() == 0) {
+        if (!exec(lessonQuery) || !lessonQuery.next() || lessonQuery.value(0).toInt() == 0) {
             qDebug() << "Debug | database.cpp: getStudentLessonGrade error: Lesson not found";
             return LESSON_NOT_FOUND;
         }
 
         // 检查学生是否存在
-        QSqlQuery studentQuery;
+        QSqlQuery studentQuery(db);
         studentQuery.prepare("SELECT COUNT(*) FROM student_information WHERE StudentId = :studentId");
         studentQuery.bindValue(":studentId", studentId);
-        if (!studentQuery.exec() || !studentQuery.next() || studentQuery.value(0).toInt() == 0) {
+        if (!exec(studentQuery) || !studentQuery.next() || studentQuery.value(0).toInt() == 0) {
             qDebug() << "Debug | database.cpp: getStudentLessonGrade error: Student not found";
             return STUDENT_NOT_FOUND;
         }
 
         // 查询学生的课程成绩
-        QSqlQuery query;
-        query.prepare("SELECT * FROM lesson_" + lessonId + " WHERE StudentId = :studentId");
+        QSqlQuery query(db);
+        query.prepare(EntitySql::selectFrom<Grade>("lesson_" + lessonId, fields) + " WHERE StudentId = :studentId");
         query.bindValue(":studentId", studentId);
-        if (!query.exec() || !query.next()) {
+        if (!exec(query) || !query.next()) {
             qDebug() << "Debug | database.cpp: getStudentLessonGrade error:" << query.lastError();
             return ERROR;
         }
-        QSqlRecord record = query.record();
-        grade.StudentId = record.value("StudentId").toString();
-        if (record.value("ExamGrade").toString().isEmpty()) {
-            grade.ExamGrade = -1;
-        } else {
-            grade.ExamGrade = record.value("ExamGrade").toDouble();
-        }
-        if (record.value("RegularGrade").toString().isEmpty()) {
-            grade.RegularGrade = -1;
-        } else {
-            grade.RegularGrade = record.value("RegularGrade").toDouble();
-        }
-        if (record.value("TotalGrade").toString().isEmpty()) {
-            grade.TotalGrade = -1;
-        } else {
-            grade.TotalGrade = record.value("TotalGrade").toDouble();
-        }
-        grade.Retake = record.value("Retake").toInt();
-        QString retakeSemestersJson = record.value("RetakeSemesters").toString();
-        QJsonParseError jsonError;
-        QJsonDocument doc = QJsonDocument::fromJson(retakeSemestersJson.toUtf8(), &jsonError);
-        QJsonArray array = doc.array();
-        for (auto &&i: array) {
-            grade.RetakeSemesters.append(i.toString());
-        }
-        QString retakeLessonIdJson = record.value("RetakeLessonId").toString();
-        doc = QJsonDocument::fromJson(retakeLessonIdJson.toUtf8(), &jsonError);
-        array = doc.array();
-        // grade.RetakeLessonId 是 QVector<QString> 类型
-        for (auto &&id: array) {
-            grade.RetakeLessonId.append(id.toString());
-        }
+        EntitySql::readRow(query, grade, fields);
+        grade.LessonId = lessonId;
         return Success;
     }
 
     Status database::listLessonClasses(const QString &lessonId, QVector<QString> &classes) {
-        QSqlQuery query;
+        QSqlQuery query(db);
         query.prepare("SELECT LessonStudents FROM lesson_information WHERE LessonId = :lessonId");
         query.bindValue(":lessonId", lessonId);
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: listLessonClasses error:" << query.lastError();
             return ERROR;
         }
@@ -1353,7 +1667,7 @@ namespace Database {
         for (auto &&i: array) {
             query.prepare("SELECT StudentClass FROM student_information WHERE StudentId = :studentId");
             query.bindValue(":studentId", i.toString());
-            if (!query.exec() || !query.next()) {
+            if (!exec(query) || !query.next()) {
                 qDebug() << "Debug | database.cpp: listLessonClasses error:" << query.lastError();
                 return ERROR;
             }
@@ -1367,26 +1681,28 @@ namespace Database {
 
     Status database::updateStudentLessonGrade(const Grade &grade) {
         // 检查课程是否存在
-        QSqlQuery lessonQuery;
+        QSqlQuery lessonQuery(db);
         lessonQuery.prepare("SELECT COUNT(*) FROM lesson_information WHERE LessonId = :lessonId");
         lessonQuery.bindValue(":lessonId", grade.LessonId);
-        if (!lessonQuery.exec() || !lessonQuery.next() || lessonQuery.value(0).toInt() == 0) {
+        if (!exec(lessonQuery) || !lessonQuery.next() || lessonQuery.value(0).toInt() == 0) {
             qDebug() << "Debug | database.cpp: updateStudentLessonGrade error: Lesson not found";
             return LESSON_NOT_FOUND;
         }
 
         // 检查学生是否存在
-        QSqlQuery studentQuery;
+        QSqlQuery studentQuery(db);
         studentQuery.prepare("SELECT COUNT(*) FROM student_information WHERE StudentId = :studentId");
         studentQuery.bindValue(":studentId", grade.StudentId);
-        if (!studentQuery.exec() || !studentQuery.next() || studentQuery.value(0).toInt() == 0) {
+        if (!exec(studentQuery) || !studentQuery.next() || studentQuery.value(0).toInt() == 0) {
             qDebug() << "Debug | database.cpp: updateStudentLessonGrade error: Student not found";
             return STUDENT_NOT_FOUND;
         }
 
         // 更新学生成绩
-        db.transaction();
-        QSqlQuery query;
+        if (!transaction()) {
+            return ERROR;
+        }
+        QSqlQuery query(db);
         QString updateStatement = "UPDATE lesson_" + grade.LessonId + " SET ";
         if (grade.ExamGrade != -1) {
             updateStatement += "ExamGrade = :examGrade, ";
@@ -1423,25 +1739,39 @@ namespace Database {
             }
         }
         query.bindValue(":studentId", grade.StudentId);
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: updateStudentLessonGrade error:" << query.lastError();
-            db.rollback();
+            rollback();
+            return ERROR;
+        }
+        if (logChange(ENTITY_GRADE, EntityVersion::gradeId(grade.StudentId, grade.LessonId),
+                      EntityVersion::registry::instance().next()) != Success) {
+            rollback();
+            return ERROR;
+        }
+        if (!commit()) {
+            rollback();
             return ERROR;
         }
-        db.commit();
         return Success;
     }
 
     //同时还要在相应课程表中插入学生信息
     Status database::addChosenLesson(const QString &studentId, const QString &lessonId) {
-        QSqlQuery query;
+        // 余量和重复选课的检查与写入在同一个事务中，并发选课不会超过课程容量
+        if (!transaction()) {
+            return ERROR;
+        }
+        QSqlQuery query(db);
         query.prepare("SELECT ChosenLessons FROM student_information WHERE StudentId = :studentId");
         query.bindValue(":studentId", studentId);
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: addChosenLesson error:" << query.lastError();
+            rollback();
             return ERROR;
         }
         if (!query.next()) {
+            rollback();
             return STUDENT_NOT_FOUND;
         }
         QString chosenLessonsJson = query.value("ChosenLessons").toString();
@@ -1453,30 +1783,47 @@ namespace Database {
         for (const auto &existingLessonId: array) {
             if (existingLessonId.toString() == lessonId) {
                 // If the lesson already exists, return Success
+                rollback();
                 return Success;
             }
         }
 
+        // 检查课程是否还有余量
+        int capacity = 0;
+        int enrolled = 0;
+        Status status = getLessonSeat(lessonId, capacity, enrolled);
+        if (status != Success) {
+            rollback();
+            return status;
+        }
+        if (capacity > 0 && enrolled >= capacity) {
+            rollback();
+            return LESSON_FULL;
+        }
+
         // If the lesson does not exist, add it
         array.append(lessonId);
         QJsonDocument newDoc(array);
         QString newChosenLessonsJson(newDoc.toJson(QJsonDocument::Compact));
-        db.transaction();
         query.prepare("UPDATE student_information SET ChosenLessons = :chosenLessons WHERE StudentId = :studentId");
         query.bindValue(":chosenLessons", newChosenLessonsJson);
         query.bindValue(":studentId", studentId);
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: addChosenLesson error:" << query.lastError();
-            db.rollback();
+            rollback();
+            return ERROR;
+        }
+        if (bumpVersion(ENTITY_STUDENT, studentId) != Success) {
+            rollback();
             return ERROR;
         }
 
         // 在相应lesson_id表中插入学生信息
         query.prepare("SELECT LessonStudents FROM lesson_information WHERE LessonId = :lessonId");
         query.bindValue(":lessonId", lessonId);
-        if (!query.exec() || !query.next()) {
+        if (!exec(query) || !query.next()) {
             qDebug() << "Debug | database.cpp: addChosenLesson error:" << query.lastError();
-            db.rollback();
+            rollback();
             return ERROR;
         }
         QString lessonStudentsJson = query.value("LessonStudents").toString();
@@ -1488,29 +1835,36 @@ namespace Database {
         query.prepare("UPDATE lesson_information SET LessonStudents = :lessonStudents WHERE LessonId = :lessonId");
         query.bindValue(":lessonStudents", newLessonStudentsJson);
         query.bindValue(":lessonId", lessonId);
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: addChosenLesson error:" << query.lastError();
-            db.rollback();
+            rollback();
+            return ERROR;
+        }
+        if (bumpVersion(ENTITY_LESSON, lessonId) != Success) {
+            rollback();
             return ERROR;
         }
 
         // 在相应lesson_id表中插入学生成绩信息
         query.prepare("INSERT INTO lesson_" + lessonId + " (StudentId) VALUES (:studentId)");
         query.bindValue(":studentId", studentId);
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: addChosenLesson error:" << query.lastError();
-            db.rollback();
+            rollback();
+            return ERROR;
+        }
+        if (!commit()) {
+            rollback();
             return ERROR;
         }
-        db.commit();
         return Success;
     }
 
     Status database::checkIsSUPER(const QString &account, bool &isSuper) {
-        QSqlQuery query;
+        QSqlQuery query(db);
         query.prepare("SELECT IsSuper FROM auth WHERE Account = :account");
         query.bindValue(":account", account);
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: checkIsSUPER error:" << query.lastError();
             return ERROR;
         }
@@ -1522,8 +1876,10 @@ namespace Database {
     }
 
     Status database::updateLessonChosenStudent(const Lesson &lesson) {
-        QSqlQuery query;
-        db.transaction();
+        QSqlQuery query(db);
+        if (!transaction()) {
+            return ERROR;
+        }
         QString lessonStudentsJson;
         QJsonParseError jsonError;
         QJsonDocument doc;
@@ -1536,31 +1892,40 @@ namespace Database {
         query.prepare("UPDATE lesson_information SET LessonStudents = :lessonStudents WHERE LessonId = :lessonId");
         query.bindValue(":lessonStudents", lessonStudentsJson);
         query.bindValue(":lessonId", lesson.Id);
-        if (!query.exec()) {
+        if (!exec(query)) {
             qDebug() << "Debug | database.cpp: updateLessonChosenStudent error:" << query.lastError();
-            db.rollback();
+            rollback();
+            return ERROR;
+        }
+        if (bumpVersion(ENTITY_LESSON, lesson.Id) != Success) {
+            rollback();
             return ERROR;
         }
         for (auto &&i: lesson.LessonStudents) {
             Status status = addChosenLesson(i, lesson.Id);
             if (status != Success) {
-                db.rollback();
+                rollback();
                 return status;
             }
         }
-        db.commit();
+        if (!commit()) {
+            rollback();
+            return ERROR;
+        }
         return Success;
     }
 
     Status database::addRetake(Lesson &toRetakeLesson, Lesson &needRetakeLesson, const QString &studentId) {
-        QSqlQuery query;
-        db.transaction();
+        QSqlQuery query(db);
+        if (!transaction()) {
+            return ERROR;
+        }
 
         // 1. 将 needRetakeLesson lesson_id 表中 对应学生的 retake 字段设置为 1
         query.prepare("UPDATE lesson_" + needRetakeLesson.Id + " SET Retake = 1 WHERE StudentId = :studentId");
         query.bindValue(":studentId", studentId);
-        if (!query.exec()) {
-            db.rollback();
+        if (!exec(query)) {
+            rollback();
             return ERROR;
         }
 
@@ -1569,8 +1934,8 @@ namespace Database {
                       " SET RetakeLessonId = array_append(RetakeLessonId, :toRetakeLessonId) WHERE StudentId = :studentId");
         query.bindValue(":toRetakeLessonId", toRetakeLesson.Id);
         query.bindValue(":studentId", studentId);
-        if (!query.exec()) {
-            db.rollback();
+        if (!exec(query)) {
+            rollback();
             return ERROR;
         }
 
@@ -1579,23 +1944,409 @@ namespace Database {
                       " SET RetakeSemesters = array_append(RetakeSemesters, :toRetakeLessonSemester) WHERE StudentId = :studentId");
         query.bindValue(":toRetakeLessonSemester", toRetakeLesson.LessonSemester);
         query.bindValue(":studentId", studentId);
-        if (!query.exec()) {
-            db.rollback();
+        if (!exec(query)) {
+            rollback();
             return ERROR;
         }
 
         // 4. 将 toRetakeLesson lesson_id 表中 对应学生的 retake 字段设置为 2
         query.prepare("UPDATE lesson_" + toRetakeLesson.Id + " SET Retake = 2 WHERE StudentId = :studentId");
         query.bindValue(":studentId", studentId);
-        if (!query.exec()) {
-            db.rollback();
+        if (!exec(query)) {
+            rollback();
+            return ERROR;
+        }
+
+        for (const auto &lessonId: {needRetakeLesson.Id, toRetakeLesson.Id}) {
+            if (logChange(ENTITY_GRADE, EntityVersion::gradeId(studentId, lessonId),
+                          EntityVersion::registry::instance().next()) != Success) {
+                rollback();
+                return ERROR;
+            }
+        }
+
+        if (!commit()) {
+            rollback();
+            return ERROR;
+        }
+        return Success;
+    }
+
+    Status database::getLessonSeat(const QString &lessonId, int &capacity, int &enrolled) {
+        QSqlQuery query(db);
+        query.prepare("SELECT LessonCapacity, LessonStudents FROM lesson_information WHERE LessonId = :lessonId");
+        query.bindValue(":lessonId", lessonId);
+        if (!exec(query)) {
+            qDebug() << "Debug | database.cpp: getLessonSeat error:" << query.lastError();
+            return ERROR;
+        }
+        if (!query.next()) {
+            return LESSON_NOT_FOUND;
+        }
+        capacity = query.value("LessonCapacity").toInt();
+        QString lessonStudentsJson = query.value("LessonStudents").toString();
+        QJsonParseError jsonError;
+        QJsonDocument doc = QJsonDocument::fromJson(lessonStudentsJson.toUtf8(), &jsonError);
+        enrolled = int(doc.array().size());
+        return Success;
+    }
+
+    Status database::checkChooseLesson(const QString &studentId, const QString &lessonId) {
+        Lesson lesson;
+        if (getLessonById(lessonId, lesson) != Success) {
+            return LESSON_NOT_FOUND;
+        }
+        Student student;
+        if (getStudentById(studentId, student) != Success) {
+            return STUDENT_NOT_FOUND;
+        }
+        if (student.ChosenLessons.contains(lessonId)) {
+            return DUPLICATE;
+        }
+
+        // 检查同一学期内的上课时间冲突与学分上限
+        QVector<Timetable::TimeSlot> lessonSlots = Timetable::parseTimeAndLocations(lesson.LessonTimeAndLocations);
+        int credits = lesson.LessonCredits;
+        for (const auto &chosenLessonId: student.ChosenLessons) {
+            Lesson chosenLesson;
+            if (getLessonById(chosenLessonId, chosenLesson) != Success) {
+                continue;
+            }
+            if (chosenLesson.LessonSemester != lesson.LessonSemester) {
+                continue;
+            }
+            if (Timetable::isConflict(lessonSlots,
+                                      Timetable::parseTimeAndLocations(chosenLesson.LessonTimeAndLocations))) {
+                return TIME_CONFLICT;
+            }
+            credits += chosenLesson.LessonCredits;
+        }
+        if (credits > MAX_SEMESTER_CREDITS) {
+            return CREDIT_EXCEEDED;
+        }
+        return Success;
+    }
+
+    Status database::addWaitlist(const QString &studentId, const QString &lessonId) {
+        QSqlQuery query(db);
+        query.prepare("SELECT COUNT(*) FROM lesson_information WHERE LessonId = :lessonId");
+        query.bindValue(":lessonId", lessonId);
+        if (!exec(query) || !query.next()) {
+            qDebug() << "Debug | database.cpp: addWaitlist error:" << query.lastError();
+            return ERROR;
+        }
+        if (query.value(0).toInt() == 0) {
+            return LESSON_NOT_FOUND;
+        }
+        query.prepare("SELECT COUNT(*) FROM student_information WHERE StudentId = :studentId");
+        query.bindValue(":studentId", studentId);
+        if (!exec(query) || !query.next()) {
+            qDebug() << "Debug | database.cpp: addWaitlist error:" << query.lastError();
+            return ERROR;
+        }
+        if (query.value(0).toInt() == 0) {
+            return STUDENT_NOT_FOUND;
+        }
+
+        // 已在候补队列中则保持原有位置
+        query.prepare("INSERT OR IGNORE INTO lesson_waitlist (LessonId, StudentId, EnqueueTime) "
+                      "VALUES (:lessonId, :studentId, :enqueueTime)");
+        query.bindValue(":lessonId", lessonId);
+        query.bindValue(":studentId", studentId);
+        query.bindValue(":enqueueTime", QDateTime::currentMSecsSinceEpoch());
+        if (!exec(query)) {
+            qDebug() << "Debug | database.cpp: addWaitlist error:" << query.lastError();
+            return ERROR;
+        }
+        return Success;
+    }
+
+    Status database::deleteWaitlist(const QString &studentId, const QString &lessonId) {
+        QSqlQuery query(db);
+        query.prepare("DELETE FROM lesson_waitlist WHERE LessonId = :lessonId AND StudentId = :studentId");
+        query.bindValue(":lessonId", lessonId);
+        query.bindValue(":studentId", studentId);
+        if (!exec(query)) {
+            qDebug() << "Debug | database.cpp: deleteWaitlist error:" << query.lastError();
+            return ERROR;
+        }
+        if (query.numRowsAffected() == 0) {
+            return NOT_FOUND;
+        }
+        return Success;
+    }
+
+    Status database::listWaitlist(const QString &lessonId, QVector<WaitlistEntry> &entries, int maximum) {
+        QSqlQuery query(db);
+        query.prepare("SELECT LessonId, StudentId, EnqueueTime FROM lesson_waitlist "
+                      "WHERE LessonId = :lessonId ORDER BY Seq LIMIT :maximum");
+        query.bindValue(":lessonId", lessonId);
+        query.bindValue(":maximum", maximum);
+        if (!exec(query)) {
+            qDebug() << "Debug | database.cpp: listWaitlist error:" << query.lastError();
+            return ERROR;
+        }
+        while (query.next()) {
+            WaitlistEntry entry;
+            entry.LessonId = query.value(0).toString();
+            entry.StudentId = query.value(1).toString();
+            entry.EnqueueTime = query.value(2).toLongLong();
+            entries.append(entry);
+        }
+        return Success;
+    }
+
+    Status database::listWaitlistLessons(QVector<QString> &lessonIds) {
+        QSqlQuery query(db);
+        query.prepare("SELECT DISTINCT LessonId FROM lesson_waitlist");
+        if (!exec(query)) {
+            qDebug() << "Debug | database.cpp: listWaitlistLessons error:" << query.lastError();
+            return ERROR;
+        }
+        while (query.next()) {
+            lessonIds.append(query.value(0).toString());
+        }
+        return Success;
+    }
+
+    int database::getWaitlistCount() {
+        QSqlQuery query(db);
+        query.prepare("SELECT COUNT(*) FROM lesson_waitlist");
+        if (!exec(query) || !query.next()) {
+            qDebug() << "Debug | database.cpp: getWaitlistCount error:" << query.lastError();
+            return -1;
+        }
+        return query.value(0).toInt();
+    }
+    Status database::updatePreferences(const QString &studentId, const QVector<QString> &lessonIds) {
+        QSqlQuery query(db);
+        query.prepare("SELECT COUNT(*) FROM student_information WHERE StudentId = :studentId");
+        query.bindValue(":studentId", studentId);
+        if (!exec(query) || !query.next()) {
+            qDebug() << "Debug | database.cpp: updatePreferences error:" << query.lastError();
+            return ERROR;
+        }
+        if (query.value(0).toInt() == 0) {
+            return STUDENT_NOT_FOUND;
+        }
+
+        if (!transaction()) {
+            return ERROR;
+        }
+        // 重新提交志愿时覆盖之前的全部志愿
+        query.prepare("DELETE FROM lesson_preference WHERE StudentId = :studentId");
+        query.bindValue(":studentId", studentId);
+        if (!exec(query)) {
+            qDebug() << "Debug | database.cpp: updatePreferences error:" << query.lastError();
+            rollback();
+            return ERROR;
+        }
+
+        QSqlQuery lessonQuery(db);
+        lessonQuery.prepare("SELECT COUNT(*) FROM lesson_information WHERE LessonId = :lessonId");
+        query.prepare("INSERT OR IGNORE INTO lesson_preference (StudentId, LessonId, Rank) "
+                      "VALUES (:studentId, :lessonId, :rank)");
+        for (int i = 0; i < lessonIds.size(); i++) {
+            lessonQuery.bindValue(":lessonId", lessonIds[i]);
+            if (!exec(lessonQuery) || !lessonQuery.next()) {
+                qDebug() << "Debug | database.cpp: updatePreferences error:" << lessonQuery.lastError();
+                rollback();
+                return ERROR;
+            }
+            if (lessonQuery.value(0).toInt() == 0) {
+                rollback();
+                return LESSON_NOT_FOUND;
+            }
+            lessonQuery.finish();
+
+            query.bindValue(":studentId", studentId);
+            query.bindValue(":lessonId", lessonIds[i]);
+            query.bindValue(":rank", i);
+            if (!exec(query)) {
+                qDebug() << "Debug | database.cpp: updatePreferences error:" << query.lastError();
+                rollback();
+                return ERROR;
+            }
+        }
+        if (!commit()) {
+            rollback();
             return ERROR;
         }
+        return Success;
+    }
 
-        db.commit();
+    Status database::listPreferences(QMap<QString, QVector<QString>> &preferences) {
+        QSqlQuery query(db);
+        query.setForwardOnly(true);
+        query.prepare("SELECT StudentId, LessonId FROM lesson_preference ORDER BY StudentId, Rank");
+        if (!exec(query)) {
+            qDebug() << "Debug | database.cpp: listPreferences error:" << query.lastError();
+            return ERROR;
+        }
+        while (query.next()) {
+            preferences[query.value(0).toString()].append(query.value(1).toString());
+        }
         return Success;
     }
 
+    Status database::clearPreferences() {
+        QSqlQuery query(db);
+        if (!exec(query, "DELETE FROM lesson_preference")) {
+            qDebug() << "Debug | database.cpp: clearPreferences error:" << query.lastError();
+            return ERROR;
+        }
+        return Success;
+    }
+
+    Status database::listPreferenceChosenLessons(QMap<QString, QVector<QString>> &chosenLessons) {
+        QSqlQuery query(db);
+        query.setForwardOnly(true);
+        query.prepare("SELECT StudentId, ChosenLessons FROM student_information "
+                      "WHERE StudentId IN (SELECT DISTINCT StudentId FROM lesson_preference)");
+        if (!exec(query)) {
+            qDebug() << "Debug | database.cpp: listPreferenceChosenLessons error:" << query.lastError();
+            return ERROR;
+        }
+        while (query.next()) {
+            QVector<QString> &lessonIds = chosenLessons[query.value(0).toString()];
+            for (const auto &lessonId: QJsonDocument::fromJson(query.value(1).toString().toUtf8()).array()) {
+                lessonIds.append(lessonId.toString());
+            }
+        }
+        return Success;
+    }
+
+    Status database::addChosenLessons(const QVector<Enrollment> &enrollments, int chunkSize, int &added) {
+        // 批量选课：分批在写事务中执行，每批先重新读取本批涉及的学生和课程的选课列表，
+        // 在同一事务中检查课程余量后写回，期间其他连接的选课不会使课程超员；
+        // 已选或课程已满的记录跳过，每批提交后数据库中的学生与课程两侧保持一致
+        added = 0;
+
+        // 预编译的语句在各批之间复用
+        QSqlQuery studentSelect(db);
+        studentSelect.setForwardOnly(true);
+        studentSelect.prepare("SELECT ChosenLessons FROM student_information WHERE StudentId = :studentId");
+        QSqlQuery lessonSelect(db);
+        lessonSelect.setForwardOnly(true);
+        lessonSelect.prepare("SELECT LessonCapacity, LessonStudents FROM lesson_information WHERE LessonId = :lessonId");
+        QSqlQuery studentQuery(db);
+        studentQuery.prepare("UPDATE student_information SET ChosenLessons = :chosenLessons, Version = :version WHERE StudentId = :studentId");
+        QSqlQuery lessonQuery(db);
+        lessonQuery.prepare("UPDATE lesson_information SET LessonStudents = :lessonStudents, Version = :version WHERE LessonId = :lessonId");
+        EntityVersion::registry &registry = EntityVersion::registry::instance();
+        QMap<QString, QSqlQuery> gradeQueries;
+
+        for (qsizetype begin = 0; begin < enrollments.size(); begin += chunkSize) {
+            qsizetype end = qMin(begin + qsizetype(chunkSize), enrollments.size());
+            QMap<QString, QJsonArray> studentLessons;
+            QMap<QString, QJsonArray> lessonStudents;
+            QMap<QString, int> lessonCapacities;
+            QSet<QString> changedStudents;
+            QSet<QString> changedLessons;
+
+            if (!transaction()) {
+                return ERROR;
+            }
+            for (qsizetype i = begin; i < end; i++) {
+                const Enrollment &enrollment = enrollments[i];
+                if (!studentLessons.contains(enrollment.StudentId)) {
+                    studentSelect.bindValue(":studentId", enrollment.StudentId);
+                    if (!exec(studentSelect)) {
+                        qDebug() << "Debug | database.cpp: addChosenLessons error:" << studentSelect.lastError();
+                        rollback();
+                        return ERROR;
+                    }
+                    if (!studentSelect.next()) {
+                        rollback();
+                        return STUDENT_NOT_FOUND;
+                    }
+                    studentLessons.insert(enrollment.StudentId,
+                                          QJsonDocument::fromJson(studentSelect.value(0).toString().toUtf8()).array());
+                    studentSelect.finish();
+                }
+                if (!lessonStudents.contains(enrollment.LessonId)) {
+                    lessonSelect.bindValue(":lessonId", enrollment.LessonId);
+                    if (!exec(lessonSelect)) {
+                        qDebug() << "Debug | database.cpp: addChosenLessons error:" << lessonSelect.lastError();
+                        rollback();
+                        return ERROR;
+                    }
+                    if (!lessonSelect.next()) {
+                        rollback();
+                        return LESSON_NOT_FOUND;
+                    }
+                    lessonCapacities.insert(enrollment.LessonId, lessonSelect.value(0).toInt());
+                    lessonStudents.insert(enrollment.LessonId,
+                                          QJsonDocument::fromJson(lessonSelect.value(1).toString().toUtf8()).array());
+                    lessonSelect.finish();
+                }
+
+                QJsonArray &chosenLessons = studentLessons[enrollment.StudentId];
+                QJsonArray &students = lessonStudents[enrollment.LessonId];
+                int capacity = lessonCapacities.value(enrollment.LessonId);
+                if (chosenLessons.contains(enrollment.LessonId) || (capacity > 0 && students.size() >= capacity)) {
+                    continue;
+                }
+                chosenLessons.append(enrollment.LessonId);
+                students.append(enrollment.StudentId);
+                changedStudents.insert(enrollment.StudentId);
+                changedLessons.insert(enrollment.LessonId);
+
+                // 在相应lesson_id表中插入学生成绩信息
+                auto it = gradeQueries.find(enrollment.LessonId);
+                if (it == gradeQueries.end()) {
+                    QSqlQuery gradeQuery(db);
+                    gradeQuery.prepare("INSERT OR IGNORE INTO lesson_" + enrollment.LessonId + " (StudentId) VALUES (:studentId)");
+                    it = gradeQueries.insert(enrollment.LessonId, gradeQuery);
+                }
+                it->bindValue(":studentId", enrollment.StudentId);
+                if (!exec(*it)) {
+                    qDebug() << "Debug | database.cpp: addChosenLessons error:" << it->lastError();
+                    rollback();
+                    return ERROR;
+                }
+                added++;
+            }
+
+            for (const auto &studentId: changedStudents) {
+                studentQuery.bindValue(":chosenLessons", QString(QJsonDocument(studentLessons[studentId]).toJson(QJsonDocument::Compact)));
+                studentQuery.bindValue(":studentId", studentId);
+                qint64 version = registry.next();
+                studentQuery.bindValue(":version", version);
+                if (!exec(studentQuery)) {
+                    qDebug() << "Debug | database.cpp: addChosenLessons error:" << studentQuery.lastError();
+                    rollback();
+                    return ERROR;
+                }
+                publishVersion(ENTITY_STUDENT, studentId, version);
+                if (logChange(ENTITY_STUDENT, studentId, version) != Success) {
+                    rollback();
+                    return ERROR;
+                }
+            }
+            for (const auto &lessonId: changedLessons) {
+                lessonQuery.bindValue(":lessonStudents", QString(QJsonDocument(lessonStudents[lessonId]).toJson(QJsonDocument::Compact)));
+                lessonQuery.bindValue(":lessonId", lessonId);
+                qint64 version = registry.next();
+                lessonQuery.bindValue(":version", version);
+                if (!exec(lessonQuery)) {
+                    qDebug() << "Debug | database.cpp: addChosenLessons error:" << lessonQuery.lastError();
+                    rollback();
+                    return ERROR;
+                }
+                publishVersion(ENTITY_LESSON, lessonId, version);
+                if (logChange(ENTITY_LESSON, lessonId, version) != Success) {
+                    rollback();
+                    return ERROR;
+                }
+            }
+            if (!commit()) {
+                rollback();
+                return ERROR;
+            }
+        }
+        return Success;
+    }
 
 }// namespace Database
 #pragma clang diagnostic pop
\ No newline at end of file
@@ -1,8 +1,10 @@
 #ifndef DATABASE_H
 #define DATABASE_H
 
+#include "entity.h"
 #include <QString>
 #include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
 #include <QList>
 #include <QMap>
 
@@ -17,6 +19,9 @@ typedef int Status;
 #define TEACHER_NOT_FOUND 7
 #define STUDENT_NOT_FOUND 8
 #define LESSON_NOT_FOUND 9
+#define LESSON_FULL 10
+#define TIME_CONFLICT 11
+#define CREDIT_EXCEEDED 12
 
 #define TEACHER 0
 #define STUDENT 1
@@ -27,76 +32,54 @@ typedef int Status;
 #define RETAKE 1
 #define RETAKEN 2
 
-class Student {
-public:
-    QString Id; // 学生学号
-    QString Name; // 学生姓名
-    QString Sex; // 学生性别
-    QString College; // 学生所在学院
-    QString Major; // 学生专业
-    QString Class; // 学生班级
-    int Age; // 学生年龄
-    QString PhoneNumber; // 学生电话号码
-    QString DormitoryArea; // 学生所在宿舍区
-    QString DormitoryNum; // 学生宿舍号码
-    QVector<QString> ChosenLessons; // 学生已选课程编号
-};
+#define MAX_SEMESTER_CREDITS 32 // 每学期学分上限
+#define MAX_PREFERENCES 10 // 每名学生最多提交的选课志愿数
 
-class Lesson {
-public:
-    QString Id; // 课程编号
-    QString LessonName; // 课程名称
-    QString TeacherId; // 课程教师编号
-    int LessonCredits; // 课程学分
-    QString LessonSemester; // 课程学期
-    QString LessonArea; // 课程上课区域
-    QMap<QString, QVector<QString>> LessonTimeAndLocations; // 课程上课时间和地点
-    QVector<QString> LessonStudents; // 选课学生学号
-};
+#define SCHEMA_VERSION 1 // 表结构版本，修改迁移逻辑时递增；建表语句的变化由指纹自动识别
+#define SCHEMA_FINGERPRINT "fingerprint" // schema_meta 中记录当前表结构指纹的键
+#define SCHEMA_CHECKED "checked" // schema_meta 中记录已通过一致性检查的表结构指纹的键
+
+#define CHANGE_DELETED (-1) // 变更日志中表示记录已删除的版本号
+#define CHANGE_LOG_SIZE 100000 // 变更日志保留的最近记录数
+#define CHANGE_LOG_TRIM_INTERVAL 1000 // 每写入多少条变更清理一次旧记录
 
-class Teacher {
+class WaitlistEntry {
 public:
-    QString Id; // 教师编号
-    QString Name; // 教师姓名
-    QString Unit; // 教师单位
-    QVector<QString> TeachingLessons; // 教师教授课程编号
+    QString LessonId; // 课程编号
+    QString StudentId; // 学生学号
+    qint64 EnqueueTime; // 加入候补队列的时间（毫秒时间戳）
 };
 
-class Auth {
+class Change {
 public:
-    QString Account; // 用户账号
-    QString Secret; // 用户密钥
-    int AccountType; // 用户类型，0为教师，1为学生
-    int IsSuper; // 是否为超级用户，0为否，1为是
+    qint64 Seq; // 变更序号，单调递增
+    int Entity; // 实体类型，见 entityversion.h 中的 ENTITY_*
+    QString Id; // 实体编号，成绩为 学号/课程编号
+    qint64 Version; // 变更后的版本号，CHANGE_DELETED 表示已删除
 };
 
-class Grade {
+class Enrollment {
 public:
     QString StudentId; // 学生学号
     QString LessonId; // 课程编号
-    double ExamGrade; // 课程考试成绩
-    double RegularGrade; // 课程平时成绩
-    double TotalGrade; // 课程总成绩
-    int Retake; // 是否重修，0为否，1为该课程已重修，2为该课程是重修科目
-    QVector<QString> RetakeSemesters; // 重修学期
-    QVector<QString> RetakeLessonId; // 重修课程编号
 };
 
 namespace Database {
 
     class database {
     public:
-        explicit database(const QString &path);
+        explicit database(const QString &path,
+                          const QString &connectionName = QLatin1String(QSqlDatabase::defaultConnection));
 
-        Status getStudentById(const QString &id, Student &student);
+        Status getStudentById(const QString &id, Student &student, Entity::FieldMask fields = FIELD_MASK_ALL);
 
         Status updateStudent(const Student &student);
 
         Status updateLessonInformation(const Lesson &lesson);
 
-        Status getLessonById(const QString &id, Lesson &lesson);
+        Status getLessonById(const QString &id, Lesson &lesson, Entity::FieldMask fields = FIELD_MASK_ALL);
 
-        Status getTeacherById(const QString &id, Teacher &teacher);
+        Status getTeacherById(const QString &id, Teacher &teacher, Entity::FieldMask fields = FIELD_MASK_ALL);
 
         Status updateTeacher(const Teacher &teacher);
 
@@ -106,31 +89,39 @@ namespace Database {
 
         Status deleteStudent(const QString &id);
 
-        Status listStudents(QVector<Student> &students, int maximum, int pageNum);
+        Status listStudents(QVector<Student> &students, int maximum, int pageNum,
+                            Entity::FieldMask fields = FIELD_MASK_ALL);
 
         int getStudentCount();
 
-        Status listTeachers(QVector<Teacher> &teachers, int maximum, int pageNum);
+        Status listTeachers(QVector<Teacher> &teachers, int maximum, int pageNum,
+                            Entity::FieldMask fields = FIELD_MASK_ALL);
 
         int getTeacherCount();
 
         int getLessonCount();
 
-        Status listLessons(QVector<Lesson> &lessons, int maximum, int pageNum);
+        Status listLessons(QVector<Lesson> &lessons, int maximum, int pageNum,
+                           Entity::FieldMask fields = FIELD_MASK_ALL);
 
-        Status verifyAccount(const QString &account, const QString &secret, Auth &auth);
+        Status getAccount(const QString &account, Auth &auth);
 
         Status updateAccount(const Auth &auth);
 
+        // 仅当密钥仍为oldSecret时替换为newSecret，其间密钥已被修改时不覆盖
+        Status migrateSecret(const QString &account, const QString &oldSecret, const QString &newSecret);
+
         Status createAccount(const Auth &auth);
 
         Status deleteLesson(const QString &id);
 
         Status deleteTeacher(const QString &id);
 
-        Status getStudentByClass(const QString &studentClass, QVector<Student> &students);
+        Status getStudentByClass(const QString &studentClass, QVector<Student> &students,
+                                 Entity::FieldMask fields = FIELD_MASK_ALL);
 
-        Status getStudentLessonGrade(const QString &studentId, const QString &lessonId, Grade &grade);
+        Status getStudentLessonGrade(const QString &studentId, const QString &lessonId, Grade &grade,
+                                     Entity::FieldMask fields = FIELD_MASK_ALL);
 
         Status listLessonClasses(const QString &lessonId, QVector<QString> &classes);
 
@@ -146,19 +137,95 @@ namespace Database {
 
         Status addRetake(Lesson &toRetakeLesson, Lesson &needRetakeLesson, const QString &studentId);
 
+        Status getLessonSeat(const QString &lessonId, int &capacity, int &enrolled);
+
+        Status checkChooseLesson(const QString &studentId, const QString &lessonId);
+
+        Status addWaitlist(const QString &studentId, const QString &lessonId);
+
+        Status deleteWaitlist(const QString &studentId, const QString &lessonId);
+
+        Status listWaitlist(const QString &lessonId, QVector<WaitlistEntry> &entries, int maximum);
+
+        Status listWaitlistLessons(QVector<QString> &lessonIds);
+
+        int getWaitlistCount();
+
+        Status updatePreferences(const QString &studentId, const QVector<QString> &lessonIds);
+
+        Status listPreferences(QMap<QString, QVector<QString>> &preferences);
+
+        Status clearPreferences();
+
+        // 提交了志愿的学生当前已选的课程，一次查询读出
+        Status listPreferenceChosenLessons(QMap<QString, QVector<QString>> &chosenLessons);
+
+        // 分批选课，added为实际写入的记录数，已选或课程已满的记录被跳过
+        Status addChosenLessons(const QVector<Enrollment> &enrollments, int chunkSize, int &added);
+
+        // 返回序号大于since的最多maximum条变更；reset为true时客户端应清空缓存并从latest开始同步
+        Status listChanges(qint64 since, int maximum, QVector<Change> &changes, qint64 &latest, bool &reset);
+
+        // 可嵌套的事务：最外层为BEGIN IMMEDIATE/COMMIT，内层为保存点，批量请求把多个操作包在同一个事务中
+        bool transaction();
+
+        // 失败时本层事务仍然打开，调用者须再调用rollback()
+        bool commit();
+
+        bool rollback();
+
+        // 创建课程的成绩表 lesson_课程编号，批量导入数据（如 DataGen）时也使用
+        Status createTableIfNotExists(const QString &tableName);
+
+        // 全库一致性检查：补建缺失的成绩表，修正教师授课列表和学生选课列表；先只读地找出不一致，
+        // 再逐条在短写事务中重新确认后修正，可以在服务运行时后台执行
+        Status checkDatabase();
+
+        // 表结构新建或升级后还没有通过一致性检查，启动时据此决定是否在后台运行 checkDatabase
+        bool needsCheck();
+
+        // 记录当前表结构已通过一致性检查，批量导入的数据本身一致时（如 DataGen）也直接标记
+        Status markChecked();
+
     private:
+        // 事务中修改的版本号，等待最外层提交
+        class PendingVersion {
+        public:
+            int Entity;
+            QString Id;
+            qint64 Version;
+            bool Deleted; // 记录已删除，Version 为删除时分配的版本号
+        };
+
         QSqlDatabase db;
+        int transactionDepth = 0; // 当前事务的嵌套层数
+        QVector<PendingVersion> pendingVersions; // 最外层事务提交后写入版本号表
+        QVector<qsizetype> savepointVersions; // 每层事务开始时 pendingVersions 的长度，回滚到保存点时截断
+
+        // 执行语句并按语句类型记录耗时，所有查询都经过这里
+        bool exec(QSqlQuery &query);
+
+        bool exec(QSqlQuery &query, const QString &statement);
+
+        // 按语句类型和语句模板累计耗时，慢查询写入日志
+        void recordStatement(const QSqlQuery &query, const QString &statement, qint64 micros);
 
         Status initializeDatabase();
 
+        // 用 Version 列上的索引取各表的最大版本号，初始化版本计数器
+        void seedVersions();
+
+        // schema_meta 中的键值，表不存在或没有该键时返回空字符串
+        QString schemaMeta(const QString &key);
+
+        Status setSchemaMeta(const QString &key, const QString &value);
+
         bool ifTableExist(const QString &tableName);
 
-        Status createTableIfNotExists(const QString &tableName);
+        bool ifColumnExist(const QString &tableName, const QString &columnName);
 
         Status deleteTeachingLesson(const QString &teacherId, const QString &lessonId);
 
-        Status checkDatabase();
-
         int getAuthCount();
 
         Status ifTeacherExist(const QString &teacherId);
@@ -167,8 +234,6 @@ namespace Database {
 
         Status deleteAccount(const QString &account);
 
-        Status getAccount(const QString &account, Auth &auth);
-
         Status listClass(QVector<QString> &classes);
 
         Status listCollege(QVector<QString> &colleges);
@@ -179,6 +244,15 @@ namespace Database {
 
         Status listLessonSemester(QVector<QString> &semesters);
 
+        Status bumpVersion(int entity, const QString &id);
+
+        Status removeVersion(int entity, const QString &id);
+
+        // 写入进程内的版本号表；在事务中时暂存，最外层提交后写入，回滚时丢弃
+        void publishVersion(int entity, const QString &id, qint64 version, bool deleted = false);
+
+        Status logChange(int entity, const QString &id, qint64 version);
+
     };
 
 } // Database
@@ -0,0 +1,400 @@
+#ifndef ENTITY_H
+#define ENTITY_H
+
+#include <QCborStreamReader>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <tuple>
+
+#define FIELD_KEY 0x01 // 主键
+#define FIELD_JSON 0x02 // 数据库中以JSON文本保存的数组或对象
+#define FIELD_SEX 0x04 // 数据库中按国标代码保存的性别
+#define FIELD_NULLABLE 0x08 // 数据库中为空时取-1，如尚未录入的成绩
+#define FIELD_MANAGED 0x10 // 由选课、版本号等专门的操作维护，新增和修改记录时不写入
+#define FIELD_INTERNAL 0x20 // 只在服务器内部使用，不出现在接口中
+#define FIELD_HEAVY 0x40 // 体积随选课人数增长的数组，列表接口默认不返回，需要时通过 fields= 指定
+
+#define FIELD_MASK_ALL (~Entity::FieldMask(0)) // 选择全部字段
+
+class Student {
+public:
+    QString Id; // 学生学号
+    QString Name; // 学生姓名
+    QString Sex; // 学生性别
+    QString College; // 学生所在学院
+    QString Major; // 学生专业
+    QString Class; // 学生班级
+    int Age; // 学生年龄
+    QString PhoneNumber; // 学生电话号码
+    QString DormitoryArea; // 学生所在宿舍区
+    QString DormitoryNum; // 学生宿舍号码
+    QVector<QString> ChosenLessons; // 学生已选课程编号
+    qint64 Version = 0; // 数据版本号，每次修改后递增
+};
+
+class Lesson {
+public:
+    QString Id; // 课程编号
+    QString LessonName; // 课程名称
+    QString TeacherId; // 课程教师编号
+    int LessonCredits; // 课程学分
+    int LessonCapacity = -1; // 课程容量，0为不限，-1表示不修改
+    QString LessonSemester; // 课程学期
+    QString LessonArea; // 课程上课区域
+    QMap<QString, QVector<QString>> LessonTimeAndLocations; // 课程上课时间和地点
+    QVector<QString> LessonStudents; // 选课学生学号
+    int LessonStudentCount = 0; // 选课人数，由数据库根据选课学生计算
+    qint64 Version = 0; // 数据版本号，每次修改后递增
+};
+
+class Teacher {
+public:
+    QString Id; // 教师编号
+    QString Name; // 教师姓名
+    QString Unit; // 教师单位
+    QVector<QString> TeachingLessons; // 教师教授课程编号
+    qint64 Version = 0; // 数据版本号，每次修改后递增
+};
+
+class Auth {
+public:
+    QString Account; // 用户账号
+    QString Secret; // 用户密钥
+    int AccountType; // 用户类型，0为教师，1为学生
+    int IsSuper; // 是否为超级用户，0为否，1为是
+};
+
+class Grade {
+public:
+    QString StudentId; // 学生学号
+    QString LessonId; // 课程编号
+    double ExamGrade; // 课程考试成绩
+    double RegularGrade; // 课程平时成绩
+    double TotalGrade; // 课程总成绩
+    int Retake; // 是否重修，0为否，1为该课程已重修，2为该课程是重修科目
+    QVector<QString> RetakeSemesters; // 重修学期
+    QVector<QString> RetakeLessonId; // 重修课程编号
+};
+
+namespace Entity {
+
+    // 字段投影，第i位表示字段表中的第i个字段
+    typedef quint64 FieldMask;
+
+    // 描述实体的一个字段：接口中的名称、数据库中的列和对应的成员
+    template<typename Class, typename T>
+    class Field {
+    public:
+        const char *Name; // 接口中的字段名
+        const char *Column; // 数据库列名，nullptr表示数据库中没有对应的列
+        T Class::*Member; // 对应的成员
+        int Flags; // FIELD_* 的组合
+
+        constexpr bool has(int flag) const {
+            return (Flags & flag) != 0;
+        }
+    };
+
+    template<typename Class, typename T>
+    constexpr Field<Class, T> field(const char *name, const char *column, T Class::*member, int flags = 0) {
+        return Field<Class, T>{name, column, member, flags};
+    }
+
+    // 每个实体的字段表，字段顺序即数据库查询的列顺序和接口中的字段顺序
+    template<typename Class>
+    class descriptor;
+
+    template<>
+    class descriptor<Student> {
+    public:
+        static constexpr const char *Table = "student_information";
+        static constexpr auto Fields = std::make_tuple(
+                field("Id", "StudentId", &Student::Id, FIELD_KEY),
+                field("Name", "StudentName", &Student::Name),
+                field("Sex", "StudentSex", &Student::Sex, FIELD_SEX),
+                field("College", "StudentCollege", &Student::College),
+                field("Major", "StudentMajor", &Student::Major),
+                field("Class", "StudentClass", &Student::Class),
+                field("Age", "StudentAge", &Student::Age),
+                field("PhoneNumber", "StudentPhoneNumber", &Student::PhoneNumber),
+                field("DormitoryArea", "DormitoryArea", &Student::DormitoryArea),
+                field("DormitoryNum", "DormitoryNum", &Student::DormitoryNum),
+                field("ChosenLessons", "ChosenLessons", &Student::ChosenLessons, FIELD_JSON | FIELD_MANAGED),
+                field("Version", "Version", &Student::Version, FIELD_MANAGED | FIELD_INTERNAL));
+    };
+
+    template<>
+    class descriptor<Lesson> {
+    public:
+        static constexpr const char *Table = "lesson_information";
+        static constexpr auto Fields = std::make_tuple(
+                field("Id", "LessonId", &Lesson::Id, FIELD_KEY),
+                field("LessonName", "LessonName", &Lesson::LessonName),
+                field("TeacherId", "TeacherId", &Lesson::TeacherId),
+                field("LessonCredits", "LessonCredits", &Lesson::LessonCredits),
+                field("LessonCapacity", "LessonCapacity", &Lesson::LessonCapacity),
+                field("LessonSemester", "LessonSemester", &Lesson::LessonSemester),
+                field("LessonArea", "LessonArea", &Lesson::LessonArea),
+                field("LessonTimeAndLocations", "LessonTimeAndLocations", &Lesson::LessonTimeAndLocations, FIELD_JSON),
+                field("LessonStudents", "LessonStudents", &Lesson::LessonStudents, FIELD_JSON | FIELD_MANAGED | FIELD_HEAVY),
+                field("LessonStudentCount", "json_array_length(LessonStudents)", &Lesson::LessonStudentCount, FIELD_MANAGED),
+                field("Version", "Version", &Lesson::Version, FIELD_MANAGED | FIELD_INTERNAL));
+    };
+
+    template<>
+    class descriptor<Teacher> {
+    public:
+        static constexpr const char *Table = "teacher_information";
+        static constexpr auto Fields = std::make_tuple(
+                field("Id", "TeacherId", &Teacher::Id, FIELD_KEY),
+                field("Name", "TeacherName", &Teacher::Name),
+                field("Unit", "TeacherUnit", &Teacher::Unit),
+                field("TeachingLessons", "TeachingLessons", &Teacher::TeachingLessons, FIELD_JSON | FIELD_MANAGED),
+                field("Version", "Version", &Teacher::Version, FIELD_MANAGED | FIELD_INTERNAL));
+    };
+
+    template<>
+    class descriptor<Auth> {
+    public:
+        static constexpr const char *Table = "auth";
+        static constexpr auto Fields = std::make_tuple(
+                field("Account", "Account", &Auth::Account, FIELD_KEY),
+                field("Secret", "Secret", &Auth::Secret, FIELD_INTERNAL),
+                field("AccountType", "AccountType", &Auth::AccountType),
+                field("IsSuper", "IsSuper", &Auth::IsSuper));
+    };
+
+    // 成绩保存在每门课程各自的 lesson_课程编号 表中，没有固定的表名
+    template<>
+    class descriptor<Grade> {
+    public:
+        static constexpr const char *Table = nullptr;
+        static constexpr auto Fields = std::make_tuple(
+                field("StudentId", "StudentId", &Grade::StudentId, FIELD_KEY),
+                field("LessonId", nullptr, &Grade::LessonId),
+                field("ExamGrade", "ExamGrade", &Grade::ExamGrade, FIELD_NULLABLE),
+                field("RegularGrade", "RegularGrade", &Grade::RegularGrade, FIELD_NULLABLE),
+                field("TotalGrade", "TotalGrade", &Grade::TotalGrade, FIELD_NULLABLE),
+                field("Retake", "Retake", &Grade::Retake),
+                field("RetakeSemesters", "RetakeSemesters", &Grade::RetakeSemesters, FIELD_JSON),
+                field("RetakeLessonId", "RetakeLessonId", &Grade::RetakeLessonId, FIELD_JSON));
+    };
+
+    // 依次对实体的每个字段调用function，在编译期展开，没有运行时的字段表查找
+    template<typename Class, typename Function>
+    void forEachField(Function &&function) {
+        std::apply([&function](const auto &...fields) {
+            (function(fields), ...);
+        }, descriptor<Class>::Fields);
+    }
+
+    // 只对mask中选中的字段调用function
+    template<typename Class, typename Function>
+    void forEachField(FieldMask mask, Function &&function) {
+        int index = 0;
+        forEachField<Class>([mask, &function, &index](const auto &field) {
+            if (mask & (FieldMask(1) << index++)) {
+                function(field);
+            }
+        });
+    }
+
+    // 未指定 fields= 时的默认投影：单条记录返回全部字段，列表不返回大数组
+    template<typename Class>
+    FieldMask defaultMask(bool list) {
+        FieldMask mask = 0;
+        int index = 0;
+        forEachField<Class>([list, &mask, &index](const auto &field) {
+            if (!list || !field.has(FIELD_HEAVY)) {
+                mask |= FieldMask(1) << index;
+            }
+            index++;
+        });
+        return mask;
+    }
+
+    // 解析逗号分隔的字段名，如 "Id,LessonName,LessonArea"，"*" 表示全部字段；
+    // 主键和内部字段（版本号用于ETag）总是选中，不认识的字段名忽略
+    template<typename Class>
+    FieldMask parseMask(const QString &fields, FieldMask fallback) {
+        if (fields.isEmpty()) {
+            return fallback;
+        }
+        if (fields == "*") {
+            return FIELD_MASK_ALL;
+        }
+        QStringList names;
+        for (const auto &name: fields.split(',', Qt::SkipEmptyParts)) {
+            names.append(name.trimmed());
+        }
+        FieldMask mask = 0;
+        int index = 0;
+        forEachField<Class>([&names, &mask, &index](const auto &field) {
+            if (field.has(FIELD_KEY) || field.has(FIELD_INTERNAL) ||
+                names.contains(QLatin1StringView(field.Name))) {
+                mask |= FieldMask(1) << index;
+            }
+            index++;
+        });
+        return mask;
+    }
+
+    // 根据国标GB/T 2261.1-2003，记录中的 0、1、2、9 对应 未知、男、女、其他
+    inline QString sexName(int code) {
+        return code == 0 ? "未知" : code == 1 ? "男" : code == 2 ? "女" : "其他";
+    }
+
+    inline int sexCode(const QString &name) {
+        return name == "男" ? 1 : name == "女" ? 2 : name == "其他" ? 9 : 0;
+    }
+
+    inline void fromJson(const QJsonValue &value, QString &out) {
+        out = value.toString();
+    }
+
+    inline void fromJson(const QJsonValue &value, int &out) {
+        out = value.toInt();
+    }
+
+    inline void fromJson(const QJsonValue &value, qint64 &out) {
+        out = value.toInteger();
+    }
+
+    inline void fromJson(const QJsonValue &value, double &out) {
+        out = value.toDouble();
+    }
+
+    inline void fromJson(const QJsonValue &value, QVector<QString> &out) {
+        out.clear();
+        const QJsonArray array = value.toArray();
+        for (const auto &item: array) {
+            out.append(item.toString());
+        }
+    }
+
+    inline void fromJson(const QJsonValue &value, QMap<QString, QVector<QString>> &out) {
+        out.clear();
+        const QJsonObject object = value.toObject();
+        for (auto it = object.constBegin(); it != object.constEnd(); ++it) {
+            fromJson(it.value(), out[it.key()]);
+        }
+    }
+
+    // 按字段表读取接口中的JSON对象，对象中没有的字段取空字符串、0或空数组
+    template<typename Class>
+    void readJson(const QJsonObject &object, Class &out) {
+        forEachField<Class>([&object, &out](const auto &field) {
+            if (!field.has(FIELD_INTERNAL)) {
+                fromJson(object.value(QLatin1StringView(field.Name)), out.*(field.Member));
+            }
+        });
+    }
+
+    inline void fromCbor(QCborStreamReader &reader, QString &out) {
+        out.clear();
+        if (!reader.isString()) {
+            reader.next();
+            return;
+        }
+        // 长字符串可能分为多段
+        auto chunk = reader.readString();
+        while (chunk.status == QCborStreamReader::Ok) {
+            out += chunk.data;
+            chunk = reader.readString();
+        }
+    }
+
+    inline void fromCbor(QCborStreamReader &reader, qint64 &out) {
+        out = 0;
+        if (reader.isInteger()) {
+            out = reader.toInteger();
+        } else if (reader.isDouble()) {
+            out = qint64(reader.toDouble());
+        }
+        reader.next();
+    }
+
+    inline void fromCbor(QCborStreamReader &reader, int &out) {
+        qint64 value;
+        fromCbor(reader, value);
+        out = int(value);
+    }
+
+    inline void fromCbor(QCborStreamReader &reader, double &out) {
+        out = 0;
+        if (reader.isDouble()) {
+            out = reader.toDouble();
+        } else if (reader.isFloat()) {
+            out = reader.toFloat();
+        } else if (reader.isInteger()) {
+            out = double(reader.toInteger());
+        }
+        reader.next();
+    }
+
+    inline void fromCbor(QCborStreamReader &reader, bool &out) {
+        out = reader.isBool() && reader.toBool();
+        reader.next();
+    }
+
+    inline void fromCbor(QCborStreamReader &reader, QVector<QString> &out) {
+        out.clear();
+        if (!reader.isArray()) {
+            reader.next();
+            return;
+        }
+        reader.enterContainer();
+        while (reader.lastError() == QCborError::NoError && reader.hasNext()) {
+            fromCbor(reader, out.emplace_back());
+        }
+        reader.leaveContainer();
+    }
+
+    inline void fromCbor(QCborStreamReader &reader, QMap<QString, QVector<QString>> &out) {
+        out.clear();
+        if (!reader.isMap()) {
+            reader.next();
+            return;
+        }
+        reader.enterContainer();
+        while (reader.lastError() == QCborError::NoError && reader.hasNext()) {
+            QString key;
+            fromCbor(reader, key);
+            fromCbor(reader, out[key]);
+        }
+        reader.leaveContainer();
+    }
+
+    // 流式读取CBOR中的一个实体，不认识的字段直接跳过
+    template<typename Class>
+    void readCbor(QCborStreamReader &reader, Class &out) {
+        if (!reader.isMap()) {
+            reader.next();
+            return;
+        }
+        reader.enterContainer();
+        while (reader.lastError() == QCborError::NoError && reader.hasNext()) {
+            QString key;
+            fromCbor(reader, key);
+            bool found = false;
+            forEachField<Class>([&reader, &out, &key, &found](const auto &field) {
+                if (!found && !field.has(FIELD_INTERNAL) && key == QLatin1StringView(field.Name)) {
+                    fromCbor(reader, out.*(field.Member));
+                    found = true;
+                }
+            });
+            if (!found) {
+                reader.next();
+            }
+        }
+        reader.leaveContainer();
+    }
+
+} // Entity
+
+#endif //ENTITY_H
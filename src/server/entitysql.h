@@ -0,0 +1,196 @@
+#ifndef ENTITYSQL_H
+#define ENTITYSQL_H
+
+#include "entity.h"
+#include "tracing.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+#include <QVariant>
+#include <QtSql/QSqlQuery>
+
+namespace EntitySql {
+
+    // 按字段表顺序列出mask中选中的列，如 "StudentId, StudentName, ..."，用于代替 SELECT *，
+    // 查询结果的列顺序与字段表一致，读取时按下标取值，不再按列名查找
+    template<typename Class>
+    QString buildColumns(Entity::FieldMask mask) {
+        QStringList names;
+        Entity::forEachField<Class>(mask, [&names](const auto &field) {
+            if (field.Column != nullptr) {
+                names.append(QString::fromLatin1(field.Column));
+            }
+        });
+        return names.join(", ");
+    }
+
+    template<typename Class>
+    QString columns(Entity::FieldMask mask = FIELD_MASK_ALL) {
+        // 全部字段的列表最常用，只构造一次
+        static const QString all = buildColumns<Class>(FIELD_MASK_ALL);
+        return mask == FIELD_MASK_ALL ? all : buildColumns<Class>(mask);
+    }
+
+    template<typename Class>
+    QString selectFrom(const QString &table, Entity::FieldMask mask = FIELD_MASK_ALL) {
+        return "SELECT " + columns<Class>(mask) + " FROM " + table;
+    }
+
+    template<typename Class>
+    QString selectFrom(Entity::FieldMask mask = FIELD_MASK_ALL) {
+        return selectFrom<Class>(QString::fromLatin1(Entity::descriptor<Class>::Table), mask);
+    }
+
+    inline void fromColumn(const QVariant &value, int flags, QString &out) {
+        out = (flags & FIELD_SEX) ? Entity::sexName(value.toInt()) : value.toString();
+    }
+
+    inline void fromColumn(const QVariant &value, int, int &out) {
+        out = value.toInt();
+    }
+
+    inline void fromColumn(const QVariant &value, int, qint64 &out) {
+        out = value.toLongLong();
+    }
+
+    inline void fromColumn(const QVariant &value, int flags, double &out) {
+        // 成绩尚未录入时为空
+        if ((flags & FIELD_NULLABLE) && value.toString().isEmpty()) {
+            out = -1;
+        } else {
+            out = value.toDouble();
+        }
+    }
+
+    inline void fromColumn(const QVariant &value, int, QVector<QString> &out) {
+        Tracing::scope trace(TRACE_PARSE);
+        Entity::fromJson(QJsonDocument::fromJson(value.toByteArray()).array(), out);
+    }
+
+    inline void fromColumn(const QVariant &value, int, QMap<QString, QVector<QString>> &out) {
+        //格式如下：{"1-6周":["40809节","4501"],"7-10周":["30609节","4601"]}
+        Tracing::scope trace(TRACE_PARSE);
+        Entity::fromJson(QJsonDocument::fromJson(value.toByteArray()).object(), out);
+    }
+
+    // 从 selectFrom 查询的当前行读取实体，mask 须与查询时相同，未选中的字段保持原值
+    template<typename Class>
+    void readRow(const QSqlQuery &query, Class &out, Entity::FieldMask mask = FIELD_MASK_ALL) {
+        int index = 0;
+        Entity::forEachField<Class>(mask, [&query, &out, &index](const auto &field) {
+            if (field.Column != nullptr) {
+                fromColumn(query.value(index++), field.Flags, out.*(field.Member));
+            }
+        });
+    }
+
+    inline QVariant toColumn(const QString &value, int flags) {
+        if (flags & FIELD_SEX) {
+            return Entity::sexCode(value);
+        }
+        return value;
+    }
+
+    inline QVariant toColumn(int value, int) {
+        return value;
+    }
+
+    inline QVariant toColumn(qint64 value, int) {
+        return value;
+    }
+
+    inline QVariant toColumn(double value, int) {
+        return value;
+    }
+
+    inline QVariant toColumn(const QVector<QString> &values, int) {
+        QJsonArray array;
+        for (const auto &item: values) {
+            array.append(item);
+        }
+        return QString::fromUtf8(QJsonDocument(array).toJson(QJsonDocument::Compact));
+    }
+
+    inline QVariant toColumn(const QMap<QString, QVector<QString>> &values, int) {
+        QJsonObject object;
+        for (auto it = values.cbegin(); it != values.cend(); ++it) {
+            QJsonArray array;
+            for (const auto &item: it.value()) {
+                array.append(item);
+            }
+            object.insert(it.key(), array);
+        }
+        return QString::fromUtf8(QJsonDocument(object).toJson(QJsonDocument::Compact));
+    }
+
+    // 新增记录时写入的列：跳过由专门操作维护的列
+    template<typename FieldType>
+    bool isWritable(const FieldType &field) {
+        return field.Column != nullptr && !field.has(FIELD_MANAGED);
+    }
+
+    template<typename Class>
+    const QString &insertStatement() {
+        static const QString statement = [] {
+            QStringList names;
+            QStringList placeholders;
+            Entity::forEachField<Class>([&names, &placeholders](const auto &field) {
+                if (isWritable(field)) {
+                    names.append(QString::fromLatin1(field.Column));
+                    placeholders.append("?");
+                }
+            });
+            return QString("INSERT INTO %1 (%2) VALUES (%3)")
+                    .arg(QString::fromLatin1(Entity::descriptor<Class>::Table), names.join(", "), placeholders.join(", "));
+        }();
+        return statement;
+    }
+
+    // 修改记录时按主键定位，主键列本身不修改
+    template<typename Class>
+    const QString &updateStatement() {
+        static const QString statement = [] {
+            QStringList assignments;
+            QString key;
+            Entity::forEachField<Class>([&assignments, &key](const auto &field) {
+                if (field.has(FIELD_KEY)) {
+                    key = QString::fromLatin1(field.Column);
+                } else if (isWritable(field)) {
+                    assignments.append(QString::fromLatin1(field.Column) + " = ?");
+                }
+            });
+            return QString("UPDATE %1 SET %2 WHERE %3 = ?")
+                    .arg(QString::fromLatin1(Entity::descriptor<Class>::Table), assignments.join(", "), key);
+        }();
+        return statement;
+    }
+
+    // 按 insertStatement 的列顺序绑定参数
+    template<typename Class>
+    void bindInsert(QSqlQuery &query, const Class &entity) {
+        Entity::forEachField<Class>([&query, &entity](const auto &field) {
+            if (isWritable(field)) {
+                query.addBindValue(toColumn(entity.*(field.Member), field.Flags));
+            }
+        });
+    }
+
+    // 按 updateStatement 的列顺序绑定参数，主键在最后
+    template<typename Class>
+    void bindUpdate(QSqlQuery &query, const Class &entity) {
+        Entity::forEachField<Class>([&query, &entity](const auto &field) {
+            if (!field.has(FIELD_KEY) && isWritable(field)) {
+                query.addBindValue(toColumn(entity.*(field.Member), field.Flags));
+            }
+        });
+        Entity::forEachField<Class>([&query, &entity](const auto &field) {
+            if (field.has(FIELD_KEY)) {
+                query.addBindValue(toColumn(entity.*(field.Member), field.Flags));
+            }
+        });
+    }
+
+} // EntitySql
+
+#endif //ENTITYSQL_H
@@ -0,0 +1,71 @@
+#include "entityversion.h"
+#include <QList>
+
+namespace EntityVersion {
+
+    registry &registry::instance() {
+        static registry versionRegistry;
+        return versionRegistry;
+    }
+
+    qint64 registry::next() {
+        return counter.fetch_add(1) + 1;
+    }
+
+    void registry::seed(qint64 version) {
+        qint64 current = counter.load();
+        while (version > current && !counter.compare_exchange_weak(current, version)) {
+        }
+    }
+
+    bool registry::find(int entity, const QString &id, qint64 &version) const {
+        QReadLocker locker(&lock);
+        auto it = versions[entity].constFind(id);
+        if (it == versions[entity].cend() || *it < 0) {
+            return false;
+        }
+        version = *it;
+        return true;
+    }
+
+    void registry::update(int entity, const QString &id, qint64 version) {
+        QWriteLocker locker(&lock);
+        qint64 &current = versions[entity][id];
+        if (version > qAbs(current)) {
+            current = version;
+        }
+    }
+
+    void registry::remove(int entity, const QString &id, qint64 version) {
+        QWriteLocker locker(&lock);
+        // 保留墓碑：其他连接在删除前读到的版本晚于删除发布时，不会把已删除的记录写回
+        qint64 &current = versions[entity][id];
+        if (version > qAbs(current)) {
+            current = -version;
+        }
+    }
+
+    QString gradeId(const QString &studentId, const QString &lessonId) {
+        return studentId + '/' + lessonId;
+    }
+
+    QByteArray makeETag(qint64 version, const QByteArray &variant) {
+        return "W/\"" + QByteArray::number(version) + '-' + variant + '"';
+    }
+
+    bool matches(const QByteArray &ifNoneMatch, const QByteArray &etag) {
+        // If-None-Match 使用弱比较，忽略 W/ 前缀
+        QByteArray opaque = etag.startsWith("W/") ? etag.mid(2) : etag;
+        for (const auto &item: ifNoneMatch.split(',')) {
+            QByteArray candidate = item.trimmed();
+            if (candidate.startsWith("W/")) {
+                candidate = candidate.mid(2);
+            }
+            if (candidate == "*" || candidate == opaque) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+} // EntityVersion
@@ -0,0 +1,58 @@
+#ifndef ENTITYVERSION_H
+#define ENTITYVERSION_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QString>
+#include <atomic>
+
+#define ENTITY_STUDENT 0 // 学生
+#define ENTITY_TEACHER 1 // 教师
+#define ENTITY_LESSON 2 // 课程
+#define ENTITY_COUNT 3
+#define ENTITY_GRADE 3 // 成绩，只记录在变更日志中，不参与条件请求
+
+namespace EntityVersion {
+
+    // 进程内共享的版本号表，所有数据库连接（包括候补线程）在修改记录后写入，
+    // 条件请求直接查询此表，命中时不需要访问数据库
+    class registry {
+    public:
+        static registry &instance();
+
+        // 分配一个新的版本号，全局单调递增，不同记录之间也不会重复
+        qint64 next();
+
+        // 启动时用数据库中已有的最大版本号初始化计数器
+        void seed(qint64 version);
+
+        bool find(int entity, const QString &id, qint64 &version) const;
+
+        // 只会增大已记录的版本号，读取到的旧版本不会覆盖新版本，也不会让已删除的记录重新出现
+        void update(int entity, const QString &id, qint64 version);
+
+        // 记录删除，version 为删除时分配的版本号；之后只有更大的版本号（重新创建的记录）才会生效
+        void remove(int entity, const QString &id, qint64 version);
+
+    private:
+        registry() = default;
+
+        mutable QReadWriteLock lock;
+        QHash<QString, qint64> versions[ENTITY_COUNT]; // 负数表示已删除的记录（墓碑），绝对值为删除时的版本号
+        std::atomic<qint64> counter{0};
+    };
+
+    // 成绩在变更日志中的编号，形如 学号/课程编号
+    QString gradeId(const QString &studentId, const QString &lessonId);
+
+    // 弱ETag，形如 W/"42-ff-json"：variant 区分同一版本的不同表示（字段投影、格式），
+    // 压缩只改变传输编码，各编码共用同一个弱ETag
+    QByteArray makeETag(qint64 version, const QByteArray &variant);
+
+    // If-None-Match 中任意一个ETag与etag弱比较相同时返回true
+    bool matches(const QByteArray &ifNoneMatch, const QByteArray &etag);
+
+} // EntityVersion
+
+#endif //ENTITYVERSION_H
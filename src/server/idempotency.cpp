@@ -0,0 +1,49 @@
+#include "idempotency.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+
+namespace Idempotency {
+
+    cache::cache() : entries(IDEMPOTENCY_CACHE_SIZE) {
+    }
+
+    QString cache::makeKey(const QString &account, const QString &path, const QByteArray &idempotencyKey) {
+        return account + '\n' + path + '\n' + QString::fromUtf8(idempotencyKey);
+    }
+
+    QByteArray cache::hashBody(const QByteArray &body) {
+        return QCryptographicHash::hash(body, QCryptographicHash::Sha256);
+    }
+
+    bool cache::find(const QString &key, Entry &entry) {
+        Entry *cached = entries.object(key);
+        if (cached == nullptr) {
+            return false;
+        }
+        if (cached->ExpireTime < QDateTime::currentMSecsSinceEpoch()) {
+            entries.remove(key);
+            return false;
+        }
+        entry = *cached;
+        return true;
+    }
+
+    void cache::insert(const QString &key, const Entry &entry) {
+        // QCache 在超出容量时淘汰最久未使用的记录
+        entries.insert(key, new Entry(entry));
+    }
+
+    void cache::reserve(const QString &key, const QByteArray &requestHash) {
+        Entry entry;
+        entry.RequestHash = requestHash;
+        entry.Pending = true;
+        entry.StatusCode = QHttpServerResponder::StatusCode::Accepted;
+        entry.ExpireTime = QDateTime::currentMSecsSinceEpoch() + IDEMPOTENCY_TTL;
+        insert(key, entry);
+    }
+
+    void cache::remove(const QString &key) {
+        entries.remove(key);
+    }
+
+} // Idempotency
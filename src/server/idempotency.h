@@ -0,0 +1,52 @@
+#ifndef IDEMPOTENCY_H
+#define IDEMPOTENCY_H
+
+#include <QByteArray>
+#include <QCache>
+#include <QString>
+#include <QHttpServerResponder>
+
+#define IDEMPOTENCY_HEADER "Idempotency-Key"
+#define IDEMPOTENCY_REPLAYED_HEADER "Idempotent-Replayed"
+#define IDEMPOTENCY_CACHE_SIZE 4096 // 最多缓存的响应条数
+#define IDEMPOTENCY_TTL 600000 // 缓存响应的有效期（毫秒）
+#define IDEMPOTENCY_RETRY_AFTER 1 // 同一Key的请求仍在处理时建议客户端等待的时间（秒）
+
+namespace Idempotency {
+
+    class Entry {
+    public:
+        QByteArray RequestHash; // 请求body的哈希，用于识别同一个Key被用于不同请求
+        bool Pending = false; // 请求已开始处理、还没有响应
+        QByteArray MimeType; // 响应类型
+        QByteArray Body; // 响应内容
+        QHttpServerResponder::StatusCode StatusCode; // 响应状态码
+        qint64 ExpireTime; // 过期时间（毫秒时间戳）
+    };
+
+    // 以 账号 + 路径 + Idempotency-Key 为键缓存写请求的响应，重试的请求直接返回缓存结果
+    class cache {
+    public:
+        cache();
+
+        static QString makeKey(const QString &account, const QString &path, const QByteArray &idempotencyKey);
+
+        static QByteArray hashBody(const QByteArray &body);
+
+        // 找到未过期的记录时返回true
+        bool find(const QString &key, Entry &entry);
+
+        void insert(const QString &key, const Entry &entry);
+
+        // 处理请求前占用Key，处理完成前同一Key的重试不会再次执行
+        void reserve(const QString &key, const QByteArray &requestHash);
+
+        void remove(const QString &key);
+
+    private:
+        QCache<QString, Entry> entries;
+    };
+
+} // Idempotency
+
+#endif //IDEMPOTENCY_H
@@ -0,0 +1,86 @@
+#include "jwtcache.h"
+#include "metrics.h"
+#include <QDateTime>
+#include <QDebug>
+
+namespace JwtCache {
+
+    namespace {
+
+        Auth readClaims(const jwt::decoded_jwt<jwt::traits::kazuho_picojson> &decodedToken) {
+            Auth auth;
+            auth.Account = QString::fromStdString(decodedToken.get_payload_claim("Account").as_string());
+            auth.AccountType = QString::fromStdString(decodedToken.get_payload_claim("AccountType").as_string()).toInt();
+            auth.IsSuper = QString::fromStdString(decodedToken.get_payload_claim("IsSuper").as_string()).toInt();
+            return auth;
+        }
+
+    }
+
+    Auth verifyUncached(const QByteArray &token, const std::string &secret, const std::string &issuer) {
+        try {
+            auto decodedToken = jwt::decode(token.toStdString());
+            auto verifier = jwt::verify()
+                    .allow_algorithm(jwt::algorithm::hs256{secret})
+                    .with_issuer(issuer);
+            verifier.verify(decodedToken);
+            return readClaims(decodedToken);
+        } catch (const std::exception &e) {
+            return Auth{"", "", -1, -1};
+        }
+    }
+
+    verifier::verifier(const std::string &secret, const std::string &issuer)
+            : jwtVerifier(jwt::verify()
+                                  .allow_algorithm(jwt::algorithm::hs256{secret})
+                                  .with_issuer(issuer)) {
+    }
+
+    Auth verifier::verifyToken(const QByteArray &token, qint64 &expireTime) const {
+        try {
+            auto decodedToken = jwt::decode(token.toStdString());
+            jwtVerifier.verify(decodedToken);
+
+            // 令牌带有过期时间时，缓存不能超过该时间
+            expireTime = QDateTime::currentMSecsSinceEpoch() + JWT_CACHE_TTL;
+            if (decodedToken.has_expires_at()) {
+                qint64 expiresAt = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        decodedToken.get_expires_at().time_since_epoch()).count();
+                expireTime = qMin(expireTime, expiresAt);
+            }
+            return readClaims(decodedToken);
+        } catch (const std::exception &e) {
+            qDebug() << "JWT decode or verify failed: " << e.what();
+            return Auth{"", "", -1, -1};
+        }
+    }
+
+    Auth verifier::verify(const QByteArray &token) {
+        Shard &shard = shards[qHash(token) % JWT_CACHE_SHARDS];
+        qint64 now = QDateTime::currentMSecsSinceEpoch();
+        {
+            QMutexLocker locker(&shard.mutex);
+            Entry *entry = shard.entries.object(token);
+            if (entry != nullptr) {
+                if (entry->ExpireTime > now) {
+                    Metrics::registry::instance().recordCache(METRICS_CACHE_JWT, true);
+                    return entry->auth;
+                }
+                shard.entries.remove(token);
+            }
+        }
+        Metrics::registry::instance().recordCache(METRICS_CACHE_JWT, false);
+
+        // 在锁外完成验证，避免阻塞同一分片上的其他请求
+        qint64 expireTime = 0;
+        Auth auth = verifyToken(token, expireTime);
+        if (auth.AccountType == -1) {
+            // 验证失败的令牌不缓存，防止伪造的令牌挤占缓存
+            return auth;
+        }
+        QMutexLocker locker(&shard.mutex);
+        shard.entries.insert(token, new Entry{auth, expireTime});
+        return auth;
+    }
+
+} // JwtCache
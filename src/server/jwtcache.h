@@ -0,0 +1,49 @@
+#ifndef JWTCACHE_H
+#define JWTCACHE_H
+
+#include "database.h"
+#include <QByteArray>
+#include <QCache>
+#include <QMutex>
+#include "jwt-cpp/jwt.h"
+
+#define JWT_CACHE_SHARDS 8 // 缓存分片数
+#define JWT_CACHE_CAPACITY 1024 // 每个分片最多缓存的令牌数
+#define JWT_CACHE_TTL 300000 // 令牌验证结果的缓存时间（毫秒）
+
+namespace JwtCache {
+
+    // 每次都重新构造verifier并解码的原始实现，仅用于基准测试对比
+    Auth verifyUncached(const QByteArray &token, const std::string &secret, const std::string &issuer);
+
+    // 启动时构造一次的JWT验证器，附带按令牌内容缓存验证结果的分片LRU
+    class verifier {
+    public:
+        verifier(const std::string &secret, const std::string &issuer);
+
+        // 命中缓存时跳过HMAC计算和JSON解码；验证失败时返回所有属性都为-1的Auth对象
+        Auth verify(const QByteArray &token);
+
+        // 不使用缓存，但复用已构造的verifier
+        Auth verifyToken(const QByteArray &token, qint64 &expireTime) const;
+
+    private:
+        class Entry {
+        public:
+            Auth auth; // 令牌中的账号信息
+            qint64 ExpireTime; // 缓存过期时间（毫秒时间戳）
+        };
+
+        class Shard {
+        public:
+            QMutex mutex;
+            QCache<QByteArray, Entry> entries{JWT_CACHE_CAPACITY};
+        };
+
+        jwt::verifier<jwt::default_clock, jwt::traits::kazuho_picojson> jwtVerifier;
+        Shard shards[JWT_CACHE_SHARDS];
+    };
+
+} // JwtCache
+
+#endif //JWTCACHE_H
@@ -1,4 +1,19 @@
 #include "database.h"
+#include "waitlist.h"
+#include "allocation.h"
+#include "idempotency.h"
+#include "ratelimit.h"
+#include "jwtcache.h"
+#include "password.h"
+#include "compression.h"
+#include "entityversion.h"
+#include "push.h"
+#include "wireformat.h"
+#include "serializer.h"
+#include "metrics.h"
+#include "accesslog.h"
+#include "tracing.h"
+#include "queryprofile.h"
 #include <QCoreApplication>
 #include <QHttpServer>
 #include <QCommandLineParser>
@@ -7,6 +22,12 @@
 #include <QJsonDocument>
 #include <QMetaEnum>
 #include <QNetworkInterface>
+#include <QElapsedTimer>
+#include <QFuture>
+#include <QPromise>
+#include <QSet>
+#include <QUrlQuery>
+#include <QtConcurrent>
 #include "jwt-cpp/jwt.h"
 
 #define SCHEME "http"
@@ -16,60 +37,31 @@
 #define SECRET_KEY "AIMS"
 #define ISSUER "AIMS"
 
+#define ROUTE_READ 0 // 只读请求
+#define ROUTE_WRITE 1 // 写请求，支持 Idempotency-Key
+
+#define CHANGES_PAGE_SIZE 1000 // 每次同步最多返回的变更数
+#define BATCH_MAX_OPERATIONS 1000 // 单个批量请求最多包含的操作数
+
+JwtCache::verifier &jwtVerifier() {
+    // 验证器在第一次使用时构造，之后HTTP请求和推送连接共用，同一会话的重复验证直接命中缓存
+    static JwtCache::verifier verifier(SECRET_KEY, ISSUER);
+    return verifier;
+}
+
 Auth verifyJwt(const QHttpServerRequest &request) {
+    Tracing::scope trace(TRACE_AUTH);
     // 从header中获取JWT
-    QString jwtString;
-    const auto headers = request.headers();
-    for (const auto &header: headers) {
-        if (header.first == "Authorization") {
-            jwtString = header.second;
-            break;
-        }
-    }
-
-    // 检查是否找到了"Authorization"头
-    if (jwtString.isEmpty()) {
-        // 如果没有找到，返回所有属性都为-1的Auth对象
-        return Auth{"", "", -1, -1};
-    }
+    QByteArray jwtString = request.value("Authorization");
 
-    //检查 Authorization 头是否以 Bearer 开头
+    //检查 Authorization 头是否存在并以 Bearer 开头
     if (!jwtString.startsWith("Bearer ")) {
         // 如果没有找到，返回所有属性都为-1的Auth对象
         return Auth{"", "", -1, -1};
     }
-    jwtString = jwtString.mid(7); //去掉Bearer
-
-    try {
-        // 使用jwt-cpp库解码JWT
-        auto decodedToken = jwt::decode(jwtString.toStdString());
-
-        // 验证JWT
-        auto verifier = jwt::verify()
-                .allow_algorithm(jwt::algorithm::hs256{SECRET_KEY})
-                .with_issuer(ISSUER);
-
-        verifier.verify(decodedToken);
-
-
-        // 从JWT的payload中获取Auth信息
-        Auth auth;
-        auth.Account = QString::fromStdString(decodedToken.get_payload_claim("Account").as_string());
-        auth.AccountType = QString::fromStdString(decodedToken.get_payload_claim("AccountType").as_string()).toInt();
-        auth.IsSuper = QString::fromStdString(decodedToken.get_payload_claim("IsSuper").as_string()).toInt();
-
-        // 返回Auth对象
-        return auth;
-    } catch (const jwt::error::token_verification_exception &e) {
-        // 如果解码或验证失败，返回所有属性都为-1的Auth对象
-        qDebug() << "JWT decode or verify failed: " << e.what();
-        return Auth{"", "", -1, -1};
-    } catch (const std::exception &e) {
-        // 如果解码或验证失败，返回所有属性都为-1的Auth对象
-        qDebug() << "JWT decode or verify failed: " << e.what();
-        return Auth{"", "", -1, -1};
 
-    }
+    // 去掉Bearer后验证
+    return jwtVerifier().verify(jwtString.mid(7));
 }
 
 //不验证具体Id
@@ -127,52 +119,136 @@ QString generateJwt(const QString &account, int accountType, int isSuper) {
     return QString::fromStdString(token);
 }
 
-QHttpServerResponse login(const QHttpServerRequest &request, Database::database &database) {
-    // 获取请求的body
-    QByteArray body = request.body();
+// 按 Content-Type 解析请求body，CBOR和JSON解析后的结构相同，处理函数不需要区分
+QJsonDocument parseBody(const QHttpServerRequest &request) {
+    Tracing::scope trace(TRACE_PARSE);
+    return WireFormat::parse(request.body(), WireFormat::contentFormat(request.value("Content-Type")));
+}
+
+// 解析 fields= 查询参数，只查询和返回指定的字段；未指定时单条记录返回全部字段，列表不返回选课名单等大数组
+template<typename Class>
+Entity::FieldMask requestFields(const QHttpServerRequest &request, bool list) {
+    QString fields = request.query().queryItemValue("fields", QUrl::FullyDecoded);
+    return Entity::parseMask<Class>(fields, Entity::defaultMask<Class>(list));
+}
+
+int responseFormat(const QHttpServerRequest &request) {
+    return WireFormat::negotiate(request.value("Accept"));
+}
+
+// 按协商的格式直接写入响应body，write 接收 Serializer::jsonWriter 或 Serializer::cborWriter，
+// reserve 为预估的body大小
+template<typename Function>
+QHttpServerResponse writeResponse(int format, QHttpServerResponder::StatusCode statusCode, qsizetype reserve,
+                                  Function write) {
+    Tracing::scope trace(TRACE_SERIALIZE);
+    if (format == FORMAT_CBOR) {
+        Serializer::cborWriter writer(reserve);
+        write(writer);
+        return QHttpServerResponse(MIME_CBOR, writer.data(), statusCode);
+    }
+    Serializer::jsonWriter writer(reserve);
+    write(writer);
+    return QHttpServerResponse(MIME_JSON, writer.data(), statusCode);
+}
+
+QHttpServerResponse respond(int format, const QJsonObject &jsonObject, QHttpServerResponder::StatusCode statusCode) {
+    return writeResponse(format, statusCode, SERIALIZER_RESERVE, [&jsonObject](auto &writer) {
+        writer.value(QJsonValue(jsonObject));
+    });
+}
+
+QHttpServerResponse respond(const QHttpServerRequest &request, const QJsonObject &jsonObject,
+                            QHttpServerResponder::StatusCode statusCode) {
+    return respond(responseFormat(request), jsonObject, statusCode);
+}
+
+QHttpServerResponse rejectRequest(const QString &message, QHttpServerResponder::StatusCode statusCode, int retryAfter) {
+    QJsonObject responseJsonObject;
+    responseJsonObject["success"] = false;
+    responseJsonObject["message"] = message;
+    QHttpServerResponse response = respond(FORMAT_JSON, responseJsonObject, statusCode);
+    response.addHeader("Retry-After", QByteArray::number(retryAfter));
+    return response;
+}
+
+// 将已经生成的响应包装为已完成的QFuture，与异步处理函数的返回类型保持一致
+QFuture<QHttpServerResponse> readyResponse(QHttpServerResponse &&response) {
+    QPromise<QHttpServerResponse> promise;
+    QFuture<QHttpServerResponse> future = promise.future();
+    promise.start();
+    promise.addResult(std::move(response));
+    promise.finish();
+    return future;
+}
+
+QFuture<QHttpServerResponse> busyResponse() {
+    // 哈希任务排队已满，让客户端稍后重试
+    return readyResponse(rejectRequest("Server is busy", QHttpServerResponder::StatusCode::ServiceUnavailable,
+                                       SHED_RETRY_AFTER));
+}
 
+QFuture<QHttpServerResponse> login(const QHttpServerRequest &request, Database::database &database,
+                                   Password::hasher &hasher) {
     // 解析body为一个QJsonObject
-    QJsonDocument doc = QJsonDocument::fromJson(body);
+    QJsonDocument doc = parseBody(request);
     QJsonObject jsonObject = doc.object();
 
     // 从QJsonObject中获取账号和密码
     QString account = jsonObject["Account"].toString();
     QString secret = jsonObject["Secret"].toString();
 
-    // 调用verifyAccount函数，验证账号和密码
+    // 读取账号，密钥的验证在哈希线程池中进行
     Auth auth;
-    Status status = database.verifyAccount(account, secret, auth);
-
-    QHttpServerResponder::StatusCode statusCode;
-    // 创建一个JSON响应
-    QJsonObject responseJsonObject;
-    if (status == Success) {
-        // 如果验证成功，生成JWT
-        QString jwt = generateJwt(account, auth.AccountType, auth.IsSuper);
-        responseJsonObject["success"] = true;
-        statusCode = QHttpServerResponse::StatusCode::Ok;
-        responseJsonObject["jwt"] = jwt;
-    } else if (status == NOT_FOUND) {
+    Status status = database.getAccount(account, auth);
+    if (status == NOT_FOUND) {
+        QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
-        statusCode = QHttpServerResponse::StatusCode::NotFound;
         responseJsonObject["message"] = "Account not found";
-    } else if (status == INVALID) {
-        responseJsonObject["success"] = false;
-        statusCode = QHttpServerResponse::StatusCode::BadRequest;
-        responseJsonObject["message"] = "Invalid password";
-    } else {
+        return readyResponse(respond(request, responseJsonObject, QHttpServerResponder::StatusCode::NotFound));
+    } else if (status != Success) {
+        QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
-        statusCode = QHttpServerResponse::StatusCode::InternalServerError;
         responseJsonObject["message"] = "Login failed";
+        return readyResponse(respond(request, responseJsonObject, QHttpServerResponder::StatusCode::InternalServerError));
     }
-    QJsonDocument responseDoc(responseJsonObject);
-    QString responseString = responseDoc.toJson(QJsonDocument::Compact);
 
-    QHttpServerResponse response("application/json", responseString.toUtf8(), statusCode);
-    return response;
+    QFuture<Password::VerifyResult> future;
+    if (!hasher.verify(secret, auth.Secret, future)) {
+        return busyResponse();
+    }
+
+    // 回调中不能再访问请求对象，先确定响应格式
+    int format = responseFormat(request);
+
+    // 验证完成后回到主线程生成响应，数据库连接只能在创建它的线程中使用
+    return future.then(qApp, [&database, format, auth](Password::VerifyResult result) {
+        QHttpServerResponder::StatusCode statusCode;
+        // 创建一个JSON响应
+        QJsonObject responseJsonObject;
+        if (result.Valid) {
+            if (!result.NewSecret.isEmpty()) {
+                // 旧格式的密钥在登录成功时迁移为新格式，失败不影响本次登录；
+                // 哈希期间密码可能已被修改，只替换验证时读到的旧密钥
+                database.migrateSecret(auth.Account, auth.Secret, result.NewSecret);
+            }
+            // 如果验证成功，生成JWT
+            QString jwt = generateJwt(auth.Account, auth.AccountType, auth.IsSuper);
+            responseJsonObject["success"] = true;
+            statusCode = QHttpServerResponse::StatusCode::Ok;
+            responseJsonObject["jwt"] = jwt;
+        } else {
+            responseJsonObject["success"] = false;
+            statusCode = QHttpServerResponse::StatusCode::BadRequest;
+            responseJsonObject["message"] = "Invalid password";
+        }
+        QHttpServerResponse response = respond(format, responseJsonObject, statusCode);
+        return response;
+    });
 }
 
-QHttpServerResponse createAccount(const QHttpServerRequest &request, Database::database &database) {
+QFuture<QHttpServerResponse> createAccount(const QHttpServerRequest &request, Database::database &database,
+                                           Password::hasher &hasher) {
     // 验证JWT
     Status status = verifyAuth(request, SUPER);
     if (status != Success) {
@@ -180,17 +256,12 @@ QHttpServerResponse createAccount(const QHttpServerRequest &request, Database::d
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "No permission";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Forbidden);
-        return response;
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
+        return readyResponse(std::move(response));
     }
 
-    // 获取请求的body
-    QByteArray body = request.body();
-
     // 解析body为一个QJsonObject
-    QJsonDocument doc = QJsonDocument::fromJson(body);
+    QJsonDocument doc = parseBody(request);
     QJsonObject jsonObject = doc.object();
 
     // 从QJsonObject中获取账号、密码、账户类型和是否为超级用户
@@ -200,72 +271,100 @@ QHttpServerResponse createAccount(const QHttpServerRequest &request, Database::d
     auth.AccountType = jsonObject["AccountType"].toInt();
     auth.IsSuper = jsonObject["IsSuper"].toInt();
 
-    // 调用createAccount函数，创建账号
-    status = database.createAccount(auth);
-
-    // 创建一个JSON响应
-    QHttpServerResponder::StatusCode statusCode;
-    QJsonObject responseJsonObject;
-    if (status == Success) {
-        responseJsonObject["success"] = true;
-        statusCode = QHttpServerResponse::StatusCode::Ok;
-        responseJsonObject["message"] = "Account created successfully";
-    } else if (status == DUPLICATE) {
-        responseJsonObject["success"] = false;
-        statusCode = QHttpServerResponse::StatusCode::Conflict;
-        responseJsonObject["message"] = "Account already exists";
-    } else {
-        responseJsonObject["success"] = false;
-        statusCode = QHttpServerResponse::StatusCode::InternalServerError;
-        responseJsonObject["message"] = "Failed to create account";
+    // 密钥在哈希线程池中计算，完成后回到主线程写入数据库
+    QFuture<QString> future;
+    if (!hasher.hash(auth.Secret, future)) {
+        return busyResponse();
     }
-    QJsonDocument responseDoc(responseJsonObject);
-    QString responseString = responseDoc.toJson(QJsonDocument::Compact);
 
-    QHttpServerResponse response("application/json", responseString.toUtf8(), statusCode);
+    // 回调中不能再访问请求对象，先确定响应格式
+    int format = responseFormat(request);
+    return future.then(qApp, [&database, format, auth](QString hashedSecret) mutable {
+        // 调用createAccount函数，创建账号
+        auth.Secret = hashedSecret;
+        Status status = database.createAccount(auth);
+
+        // 创建一个JSON响应
+        QHttpServerResponder::StatusCode statusCode;
+        QJsonObject responseJsonObject;
+        if (status == Success) {
+            responseJsonObject["success"] = true;
+            statusCode = QHttpServerResponse::StatusCode::Ok;
+            responseJsonObject["message"] = "Account created successfully";
+        } else if (status == DUPLICATE) {
+            responseJsonObject["success"] = false;
+            statusCode = QHttpServerResponse::StatusCode::Conflict;
+            responseJsonObject["message"] = "Account already exists";
+        } else {
+            responseJsonObject["success"] = false;
+            statusCode = QHttpServerResponse::StatusCode::InternalServerError;
+            responseJsonObject["message"] = "Failed to create account";
+        }
+        QHttpServerResponse response = respond(format, responseJsonObject, statusCode);
+        return response;
+    });
+}
+
+// 同一版本的不同表示使用不同的ETag：字段投影和响应格式都计入，压缩由弱ETag覆盖
+QByteArray responseETag(const QHttpServerRequest &request, qint64 version, Entity::FieldMask fields) {
+    QByteArray variant = QByteArray::number(fields, 16) + (responseFormat(request) == FORMAT_CBOR ? "-cbor" : "-json");
+    return EntityVersion::makeETag(version, variant);
+}
+
+// If-None-Match 与内存中记录的版本号和本次请求的表示一致时返回true
+bool isNotModified(const QHttpServerRequest &request, int entity, const QString &id, Entity::FieldMask fields,
+                   QByteArray &etag) {
+    QByteArray ifNoneMatch = request.value("If-None-Match");
+    if (ifNoneMatch.isEmpty()) {
+        return false;
+    }
+    qint64 version = 0;
+    bool hit = false;
+    if (EntityVersion::registry::instance().find(entity, id, version)) {
+        etag = responseETag(request, version, fields);
+        hit = EntityVersion::matches(ifNoneMatch, etag);
+    }
+    Metrics::registry::instance().recordCache(METRICS_CACHE_ETAG, hit);
+    return hit;
+}
+
+QHttpServerResponse notModified(const QByteArray &etag) {
+    QHttpServerResponse response(QHttpServerResponder::StatusCode::NotModified);
+    response.addHeader("ETag", etag);
     return response;
 }
 
-QHttpServerResponse getStudentInformation(const QString &studentId, Database::database &database) {
+QHttpServerResponse getStudentInformation(const QString &studentId, const QHttpServerRequest &request,
+                                          Database::database &database) {
+    // 客户端缓存的版本仍是最新时直接返回304，不访问数据库
+    Entity::FieldMask fields = requestFields<Student>(request, false);
+    QByteArray etag;
+    if (isNotModified(request, ENTITY_STUDENT, studentId, fields, etag)) {
+        return notModified(etag);
+    }
+
     Student student;
-    Status status = database.getStudentById(studentId, student);
-    QHttpServerResponder::StatusCode statusCode;
-    QJsonObject jsonObject;
-    if (status == Success) {
-        statusCode = QHttpServerResponse::StatusCode::Ok;
-        jsonObject["success"] = true;
-        jsonObject["Id"] = student.Id;
-        jsonObject["Name"] = student.Name;
-        jsonObject["Sex"] = student.Sex;
-        jsonObject["College"] = student.College;
-        jsonObject["Major"] = student.Major;
-        jsonObject["Class"] = student.Class;
-        jsonObject["Age"] = student.Age;
-        jsonObject["PhoneNumber"] = student.PhoneNumber;
-        jsonObject["DormitoryArea"] = student.DormitoryArea;
-        jsonObject["DormitoryNum"] = student.DormitoryNum;
-        QJsonArray chosenLessonsArray;
-        for (const auto &lesson: student.ChosenLessons) {
-            chosenLessonsArray.append(lesson);
-        }
-        jsonObject["ChosenLessons"] = chosenLessonsArray;
-    } else {
+    Status status = database.getStudentById(studentId, student, fields);
+    if (status != Success) {
+        QJsonObject jsonObject;
         jsonObject["success"] = false;
-        statusCode = QHttpServerResponse::StatusCode::NotFound;
         jsonObject["message"] = "Failed to get student information";
-    }
-    QJsonDocument doc(jsonObject);
-    QString jsonString = doc.toJson(QJsonDocument::Compact);
-
-    // 创建一个JSON响应
-    QHttpServerResponse response("application/json", jsonString.toUtf8(), statusCode);
+        return respond(request, jsonObject, QHttpServerResponse::StatusCode::NotFound);
+    }
+
+    // 直接写入响应body，不构造中间的QJsonObject
+    QHttpServerResponse response = writeResponse(
+            responseFormat(request), QHttpServerResponse::StatusCode::Ok, SERIALIZER_RESERVE, [&student, fields](auto &writer) {
+                writer.beginObject();
+                writer.field("success", true);
+                Serializer::writeFields(writer, student, fields);
+                writer.endObject();
+            });
+    response.addHeader("ETag", responseETag(request, student.Version, fields));
     return response;
 }
 
 QHttpServerResponse updateStudentInformation(const QHttpServerRequest &request, Database::database &database) {
-    // 获取请求的body
-    QByteArray body = request.body();
-
     // 验证权限
     Status status = verifyAuth(request, SUPER);
     if (status != Success) {
@@ -273,28 +372,17 @@ QHttpServerResponse updateStudentInformation(const QHttpServerRequest &request,
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "No permission";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Forbidden);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
         return response;
     }
 
     // 解析body为一个QJsonObject
-    QJsonDocument doc = QJsonDocument::fromJson(body);
+    QJsonDocument doc = parseBody(request);
     QJsonObject jsonObject = doc.object();
 
     // 从QJsonObject中获取学生的信息
     Student student;
-    student.Id = jsonObject["Id"].toString();
-    student.Name = jsonObject["Name"].toString();
-    student.Sex = jsonObject["Sex"].toString();
-    student.College = jsonObject["College"].toString();
-    student.Major = jsonObject["Major"].toString();
-    student.Class = jsonObject["Class"].toString();
-    student.Age = jsonObject["Age"].toInt();
-    student.PhoneNumber = jsonObject["PhoneNumber"].toString();
-    student.DormitoryArea = jsonObject["DormitoryArea"].toString();
-    student.DormitoryNum = jsonObject["DormitoryNum"].toString();
+    Entity::readJson(jsonObject, student);
 
     // 更新数据库
     status = database.updateStudent(student);
@@ -311,29 +399,24 @@ QHttpServerResponse updateStudentInformation(const QHttpServerRequest &request,
         statusCode = QHttpServerResponse::StatusCode::InternalServerError;
         responseJsonObject["message"] = "Failed to update student information";
     }
-    QJsonDocument responseDoc(responseJsonObject);
-    QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-
-    QHttpServerResponse response("application/json", responseString.toUtf8(), statusCode);
+    QHttpServerResponse response = respond(request, responseJsonObject, statusCode);
     return response;
 }
 
-QHttpServerResponse updateLessonInformation(const QHttpServerRequest &request, Database::database &database) {
-    // 获取请求的body
-    QByteArray body = request.body();
-
+QHttpServerResponse updateLessonInformation(const QHttpServerRequest &request, Database::database &database,
+                                            Waitlist::service &waitlist) {
     // 解析body为一个QJsonObject
-    QJsonDocument doc = QJsonDocument::fromJson(body);
+    QJsonDocument doc = parseBody(request);
     QJsonObject jsonObject = doc.object();
 
     // 从QJsonObject中获取课程的信息
+    //jsonObject["LessonTimeAndLocations"]结构如下: {"1-6周":["40809节","4501"],"7-10周":["30609节","4601"]}
     Lesson lesson;
-    lesson.Id = jsonObject["Id"].toString();
-    lesson.LessonName = jsonObject["LessonName"].toString();
-    lesson.TeacherId = jsonObject["TeacherId"].toString();
-    lesson.LessonCredits = jsonObject["LessonCredits"].toInt();
-    lesson.LessonArea = jsonObject["LessonArea"].toString();
-    lesson.LessonSemester = jsonObject["LessonSemester"].toString();
+    Entity::readJson(jsonObject, lesson);
+    // 未提供课程容量时保持原值不变
+    if (!jsonObject.contains("LessonCapacity")) {
+        lesson.LessonCapacity = -1;
+    }
 
     // 验证权限
     Status status = verifyAuth(request, TEACHER, lesson.TeacherId);
@@ -342,32 +425,10 @@ QHttpServerResponse updateLessonInformation(const QHttpServerRequest &request, D
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "No permission";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Forbidden);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
         return response;
     }
 
-    //jsonObject["LessonTimeAndLocations"]结构如下: {"1-6周":["40809节","4501"],"7-10周":["30609节","4601"]}
-    QJsonObject lessonTimeAndLocations = jsonObject["LessonTimeAndLocations"].toObject();
-    QMap<QString, QVector<QString>> timeAndLocationsMap;
-
-    for (auto it = lessonTimeAndLocations.begin(); it != lessonTimeAndLocations.end(); ++it) {
-        QJsonArray timeAndLocationArray = it.value().toArray();
-        QVector<QString> timeAndLocation;
-        for (auto &&i: timeAndLocationArray) {
-            timeAndLocation.append(i.toString());
-        }
-        timeAndLocationsMap.insert(it.key(), timeAndLocation);
-    }
-    lesson.LessonTimeAndLocations = timeAndLocationsMap;
-
-
-    QJsonArray lessonStudentsArray = jsonObject["LessonStudents"].toArray();
-    for (const auto &lessonStudent: lessonStudentsArray) {
-        lesson.LessonStudents.append(lessonStudent.toString());
-    }
-
     // 更新数据库
     status = database.updateLessonInformation(lesson);
     database.addTeachingLesson(lesson.TeacherId, lesson.Id);
@@ -376,6 +437,8 @@ QHttpServerResponse updateLessonInformation(const QHttpServerRequest &request, D
     QHttpServerResponder::StatusCode statusCode;
     QJsonObject responseJsonObject;
     if (status == Success) {
+        // 课程容量可能增加，通知后台递补候补学生
+        waitlist.notifySeatFreed(lesson.Id);
         responseJsonObject["success"] = true;
         statusCode = QHttpServerResponse::StatusCode::Ok;
         responseJsonObject["message"] = "Lesson information updated successfully";
@@ -388,19 +451,13 @@ QHttpServerResponse updateLessonInformation(const QHttpServerRequest &request, D
         statusCode = QHttpServerResponse::StatusCode::InternalServerError;
         responseJsonObject["message"] = "Failed to update lesson information";
     }
-    QJsonDocument responseDoc(responseJsonObject);
-    QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-
-    QHttpServerResponse response("application/json", responseString.toUtf8(), statusCode);
+    QHttpServerResponse response = respond(request, responseJsonObject, statusCode);
     return response;
 }
 
 QHttpServerResponse updateLessonChosenStudent(const QHttpServerRequest &request, Database::database &database) {
-    // 获取请求的body
-    QByteArray body = request.body();
-
     // 解析body为一个QJsonObject
-    QJsonDocument doc = QJsonDocument::fromJson(body);
+    QJsonDocument doc = parseBody(request);
     QJsonObject jsonObject = doc.object();
 
     // 从QJsonObject中获取课程的编号和学生的学号
@@ -418,9 +475,7 @@ QHttpServerResponse updateLessonChosenStudent(const QHttpServerRequest &request,
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "No permission";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Forbidden);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
         return response;
     }
 
@@ -447,98 +502,79 @@ QHttpServerResponse updateLessonChosenStudent(const QHttpServerRequest &request,
         statusCode = QHttpServerResponse::StatusCode::InternalServerError;
         responseJsonObject["message"] = "Failed to update lesson chosen student";
     }
-    QJsonDocument responseDoc(responseJsonObject);
-    QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-
-    QHttpServerResponse response("application/json", responseString.toUtf8(), statusCode);
+    QHttpServerResponse response = respond(request, responseJsonObject, statusCode);
     return response;
 }
 
-QHttpServerResponse getLessonInformation(const QString &lessonId, Database::database &database) {
-    Lesson lesson;
-    Status status = database.getLessonById(lessonId, lesson);
-    QJsonObject jsonObject;
-    QHttpServerResponder::StatusCode statusCode;
-    if (status == Success) {
-        statusCode = QHttpServerResponse::StatusCode::Ok;
-        jsonObject["success"] = true;
-        jsonObject["Id"] = lesson.Id;
-        jsonObject["LessonName"] = lesson.LessonName;
-        jsonObject["TeacherId"] = lesson.TeacherId;
-        jsonObject["LessonCredits"] = lesson.LessonCredits;
-        jsonObject["LessonSemester"] = lesson.LessonSemester;
-        jsonObject["LessonArea"] = lesson.LessonArea;
-
-        QJsonObject lessonTimeAndLocationsObj;
-        for (auto it = lesson.LessonTimeAndLocations.cbegin(); it != lesson.LessonTimeAndLocations.cend(); ++it) {
-            QJsonArray jsonArray;
-            for (const auto &str: it.value()) {
-                jsonArray.append(QJsonValue(str));
-            }
-            lessonTimeAndLocationsObj.insert(it.key(), jsonArray);
-        }
-        jsonObject["LessonTimeAndLocations"] = lessonTimeAndLocationsObj;
+QHttpServerResponse getLessonInformation(const QString &lessonId, const QHttpServerRequest &request,
+                                         Database::database &database) {
+    // 客户端缓存的版本仍是最新时直接返回304，不访问数据库
+    Entity::FieldMask fields = requestFields<Lesson>(request, false);
+    QByteArray etag;
+    if (isNotModified(request, ENTITY_LESSON, lessonId, fields, etag)) {
+        return notModified(etag);
+    }
 
-        QJsonArray lessonStudentsArray;
-        for (const auto &lessonStudent: lesson.LessonStudents) {
-            lessonStudentsArray.append(lessonStudent);
-        }
-        jsonObject["LessonStudents"] = lessonStudentsArray;
-    } else {
+    Lesson lesson;
+    Status status = database.getLessonById(lessonId, lesson, fields);
+    if (status != Success) {
+        QJsonObject jsonObject;
         jsonObject["success"] = false;
-        statusCode = QHttpServerResponse::StatusCode::NotFound;
         jsonObject["message"] = "Failed to get lesson information";
-    }
-    QJsonDocument doc(jsonObject);
-    QString jsonString = doc.toJson(QJsonDocument::Compact);
-
-    // 创建一个JSON响应
-    QHttpServerResponse response("application/json", jsonString.toUtf8(), statusCode);
+        return respond(request, jsonObject, QHttpServerResponse::StatusCode::NotFound);
+    }
+
+    // 直接写入响应body，选课学生较多时按人数预留缓冲区
+    qsizetype reserve = SERIALIZER_RESERVE + lesson.LessonStudents.size() * SERIALIZER_ID_RESERVE;
+    QHttpServerResponse response = writeResponse(
+            responseFormat(request), QHttpServerResponse::StatusCode::Ok, reserve, [&lesson, fields](auto &writer) {
+                writer.beginObject();
+                writer.field("success", true);
+                Serializer::writeFields(writer, lesson, fields);
+                writer.endObject();
+            });
+    response.addHeader("ETag", responseETag(request, lesson.Version, fields));
     return response;
 }
 
-QHttpServerResponse getTeacherInformation(const QString &teacherId, Database::database &database) {
+QHttpServerResponse getTeacherInformation(const QString &teacherId, const QHttpServerRequest &request,
+                                          Database::database &database) {
+    // 客户端缓存的版本仍是最新时直接返回304，不访问数据库
+    Entity::FieldMask fields = requestFields<Teacher>(request, false);
+    QByteArray etag;
+    if (isNotModified(request, ENTITY_TEACHER, teacherId, fields, etag)) {
+        return notModified(etag);
+    }
+
     Teacher teacher;
-    Status status = database.getTeacherById(teacherId, teacher);
-    QJsonObject jsonObject;
-    QHttpServerResponder::StatusCode statusCode;
-    if (status == Success) {
-        statusCode = QHttpServerResponse::StatusCode::Ok;
-        jsonObject["success"] = true;
-        jsonObject["Id"] = teacher.Id;
-        jsonObject["Name"] = teacher.Name;
-        jsonObject["Unit"] = teacher.Unit;
-        QJsonArray teachingLessonsArray;
-        for (const auto &teachingLesson: teacher.TeachingLessons) {
-            teachingLessonsArray.append(teachingLesson);
-        }
-        jsonObject["TeachingLessons"] = teachingLessonsArray;
-    } else {
+    Status status = database.getTeacherById(teacherId, teacher, fields);
+    if (status != Success) {
+        QJsonObject jsonObject;
         jsonObject["success"] = false;
-        statusCode = QHttpServerResponse::StatusCode::NotFound;
         jsonObject["message"] = "Failed to get teacher information";
-    }
-    QJsonDocument doc(jsonObject);
-    QString jsonString = doc.toJson(QJsonDocument::Compact);
-
-    // 创建一个JSON响应
-    QHttpServerResponse response("application/json", jsonString.toUtf8(), statusCode);
+        return respond(request, jsonObject, QHttpServerResponse::StatusCode::NotFound);
+    }
+
+    // 直接写入响应body，不构造中间的QJsonObject
+    QHttpServerResponse response = writeResponse(
+            responseFormat(request), QHttpServerResponse::StatusCode::Ok, SERIALIZER_RESERVE, [&teacher, fields](auto &writer) {
+                writer.beginObject();
+                writer.field("success", true);
+                Serializer::writeFields(writer, teacher, fields);
+                writer.endObject();
+            });
+    response.addHeader("ETag", responseETag(request, teacher.Version, fields));
     return response;
 }
 
 QHttpServerResponse updateTeacherInformation(const QHttpServerRequest &request, Database::database &database) {
-    // 获取请求的body
-    QByteArray body = request.body();
-
     // 解析body为一个QJsonObject
-    QJsonDocument doc = QJsonDocument::fromJson(body);
+    QJsonDocument doc = parseBody(request);
     QJsonObject jsonObject = doc.object();
 
     // 从QJsonObject中获取教师的信息
     Teacher teacher;
-    teacher.Id = jsonObject["Id"].toString();
-    teacher.Name = jsonObject["Name"].toString();
-    teacher.Unit = jsonObject["Unit"].toString();
+    Entity::readJson(jsonObject, teacher);
 
     // 验证权限
     Status status = verifyAuth(request, TEACHER, teacher.Id);
@@ -547,9 +583,7 @@ QHttpServerResponse updateTeacherInformation(const QHttpServerRequest &request,
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "No permission";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Forbidden);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
         return response;
     }
 
@@ -568,19 +602,13 @@ QHttpServerResponse updateTeacherInformation(const QHttpServerRequest &request,
         statusCode = QHttpServerResponse::StatusCode::InternalServerError;
         responseJsonObject["message"] = "Failed to update teacher information";
     }
-    QJsonDocument responseDoc(responseJsonObject);
-    QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-
-    QHttpServerResponse response("application/json", responseString.toUtf8(), statusCode);
+    QHttpServerResponse response = respond(request, responseJsonObject, statusCode);
     return response;
 }
 
 QHttpServerResponse addTeachingLessons(const QHttpServerRequest &request, Database::database &database) {
-    // 获取请求的body
-    QByteArray body = request.body();
-
     // 解析body为一个QJsonObject
-    QJsonDocument doc = QJsonDocument::fromJson(body);
+    QJsonDocument doc = parseBody(request);
     QJsonObject jsonObject = doc.object();
 
     // 从QJsonObject中获取教师的编号和教授课程的编号
@@ -593,9 +621,7 @@ QHttpServerResponse addTeachingLessons(const QHttpServerRequest &request, Databa
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "No permission";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Forbidden);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
         return response;
     }
 
@@ -608,10 +634,7 @@ QHttpServerResponse addTeachingLessons(const QHttpServerRequest &request, Databa
             QJsonObject responseJsonObject;
             responseJsonObject["success"] = false;
             responseJsonObject["message"] = "Failed to add teaching lesson";
-            QJsonDocument responseDoc(responseJsonObject);
-            QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-            QHttpServerResponse response("application/json", responseString.toUtf8(),
-                                         QHttpServerResponder::StatusCode::InternalServerError);
+            QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::InternalServerError);
             return response;
         }
     }
@@ -620,18 +643,14 @@ QHttpServerResponse addTeachingLessons(const QHttpServerRequest &request, Databa
     QJsonObject responseJsonObject;
     responseJsonObject["success"] = true;
     responseJsonObject["message"] = "Teaching lessons added successfully";
-    QJsonDocument responseDoc(responseJsonObject);
-    QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-    QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Ok);
+    QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Ok);
     return response;
 }
 
-QHttpServerResponse deleteChosenLesson(const QHttpServerRequest &request, Database::database &database) {
-    // 获取请求的body
-    QByteArray body = request.body();
-
+QHttpServerResponse deleteChosenLesson(const QHttpServerRequest &request, Database::database &database,
+                                       Waitlist::service &waitlist) {
     // 解析body为一个QJsonObject
-    QJsonDocument doc = QJsonDocument::fromJson(body);
+    QJsonDocument doc = parseBody(request);
     QJsonObject jsonObject = doc.object();
 
     // 从QJsonObject中获取学生的学号和课程的编号
@@ -645,9 +664,7 @@ QHttpServerResponse deleteChosenLesson(const QHttpServerRequest &request, Databa
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "No permission";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Forbidden);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
         return response;
     }
 
@@ -658,6 +675,8 @@ QHttpServerResponse deleteChosenLesson(const QHttpServerRequest &request, Databa
     QJsonObject responseJsonObject;
     QHttpServerResponder::StatusCode statusCode;
     if (status == Success) {
+        // 空出的名额交给后台递补候补学生
+        waitlist.notifySeatFreed(lessonId);
         responseJsonObject["success"] = true;
         statusCode = QHttpServerResponse::StatusCode::Ok;
         responseJsonObject["message"] = "Chosen lesson deleted successfully";
@@ -674,17 +693,12 @@ QHttpServerResponse deleteChosenLesson(const QHttpServerRequest &request, Databa
         statusCode = QHttpServerResponse::StatusCode::InternalServerError;
         responseJsonObject["message"] = "Failed to delete chosen lesson";
     }
-    QJsonDocument responseDoc(responseJsonObject);
-    QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-
-    QHttpServerResponse response("application/json", responseString.toUtf8(), statusCode);
+    QHttpServerResponse response = respond(request, responseJsonObject, statusCode);
     return response;
 }
 
-QHttpServerResponse deleteStudent(const QHttpServerRequest &request, Database::database &database) {
-    // 获取请求的body
-    QByteArray body = request.body();
-
+QHttpServerResponse deleteStudent(const QHttpServerRequest &request, Database::database &database,
+                                  Waitlist::service &waitlist) {
     // 验证权限
     Status status = verifyAuth(request, SUPER);
     if (status != Success) {
@@ -692,19 +706,21 @@ QHttpServerResponse deleteStudent(const QHttpServerRequest &request, Database::d
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "No permission";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Forbidden);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
         return response;
     }
 
     // 解析body为一个QJsonObject
-    QJsonDocument doc = QJsonDocument::fromJson(body);
+    QJsonDocument doc = parseBody(request);
     QJsonObject jsonObject = doc.object();
 
     // 从QJsonObject中获取学生的学号
     QString studentId = jsonObject["Id"].toString();
 
+    // 删除前记录学生已选的课程，用于之后递补候补学生
+    Student student;
+    database.getStudentById(studentId, student);
+
     // 调用deleteStudent函数
     status = database.deleteStudent(studentId);
 
@@ -712,6 +728,9 @@ QHttpServerResponse deleteStudent(const QHttpServerRequest &request, Database::d
     QJsonObject responseJsonObject;
     QHttpServerResponder::StatusCode statusCode;
     if (status == Success) {
+        for (const auto &lessonId: student.ChosenLessons) {
+            waitlist.notifySeatFreed(lessonId);
+        }
         responseJsonObject["success"] = true;
         statusCode = QHttpServerResponse::StatusCode::Ok;
         responseJsonObject["message"] = "Student information deleted successfully";
@@ -724,17 +743,11 @@ QHttpServerResponse deleteStudent(const QHttpServerRequest &request, Database::d
         statusCode = QHttpServerResponse::StatusCode::InternalServerError;
         responseJsonObject["message"] = "Failed to delete student information";
     }
-    QJsonDocument responseDoc(responseJsonObject);
-    QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-
-    QHttpServerResponse response("application/json", responseString.toUtf8(), statusCode);
+    QHttpServerResponse response = respond(request, responseJsonObject, statusCode);
     return response;
 }
 
 QHttpServerResponse listStudents(const QHttpServerRequest &request, Database::database &database) {
-    // 获取请求的body
-    QByteArray body = request.body();
-
     // 验证权限
     Status status = verifyAuth(request, SUPER);
     if (status != Success) {
@@ -742,14 +755,12 @@ QHttpServerResponse listStudents(const QHttpServerRequest &request, Database::da
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "No permission";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Forbidden);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
         return response;
     }
 
     // 解析body为一个QJsonObject
-    QJsonDocument doc = QJsonDocument::fromJson(body);
+    QJsonDocument doc = parseBody(request);
     QJsonObject jsonObject = doc.object();
 
     // 调用getStudentCount函数，获取学生总数
@@ -766,67 +777,44 @@ QHttpServerResponse listStudents(const QHttpServerRequest &request, Database::da
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "Invalid maximum or page";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::BadRequest);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::BadRequest);
         return response;
     }
 
     // 调用listStudents函数，获取指定页的学生列表
+    Entity::FieldMask fields = requestFields<Student>(request, true);
     QVector<Student> students;
-    status = database.listStudents(students, maximum, page);
-
-    // 创建一个JSON响应
-    QJsonObject responseJsonObject;
-    QHttpServerResponder::StatusCode statusCode;
-    if (status == Success) {
-        statusCode = QHttpServerResponse::StatusCode::Ok;
-        // 计算总页数
-        int totalPages = (total + maximum - 1) / maximum;
-
-        // 将学生列表、总页数和学生总数包装成一个JSON对象
-        responseJsonObject["success"] = true;
-        responseJsonObject["total"] = total;
-        responseJsonObject["totalPages"] = totalPages;
-        QJsonArray studentsArray;
-        for (const auto &student: students) {
-            QJsonObject studentObject;
-            studentObject["Id"] = student.Id;
-            studentObject["Name"] = student.Name;
-            studentObject["Sex"] = student.Sex;
-            studentObject["College"] = student.College;
-            studentObject["Major"] = student.Major;
-            studentObject["Class"] = student.Class;
-            studentObject["Age"] = student.Age;
-            studentObject["PhoneNumber"] = student.PhoneNumber;
-            studentObject["DormitoryArea"] = student.DormitoryArea;
-            studentObject["DormitoryNum"] = student.DormitoryNum;
-            QJsonArray chosenLessonsArray;
-            for (const auto &lesson: student.ChosenLessons) {
-                chosenLessonsArray.append(lesson);
-            }
-            studentObject["ChosenLessons"] = chosenLessonsArray;
-            studentsArray.append(studentObject);
-        }
-        responseJsonObject["students"] = studentsArray;
-    } else {
-        statusCode = QHttpServerResponse::StatusCode::InternalServerError;
+    status = database.listStudents(students, maximum, page, fields);
+    if (status != Success) {
+        QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "Failed to list students";
+        return respond(request, responseJsonObject, QHttpServerResponse::StatusCode::InternalServerError);
     }
-    QJsonDocument responseDoc(responseJsonObject);
-    QString responseString = responseDoc.toJson(QJsonDocument::Compact);
 
-    QHttpServerResponse response("application/json", responseString.toUtf8(), statusCode);
-    return response;
+    // 计算总页数
+    int totalPages = (total + maximum - 1) / maximum;
+
+    // 将学生列表、总页数和学生总数直接写入响应body，按行数预留缓冲区
+    qsizetype reserve = SERIALIZER_RESERVE + students.size() * SERIALIZER_ROW_RESERVE;
+    return writeResponse(responseFormat(request), QHttpServerResponse::StatusCode::Ok, reserve, [&](auto &writer) {
+        writer.beginObject();
+        writer.field("success", true);
+        writer.field("total", total);
+        writer.field("totalPages", totalPages);
+        writer.key("students");
+        writer.beginArray();
+        for (const auto &student: students) {
+            Serializer::writeObject(writer, student, fields);
+        }
+        writer.endArray();
+        writer.endObject();
+    });
 }
 
 QHttpServerResponse addChosenLesson(const QHttpServerRequest &request, Database::database &database) {
-    // 获取请求的body
-    QByteArray body = request.body();
-
     // 解析body为一个QJsonObject
-    QJsonDocument doc = QJsonDocument::fromJson(body);
+    QJsonDocument doc = parseBody(request);
     QJsonObject jsonObject = doc.object();
 
     // 从QJsonObject中获取学生的学号和课程的编号
@@ -840,9 +828,7 @@ QHttpServerResponse addChosenLesson(const QHttpServerRequest &request, Database:
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "No permission";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Forbidden);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
         return response;
     }
 
@@ -864,22 +850,20 @@ QHttpServerResponse addChosenLesson(const QHttpServerRequest &request, Database:
         responseJsonObject["success"] = false;
         statusCode = QHttpServerResponse::StatusCode::NotFound;
         responseJsonObject["message"] = "Lesson not found";
+    } else if (status == LESSON_FULL) {
+        responseJsonObject["success"] = false;
+        statusCode = QHttpServerResponse::StatusCode::Conflict;
+        responseJsonObject["message"] = "Lesson is full";
     } else {
         responseJsonObject["success"] = false;
         statusCode = QHttpServerResponse::StatusCode::InternalServerError;
         responseJsonObject["message"] = "Failed to add chosen lesson";
     }
-    QJsonDocument responseDoc(responseJsonObject);
-    QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-
-    QHttpServerResponse response("application/json", responseString.toUtf8(), statusCode);
+    QHttpServerResponse response = respond(request, responseJsonObject, statusCode);
     return response;
 }
 
 QHttpServerResponse listTeachers(const QHttpServerRequest &request, Database::database &database) {
-    // 获取请求的body
-    QByteArray body = request.body();
-
     // 验证权限
     Status status = verifyAuth(request, SUPER);
     if (status != Success) {
@@ -887,14 +871,12 @@ QHttpServerResponse listTeachers(const QHttpServerRequest &request, Database::da
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "No permission";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Forbidden);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
         return response;
     }
 
     // 解析body为一个QJsonObject
-    QJsonDocument doc = QJsonDocument::fromJson(body);
+    QJsonDocument doc = parseBody(request);
     QJsonObject jsonObject = doc.object();
 
     // 调用getTeacherCount函数，获取教师总数
@@ -911,58 +893,42 @@ QHttpServerResponse listTeachers(const QHttpServerRequest &request, Database::da
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "Invalid maximum or page";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::BadRequest);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::BadRequest);
         return response;
     }
 
     // 调用listTeachers函数，获取指定页的教师列表
+    Entity::FieldMask fields = requestFields<Teacher>(request, true);
     QVector<Teacher> teachers;
-    status = database.listTeachers(teachers, maximum, page);
-
-    // 创建一个JSON响应
-    QJsonObject responseJsonObject;
-    QHttpServerResponder::StatusCode statusCode;
-    if (status == Success) {
-        statusCode = QHttpServerResponse::StatusCode::Ok;
-        // 计算总页数
-        int totalPages = (total + maximum - 1) / maximum;
-
-        // 将教师列表、总页数和教师总数包装成一个JSON对象
-        responseJsonObject["success"] = true;
-        responseJsonObject["total"] = total;
-        responseJsonObject["totalPages"] = totalPages;
-        QJsonArray teachersArray;
-        for (const auto &teacher: teachers) {
-            QJsonObject teacherObject;
-            teacherObject["Id"] = teacher.Id;
-            teacherObject["Name"] = teacher.Name;
-            teacherObject["Unit"] = teacher.Unit;
-            QJsonArray teachingLessonsArray;
-            for (const auto &lesson: teacher.TeachingLessons) {
-                teachingLessonsArray.append(lesson);
-            }
-            teacherObject["TeachingLessons"] = teachingLessonsArray;
-            teachersArray.append(teacherObject);
-        }
-        responseJsonObject["teachers"] = teachersArray;
-    } else {
-        statusCode = QHttpServerResponse::StatusCode::InternalServerError;
+    status = database.listTeachers(teachers, maximum, page, fields);
+    if (status != Success) {
+        QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "Failed to list teachers";
+        return respond(request, responseJsonObject, QHttpServerResponse::StatusCode::InternalServerError);
     }
-    QJsonDocument responseDoc(responseJsonObject);
-    QString responseString = responseDoc.toJson(QJsonDocument::Compact);
 
-    QHttpServerResponse response("application/json", responseString.toUtf8(), statusCode);
-    return response;
+    // 计算总页数
+    int totalPages = (total + maximum - 1) / maximum;
+
+    // 将教师列表、总页数和教师总数直接写入响应body，按行数预留缓冲区
+    qsizetype reserve = SERIALIZER_RESERVE + teachers.size() * SERIALIZER_ROW_RESERVE;
+    return writeResponse(responseFormat(request), QHttpServerResponse::StatusCode::Ok, reserve, [&](auto &writer) {
+        writer.beginObject();
+        writer.field("success", true);
+        writer.field("total", total);
+        writer.field("totalPages", totalPages);
+        writer.key("teachers");
+        writer.beginArray();
+        for (const auto &teacher: teachers) {
+            Serializer::writeObject(writer, teacher, fields);
+        }
+        writer.endArray();
+        writer.endObject();
+    });
 }
 
 QHttpServerResponse listLessons(const QHttpServerRequest &request, Database::database &database) {
-    // 获取请求的body
-    QByteArray body = request.body();
-
     // 验证权限
     Status status = verifyAuth(request, EVERYONE);
     if (status != Success) {
@@ -970,14 +936,12 @@ QHttpServerResponse listLessons(const QHttpServerRequest &request, Database::dat
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "No permission";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Forbidden);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
         return response;
     }
 
     // 解析body为一个QJsonObject
-    QJsonDocument doc = QJsonDocument::fromJson(body);
+    QJsonDocument doc = parseBody(request);
     QJsonObject jsonObject = doc.object();
 
     // 调用getLessonCount函数，获取课程总数
@@ -994,73 +958,43 @@ QHttpServerResponse listLessons(const QHttpServerRequest &request, Database::dat
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "Invalid maximum or page";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::BadRequest);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::BadRequest);
         return response;
     }
 
     // 调用listLessons函数，获取指定页的课程列表
+    Entity::FieldMask fields = requestFields<Lesson>(request, true);
     QVector<Lesson> lessons;
-    status = database.listLessons(lessons, maximum, page);
-
-    // 创建一个JSON响应
-    QJsonObject responseJsonObject;
-    QHttpServerResponder::StatusCode statusCode;
-    if (status == Success) {
-        statusCode = QHttpServerResponse::StatusCode::Ok;
-        // 计算总页数
-        int totalPages = (total + maximum - 1) / maximum;
-
-        // 将课程列表、总页数和课程总数包装成一个JSON对象
-        responseJsonObject["success"] = true;
-        responseJsonObject["total"] = total;
-        responseJsonObject["totalPages"] = totalPages;
-        QJsonArray lessonsArray;
-        for (const auto &lesson: lessons) {
-            QJsonObject lessonObject;
-            lessonObject["Id"] = lesson.Id;
-            lessonObject["LessonName"] = lesson.LessonName;
-            lessonObject["TeacherId"] = lesson.TeacherId;
-            lessonObject["LessonCredits"] = lesson.LessonCredits;
-            lessonObject["LessonSemester"] = lesson.LessonSemester;
-            lessonObject["LessonArea"] = lesson.LessonArea;
-
-            QJsonObject lessonTimeAndLocationsObj;
-            for (auto it = lesson.LessonTimeAndLocations.cbegin(); it != lesson.LessonTimeAndLocations.cend(); ++it) {
-                QJsonArray jsonArray;
-                for (const auto &str: it.value()) {
-                    jsonArray.append(QJsonValue(str));
-                }
-                lessonTimeAndLocationsObj.insert(it.key(), jsonArray);
-            }
-            lessonObject["LessonTimeAndLocations"] = lessonTimeAndLocationsObj;
-
-            QJsonArray lessonStudentsArray;
-            for (const auto &lessonStudent: lesson.LessonStudents) {
-                lessonStudentsArray.append(lessonStudent);
-            }
-            lessonObject["LessonStudents"] = lessonStudentsArray;
-
-            lessonsArray.append(lessonObject);
-        }
-        responseJsonObject["lessons"] = lessonsArray;
-    } else {
-        statusCode = QHttpServerResponse::StatusCode::InternalServerError;
+    status = database.listLessons(lessons, maximum, page, fields);
+    if (status != Success) {
+        QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "Failed to list lessons";
+        return respond(request, responseJsonObject, QHttpServerResponse::StatusCode::InternalServerError);
     }
-    QJsonDocument responseDoc(responseJsonObject);
-    QString responseString = responseDoc.toJson(QJsonDocument::Compact);
 
-    QHttpServerResponse response("application/json", responseString.toUtf8(), statusCode);
-    return response;
-}
+    // 计算总页数
+    int totalPages = (total + maximum - 1) / maximum;
 
-QHttpServerResponse addAccount(const QHttpServerRequest &request, Database::database &database) {
-    // 获取请求的body
-    QByteArray body = request.body();
+    // 将课程列表、总页数和课程总数直接写入响应body，按行数预留缓冲区
+    qsizetype reserve = SERIALIZER_RESERVE + lessons.size() * SERIALIZER_ROW_RESERVE;
+    return writeResponse(responseFormat(request), QHttpServerResponse::StatusCode::Ok, reserve, [&](auto &writer) {
+        writer.beginObject();
+        writer.field("success", true);
+        writer.field("total", total);
+        writer.field("totalPages", totalPages);
+        writer.key("lessons");
+        writer.beginArray();
+        for (const auto &lesson: lessons) {
+            Serializer::writeObject(writer, lesson, fields);
+        }
+        writer.endArray();
+        writer.endObject();
+    });
+}
 
+QFuture<QHttpServerResponse> addAccount(const QHttpServerRequest &request, Database::database &database,
+                                        Password::hasher &hasher) {
     // 验证权限
     Status status = verifyAuth(request, SUPER);
     if (status != Success) {
@@ -1068,14 +1002,12 @@ QHttpServerResponse addAccount(const QHttpServerRequest &request, Database::data
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "No permission";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Forbidden);
-        return response;
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
+        return readyResponse(std::move(response));
     }
 
     // 解析body为一个QJsonObject
-    QJsonDocument doc = QJsonDocument::fromJson(body);
+    QJsonDocument doc = parseBody(request);
     QJsonObject jsonObject = doc.object();
 
     // 从QJsonObject中获取账号、密码、账户类型和是否为超级用户
@@ -1085,36 +1017,41 @@ QHttpServerResponse addAccount(const QHttpServerRequest &request, Database::data
     auth.AccountType = jsonObject["AccountType"].toInt();
     auth.IsSuper = jsonObject["IsSuper"].toInt();
 
-    // 调用createAccount函数，创建账号
-    status = database.createAccount(auth);
-
-    // 创建一个JSON响应
-    QJsonObject responseJsonObject;
-    QHttpServerResponder::StatusCode statusCode;
-    if (status == Success) {
-        responseJsonObject["success"] = true;
-        statusCode = QHttpServerResponse::StatusCode::Ok;
-        responseJsonObject["message"] = "Account created successfully";
-    } else if (status == DUPLICATE) {
-        responseJsonObject["success"] = false;
-        statusCode = QHttpServerResponse::StatusCode::Conflict;
-        responseJsonObject["message"] = "Account already exists";
-    } else {
-        responseJsonObject["success"] = false;
-        statusCode = QHttpServerResponse::StatusCode::InternalServerError;
-        responseJsonObject["message"] = "Failed to create account";
+    // 密钥在哈希线程池中计算，完成后回到主线程写入数据库
+    QFuture<QString> future;
+    if (!hasher.hash(auth.Secret, future)) {
+        return busyResponse();
     }
-    QJsonDocument responseDoc(responseJsonObject);
-    QString responseString = responseDoc.toJson(QJsonDocument::Compact);
 
-    QHttpServerResponse response("application/json", responseString.toUtf8(), statusCode);
-    return response;
+    // 回调中不能再访问请求对象，先确定响应格式
+    int format = responseFormat(request);
+    return future.then(qApp, [&database, format, auth](QString hashedSecret) mutable {
+        // 调用createAccount函数，创建账号
+        auth.Secret = hashedSecret;
+        Status status = database.createAccount(auth);
+
+        // 创建一个JSON响应
+        QJsonObject responseJsonObject;
+        QHttpServerResponder::StatusCode statusCode;
+        if (status == Success) {
+            responseJsonObject["success"] = true;
+            statusCode = QHttpServerResponse::StatusCode::Ok;
+            responseJsonObject["message"] = "Account created successfully";
+        } else if (status == DUPLICATE) {
+            responseJsonObject["success"] = false;
+            statusCode = QHttpServerResponse::StatusCode::Conflict;
+            responseJsonObject["message"] = "Account already exists";
+        } else {
+            responseJsonObject["success"] = false;
+            statusCode = QHttpServerResponse::StatusCode::InternalServerError;
+            responseJsonObject["message"] = "Failed to create account";
+        }
+        QHttpServerResponse response = respond(format, responseJsonObject, statusCode);
+        return response;
+    });
 }
 
 QHttpServerResponse deleteLesson(const QHttpServerRequest &request, Database::database &database) {
-    // 获取请求的body
-    QByteArray body = request.body();
-
     // 验证权限
     Status status = verifyAuth(request, SUPER);
     if (status != Success) {
@@ -1122,14 +1059,12 @@ QHttpServerResponse deleteLesson(const QHttpServerRequest &request, Database::da
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "No permission";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Forbidden);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
         return response;
     }
 
     // 解析body为一个QJsonObject
-    QJsonDocument doc = QJsonDocument::fromJson(body);
+    QJsonDocument doc = parseBody(request);
     QJsonObject jsonObject = doc.object();
 
     // 从QJsonObject中获取课程的编号
@@ -1154,19 +1089,13 @@ QHttpServerResponse deleteLesson(const QHttpServerRequest &request, Database::da
         statusCode = QHttpServerResponse::StatusCode::InternalServerError;
         responseJsonObject["message"] = "Failed to delete lesson";
     }
-    QJsonDocument responseDoc(responseJsonObject);
-    QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-
-    QHttpServerResponse response("application/json", responseString.toUtf8(), statusCode);
+    QHttpServerResponse response = respond(request, responseJsonObject, statusCode);
     return response;
 }
 
 QHttpServerResponse addRetake(const QHttpServerRequest &request, Database::database &database) {
-    // 获取请求的body
-    QByteArray body = request.body();
-
     // 解析body为一个QJsonObject
-    QJsonDocument doc = QJsonDocument::fromJson(body);
+    QJsonDocument doc = parseBody(request);
     QJsonObject jsonObject = doc.object();
 
     // 从QJsonObject中获取学生的学号和课程的编号
@@ -1184,9 +1113,7 @@ QHttpServerResponse addRetake(const QHttpServerRequest &request, Database::datab
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "No permission";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Forbidden);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
         return response;
     }
 
@@ -1212,17 +1139,11 @@ QHttpServerResponse addRetake(const QHttpServerRequest &request, Database::datab
         statusCode = QHttpServerResponse::StatusCode::InternalServerError;
         responseJsonObject["message"] = "Failed to add retake";
     }
-    QJsonDocument responseDoc(responseJsonObject);
-    QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-
-    QHttpServerResponse response("application/json", responseString.toUtf8(), statusCode);
+    QHttpServerResponse response = respond(request, responseJsonObject, statusCode);
     return response;
 }
 
 QHttpServerResponse deleteTeacher(const QHttpServerRequest &request, Database::database &database) {
-    // 获取请求的body
-    QByteArray body = request.body();
-
     // 验证权限
     Status status = verifyAuth(request, SUPER);
     if (status != Success) {
@@ -1230,14 +1151,12 @@ QHttpServerResponse deleteTeacher(const QHttpServerRequest &request, Database::d
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "No permission";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Forbidden);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
         return response;
     }
 
     // 解析body为一个QJsonObject
-    QJsonDocument doc = QJsonDocument::fromJson(body);
+    QJsonDocument doc = parseBody(request);
     QJsonObject jsonObject = doc.object();
 
     // 从QJsonObject中获取教师的编号
@@ -1262,17 +1181,11 @@ QHttpServerResponse deleteTeacher(const QHttpServerRequest &request, Database::d
         statusCode = QHttpServerResponse::StatusCode::InternalServerError;
         responseJsonObject["message"] = "Failed to delete teacher";
     }
-    QJsonDocument responseDoc(responseJsonObject);
-    QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-
-    QHttpServerResponse response("application/json", responseString.toUtf8(), statusCode);
+    QHttpServerResponse response = respond(request, responseJsonObject, statusCode);
     return response;
 }
 
 QHttpServerResponse getStudentByClass(const QHttpServerRequest &request, Database::database &database) {
-    // 获取请求的body
-    QByteArray body = request.body();
-
     // 验证权限
     Status status = verifyAuth(request, TEACHER);
     if (status != Success) {
@@ -1280,14 +1193,12 @@ QHttpServerResponse getStudentByClass(const QHttpServerRequest &request, Databas
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "No permission";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Forbidden);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
         return response;
     }
 
     // 解析body为一个QJsonObject
-    QJsonDocument bodyDoc = QJsonDocument::fromJson(body);
+    QJsonDocument bodyDoc = parseBody(request);
     QJsonObject bodyJsonObject = bodyDoc.object();
     // 从QJsonObject中获取班级的名称
     // 检查Class关键字是否存在
@@ -1296,62 +1207,40 @@ QHttpServerResponse getStudentByClass(const QHttpServerRequest &request, Databas
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "Key 'Class' not found in request body";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::BadRequest);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::BadRequest);
         return response;
     }
     QString className = bodyJsonObject["Class"].toString();
 
+    Entity::FieldMask fields = requestFields<Student>(request, true);
     QVector<Student> students;
-    status = database.getStudentByClass(className, students);
-    QJsonObject jsonObject;
-    QHttpServerResponder::StatusCode statusCode;
-    if (status == Success) {
-        statusCode = QHttpServerResponse::StatusCode::Ok;
-        jsonObject["success"] = true;
-        QJsonArray studentsArray;
-        for (const auto &student: students) {
-            QJsonObject studentObject;
-            studentObject["Id"] = student.Id;
-            studentObject["Name"] = student.Name;
-            studentObject["Sex"] = student.Sex;
-            studentObject["College"] = student.College;
-            studentObject["Major"] = student.Major;
-            studentObject["Class"] = student.Class;
-            studentObject["Age"] = student.Age;
-            studentObject["PhoneNumber"] = student.PhoneNumber;
-            studentObject["DormitoryArea"] = student.DormitoryArea;
-            studentObject["DormitoryNum"] = student.DormitoryNum;
-            QJsonArray chosenLessonsArray;
-            for (const auto &lesson: student.ChosenLessons) {
-                chosenLessonsArray.append(lesson);
-            }
-            studentObject["ChosenLessons"] = chosenLessonsArray;
-            studentsArray.append(studentObject);
-        }
-        jsonObject["students"] = studentsArray;
-        jsonObject["total"] = students.size();
-
-    } else {
+    status = database.getStudentByClass(className, students, fields);
+    if (status != Success) {
+        QJsonObject jsonObject;
         jsonObject["success"] = false;
-        statusCode = QHttpServerResponse::StatusCode::NotFound;
         jsonObject["message"] = "Failed to get student information";
+        return respond(request, jsonObject, QHttpServerResponse::StatusCode::NotFound);
     }
-    QJsonDocument doc(jsonObject);
-    QString jsonString = doc.toJson(QJsonDocument::Compact);
 
-    // 创建一个JSON响应
-    QHttpServerResponse response("application/json", jsonString.toUtf8(), statusCode);
-    return response;
+    qsizetype reserve = SERIALIZER_RESERVE + students.size() * SERIALIZER_ROW_RESERVE;
+    return writeResponse(responseFormat(request), QHttpServerResponse::StatusCode::Ok, reserve, [&](auto &writer) {
+        writer.beginObject();
+        writer.field("success", true);
+        writer.key("students");
+        writer.beginArray();
+        for (const auto &student: students) {
+            Serializer::writeObject(writer, student, fields);
+        }
+        writer.endArray();
+        writer.field("total", int(students.size()));
+        writer.endObject();
+    });
 }
 
-QHttpServerResponse changePassword(const QHttpServerRequest &request, Database::database &database) {
-    // 获取请求的body
-    QByteArray body = request.body();
-
+QFuture<QHttpServerResponse> changePassword(const QHttpServerRequest &request, Database::database &database,
+                                            Password::hasher &hasher) {
     // 解析body为一个QJsonObject
-    QJsonDocument doc = QJsonDocument::fromJson(body);
+    QJsonDocument doc = parseBody(request);
     QJsonObject jsonObject = doc.object();
 
     // 从QJsonObject中获取用户名和密码
@@ -1365,45 +1254,47 @@ QHttpServerResponse changePassword(const QHttpServerRequest &request, Database::
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "No permission";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Forbidden);
-        return response;
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
+        return readyResponse(std::move(response));
     }
 
-    // 更新数据库
-    Auth auth;
-    auth.Account = account;
-    auth.Secret = secret;
-    auth.IsSuper = -1;
-    auth.AccountType = -1;
-    status = database.updateAccount(auth);
-
-    // 创建一个JSON响应
-    QJsonObject responseJsonObject;
-    QHttpServerResponder::StatusCode statusCode;
-    if (status == Success) {
-        responseJsonObject["success"] = true;
-        statusCode = QHttpServerResponse::StatusCode::Ok;
-        responseJsonObject["message"] = "Password changed successfully";
-    } else {
-        responseJsonObject["success"] = false;
-        statusCode = QHttpServerResponse::StatusCode::InternalServerError;
-        responseJsonObject["message"] = "Failed to change password";
+    // 密钥在哈希线程池中计算，完成后回到主线程更新数据库
+    QFuture<QString> future;
+    if (!hasher.hash(secret, future)) {
+        return busyResponse();
     }
-    QJsonDocument responseDoc(responseJsonObject);
-    QString responseString = responseDoc.toJson(QJsonDocument::Compact);
 
-    QHttpServerResponse response("application/json", responseString.toUtf8(), statusCode);
-    return response;
+    // 回调中不能再访问请求对象，先确定响应格式
+    int format = responseFormat(request);
+    return future.then(qApp, [&database, format, account](QString hashedSecret) {
+        // 更新数据库
+        Auth auth;
+        auth.Account = account;
+        auth.Secret = hashedSecret;
+        auth.IsSuper = -1;
+        auth.AccountType = -1;
+        Status status = database.updateAccount(auth);
+
+        // 创建一个JSON响应
+        QJsonObject responseJsonObject;
+        QHttpServerResponder::StatusCode statusCode;
+        if (status == Success) {
+            responseJsonObject["success"] = true;
+            statusCode = QHttpServerResponse::StatusCode::Ok;
+            responseJsonObject["message"] = "Password changed successfully";
+        } else {
+            responseJsonObject["success"] = false;
+            statusCode = QHttpServerResponse::StatusCode::InternalServerError;
+            responseJsonObject["message"] = "Failed to change password";
+        }
+        QHttpServerResponse response = respond(format, responseJsonObject, statusCode);
+        return response;
+    });
 }
 
 QHttpServerResponse updateAccount(const QHttpServerRequest &request, Database::database &database) {
-    // 获取请求的body
-    QByteArray body = request.body();
-
     // 解析body为一个QJsonObject
-    QJsonDocument doc = QJsonDocument::fromJson(body);
+    QJsonDocument doc = parseBody(request);
     QJsonObject jsonObject = doc.object();
 
     // 从QJsonObject中获取用户名、密码、账户类型和是否为超级用户
@@ -1419,9 +1310,7 @@ QHttpServerResponse updateAccount(const QHttpServerRequest &request, Database::d
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "No permission";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Forbidden);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
         return response;
     }
 
@@ -1440,19 +1329,13 @@ QHttpServerResponse updateAccount(const QHttpServerRequest &request, Database::d
         statusCode = QHttpServerResponse::StatusCode::InternalServerError;
         responseJsonObject["message"] = "Failed to update account";
     }
-    QJsonDocument responseDoc(responseJsonObject);
-    QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-
-    QHttpServerResponse response("application/json", responseString.toUtf8(), statusCode);
+    QHttpServerResponse response = respond(request, responseJsonObject, statusCode);
     return response;
 }
 
 QHttpServerResponse getStudentLessonGrade(const QHttpServerRequest &request, Database::database &database) {
-    // 获取请求的body
-    QByteArray body = request.body();
-
     // 解析body为一个QJsonObject
-    QJsonDocument doc = QJsonDocument::fromJson(body);
+    QJsonDocument doc = parseBody(request);
     QJsonObject jsonObject = doc.object();
 
     // 从QJsonObject中获取学生的学号
@@ -1467,15 +1350,14 @@ QHttpServerResponse getStudentLessonGrade(const QHttpServerRequest &request, Dat
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "No permission";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Forbidden);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
         return response;
     }
 
     // 调用getStudentLessonGrade函数
+    Entity::FieldMask fields = requestFields<Grade>(request, false);
     Grade grade;
-    Status status = database.getStudentLessonGrade(studentId, lessonId, grade);
+    Status status = database.getStudentLessonGrade(studentId, lessonId, grade, fields);
 
     // 创建一个JSON响应
     QJsonObject responseJsonObject;
@@ -1489,46 +1371,26 @@ QHttpServerResponse getStudentLessonGrade(const QHttpServerRequest &request, Dat
         statusCode = QHttpServerResponse::StatusCode::NotFound;
         responseJsonObject["message"] = "Student not found";
     } else if (status == Success) {
-        responseJsonObject["success"] = true;
-        statusCode = QHttpServerResponse::StatusCode::Ok;
-        responseJsonObject.insert("StudentId", grade.StudentId);
-        responseJsonObject.insert("ExamGrade", grade.ExamGrade);
-        responseJsonObject.insert("RegularGrade", grade.RegularGrade);
-        responseJsonObject.insert("TotalGrade", grade.TotalGrade);
-        responseJsonObject.insert("Retake", grade.Retake);
-
-        // RetakeSemesters 是 QVector<QString> 类型
-        QJsonArray retakeSemestersArray;
-        for (const auto &semester: grade.RetakeSemesters) {
-            retakeSemestersArray.append(semester);
-        }
-        responseJsonObject.insert("RetakeSemesters", retakeSemestersArray);
-
-        // RetakeLessonId 是 QVector<QPair<QString, QString>> 类型
-        QJsonArray retakeLessonIdArray;
-        for (const auto &RetakeLessonId: grade.RetakeLessonId) {
-            retakeLessonIdArray.append(RetakeLessonId);
-        }
-        responseJsonObject.insert("RetakeLessonId", retakeLessonIdArray);
-
+        // 直接写入响应body，不构造中间的QJsonObject
+        return writeResponse(
+                responseFormat(request), QHttpServerResponse::StatusCode::Ok, SERIALIZER_RESERVE, [&grade, fields](auto &writer) {
+                    writer.beginObject();
+                    writer.field("success", true);
+                    Serializer::writeFields(writer, grade, fields);
+                    writer.endObject();
+                });
     } else {
         responseJsonObject["success"] = false;
         statusCode = QHttpServerResponse::StatusCode::InternalServerError;
         responseJsonObject["message"] = "Failed to get student lesson grade";
     }
-    QJsonDocument responseDoc(responseJsonObject);
-    QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-
-    QHttpServerResponse response("application/json", responseString.toUtf8(), statusCode);
+    QHttpServerResponse response = respond(request, responseJsonObject, statusCode);
     return response;
 }
 
 QHttpServerResponse listLessonClasses(const QHttpServerRequest &request, Database::database &database) {
-    // 获取请求的body
-    QByteArray body = request.body();
-
     // 解析body为一个QJsonObject
-    QJsonDocument doc = QJsonDocument::fromJson(body);
+    QJsonDocument doc = parseBody(request);
     QJsonObject jsonObject = doc.object();
 
     // 从QJsonObject中获取课程的编号
@@ -1541,9 +1403,7 @@ QHttpServerResponse listLessonClasses(const QHttpServerRequest &request, Databas
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "No permission";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Forbidden);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
         return response;
     }
 
@@ -1553,9 +1413,7 @@ QHttpServerResponse listLessonClasses(const QHttpServerRequest &request, Databas
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "Lesson not found";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::NotFound);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::NotFound);
         return response;
     } else if (status == Success) {
         QJsonObject responseJsonObject;
@@ -1565,28 +1423,20 @@ QHttpServerResponse listLessonClasses(const QHttpServerRequest &request, Databas
             classesArray.append(className);
         }
         responseJsonObject["classes"] = classesArray;
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Ok);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Ok);
         return response;
     } else {
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "Failed to list lesson chosen students";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(),
-                                     QHttpServerResponder::StatusCode::InternalServerError);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::InternalServerError);
         return response;
     }
 }
 
 QHttpServerResponse updateStudentLessonGrade(const QHttpServerRequest &request, Database::database &database) {
-    // 获取请求的body
-    QByteArray body = request.body();
-
     // 解析body为一个QJsonObject
-    QJsonDocument doc = QJsonDocument::fromJson(body);
+    QJsonDocument doc = parseBody(request);
     QJsonObject jsonObject = doc.object();
 
     // 从QJsonObject中获取学生的学号
@@ -1602,9 +1452,7 @@ QHttpServerResponse updateStudentLessonGrade(const QHttpServerRequest &request,
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = true;
         responseJsonObject["message"] = "Nothing to update";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Ok);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Ok);
         return response;
     }
 
@@ -1615,9 +1463,7 @@ QHttpServerResponse updateStudentLessonGrade(const QHttpServerRequest &request,
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "No permission";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Forbidden);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
         return response;
     }
 
@@ -1651,10 +1497,7 @@ QHttpServerResponse updateStudentLessonGrade(const QHttpServerRequest &request,
         responseJsonObject["message"] = "Failed to update student lesson grade";
     }
 
-    QJsonDocument responseDoc(responseJsonObject);
-    QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-
-    QHttpServerResponse response("application/json", responseString.toUtf8(), statusCode);
+    QHttpServerResponse response = respond(request, responseJsonObject, statusCode);
     return response;
 }
 
@@ -1666,15 +1509,12 @@ QHttpServerResponse checkAccountSUPER(const QHttpServerRequest &request, Databas
         QJsonObject responseJsonObject;
         responseJsonObject["success"] = false;
         responseJsonObject["message"] = "No permission";
-        QJsonDocument responseDoc(responseJsonObject);
-        QString responseString = responseDoc.toJson(QJsonDocument::Compact);
-        QHttpServerResponse response("application/json", responseString.toUtf8(), QHttpServerResponder::StatusCode::Forbidden);
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
         return response;
     }
 
     // 从body中获取账号
-    QByteArray body = request.body();
-    QJsonDocument doc = QJsonDocument::fromJson(body);
+    QJsonDocument doc = parseBody(request);
     QJsonObject jsonObject = doc.object();
     QString account = jsonObject["Account"].toString();
 
@@ -1695,145 +1535,936 @@ QHttpServerResponse checkAccountSUPER(const QHttpServerRequest &request, Databas
         responseJsonObject["message"] = "This account is not SUPER";
     }
 
-    QJsonDocument responseDoc(responseJsonObject);
-    QString responseString = responseDoc.toJson(QJsonDocument::Compact);
+    QHttpServerResponse response = respond(request, responseJsonObject, statusCode);
+    return response;
+}
+
+QHttpServerResponse addWaitlist(const QHttpServerRequest &request, Database::database &database,
+                                Waitlist::service &waitlist) {
+    // 解析body为一个QJsonObject
+    QJsonDocument doc = parseBody(request);
+    QJsonObject jsonObject = doc.object();
+
+    // 从QJsonObject中获取学生的学号和课程的编号
+    QString studentId = jsonObject["studentId"].toString();
+    QString lessonId = jsonObject["lessonId"].toString();
+
+    // 验证权限
+    Status status = verifyAuth(request, STUDENT, studentId);
+    if (status != Success) {
+        // 如果验证失败，返回错误信息
+        QJsonObject responseJsonObject;
+        responseJsonObject["success"] = false;
+        responseJsonObject["message"] = "No permission";
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
+        return response;
+    }
+
+    // 调用addWaitlist函数
+    status = database.addWaitlist(studentId, lessonId);
+
+    // 创建一个JSON响应
+    QJsonObject responseJsonObject;
+    QHttpServerResponder::StatusCode statusCode;
+    if (status == Success) {
+        // 课程可能仍有空位，交给后台立即尝试递补
+        waitlist.notifySeatFreed(lessonId);
+        responseJsonObject["success"] = true;
+        statusCode = QHttpServerResponse::StatusCode::Ok;
+        responseJsonObject["message"] = "Waitlist added successfully";
+    } else if (status == STUDENT_NOT_FOUND) {
+        responseJsonObject["success"] = false;
+        statusCode = QHttpServerResponse::StatusCode::NotFound;
+        responseJsonObject["message"] = "Student not found";
+    } else if (status == LESSON_NOT_FOUND) {
+        responseJsonObject["success"] = false;
+        statusCode = QHttpServerResponse::StatusCode::NotFound;
+        responseJsonObject["message"] = "Lesson not found";
+    } else {
+        responseJsonObject["success"] = false;
+        statusCode = QHttpServerResponse::StatusCode::InternalServerError;
+        responseJsonObject["message"] = "Failed to add waitlist";
+    }
+    QHttpServerResponse response = respond(request, responseJsonObject, statusCode);
+    return response;
+}
+
+QHttpServerResponse deleteWaitlist(const QHttpServerRequest &request, Database::database &database) {
+    // 解析body为一个QJsonObject
+    QJsonDocument doc = parseBody(request);
+    QJsonObject jsonObject = doc.object();
+
+    // 从QJsonObject中获取学生的学号和课程的编号
+    QString studentId = jsonObject["studentId"].toString();
+    QString lessonId = jsonObject["lessonId"].toString();
+
+    // 验证权限
+    Status status = verifyAuth(request, STUDENT, studentId);
+    if (status != Success) {
+        // 如果验证失败，返回错误信息
+        QJsonObject responseJsonObject;
+        responseJsonObject["success"] = false;
+        responseJsonObject["message"] = "No permission";
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
+        return response;
+    }
+
+    // 调用deleteWaitlist函数
+    status = database.deleteWaitlist(studentId, lessonId);
+
+    // 创建一个JSON响应
+    QJsonObject responseJsonObject;
+    QHttpServerResponder::StatusCode statusCode;
+    if (status == Success) {
+        responseJsonObject["success"] = true;
+        statusCode = QHttpServerResponse::StatusCode::Ok;
+        responseJsonObject["message"] = "Waitlist deleted successfully";
+    } else if (status == NOT_FOUND) {
+        responseJsonObject["success"] = false;
+        statusCode = QHttpServerResponse::StatusCode::NotFound;
+        responseJsonObject["message"] = "Waitlist not found";
+    } else {
+        responseJsonObject["success"] = false;
+        statusCode = QHttpServerResponse::StatusCode::InternalServerError;
+        responseJsonObject["message"] = "Failed to delete waitlist";
+    }
+    QHttpServerResponse response = respond(request, responseJsonObject, statusCode);
+    return response;
+}
+
+QHttpServerResponse waitlistMetrics(const QHttpServerRequest &request, Waitlist::service &waitlist) {
+    // 验证权限
+    Status status = verifyAuth(request, SUPER);
+    if (status != Success) {
+        // 如果验证失败，返回错误信息
+        QJsonObject responseJsonObject;
+        responseJsonObject["success"] = false;
+        responseJsonObject["message"] = "No permission";
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
+        return response;
+    }
+
+    // 指标由后台线程维护，这里只读取，不访问数据库
+    const Waitlist::Metrics &metrics = waitlist.metrics();
+    qint64 promoted = metrics.Promoted;
+    QJsonObject responseJsonObject;
+    responseJsonObject["success"] = true;
+    responseJsonObject["QueueDepth"] = metrics.QueueDepth.load();
+    responseJsonObject["Promoted"] = promoted;
+    responseJsonObject["Skipped"] = qint64(metrics.Skipped);
+    responseJsonObject["LastLatency"] = qint64(metrics.LastLatency);
+    responseJsonObject["AverageLatency"] = promoted > 0 ? double(metrics.TotalLatency) / double(promoted) : 0.0;
+    responseJsonObject["MaxLatency"] = qint64(metrics.MaxLatency);
+    responseJsonObject["LastBatchTime"] = qint64(metrics.LastBatchTime);
+    QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponse::StatusCode::Ok);
+    return response;
+}
+
+QHttpServerResponse queryProfile(const QHttpServerRequest &request) {
+    // 验证权限
+    Status status = verifyAuth(request, SUPER);
+    if (status != Success) {
+        // 如果验证失败，返回错误信息
+        QJsonObject responseJsonObject;
+        responseJsonObject["success"] = false;
+        responseJsonObject["message"] = "No permission";
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
+        return response;
+    }
+
+    bool ok = false;
+    int top = request.query().queryItemValue("top").toInt(&ok);
+    if (!ok || top <= 0) {
+        top = QUERY_PROFILE_DEFAULT_TOP;
+    }
+
+    // 统计在内存中，按语句模板汇总，时间单位为微秒
+    QVector<QueryProfile::Stats> statements = QueryProfile::profiler::instance().top(top);
+    QJsonArray statementsArray;
+    for (const auto &stats: statements) {
+        QJsonObject statementObject;
+        statementObject["Statement"] = stats.Statement;
+        statementObject["Count"] = stats.Count;
+        statementObject["TotalTime"] = stats.TotalTime;
+        statementObject["AverageTime"] = stats.Count > 0 ? double(stats.TotalTime) / double(stats.Count) : 0.0;
+        statementObject["MaxTime"] = stats.MaxTime;
+        statementsArray.append(statementObject);
+    }
+    QJsonObject responseJsonObject;
+    responseJsonObject["success"] = true;
+    responseJsonObject["statements"] = statementsArray;
+    QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponse::StatusCode::Ok);
+    return response;
+}
+
+QHttpServerResponse listChanges(const QHttpServerRequest &request, Database::database &database) {
+    // 验证权限
+    Status status = verifyAuth(request, EVERYONE);
+    if (status != Success) {
+        // 如果验证失败，返回错误信息
+        QJsonObject responseJsonObject;
+        responseJsonObject["success"] = false;
+        responseJsonObject["message"] = "No permission";
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
+        return response;
+    }
+
+    // 从查询参数中获取客户端已同步到的序号，缺省表示第一次同步
+    bool ok = false;
+    qint64 since = request.query().queryItemValue("since").toLongLong(&ok);
+    if (!ok) {
+        since = -1;
+    }
+
+    QVector<Change> changes;
+    qint64 latest = 0;
+    bool reset = false;
+    status = database.listChanges(since, CHANGES_PAGE_SIZE, changes, latest, reset);
+
+    // 创建一个JSON响应
+    QJsonObject responseJsonObject;
+    QHttpServerResponder::StatusCode statusCode;
+    if (status == Success) {
+        statusCode = QHttpServerResponse::StatusCode::Ok;
+        responseJsonObject["success"] = true;
+        responseJsonObject["reset"] = reset;
+        // 每条变更为 [实体类型, 编号, 版本号]，版本号为-1表示已删除
+        QJsonArray changesArray;
+        for (const auto &change: changes) {
+            changesArray.append(QJsonArray{change.Entity, change.Id, change.Version});
+        }
+        responseJsonObject["changes"] = changesArray;
+        // 本页之后还有变更时，客户端以next继续请求
+        responseJsonObject["next"] = changes.isEmpty() || reset ? latest : changes.last().Seq;
+        responseJsonObject["more"] = !reset && changes.size() == CHANGES_PAGE_SIZE;
+    } else {
+        statusCode = QHttpServerResponse::StatusCode::InternalServerError;
+        responseJsonObject["success"] = false;
+        responseJsonObject["message"] = "Failed to list changes";
+    }
+    QHttpServerResponse response = respond(request, responseJsonObject, statusCode);
+    return response;
+}
+
+QHttpServerResponse submitPreferences(const QHttpServerRequest &request, Database::database &database) {
+    // 解析body为一个QJsonObject
+    QJsonDocument doc = parseBody(request);
+    QJsonObject jsonObject = doc.object();
+
+    // 从QJsonObject中获取学生的学号和按志愿顺序排列的课程编号
+    QString studentId = jsonObject["studentId"].toString();
+    QVector<QString> lessonIds;
+    for (const auto &lessonId: jsonObject["lessonIds"].toArray()) {
+        lessonIds.append(lessonId.toString());
+    }
+
+    // 验证权限
+    Status status = verifyAuth(request, STUDENT, studentId);
+    if (status != Success) {
+        // 如果验证失败，返回错误信息
+        QJsonObject responseJsonObject;
+        responseJsonObject["success"] = false;
+        responseJsonObject["message"] = "No permission";
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
+        return response;
+    }
+
+    //处理异常值，返回错误信息
+    if (lessonIds.size() > MAX_PREFERENCES) {
+        QJsonObject responseJsonObject;
+        responseJsonObject["success"] = false;
+        responseJsonObject["message"] = "Too many preferences";
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::BadRequest);
+        return response;
+    }
+
+    // 调用updatePreferences函数
+    status = database.updatePreferences(studentId, lessonIds);
+
+    // 创建一个JSON响应
+    QJsonObject responseJsonObject;
+    QHttpServerResponder::StatusCode statusCode;
+    if (status == Success) {
+        responseJsonObject["success"] = true;
+        statusCode = QHttpServerResponse::StatusCode::Ok;
+        responseJsonObject["message"] = "Preferences submitted successfully";
+    } else if (status == STUDENT_NOT_FOUND) {
+        responseJsonObject["success"] = false;
+        statusCode = QHttpServerResponse::StatusCode::NotFound;
+        responseJsonObject["message"] = "Student not found";
+    } else if (status == LESSON_NOT_FOUND) {
+        responseJsonObject["success"] = false;
+        statusCode = QHttpServerResponse::StatusCode::NotFound;
+        responseJsonObject["message"] = "Lesson not found";
+    } else {
+        responseJsonObject["success"] = false;
+        statusCode = QHttpServerResponse::StatusCode::InternalServerError;
+        responseJsonObject["message"] = "Failed to submit preferences";
+    }
+    QHttpServerResponse response = respond(request, responseJsonObject, statusCode);
+    return response;
+}
+
+QHttpServerResponse runAllocation(const QHttpServerRequest &request, Allocation::service &allocation) {
+    // 验证权限
+    Status status = verifyAuth(request, SUPER);
+    if (status != Success) {
+        // 如果验证失败，返回错误信息
+        QJsonObject responseJsonObject;
+        responseJsonObject["success"] = false;
+        responseJsonObject["message"] = "No permission";
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
+        return response;
+    }
+
+    // 解析body为一个QJsonObject
+    QJsonDocument doc = parseBody(request);
+    QJsonObject jsonObject = doc.object();
+
+    // 从QJsonObject中获取抽签种子和分配方式，默认为当前时间和抽签分配
+    quint64 seed = jsonObject.contains("Seed") ? quint64(jsonObject["Seed"].toInteger())
+                                               : quint64(QDateTime::currentMSecsSinceEpoch());
+    int mode = jsonObject["Mode"].toString() == "priority" ? ALLOCATION_PRIORITY : ALLOCATION_LOTTERY;
+
+    // 分配在后台线程中进行，结果通过 /api/allocationStatus/ 查询
+    QJsonObject responseJsonObject;
+    QHttpServerResponder::StatusCode statusCode;
+    if (allocation.start(seed, mode)) {
+        responseJsonObject["success"] = true;
+        statusCode = QHttpServerResponse::StatusCode::Accepted;
+        responseJsonObject["message"] = "Allocation started";
+        responseJsonObject["Seed"] = QString::number(seed);
+    } else {
+        responseJsonObject["success"] = false;
+        statusCode = QHttpServerResponse::StatusCode::Conflict;
+        responseJsonObject["message"] = "Allocation is already running";
+    }
+    QHttpServerResponse response = respond(request, responseJsonObject, statusCode);
+    return response;
+}
+
+QHttpServerResponse allocationStatus(const QHttpServerRequest &request, Allocation::service &allocation) {
+    // 验证权限
+    Status status = verifyAuth(request, SUPER);
+    if (status != Success) {
+        // 如果验证失败，返回错误信息
+        QJsonObject responseJsonObject;
+        responseJsonObject["success"] = false;
+        responseJsonObject["message"] = "No permission";
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
+        return response;
+    }
 
-    QHttpServerResponse response("application/json", responseString.toUtf8(), statusCode);
+    Allocation::Progress progress = allocation.progress();
+    QJsonObject responseJsonObject;
+    responseJsonObject["success"] = true;
+    responseJsonObject["Running"] = progress.Running;
+    responseJsonObject["Finished"] = progress.Finished;
+    responseJsonObject["Seed"] = QString::number(progress.Seed);
+    responseJsonObject["Mode"] = progress.Mode == ALLOCATION_PRIORITY ? "priority" : "lottery";
+    responseJsonObject["StartTime"] = progress.StartTime;
+    if (progress.Finished) {
+        // 正在进行新的分配时，结果为上一次完成的分配
+        responseJsonObject["Result"] = progress.RunStatus == Success ? "success" : "failed";
+        responseJsonObject["Students"] = progress.RunResult.Students;
+        responseJsonObject["Preferences"] = progress.RunResult.Preferences;
+        responseJsonObject["Allocated"] = progress.RunResult.Allocated;
+        responseJsonObject["Rejected"] = progress.RunResult.Rejected;
+        responseJsonObject["Groups"] = progress.RunResult.Groups;
+        responseJsonObject["AllocateTime"] = progress.RunResult.AllocateTime;
+        responseJsonObject["WriteTime"] = progress.RunResult.WriteTime;
+    }
+    QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponse::StatusCode::Ok);
     return response;
 }
 
-void addRoute(QHttpServer &httpServer, Database::database database) {
+// 批量请求中单个操作的结果，状态码和消息与对应的单独接口相同
+QJsonObject batchResult(Status status, const QString &successMessage, const QString &failureMessage) {
+    QJsonObject result;
+    QHttpServerResponder::StatusCode statusCode;
+    if (status == Success) {
+        result["success"] = true;
+        statusCode = QHttpServerResponse::StatusCode::Ok;
+        result["message"] = successMessage;
+    } else if (status == STUDENT_NOT_FOUND) {
+        result["success"] = false;
+        statusCode = QHttpServerResponse::StatusCode::NotFound;
+        result["message"] = "Student not found";
+    } else if (status == LESSON_NOT_FOUND) {
+        result["success"] = false;
+        statusCode = QHttpServerResponse::StatusCode::NotFound;
+        result["message"] = "Lesson not found";
+    } else if (status == LESSON_FULL) {
+        result["success"] = false;
+        statusCode = QHttpServerResponse::StatusCode::Conflict;
+        result["message"] = "Lesson is full";
+    } else {
+        result["success"] = false;
+        statusCode = QHttpServerResponse::StatusCode::InternalServerError;
+        result["message"] = failureMessage;
+    }
+    result["status"] = int(statusCode);
+    return result;
+}
+
+// 在一次请求、一个事务中执行多个操作，body格式如下：
+// {"operations": [{"route": "addChosenLesson", "body": {"studentId": "...", "lessonId": "..."}}, ...]}
+// 每个操作使用各自的保存点，失败的操作只撤销自己的修改，结果按顺序放在results中
+QHttpServerResponse batch(const QHttpServerRequest &request, Database::database &database,
+                          Waitlist::service &waitlist) {
+    // 验证权限，批量请求中的操作都只允许管理员执行，整个批次只验证一次
+    Status status = verifyAuth(request, SUPER);
+    if (status != Success) {
+        // 如果验证失败，返回错误信息
+        QJsonObject responseJsonObject;
+        responseJsonObject["success"] = false;
+        responseJsonObject["message"] = "No permission";
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::Forbidden);
+        return response;
+    }
+
+    // 解析body为一个QJsonObject
+    QJsonDocument doc = parseBody(request);
+    QJsonObject jsonObject = doc.object();
+    QJsonArray operations = jsonObject["operations"].toArray();
+    if (operations.size() > BATCH_MAX_OPERATIONS) {
+        QJsonObject responseJsonObject;
+        responseJsonObject["success"] = false;
+        responseJsonObject["message"] = "Too many operations";
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::PayloadTooLarge);
+        return response;
+    }
+
+    if (!database.transaction()) {
+        QJsonObject responseJsonObject;
+        responseJsonObject["success"] = false;
+        responseJsonObject["message"] = "Failed to execute batch";
+        QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::InternalServerError);
+        return response;
+    }
+    QJsonArray results;
+    QSet<QString> freedLessons;
+    for (const auto &item: operations) {
+        QJsonObject operation = item.toObject();
+        // 同时接受 "addChosenLesson" 和 "/api/addChosenLesson/" 两种写法
+        QString route = operation["route"].toString().remove("/api/").remove('/');
+        QJsonObject body = operation["body"].toObject();
+        QString studentId = body["studentId"].toString();
+        QString lessonId = body["lessonId"].toString();
+        if (route == "addChosenLesson") {
+            status = database.addChosenLesson(studentId, lessonId);
+            results.append(batchResult(status, "Chosen lesson added successfully", "Failed to add chosen lesson"));
+        } else if (route == "deleteChosenLesson") {
+            status = database.deleteChosenLesson(studentId, lessonId);
+            if (status == Success) {
+                freedLessons.insert(lessonId);
+            }
+            results.append(batchResult(status, "Chosen lesson deleted successfully", "Failed to delete chosen lesson"));
+        } else {
+            QJsonObject result;
+            result["success"] = false;
+            result["status"] = int(QHttpServerResponse::StatusCode::BadRequest);
+            result["message"] = "Unsupported route";
+            results.append(result);
+        }
+    }
+
+    // 创建一个JSON响应
+    QJsonObject responseJsonObject;
+    QHttpServerResponder::StatusCode statusCode;
+    if (database.commit()) {
+        // 提交后再通知后台递补候补学生，候补线程的连接不会等待本事务的锁
+        for (const auto &lessonId: freedLessons) {
+            waitlist.notifySeatFreed(lessonId);
+        }
+        responseJsonObject["success"] = true;
+        statusCode = QHttpServerResponse::StatusCode::Ok;
+        responseJsonObject["message"] = "Batch executed successfully";
+        responseJsonObject["results"] = results;
+    } else {
+        database.rollback();
+        responseJsonObject["success"] = false;
+        statusCode = QHttpServerResponse::StatusCode::InternalServerError;
+        responseJsonObject["message"] = "Failed to execute batch";
+    }
+    QHttpServerResponse response = respond(request, responseJsonObject, statusCode);
+    return response;
+}
+
+// 写请求按 Idempotency-Key 去重：同一账号在同一路径上重复提交同一个Key时直接返回首次执行的结果，不再执行SQL
+template<typename Handler>
+auto idempotent(const QHttpServerRequest &request, Idempotency::cache &idempotencyCache, Handler handler) {
+    // 处理函数可能同步返回响应，也可能返回在主线程完成的QFuture（如需要计算密码哈希的请求）
+    using Response = decltype(handler());
+    constexpr bool async = std::is_same_v<Response, QFuture<QHttpServerResponse>>;
+    auto ready = [](QHttpServerResponse &&response) -> Response {
+        if constexpr (async) {
+            return readyResponse(std::move(response));
+        } else {
+            return std::move(response);
+        }
+    };
+
+    QByteArray idempotencyKey = request.value(IDEMPOTENCY_HEADER);
+    if (idempotencyKey.isEmpty()) {
+        return handler();
+    }
+
+    QString key = Idempotency::cache::makeKey(verifyJwt(request).Account, request.url().path(), idempotencyKey);
+    QByteArray requestHash = Idempotency::cache::hashBody(request.body());
+    Idempotency::Entry entry;
+    bool found = idempotencyCache.find(key, entry);
+    Metrics::registry::instance().recordCache(METRICS_CACHE_IDEMPOTENCY, found);
+    if (found) {
+        if (entry.RequestHash != requestHash) {
+            // 同一个Key被用于内容不同的请求，拒绝执行
+            QJsonObject responseJsonObject;
+            responseJsonObject["success"] = false;
+            responseJsonObject["message"] = "Idempotency key reused with a different request";
+            QHttpServerResponse response = respond(request, responseJsonObject, QHttpServerResponder::StatusCode::UnprocessableEntity);
+            return ready(std::move(response));
+        }
+        if (entry.Pending) {
+            // 第一次请求还在处理（如等待密码哈希），重试不能再执行一次，稍后重试时返回其结果
+            return ready(rejectRequest("A request with this idempotency key is still in progress",
+                                       QHttpServerResponder::StatusCode::Conflict, IDEMPOTENCY_RETRY_AFTER));
+        }
+        QHttpServerResponse response(entry.MimeType, entry.Body, entry.StatusCode);
+        response.addHeader(IDEMPOTENCY_REPLAYED_HEADER, "true");
+        return ready(std::move(response));
+    }
+
+    // 在调用处理函数前占用Key，异步处理完成前到达的重试会看到处理中的记录
+    idempotencyCache.reserve(key, requestHash);
+    auto store = [&idempotencyCache, key, requestHash](const QHttpServerResponse &response) {
+        // 服务器内部错误可能是暂时的，不缓存，释放Key允许客户端重试
+        if (int(response.statusCode()) >= 500) {
+            idempotencyCache.remove(key);
+        } else {
+            Idempotency::Entry entry;
+            entry.RequestHash = requestHash;
+            entry.MimeType = response.mimeType();
+            entry.Body = response.data();
+            entry.StatusCode = response.statusCode();
+            entry.ExpireTime = QDateTime::currentMSecsSinceEpoch() + IDEMPOTENCY_TTL;
+            idempotencyCache.insert(key, entry);
+        }
+    };
+    if constexpr (async) {
+        return handler().then(qApp, [store](QFuture<QHttpServerResponse> future) {
+            QHttpServerResponse response = future.takeResult();
+            store(response);
+            return response;
+        });
+    } else {
+        QHttpServerResponse response = handler();
+        store(response);
+        return response;
+    }
+}
+
+// 在响应中附加各阶段的耗时，并按抽样写入跟踪日志
+void addServerTiming(QHttpServerResponse &response, const QString &path, const Tracing::context &trace) {
+    if (!TRACE_ENABLED) {
+        return;
+    }
+    response.addHeader("Server-Timing", trace.header());
+    if (Tracing::sampled()) {
+        Tracing::log(path, int(response.statusCode()), trace);
+    }
+}
+
+// 请求分发路径上共享的限流、过载保护和幂等缓存
+class Gateway {
+public:
+    RateLimit::limiter limiter;
+    RateLimit::shedder shedder;
+    Idempotency::cache idempotencyCache;
+};
+
+// 所有API请求的统一入口：过载保护 -> 按IP和账号限流 -> 写请求幂等 -> 执行处理函数
+template<typename Handler>
+auto dispatch(const QHttpServerRequest &request, Gateway &gateway, int routeType, Handler handler) {
+    using Response = decltype(handler());
+    constexpr bool async = std::is_same_v<Response, QFuture<QHttpServerResponse>>;
+    // 按路由统计，路径中的编号（如 /api/getStudentInformation/<id>）不计入路由名
+    Metrics::route &metrics = Metrics::registry::instance().findRoute(request.url().path().section('/', 0, 2) + '/');
+    QElapsedTimer timer;
+    timer.start();
+    metrics.begin();
+    // 处理函数同步执行的部分在当前线程中计时，异步完成的部分（如密码哈希）只计入total
+    Tracing::context trace;
+    Tracing::activation activation(TRACE_ENABLED ? &trace : nullptr);
+    auto reject = [&metrics, &timer](const QString &message, QHttpServerResponder::StatusCode statusCode,
+                                     int retryAfter) -> Response {
+        metrics.end(timer.nsecsElapsed() / 1000, int(statusCode));
+        if constexpr (async) {
+            return readyResponse(rejectRequest(message, statusCode, retryAfter));
+        } else {
+            return rejectRequest(message, statusCode, retryAfter);
+        }
+    };
+
+    if (gateway.shedder.overloaded()) {
+        return reject("Server is overloaded", QHttpServerResponder::StatusCode::ServiceUnavailable,
+                      SHED_RETRY_AFTER);
+    }
+
+    int retryAfter = 0;
+    if (!gateway.limiter.acquire("ip:" + request.remoteAddress().toString(), RATE_LIMIT_IP_RATE,
+                                 RATE_LIMIT_IP_BURST, retryAfter)) {
+        return reject("Too many requests", QHttpServerResponder::StatusCode::TooManyRequests, retryAfter);
+    }
+    QString account = verifyJwt(request).Account;
+    if (!account.isEmpty() &&
+        !gateway.limiter.acquire("account:" + account, RATE_LIMIT_ACCOUNT_RATE, RATE_LIMIT_ACCOUNT_BURST,
+                                 retryAfter)) {
+        return reject("Too many requests", QHttpServerResponder::StatusCode::TooManyRequests, retryAfter);
+    }
+
+    gateway.shedder.begin();
+    Response response = routeType == ROUTE_WRITE
+                        ? idempotent(request, gateway.idempotencyCache, handler)
+                        : handler();
+    if constexpr (async) {
+        // 异步请求在响应完成时才计入耗时，排队等待哈希的时间也反映在延迟中
+        return response.then(qApp, [&gateway, &metrics, timer, trace, path = request.url().path()](
+                QFuture<QHttpServerResponse> future) {
+            gateway.shedder.end(timer.elapsed());
+            QHttpServerResponse result = future.takeResult();
+            metrics.end(timer.nsecsElapsed() / 1000, int(result.statusCode()));
+            addServerTiming(result, path, trace);
+            return result;
+        });
+    } else {
+        gateway.shedder.end(timer.elapsed());
+        metrics.end(timer.nsecsElapsed() / 1000, int(response.statusCode()));
+        addServerTiming(response, request.url().path(), trace);
+        return response;
+    }
+}
+
+void addRoute(QHttpServer &httpServer, Database::database &database, Waitlist::service &waitlist,
+              Allocation::service &allocation, Password::hasher &hasher, Gateway &gateway) {
     httpServer.route("/", [](const QHttpServerRequest &request) {
         return "教务信息管理系统已运行！";
     });
-    httpServer.route("/api/getStudentInformation/", [&database](const QString &studentId) {
-        return getStudentInformation(studentId, database);
+    // 不经过dispatch：抓取指标不受限流影响，也不计入请求统计
+    httpServer.route("/metrics", QHttpServerRequest::Method::Get, []() {
+        return QHttpServerResponse("text/plain; version=0.0.4; charset=utf-8",
+                                   Metrics::registry::instance().exposition());
     });
+    httpServer.route("/api/getStudentInformation/",
+                     [&database, &gateway](const QString &studentId, const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_READ, [&]() {
+                             return getStudentInformation(studentId, request, database);
+                         });
+                     });
     httpServer.route("/api/updateStudentInformation/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return updateStudentInformation(request, database);
+                     [&database, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_WRITE, [&]() {
+                             return updateStudentInformation(request, database);
+                         });
                      });
     httpServer.route("/api/updateLessonInformation/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return updateLessonInformation(request, database);
+                     [&database, &waitlist, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_WRITE, [&]() {
+                             return updateLessonInformation(request, database, waitlist);
+                         });
+                     });
+    httpServer.route("/api/getLessonInformation/",
+                     [&database, &gateway](const QString &lessonId, const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_READ, [&]() {
+                             return getLessonInformation(lessonId, request, database);
+                         });
+                     });
+    httpServer.route("/api/getTeacherInformation/",
+                     [&database, &gateway](const QString &teacherId, const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_READ, [&]() {
+                             return getTeacherInformation(teacherId, request, database);
+                         });
                      });
-    httpServer.route("/api/getLessonInformation/", [&database](const QString &lessonId) {
-        return getLessonInformation(lessonId, database);
-    });
-    httpServer.route("/api/getTeacherInformation/", [&database](const QString &teacherId) {
-        return getTeacherInformation(teacherId, database);
-    });
     httpServer.route("/api/updateTeacherInformation/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return updateTeacherInformation(request, database);
+                     [&database, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_WRITE, [&]() {
+                             return updateTeacherInformation(request, database);
+                         });
                      });
     httpServer.route("/api/addTeachingLessons/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return addTeachingLessons(request, database);
+                     [&database, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_WRITE, [&]() {
+                             return addTeachingLessons(request, database);
+                         });
                      });
     httpServer.route("/api/deleteStudent/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return deleteStudent(request, database);
+                     [&database, &waitlist, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_WRITE, [&]() {
+                             return deleteStudent(request, database, waitlist);
+                         });
                      });
     httpServer.route("/api/listStudents/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return listStudents(request, database);
+                     [&database, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_READ, [&]() {
+                             return listStudents(request, database);
+                         });
                      });
     httpServer.route("/api/listTeachers/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return listTeachers(request, database);
+                     [&database, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_READ, [&]() {
+                             return listTeachers(request, database);
+                         });
                      });
     httpServer.route("/api/listLessons/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return listLessons(request, database);
+                     [&database, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_READ, [&]() {
+                             return listLessons(request, database);
+                         });
                      });
     httpServer.route("/api/login/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return login(request, database);
+                     [&database, &gateway, &hasher](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_READ, [&]() {
+                             return login(request, database, hasher);
+                         });
                      });
     httpServer.route("/api/createAccount/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return createAccount(request, database);
+                     [&database, &gateway, &hasher](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_WRITE, [&]() {
+                             return createAccount(request, database, hasher);
+                         });
                      });
     httpServer.route("/api/deleteLesson/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return deleteLesson(request, database);
+                     [&database, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_WRITE, [&]() {
+                             return deleteLesson(request, database);
+                         });
                      });
     httpServer.route("/api/deleteTeacher/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return deleteTeacher(request, database);
+                     [&database, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_WRITE, [&]() {
+                             return deleteTeacher(request, database);
+                         });
                      });
     httpServer.route("/api/getStudentByClass/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return getStudentByClass(request, database);
+                     [&database, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_READ, [&]() {
+                             return getStudentByClass(request, database);
+                         });
                      });
     httpServer.route("/api/changePassword/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return changePassword(request, database);
+                     [&database, &gateway, &hasher](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_WRITE, [&]() {
+                             return changePassword(request, database, hasher);
+                         });
                      });
     httpServer.route("/api/getStudentLessonGrade/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return getStudentLessonGrade(request, database);
+                     [&database, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_READ, [&]() {
+                             return getStudentLessonGrade(request, database);
+                         });
                      });
     httpServer.route("/api/listLessonClasses/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return listLessonClasses(request, database);
+                     [&database, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_READ, [&]() {
+                             return listLessonClasses(request, database);
+                         });
                      });
     httpServer.route("/api/updateStudentLessonGrade/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return updateStudentLessonGrade(request, database);
+                     [&database, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_WRITE, [&]() {
+                             return updateStudentLessonGrade(request, database);
+                         });
                      });
     httpServer.route("/api/changePassword/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return changePassword(request, database);
+                     [&database, &gateway, &hasher](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_WRITE, [&]() {
+                             return changePassword(request, database, hasher);
+                         });
                      });
     httpServer.route("/api/addAccount/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return addAccount(request, database);
+                     [&database, &gateway, &hasher](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_WRITE, [&]() {
+                             return addAccount(request, database, hasher);
+                         });
                      });
     httpServer.route("/api/checkAccountSUPER/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return checkAccountSUPER(request, database);
+                     [&database, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_READ, [&]() {
+                             return checkAccountSUPER(request, database);
+                         });
                      });
     httpServer.route("/api/updateAccount/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return updateAccount(request, database);
+                     [&database, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_WRITE, [&]() {
+                             return updateAccount(request, database);
+                         });
                      });
     httpServer.route("/api/updateLessonChosenStudent/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return updateLessonChosenStudent(request, database);
+                     [&database, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_WRITE, [&]() {
+                             return updateLessonChosenStudent(request, database);
+                         });
                      });
     httpServer.route("/api/deleteChosenLesson/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return deleteChosenLesson(request, database);
+                     [&database, &waitlist, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_WRITE, [&]() {
+                             return deleteChosenLesson(request, database, waitlist);
+                         });
                      });
     httpServer.route("/api/addChosenLesson/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return addChosenLesson(request, database);
+                     [&database, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_WRITE, [&]() {
+                             return addChosenLesson(request, database);
+                         });
                      });
     httpServer.route("/api/addRetake/", QHttpServerRequest::Method::Post,
-                     [&database](const QHttpServerRequest &request) {
-                         return addRetake(request, database);
+                     [&database, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_WRITE, [&]() {
+                             return addRetake(request, database);
+                         });
+                     });
+    httpServer.route("/api/addWaitlist/", QHttpServerRequest::Method::Post,
+                     [&database, &waitlist, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_WRITE, [&]() {
+                             return addWaitlist(request, database, waitlist);
+                         });
+                     });
+    httpServer.route("/api/deleteWaitlist/", QHttpServerRequest::Method::Post,
+                     [&database, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_WRITE, [&]() {
+                             return deleteWaitlist(request, database);
+                         });
+                     });
+    httpServer.route("/api/waitlistMetrics/", QHttpServerRequest::Method::Post,
+                     [&waitlist, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_READ, [&]() {
+                             return waitlistMetrics(request, waitlist);
+                         });
+                     });
+    httpServer.route("/api/queryProfile/", QHttpServerRequest::Method::Get,
+                     [&gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_READ, [&]() {
+                             return queryProfile(request);
+                         });
+                     });
+    httpServer.route("/api/changes/", QHttpServerRequest::Method::Get,
+                     [&database, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_READ, [&]() {
+                             return listChanges(request, database);
+                         });
+                     });
+    httpServer.route("/api/submitPreferences/", QHttpServerRequest::Method::Post,
+                     [&database, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_WRITE, [&]() {
+                             return submitPreferences(request, database);
+                         });
+                     });
+    httpServer.route("/api/runAllocation/", QHttpServerRequest::Method::Post,
+                     [&allocation, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_WRITE, [&]() {
+                             return runAllocation(request, allocation);
+                         });
+                     });
+    httpServer.route("/api/allocationStatus/", QHttpServerRequest::Method::Get,
+                     [&allocation, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_READ, [&]() {
+                             return allocationStatus(request, allocation);
+                         });
+                     });
+    httpServer.route("/api/batch/", QHttpServerRequest::Method::Post,
+                     [&database, &waitlist, &gateway](const QHttpServerRequest &request) {
+                         return dispatch(request, gateway, ROUTE_WRITE, [&]() {
+                             return batch(request, database, waitlist);
+                         });
                      });
 
 }
 
-void addLogger(QHttpServer &httpServer) {
-    httpServer.afterRequest([](const QHttpServerRequest &request, QHttpServerResponse &&response) {
-        // 获取请求的路径
-        QString path = request.url().path();
-        // 获取时间
-        QDateTime current_date_time = QDateTime::currentDateTime();
-        // 打印路径
-        qInfo() << "AIMS Server:"
-                << current_date_time.toString("yyyy-MM-dd hh:mm:ss") + " " + request.remoteAddress().toString() + ":" +
-                   QString::number(request.remotePort()) + " " +
-                   QVariant::fromValue(request.method()).toString() + " " + path << int(response.statusCode());
-        // 返回响应
+// 重新构造响应时需要从原响应复制过来的header，Content-Type由构造函数重新设置
+const QByteArray responseKeepHeaders[] = {
+        "Retry-After",
+        "ETag",
+        "Server-Timing",
+        IDEMPOTENCY_REPLAYED_HEADER,
+};
+
+QHttpServerResponse encodeResponse(const QHttpServerRequest &request, QHttpServerResponse &&response) {
+    if (response.mimeType() != MIME_JSON || WireFormat::negotiate(request.value("Accept")) != FORMAT_CBOR) {
+        return std::move(response);
+    }
+    QByteArray encoded = WireFormat::toCbor(response.data());
+    if (encoded.isEmpty()) {
         return std::move(response);
+    }
+
+    QHttpServerResponse encodedResponse(MIME_CBOR, encoded, response.statusCode());
+    for (const auto &name: responseKeepHeaders) {
+        for (const auto &value: response.headers(name)) {
+            encodedResponse.addHeader(name, value);
+        }
+    }
+    return encodedResponse;
+}
+
+QHttpServerResponse compressResponse(const QHttpServerRequest &request, QHttpServerResponse &&response) {
+    QByteArray data = response.data();
+    if (data.size() < COMPRESSION_THRESHOLD || response.hasHeader("Content-Encoding")) {
+        return std::move(response);
+    }
+    int encoding = Compression::negotiate(request.value("Accept-Encoding"));
+    QByteArray compressed = Compression::compress(data, encoding);
+    if (compressed.isEmpty() || compressed.size() >= data.size()) {
+        return std::move(response);
+    }
+
+    QHttpServerResponse compressedResponse(response.mimeType(), compressed, response.statusCode());
+    for (const auto &name: responseKeepHeaders) {
+        for (const auto &value: response.headers(name)) {
+            compressedResponse.addHeader(name, value);
+        }
+    }
+    compressedResponse.addHeader("Content-Encoding", Compression::encodingName(encoding));
+    return compressedResponse;
+}
+
+void addLogger(QHttpServer &httpServer, AccessLog::service &accessLog) {
+    httpServer.afterRequest([&accessLog](const QHttpServerRequest &request, QHttpServerResponse &&response) {
+        // 只向环形缓冲区写入定长记录，格式化和写文件由后台线程批量完成
+        accessLog.append(request, int(response.statusCode()));
+        // 未经过写入器的响应（如限流拒绝）在这里转换格式，再按支持的编码压缩响应
+        QHttpServerResponse negotiated = compressResponse(request, encodeResponse(request, std::move(response)));
+        // 每个响应的格式和编码都取决于这两个请求头，未转换或未压缩的响应同样要告知缓存
+        negotiated.addHeader("Vary", "Accept, Accept-Encoding");
+        return negotiated;
     });
 }
 
+// 把后台线程和请求路径上各模块维护的状态注册到 /metrics，抓取时读取，不增加请求路径的开销
+void addMetrics(Waitlist::service &waitlist, Password::hasher &hasher, Gateway &gateway) {
+    Metrics::registry &registry = Metrics::registry::instance();
+    const Waitlist::Metrics &waitlistMetrics = waitlist.metrics();
+    registry.addCallback("aims_waitlist_queue_depth", "gauge", "Students currently waiting for a seat.",
+                         [&waitlistMetrics]() { return double(waitlistMetrics.QueueDepth.load()); });
+    registry.addCallback("aims_waitlist_promoted_total", "counter", "Students promoted from the waitlist.",
+                         [&waitlistMetrics]() { return double(waitlistMetrics.Promoted.load()); });
+    registry.addCallback("aims_waitlist_skipped_total", "counter",
+                         "Waitlist entries skipped for time conflicts, credit limits or full lessons.",
+                         [&waitlistMetrics]() { return double(waitlistMetrics.Skipped.load()); });
+    registry.addCallback("aims_waitlist_promotion_latency_seconds_max", "gauge",
+                         "Longest wait between a freed seat and the promotion.",
+                         [&waitlistMetrics]() { return double(waitlistMetrics.MaxLatency.load()) / 1e3; });
+    registry.addCallback("aims_waitlist_last_batch_duration_seconds", "gauge",
+                         "Duration of the most recent promotion batch.",
+                         [&waitlistMetrics]() { return double(waitlistMetrics.LastBatchTime.load()) / 1e3; });
+    registry.addCallback("aims_shed_in_flight", "gauge", "Requests admitted by load shedding and not yet finished.",
+                         [&gateway]() { return double(gateway.shedder.inFlight()); });
+    registry.addCallback("aims_shed_event_loop_lag_seconds", "gauge", "Smoothed event loop lag used by load shedding.",
+                         [&gateway]() { return double(gateway.shedder.lag()) / 1e3; });
+    registry.addCallback("aims_shed_latency_p99_seconds", "gauge", "Recent request latency P99 used by load shedding.",
+                         [&gateway]() { return double(gateway.shedder.latencyP99()) / 1e3; });
+    registry.addCallback("aims_password_hash_pending", "gauge", "Password hashes queued or running.",
+                         [&hasher]() { return double(hasher.pending()); });
+}
+
 void showStartInfo(quint16 port) {
     qInfo() << "Info | AIMS Server started!";
     qInfo() << "Info | Use the following URL to access the server:";
@@ -1857,17 +2488,63 @@ void showStartInfo(quint16 port) {
         }
     }
 }
-
+// 表结构新建或升级后还没有通过一致性检查时，在后台线程中用独立的数据库连接检查，不阻塞启动
+QFuture<void> checkDatabaseInBackground(Database::database &database, const QString &path) {
+    if (!database.needsCheck()) {
+        return QFuture<void>();
+    }
+    return QtConcurrent::run([path]() {
+        QElapsedTimer timer;
+        timer.start();
+        // 数据库连接必须在使用它的线程中创建
+        Database::database checker(path, "check");
+        if (checker.checkDatabase() == Success && checker.markChecked() == Success) {
+            qInfo() << "Info | Database check finished in" << timer.elapsed() << "ms";
+        } else {
+            qInfo() << "Info | Database check failed, it will run again at next start";
+        }
+    });
+}
 
 int main(int argc, char *argv[]) {
+    QElapsedTimer startupTimer;
+    startupTimer.start();
     QCoreApplication app(argc, argv);
 
+    // 访问日志在后台线程中写入文件；慢查询和跟踪日志也经由它的缓冲区写出，须先于所有数据库连接创建、最后销毁
+    AccessLog::service accessLog(ACCESS_LOG_PATH);
+    QueryProfile::profiler::instance().setSlowLog([&accessLog](const QString &line) {
+        accessLog.message(ACCESS_LOG_SLOW_QUERY, line);
+    });
+    Tracing::setLog([&accessLog](const QString &line) {
+        accessLog.message(ACCESS_LOG_TRACE, line);
+    });
+
     Database::database database("AIMS.sqlite");
+    QFuture<void> databaseCheck = checkDatabaseInBackground(database, "AIMS.sqlite");
+    // 候补递补在后台线程中使用独立的数据库连接
+    Waitlist::service waitlist("AIMS.sqlite");
+    // 批量分配同样在后台线程中使用独立的数据库连接，不阻塞事件循环
+    Allocation::service allocation("AIMS.sqlite");
+    // 密码哈希在独立的有界线程池中计算
+    Password::hasher hasher;
+    Gateway gateway;
+    // 过载保护按主线程事件循环的延迟判断，定时器须在主线程中启动
+    gateway.shedder.start();
 
     quint16 portArg = PORT;
     QHttpServer httpServer;
-    addRoute(httpServer, database);
-    addLogger(httpServer);
+    addRoute(httpServer, database, waitlist, allocation, hasher, gateway);
+    addLogger(httpServer, accessLog);
+    addMetrics(waitlist, hasher, gateway);
+
+    // WebSocket连接用于推送缓存失效通知，升级后交给推送中心管理
+    Push::hub hub(database, jwtVerifier());
+    QObject::connect(&httpServer, &QAbstractHttpServer::newWebSocketConnection, &hub, [&httpServer, &hub]() {
+        while (httpServer.hasPendingWebSocketConnections()) {
+            hub.addConnection(httpServer.nextPendingWebSocketConnection());
+        }
+    });
 
     const auto port = httpServer.listen(QHostAddress::Any, portArg);
     if (!port) {
@@ -1876,6 +2553,10 @@ int main(int argc, char *argv[]) {
     }
 
     showStartInfo(port);
+    qInfo() << "Info | Startup time:" << startupTimer.elapsed() << "ms";
 
-    return QCoreApplication::exec();
+    int exitCode = QCoreApplication::exec();
+    // 退出前等待后台检查完成
+    databaseCheck.waitForFinished();
+    return exitCode;
 }
\ No newline at end of file
@@ -0,0 +1,339 @@
+#include "metrics.h"
+#include <QMutexLocker>
+#include <bit>
+#include <cmath>
+
+namespace Metrics {
+
+    namespace {
+
+        const char *const STATEMENT_NAMES[METRICS_STATEMENT_COUNT] = {"select", "insert", "update", "delete", "other"};
+
+        const char *const CACHE_NAMES[METRICS_CACHE_COUNT] = {"jwt", "idempotency", "etag"};
+
+        const char *const STATUS_NAMES[5] = {"1xx", "2xx", "3xx", "4xx", "5xx"};
+
+        const double QUANTILES[] = {0.5, 0.9, 0.99};
+
+        // 标签值中的反斜杠、双引号和换行需要转义
+        QByteArray escapeLabel(const QString &value) {
+            QByteArray escaped;
+            escaped.reserve(value.size());
+            for (char c: value.toUtf8()) {
+                if (c == '\\' || c == '"') {
+                    escaped.append('\\');
+                    escaped.append(c);
+                } else if (c == '\n') {
+                    escaped.append("\\n", 2);
+                } else {
+                    escaped.append(c);
+                }
+            }
+            return escaped;
+        }
+
+        QByteArray seconds(quint64 micros) {
+            return QByteArray::number(double(micros) / 1e6, 'g', 9);
+        }
+
+        void writeHeader(QByteArray &out, const char *name, const char *type, const char *help) {
+            out.append("# HELP ").append(name).append(' ').append(help).append('\n');
+            out.append("# TYPE ").append(name).append(' ').append(type).append('\n');
+        }
+
+        // 以 summary 输出直方图的分位数、总和与样本数，另以 gauge 输出最大值
+        void writeSummary(QByteArray &out, const char *name, const QByteArray &labels,
+                          const histogram::Snapshot &snapshot) {
+            for (double q: QUANTILES) {
+                out.append(name).append('{').append(labels).append(",quantile=\"")
+                        .append(QByteArray::number(q)).append("\"} ")
+                        .append(seconds(snapshot.quantile(q))).append('\n');
+            }
+            out.append(name).append("_sum{").append(labels).append("} ").append(seconds(snapshot.Sum)).append('\n');
+            out.append(name).append("_count{").append(labels).append("} ")
+                    .append(QByteArray::number(snapshot.Count)).append('\n');
+        }
+
+        void writeMax(QByteArray &out, const char *name, const QByteArray &labels,
+                      const histogram::Snapshot &snapshot) {
+            out.append(name).append("_max{").append(labels).append("} ").append(seconds(snapshot.Max)).append('\n');
+        }
+
+    }
+
+    int shardIndex() {
+        static std::atomic<int> nextShard{0};
+        thread_local int index = nextShard.fetch_add(1, std::memory_order_relaxed) % METRICS_SHARDS;
+        return index;
+    }
+
+    void counter::add(quint64 value) {
+        shards[shardIndex()].value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    quint64 counter::value() const {
+        quint64 total = 0;
+        for (const auto &shard: shards) {
+            total += shard.value.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    histogram::histogram() : shards(new Shard[METRICS_SHARDS]) {
+    }
+
+    histogram::~histogram() {
+        delete[] shards;
+    }
+
+    int histogram::bucketIndex(quint64 value) {
+        constexpr quint64 subCount = quint64(1) << METRICS_SUB_BITS;
+        if (value < subCount) {
+            return int(value);
+        }
+        int exponent = std::bit_width(value) - 1;
+        if (exponent > METRICS_MAX_EXPONENT) {
+            return METRICS_BUCKETS - 1;
+        }
+        int shift = exponent - METRICS_SUB_BITS;
+        // 最高位之后的 METRICS_SUB_BITS 位决定区间内的子桶
+        int sub = int((value >> shift) - subCount);
+        return int(subCount) + (shift << METRICS_SUB_BITS) + sub;
+    }
+
+    quint64 histogram::bucketUpperBound(int index) {
+        constexpr int subCount = 1 << METRICS_SUB_BITS;
+        if (index < subCount) {
+            return quint64(index);
+        }
+        int shift = (index - subCount) >> METRICS_SUB_BITS;
+        int sub = (index - subCount) & (subCount - 1);
+        quint64 lower = quint64(subCount + sub) << shift;
+        return lower + (quint64(1) << shift) - 1;
+    }
+
+    void histogram::record(quint64 value) {
+        Shard &shard = shards[shardIndex()];
+        shard.buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        shard.count.fetch_add(1, std::memory_order_relaxed);
+        shard.sum.fetch_add(value, std::memory_order_relaxed);
+        quint64 current = shard.max.load(std::memory_order_relaxed);
+        while (value > current && !shard.max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    histogram::Snapshot histogram::snapshot() const {
+        // 与写入并发时各字段之间可能相差正在写入的几个样本，对监控没有影响
+        Snapshot snapshot;
+        snapshot.Buckets.fill(0, METRICS_BUCKETS);
+        for (int i = 0; i < METRICS_SHARDS; i++) {
+            const Shard &shard = shards[i];
+            for (int j = 0; j < METRICS_BUCKETS; j++) {
+                snapshot.Buckets[j] += shard.buckets[j].load(std::memory_order_relaxed);
+            }
+            snapshot.Count += shard.count.load(std::memory_order_relaxed);
+            snapshot.Sum += shard.sum.load(std::memory_order_relaxed);
+            snapshot.Max = qMax(snapshot.Max, shard.max.load(std::memory_order_relaxed));
+        }
+        return snapshot;
+    }
+
+    quint64 histogram::Snapshot::quantile(double q) const {
+        quint64 total = 0;
+        for (quint64 count: Buckets) {
+            total += count;
+        }
+        if (total == 0) {
+            return 0;
+        }
+        auto rank = quint64(std::ceil(q * double(total)));
+        rank = qMax(rank, quint64(1));
+        quint64 seen = 0;
+        for (int i = 0; i < Buckets.size(); i++) {
+            seen += Buckets[i];
+            if (seen >= rank) {
+                // 桶的上界可能超过实际出现过的最大值
+                return qMin(histogram::bucketUpperBound(i), Max);
+            }
+        }
+        return Max;
+    }
+
+    route::route(const QString &name) : Name(name) {
+    }
+
+    void route::begin() {
+        Started.add();
+    }
+
+    void route::end(qint64 micros, int statusCode) {
+        Latency.record(quint64(qMax(micros, qint64(0))));
+        int statusClass = statusCode / 100 - 1;
+        if (statusClass >= 0 && statusClass < 5) {
+            Status[statusClass].add();
+        }
+        Finished.add();
+    }
+
+    registry &registry::instance() {
+        static registry metricsRegistry;
+        return metricsRegistry;
+    }
+
+    registry::registry() : otherRoute("other") {
+        for (auto &item: routes) {
+            item.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    route &registry::findRoute(const QString &name) {
+        int count = routeCount.load(std::memory_order_acquire);
+        for (int i = 0; i < count; i++) {
+            route *item = routes[i].load(std::memory_order_acquire);
+            if (item->Name == name) {
+                return *item;
+            }
+        }
+
+        QMutexLocker locker(&mutex);
+        // 加锁期间可能已有其他线程添加了同一路由
+        count = routeCount.load(std::memory_order_acquire);
+        for (int i = 0; i < count; i++) {
+            route *item = routes[i].load(std::memory_order_acquire);
+            if (item->Name == name) {
+                return *item;
+            }
+        }
+        if (count == METRICS_MAX_ROUTES) {
+            return otherRoute;
+        }
+        // 路由只增不删，在进程退出前一直有效
+        auto *item = new route(name);
+        routes[count].store(item, std::memory_order_release);
+        routeCount.store(count + 1, std::memory_order_release);
+        return *item;
+    }
+
+    void registry::recordStatement(int kind, qint64 micros) {
+        statements[kind].record(quint64(qMax(micros, qint64(0))));
+    }
+
+    void registry::recordCache(int cache, bool hit) {
+        if (hit) {
+            cacheHits[cache].add();
+        } else {
+            cacheMisses[cache].add();
+        }
+    }
+
+    void registry::addCallback(const char *name, const char *type, const char *help, std::function<double()> read) {
+        QMutexLocker locker(&callbackMutex);
+        callbacks.append(Callback{name, type, help, std::move(read)});
+    }
+
+    int registry::statementKind(const QString &sql) {
+        QStringView statement = QStringView(sql).trimmed();
+        if (statement.startsWith(u"SELECT", Qt::CaseInsensitive) ||
+            statement.startsWith(u"WITH", Qt::CaseInsensitive)) {
+            return METRICS_STATEMENT_SELECT;
+        }
+        if (statement.startsWith(u"INSERT", Qt::CaseInsensitive) ||
+            statement.startsWith(u"REPLACE", Qt::CaseInsensitive)) {
+            return METRICS_STATEMENT_INSERT;
+        }
+        if (statement.startsWith(u"UPDATE", Qt::CaseInsensitive)) {
+            return METRICS_STATEMENT_UPDATE;
+        }
+        if (statement.startsWith(u"DELETE", Qt::CaseInsensitive)) {
+            return METRICS_STATEMENT_DELETE;
+        }
+        return METRICS_STATEMENT_OTHER;
+    }
+
+    QByteArray registry::exposition() const {
+        QVector<const route *> routeList;
+        int count = routeCount.load(std::memory_order_acquire);
+        for (int i = 0; i < count; i++) {
+            routeList.append(routes[i].load(std::memory_order_acquire));
+        }
+        if (otherRoute.Started.value() > 0) {
+            routeList.append(&otherRoute);
+        }
+        QVector<QByteArray> routeLabels;
+        QVector<histogram::Snapshot> latencies;
+        for (const route *item: routeList) {
+            routeLabels.append("route=\"" + escapeLabel(item->Name) + '"');
+            latencies.append(item->Latency.snapshot());
+        }
+
+        QByteArray out;
+        out.reserve(4096 + int(routeList.size()) * 1024);
+
+        writeHeader(out, "aims_http_requests_total", "counter", "Finished HTTP requests by route and status class.");
+        for (int i = 0; i < routeList.size(); i++) {
+            for (int j = 0; j < 5; j++) {
+                quint64 value = routeList[i]->Status[j].value();
+                if (value > 0) {
+                    out.append("aims_http_requests_total{").append(routeLabels[i]).append(",code=\"")
+                            .append(STATUS_NAMES[j]).append("\"} ").append(QByteArray::number(value)).append('\n');
+                }
+            }
+        }
+
+        writeHeader(out, "aims_http_request_duration_seconds", "summary", "HTTP request latency by route.");
+        for (int i = 0; i < routeList.size(); i++) {
+            writeSummary(out, "aims_http_request_duration_seconds", routeLabels[i], latencies[i]);
+        }
+        writeHeader(out, "aims_http_request_duration_seconds_max", "gauge", "Slowest HTTP request by route.");
+        for (int i = 0; i < routeList.size(); i++) {
+            writeMax(out, "aims_http_request_duration_seconds", routeLabels[i], latencies[i]);
+        }
+
+        writeHeader(out, "aims_http_requests_in_flight", "gauge", "HTTP requests currently being handled by route.");
+        for (int i = 0; i < routeList.size(); i++) {
+            // 先读Finished再读Started，并发时不会得到负数
+            quint64 finished = routeList[i]->Finished.value();
+            quint64 started = routeList[i]->Started.value();
+            out.append("aims_http_requests_in_flight{").append(routeLabels[i]).append("} ")
+                    .append(QByteArray::number(started > finished ? started - finished : 0)).append('\n');
+        }
+
+        QVector<histogram::Snapshot> statementSnapshots;
+        for (const auto &item: statements) {
+            statementSnapshots.append(item.snapshot());
+        }
+        writeHeader(out, "aims_db_statement_duration_seconds", "summary", "Database statement latency by kind.");
+        for (int i = 0; i < METRICS_STATEMENT_COUNT; i++) {
+            writeSummary(out, "aims_db_statement_duration_seconds",
+                         QByteArray("statement=\"") + STATEMENT_NAMES[i] + '"', statementSnapshots[i]);
+        }
+        writeHeader(out, "aims_db_statement_duration_seconds_max", "gauge", "Slowest database statement by kind.");
+        for (int i = 0; i < METRICS_STATEMENT_COUNT; i++) {
+            writeMax(out, "aims_db_statement_duration_seconds",
+                     QByteArray("statement=\"") + STATEMENT_NAMES[i] + '"', statementSnapshots[i]);
+        }
+
+        writeHeader(out, "aims_cache_requests_total", "counter", "Cache lookups by cache and result.");
+        for (int i = 0; i < METRICS_CACHE_COUNT; i++) {
+            out.append("aims_cache_requests_total{cache=\"").append(CACHE_NAMES[i]).append("\",result=\"hit\"} ")
+                    .append(QByteArray::number(cacheHits[i].value())).append('\n');
+            out.append("aims_cache_requests_total{cache=\"").append(CACHE_NAMES[i]).append("\",result=\"miss\"} ")
+                    .append(QByteArray::number(cacheMisses[i].value())).append('\n');
+        }
+        writeHeader(out, "aims_cache_hit_ratio", "gauge", "Cache hit ratio since startup.");
+        for (int i = 0; i < METRICS_CACHE_COUNT; i++) {
+            quint64 hits = cacheHits[i].value();
+            quint64 total = hits + cacheMisses[i].value();
+            out.append("aims_cache_hit_ratio{cache=\"").append(CACHE_NAMES[i]).append("\"} ")
+                    .append(QByteArray::number(total == 0 ? 0.0 : double(hits) / double(total), 'g', 6)).append('\n');
+        }
+
+        QMutexLocker locker(&callbackMutex);
+        for (const auto &callback: callbacks) {
+            writeHeader(out, callback.Name, callback.Type, callback.Help);
+            out.append(callback.Name).append(' ').append(QByteArray::number(callback.Read(), 'g', 9)).append('\n');
+        }
+        return out;
+    }
+
+} // Metrics
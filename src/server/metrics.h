@@ -0,0 +1,158 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <functional>
+
+#define METRICS_SHARDS 8 // 累加器分片数，每个线程固定写入一个分片，不同线程之间不争用同一缓存行
+#define METRICS_SUB_BITS 4 // 直方图每个2的幂区间再细分为 2^METRICS_SUB_BITS 个桶，相对误差不超过1/16
+#define METRICS_MAX_EXPONENT 36 // 直方图覆盖的最大值约为 2^37 微秒（约38小时），超过的记入最后一个桶
+#define METRICS_BUCKETS ((METRICS_MAX_EXPONENT - METRICS_SUB_BITS + 2) << METRICS_SUB_BITS)
+#define METRICS_MAX_ROUTES 64 // 最多单独统计的路由数，超过的合并到 other
+
+#define METRICS_STATEMENT_SELECT 0 // 查询语句
+#define METRICS_STATEMENT_INSERT 1 // 插入语句
+#define METRICS_STATEMENT_UPDATE 2 // 修改语句
+#define METRICS_STATEMENT_DELETE 3 // 删除语句
+#define METRICS_STATEMENT_OTHER 4 // 事务控制、建表等其他语句
+#define METRICS_STATEMENT_COUNT 5
+
+#define METRICS_CACHE_JWT 0 // JWT验证结果缓存
+#define METRICS_CACHE_IDEMPOTENCY 1 // 幂等响应缓存
+#define METRICS_CACHE_ETAG 2 // 条件请求（If-None-Match）命中内存中的版本号
+#define METRICS_CACHE_COUNT 3
+
+namespace Metrics {
+
+    // 当前线程写入的分片，线程第一次调用时轮流分配
+    int shardIndex();
+
+    // 按线程分片的计数器，写入只做一次relaxed原子加法，读取时汇总所有分片
+    class counter {
+    public:
+        void add(quint64 value = 1);
+
+        quint64 value() const;
+
+    private:
+        class alignas(64) Shard {
+        public:
+            std::atomic<quint64> value{0};
+        };
+
+        Shard shards[METRICS_SHARDS];
+    };
+
+    // 对数-线性分桶的直方图（HDR风格）：小于 2^METRICS_SUB_BITS 的值每个值一个桶，
+    // 之后每个2的幂区间等分为 2^METRICS_SUB_BITS 个桶，分位数的相对误差有上界
+    class histogram {
+    public:
+        class Snapshot {
+        public:
+            QVector<quint64> Buckets; // 各桶的样本数
+            quint64 Count = 0; // 样本总数
+            quint64 Sum = 0; // 样本之和
+            quint64 Max = 0; // 最大值
+
+            // 返回第q分位所在桶的上界，没有样本时返回0
+            quint64 quantile(double q) const;
+        };
+
+        histogram();
+
+        ~histogram();
+
+        histogram(const histogram &) = delete;
+
+        histogram &operator=(const histogram &) = delete;
+
+        void record(quint64 value);
+
+        Snapshot snapshot() const;
+
+        static int bucketIndex(quint64 value);
+
+        // 桶内最大的值
+        static quint64 bucketUpperBound(int index);
+
+    private:
+        class alignas(64) Shard {
+        public:
+            std::atomic<quint64> count{0};
+            std::atomic<quint64> sum{0};
+            std::atomic<quint64> max{0};
+            std::atomic<quint64> buckets[METRICS_BUCKETS];
+        };
+
+        // 每个分片约4KB，放在堆上，避免路由表整体过大
+        Shard *shards;
+    };
+
+    // 单个路由的请求数、状态码分布、耗时和处理中的请求数
+    class route {
+    public:
+        explicit route(const QString &name);
+
+        void begin();
+
+        void end(qint64 micros, int statusCode);
+
+        const QString Name; // 路由路径，如 /api/listLessons/
+        histogram Latency; // 请求耗时（微秒）
+        counter Started; // 开始处理的请求数
+        counter Finished; // 处理完成的请求数，与Started之差为处理中的请求数
+        counter Status[5]; // 按状态码类别（1xx-5xx）统计的请求数
+    };
+
+    // 进程内共享的指标表，请求路径只做原子写入，/metrics 抓取时汇总各分片，两者之间没有锁
+    class registry {
+    public:
+        static registry &instance();
+
+        // 查找或创建路由的统计，已有的路由只做无锁的线性查找
+        route &findRoute(const QString &name);
+
+        void recordStatement(int kind, qint64 micros);
+
+        void recordCache(int cache, bool hit);
+
+        // 由其他模块维护的值（候补队列长度、过载保护的延迟等），抓取时调用read读取，type为gauge或counter；
+        // 须在开始处理请求前注册，被读取的对象须在服务器退出前一直有效
+        void addCallback(const char *name, const char *type, const char *help, std::function<double()> read);
+
+        // Prometheus文本格式（version 0.0.4）
+        QByteArray exposition() const;
+
+        // 按SQL语句的第一个关键字分类
+        static int statementKind(const QString &sql);
+
+    private:
+        registry();
+
+        QMutex mutex; // 只在新增路由时加锁
+        std::atomic<route *> routes[METRICS_MAX_ROUTES];
+        std::atomic<int> routeCount{0};
+        route otherRoute;
+        histogram statements[METRICS_STATEMENT_COUNT];
+        counter cacheHits[METRICS_CACHE_COUNT];
+        counter cacheMisses[METRICS_CACHE_COUNT];
+
+        class Callback {
+        public:
+            const char *Name;
+            const char *Type;
+            const char *Help;
+            std::function<double()> Read;
+        };
+
+        mutable QMutex callbackMutex; // 只在注册和抓取时加锁，请求路径不经过
+        QVector<Callback> callbacks;
+    };
+
+} // Metrics
+
+#endif //METRICS_H
@@ -0,0 +1,111 @@
+#include "password.h"
+#include <QCryptographicHash>
+#include <QPasswordDigestor>
+#include <QRandomGenerator>
+#include <QStringList>
+#include <QtConcurrent>
+
+namespace Password {
+
+    namespace {
+
+        // 逐字节比较全部内容，耗时与不匹配的位置无关
+        bool constantTimeEquals(const QByteArray &a, const QByteArray &b) {
+            if (a.size() != b.size()) {
+                return false;
+            }
+            unsigned char diff = 0;
+            for (qsizetype i = 0; i < a.size(); i++) {
+                diff |= static_cast<unsigned char>(a[i] ^ b[i]);
+            }
+            return diff == 0;
+        }
+
+        QByteArray derive(const QString &secret, const QByteArray &salt, int iterations) {
+            return QPasswordDigestor::deriveKeyPbkdf2(QCryptographicHash::Sha256, secret.toUtf8(), salt,
+                                                      iterations, PASSWORD_HASH_SIZE);
+        }
+
+    }
+
+    QString hash(const QString &secret, int iterations) {
+        QByteArray salt(PASSWORD_SALT_SIZE, Qt::Uninitialized);
+        QRandomGenerator::system()->fillRange(reinterpret_cast<quint32 *>(salt.data()),
+                                              PASSWORD_SALT_SIZE / sizeof(quint32));
+        return QString("%1$%2$%3$%4").arg(PASSWORD_SCHEME).arg(iterations)
+                .arg(QString::fromLatin1(salt.toBase64()))
+                .arg(QString::fromLatin1(derive(secret, salt, iterations).toBase64()));
+    }
+
+    VerifyResult verify(const QString &secret, const QString &stored) {
+        VerifyResult result;
+        QStringList parts = stored.split('$');
+        if (parts.size() != 4 || parts[0] != PASSWORD_SCHEME) {
+            // 迁移前保存的明文密钥
+            result.Valid = constantTimeEquals(secret.toUtf8(), stored.toUtf8());
+            if (result.Valid) {
+                result.NewSecret = hash(secret);
+            }
+            return result;
+        }
+
+        int iterations = parts[1].toInt();
+        QByteArray salt = QByteArray::fromBase64(parts[2].toLatin1());
+        QByteArray expected = QByteArray::fromBase64(parts[3].toLatin1());
+        if (iterations <= 0) {
+            return result;
+        }
+        result.Valid = constantTimeEquals(derive(secret, salt, iterations), expected);
+        if (result.Valid && iterations < PASSWORD_ITERATIONS) {
+            result.NewSecret = hash(secret);
+        }
+        return result;
+    }
+
+    hasher::hasher() {
+        pool.setMaxThreadCount(PASSWORD_WORKERS);
+    }
+
+    hasher::~hasher() {
+        pool.waitForDone();
+    }
+
+    bool hasher::tryAcquire() {
+        int current = pendingCount.load(std::memory_order_relaxed);
+        while (current < PASSWORD_MAX_PENDING) {
+            if (pendingCount.compare_exchange_weak(current, current + 1, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool hasher::hash(const QString &secret, QFuture<QString> &future) {
+        if (!tryAcquire()) {
+            return false;
+        }
+        future = QtConcurrent::run(&pool, [this, secret]() {
+            QString result = Password::hash(secret);
+            pendingCount.fetch_sub(1, std::memory_order_relaxed);
+            return result;
+        });
+        return true;
+    }
+
+    bool hasher::verify(const QString &secret, const QString &stored, QFuture<VerifyResult> &future) {
+        if (!tryAcquire()) {
+            return false;
+        }
+        future = QtConcurrent::run(&pool, [this, secret, stored]() {
+            VerifyResult result = Password::verify(secret, stored);
+            pendingCount.fetch_sub(1, std::memory_order_relaxed);
+            return result;
+        });
+        return true;
+    }
+
+    int hasher::pending() const {
+        return pendingCount.load(std::memory_order_relaxed);
+    }
+
+} // Password
@@ -0,0 +1,53 @@
+#ifndef PASSWORD_H
+#define PASSWORD_H
+
+#include <QFuture>
+#include <QString>
+#include <QThreadPool>
+#include <atomic>
+
+#define PASSWORD_SCHEME "pbkdf2-sha256" // 密钥存储格式：pbkdf2-sha256$迭代次数$盐$哈希
+#define PASSWORD_ITERATIONS 100000 // PBKDF2迭代次数，调大可提高破解成本
+#define PASSWORD_SALT_SIZE 16 // 盐的字节数
+#define PASSWORD_HASH_SIZE 32 // 哈希的字节数
+#define PASSWORD_WORKERS 4 // 计算哈希的线程数
+#define PASSWORD_MAX_PENDING 64 // 排队中的哈希任务上限，超过时直接拒绝登录请求
+
+namespace Password {
+
+    class VerifyResult {
+    public:
+        bool Valid = false; // 密钥是否正确
+        QString NewSecret; // 需要迁移时的新密钥，为空表示不需要迁移
+    };
+
+    // 生成 pbkdf2-sha256$迭代次数$盐$哈希 格式的密钥
+    QString hash(const QString &secret, int iterations = PASSWORD_ITERATIONS);
+
+    // 验证密钥；旧的明文密钥或迭代次数较低的密钥验证成功后会附带重新计算的新密钥
+    VerifyResult verify(const QString &secret, const QString &stored);
+
+    // 在独立的有界线程池中计算哈希，避免阻塞处理请求的事件循环
+    class hasher {
+    public:
+        hasher();
+
+        ~hasher();
+
+        // 排队任务已满时返回false，调用方应返回503
+        bool hash(const QString &secret, QFuture<QString> &future);
+
+        bool verify(const QString &secret, const QString &stored, QFuture<VerifyResult> &future);
+
+        int pending() const;
+
+    private:
+        QThreadPool pool;
+        std::atomic<int> pendingCount{0};
+
+        bool tryAcquire();
+    };
+
+} // Password
+
+#endif //PASSWORD_H
@@ -0,0 +1,214 @@
+#include "push.h"
+#include "entityversion.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDebug>
+
+namespace Push {
+
+    hub::hub(Database::database &database, JwtCache::verifier &verifier) : database(database), verifier(verifier) {
+        pollTimer.setInterval(PUSH_POLL_INTERVAL);
+        QObject::connect(&pollTimer, &QTimer::timeout, this, [this]() {
+            poll();
+        });
+
+        // 从当前最新的变更开始推送
+        QVector<Change> changes;
+        bool reset = false;
+        database.listChanges(-1, 0, changes, lastSeq, reset);
+    }
+
+    hub::~hub() {
+        for (auto it = subscribers.cbegin(); it != subscribers.cend(); ++it) {
+            it.key()->disconnect();
+            delete it.key();
+        }
+    }
+
+    void hub::addConnection(std::unique_ptr<QWebSocket> connection) {
+        QWebSocket *socket = connection.release();
+        subscribers.insert(socket, Subscriber());
+
+        QObject::connect(socket, &QWebSocket::textMessageReceived, this, [this, socket](const QString &message) {
+            authenticate(socket, message);
+        });
+        QObject::connect(socket, &QWebSocket::bytesWritten, this, [this, socket](qint64 bytes) {
+            auto it = subscribers.find(socket);
+            if (it != subscribers.end()) {
+                it->PendingBytes = qMax<qint64>(0, it->PendingBytes - bytes);
+            }
+        });
+        QObject::connect(socket, &QWebSocket::disconnected, this, [this, socket]() {
+            removeConnection(socket);
+        });
+
+        // 超时仍未验证的连接直接关闭
+        QTimer::singleShot(PUSH_AUTH_TIMEOUT, socket, [this, socket]() {
+            auto it = subscribers.constFind(socket);
+            if (it != subscribers.cend() && !it->Authenticated) {
+                socket->close(QWebSocketProtocol::CloseCodePolicyViolated, "Authentication timeout");
+            }
+        });
+    }
+
+    int hub::subscriberCount() const {
+        return int(subscribers.size());
+    }
+
+    qint64 hub::droppedCount() const {
+        return dropped;
+    }
+
+    void hub::authenticate(QWebSocket *socket, const QString &message) {
+        auto it = subscribers.find(socket);
+        if (it == subscribers.end() || it->Authenticated) {
+            // 验证后客户端不需要再发送消息
+            return;
+        }
+
+        QJsonObject jsonObject = QJsonDocument::fromJson(message.toUtf8()).object();
+        Auth auth = verifier.verify(jsonObject["jwt"].toString().toUtf8());
+        if (auth.Account.isEmpty() || auth.AccountType == -1 || auth.IsSuper == -1) {
+            socket->close(QWebSocketProtocol::CloseCodePolicyViolated, "Invalid token");
+            return;
+        }
+
+        it->Account = auth.Account;
+        it->AccountType = auth.AccountType;
+        it->IsSuper = auth.IsSuper == 1;
+        it->Authenticated = true;
+        loadLessons(*it);
+
+        QJsonObject responseJsonObject;
+        responseJsonObject["subscribed"] = true;
+        send(socket, QJsonDocument(responseJsonObject).toJson(QJsonDocument::Compact));
+        if (!pollTimer.isActive()) {
+            pollTimer.start();
+        }
+    }
+
+    void hub::loadLessons(Subscriber &subscriber) {
+        subscriber.Lessons.clear();
+        if (subscriber.IsSuper) {
+            return;
+        }
+        if (subscriber.AccountType == STUDENT) {
+            Student student;
+            if (database.getStudentById(subscriber.Account, student) == Success) {
+                subscriber.Lessons = QSet<QString>(student.ChosenLessons.cbegin(), student.ChosenLessons.cend());
+            }
+        } else if (subscriber.AccountType == TEACHER) {
+            Teacher teacher;
+            if (database.getTeacherById(subscriber.Account, teacher) == Success) {
+                subscriber.Lessons = QSet<QString>(teacher.TeachingLessons.cbegin(), teacher.TeachingLessons.cend());
+            }
+        }
+    }
+
+    bool hub::isRelevant(const Subscriber &subscriber, const Change &change) const {
+        if (subscriber.IsSuper) {
+            return true;
+        }
+        switch (change.Entity) {
+            case ENTITY_STUDENT:
+                return subscriber.AccountType == STUDENT && change.Id == subscriber.Account;
+            case ENTITY_TEACHER:
+                return subscriber.AccountType == TEACHER && change.Id == subscriber.Account;
+            case ENTITY_LESSON:
+                return subscriber.Lessons.contains(change.Id);
+            case ENTITY_GRADE:
+                // 成绩编号为 学号/课程编号
+                if (subscriber.AccountType == STUDENT) {
+                    return change.Id.section('/', 0, 0) == subscriber.Account;
+                }
+                return subscriber.Lessons.contains(change.Id.section('/', 1, 1));
+            default:
+                return false;
+        }
+    }
+
+    void hub::poll() {
+        if (subscribers.isEmpty()) {
+            pollTimer.stop();
+            return;
+        }
+
+        QVector<Change> changes;
+        qint64 latest = 0;
+        bool reset = false;
+        if (database.listChanges(lastSeq, PUSH_BATCH_SIZE, changes, latest, reset) != Success) {
+            return;
+        }
+        if (reset) {
+            // 无法确定哪些记录发生了变化，通知所有订阅者清空缓存
+            lastSeq = latest;
+            QJsonObject responseJsonObject;
+            responseJsonObject["reset"] = true;
+            QByteArray message = QJsonDocument(responseJsonObject).toJson(QJsonDocument::Compact);
+            for (auto it = subscribers.begin(); it != subscribers.end(); ++it) {
+                if (it->Authenticated) {
+                    send(it.key(), message);
+                }
+            }
+            return;
+        }
+        if (changes.isEmpty()) {
+            return;
+        }
+        lastSeq = changes.last().Seq;
+
+        // 遍历时可能断开慢速连接，先取出当前的连接列表
+        const QList<QWebSocket *> sockets = subscribers.keys();
+        for (QWebSocket *socket: sockets) {
+            auto it = subscribers.find(socket);
+            if (it == subscribers.end() || !it->Authenticated) {
+                continue;
+            }
+            QJsonArray changesArray;
+            for (const auto &change: changes) {
+                if (!isRelevant(*it, change)) {
+                    continue;
+                }
+                changesArray.append(QJsonArray{change.Entity, change.Id, change.Version});
+                // 订阅者自己的记录变化时（选课、退课、授课调整），重新读取相关课程
+                if (change.Entity == ENTITY_STUDENT || change.Entity == ENTITY_TEACHER) {
+                    if (change.Id == it->Account) {
+                        loadLessons(*it);
+                    }
+                }
+            }
+            if (changesArray.isEmpty()) {
+                continue;
+            }
+            QJsonObject responseJsonObject;
+            responseJsonObject["changes"] = changesArray;
+            responseJsonObject["next"] = lastSeq;
+            send(socket, QJsonDocument(responseJsonObject).toJson(QJsonDocument::Compact));
+        }
+    }
+
+    void hub::send(QWebSocket *socket, const QByteArray &message) {
+        auto it = subscribers.find(socket);
+        if (it == subscribers.end()) {
+            return;
+        }
+        if (it->PendingBytes + message.size() > PUSH_MAX_PENDING_BYTES) {
+            // 对方接收过慢，断开连接，客户端重连后通过变更日志补齐
+            dropped++;
+            qDebug() << "Debug | push.cpp: drop slow consumer" << it->Account << it->PendingBytes;
+            removeConnection(socket);
+            socket->abort();
+            return;
+        }
+        it->PendingBytes += message.size();
+        socket->sendTextMessage(QString::fromUtf8(message));
+    }
+
+    void hub::removeConnection(QWebSocket *socket) {
+        if (subscribers.remove(socket) > 0) {
+            socket->deleteLater();
+        }
+    }
+
+} // Push
@@ -0,0 +1,68 @@
+#ifndef PUSH_H
+#define PUSH_H
+
+#include "database.h"
+#include "jwtcache.h"
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QTimer>
+#include <QWebSocket>
+#include <memory>
+
+#define PUSH_POLL_INTERVAL 100 // 有订阅者时读取变更日志的间隔（毫秒）
+#define PUSH_BATCH_SIZE 1000 // 每次读取的最大变更数
+#define PUSH_AUTH_TIMEOUT 5000 // 连接后发送JWT的最长等待时间（毫秒）
+#define PUSH_MAX_PENDING_BYTES 262144 // 每个连接未发送完的最大字节数，超过时断开慢速连接
+
+namespace Push {
+
+    class Subscriber {
+    public:
+        QString Account; // 订阅者账号
+        int AccountType = -1; // 账户类型，0为教师，1为学生
+        bool IsSuper = false; // 是否为超级用户，超级用户接收全部变更
+        bool Authenticated = false; // 是否已通过JWT验证
+        QSet<QString> Lessons; // 相关课程：学生的已选课程或教师的授课课程
+        qint64 PendingBytes = 0; // 已提交但尚未写入网络的字节数
+    };
+
+    // 运行在主线程，按订阅者的身份过滤变更日志并推送失效通知。
+    // 发送只写入每个连接的缓冲区，不等待对方接收；缓冲区超过上限的连接直接断开，不影响其他连接
+    class hub : public QObject {
+    public:
+        hub(Database::database &database, JwtCache::verifier &verifier);
+
+        ~hub() override;
+
+        // 接管一个新的WebSocket连接，对方需在 PUSH_AUTH_TIMEOUT 内发送 {"jwt": "..."}
+        void addConnection(std::unique_ptr<QWebSocket> socket);
+
+        int subscriberCount() const;
+
+        qint64 droppedCount() const;
+
+    private:
+        Database::database &database;
+        JwtCache::verifier &verifier;
+        QHash<QWebSocket *, Subscriber> subscribers;
+        QTimer pollTimer;
+        qint64 lastSeq = -1;
+        qint64 dropped = 0;
+
+        void authenticate(QWebSocket *socket, const QString &message);
+
+        void loadLessons(Subscriber &subscriber);
+
+        bool isRelevant(const Subscriber &subscriber, const Change &change) const;
+
+        void poll();
+
+        void send(QWebSocket *socket, const QByteArray &message);
+
+        void removeConnection(QWebSocket *socket);
+    };
+
+} // Push
+
+#endif //PUSH_H
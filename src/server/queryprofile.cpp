@@ -0,0 +1,189 @@
+#include "queryprofile.h"
+#include <QDebug>
+#include <QStringList>
+#include <QVariant>
+#include <algorithm>
+
+namespace QueryProfile {
+
+    namespace {
+
+        // 名称以 lesson_ 开头的固定表，其余 lesson_ 开头的表是每门课程的成绩表
+        const char *const LESSON_TABLES[] = {"lesson_information", "lesson_preference", "lesson_waitlist"};
+
+        const QString OTHER_STATEMENT = "(other)";
+
+        bool isIdentifierStart(QChar c) {
+            return c.isLetter() || c == '_';
+        }
+
+        bool isIdentifierPart(QChar c) {
+            return c.isLetterOrNumber() || c == '_';
+        }
+
+        QStringView normalizeIdentifier(QStringView identifier) {
+            if (identifier.startsWith(u"lesson_", Qt::CaseInsensitive)) {
+                for (const char *table: LESSON_TABLES) {
+                    if (identifier.compare(QLatin1StringView(table), Qt::CaseInsensitive) == 0) {
+                        return identifier;
+                    }
+                }
+                return u"lesson_?";
+            }
+            if (identifier.startsWith(u"sp_", Qt::CaseInsensitive)) {
+                return u"sp_?";
+            }
+            return identifier;
+        }
+
+        // 同一连接反复执行的语句文本相同，按原文缓存归一化结果，避免每次执行都逐字符扫描
+        const QString &cachedNormalize(const QString &sql) {
+            thread_local QHash<QString, QString> cache;
+            auto it = cache.constFind(sql);
+            if (it != cache.cend()) {
+                return *it;
+            }
+            if (cache.size() >= QUERY_PROFILE_CACHE_SIZE) {
+                cache.clear();
+            }
+            return *cache.insert(sql, normalize(sql));
+        }
+
+    }
+
+    QString normalize(const QString &sql) {
+        QString result;
+        result.reserve(sql.size());
+        qsizetype n = sql.size();
+        qsizetype i = 0;
+        bool pendingSpace = false;
+        while (i < n) {
+            QChar c = sql[i];
+            if (c.isSpace()) {
+                pendingSpace = !result.isEmpty();
+                i++;
+                continue;
+            }
+            if (pendingSpace) {
+                result.append(' ');
+                pendingSpace = false;
+            }
+            if (c == '\'') {
+                // 字符串字面量，'' 表示转义的单引号
+                i++;
+                while (i < n) {
+                    if (sql[i] == '\'') {
+                        if (i + 1 < n && sql[i + 1] == '\'') {
+                            i += 2;
+                            continue;
+                        }
+                        break;
+                    }
+                    i++;
+                }
+                i++;
+                result.append('?');
+            } else if (isIdentifierStart(c)) {
+                qsizetype start = i;
+                while (i < n && isIdentifierPart(sql[i])) {
+                    i++;
+                }
+                result.append(normalizeIdentifier(QStringView(sql).mid(start, i - start)));
+            } else if (c.isDigit()) {
+                while (i < n && (sql[i].isDigit() || sql[i] == '.')) {
+                    i++;
+                }
+                result.append('?');
+            } else {
+                result.append(c);
+                i++;
+            }
+        }
+        return result;
+    }
+
+    QString redact(const QVariantList &values) {
+        QStringList items;
+        for (const auto &value: values) {
+            if (value.isNull()) {
+                items.append("null");
+            } else if (value.typeId() == QMetaType::QString || value.typeId() == QMetaType::QByteArray) {
+                items.append(QString("%1(%2)").arg(value.typeName()).arg(value.toString().size()));
+            } else {
+                items.append(value.typeName());
+            }
+        }
+        return "[" + items.join(", ") + "]";
+    }
+
+    profiler &profiler::instance() {
+        static profiler queryProfiler;
+        return queryProfiler;
+    }
+
+    void profiler::record(const QString &sql, const QVariantList &boundValues, qint64 micros) {
+        const QString &statement = cachedNormalize(sql);
+        if (micros >= qint64(QUERY_SLOW_THRESHOLD) * 1000) {
+            QString line = QString::number(double(micros) / 1000.0, 'f', 1) + "ms " + statement + " params: " +
+                           redact(boundValues);
+            if (slowLog) {
+                slowLog(line);
+            } else {
+                qInfo().noquote() << "Slow |" << line;
+            }
+        }
+
+        Shard &shard = shards[qHash(statement) % QUERY_PROFILE_SHARDS];
+        QMutexLocker locker(&shard.mutex);
+        auto it = shard.statements.find(statement);
+        if (it == shard.statements.end()) {
+            if (statementCount.fetch_add(1, std::memory_order_relaxed) >= QUERY_PROFILE_MAX_STATEMENTS) {
+                // 模板数量超过上限时不再新增，计入同一分片的合并项
+                statementCount.fetch_sub(1, std::memory_order_relaxed);
+                it = shard.statements.find(OTHER_STATEMENT);
+                if (it == shard.statements.end()) {
+                    it = shard.statements.insert(OTHER_STATEMENT, Stats{OTHER_STATEMENT});
+                }
+            } else {
+                it = shard.statements.insert(statement, Stats{statement});
+            }
+        }
+        it->Count++;
+        it->TotalTime += micros;
+        it->MaxTime = qMax(it->MaxTime, micros);
+    }
+
+    void profiler::setSlowLog(std::function<void(const QString &)> sink) {
+        slowLog = std::move(sink);
+    }
+
+    QVector<Stats> profiler::top(int n) const {
+        QVector<Stats> all;
+        for (const auto &shard: shards) {
+            QMutexLocker locker(&shard.mutex);
+            for (const auto &stats: shard.statements) {
+                // 不同分片的合并项汇总为一条
+                if (stats.Statement == OTHER_STATEMENT) {
+                    auto other = std::find_if(all.begin(), all.end(), [](const Stats &item) {
+                        return item.Statement == OTHER_STATEMENT;
+                    });
+                    if (other != all.end()) {
+                        other->Count += stats.Count;
+                        other->TotalTime += stats.TotalTime;
+                        other->MaxTime = qMax(other->MaxTime, stats.MaxTime);
+                        continue;
+                    }
+                }
+                all.append(stats);
+            }
+        }
+        std::sort(all.begin(), all.end(), [](const Stats &a, const Stats &b) {
+            return a.TotalTime > b.TotalTime;
+        });
+        if (n >= 0 && all.size() > n) {
+            all.resize(n);
+        }
+        return all;
+    }
+
+} // QueryProfile
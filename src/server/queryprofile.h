@@ -0,0 +1,66 @@
+#ifndef QUERYPROFILE_H
+#define QUERYPROFILE_H
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QVariantList>
+#include <QVector>
+#include <atomic>
+#include <functional>
+
+#define QUERY_SLOW_THRESHOLD 100 // 慢查询阈值（毫秒），超过时写入慢查询日志
+#define QUERY_PROFILE_SHARDS 8 // 统计表分片数，不同语句落在不同分片上互不加锁
+#define QUERY_PROFILE_MAX_STATEMENTS 1024 // 最多单独统计的语句模板数，超过的合并统计
+#define QUERY_PROFILE_DEFAULT_TOP 20 // 未指定top时返回的语句数
+#define QUERY_PROFILE_CACHE_SIZE 4096 // 每个线程缓存的 SQL -> 语句模板 条数，超过时清空重建
+
+namespace QueryProfile {
+
+    // 把SQL归一化为语句模板：lesson_<课程编号> 表名替换为 lesson_?，保存点编号、数字和字符串字面量替换为 ?，
+    // 连续空白合并为一个空格，同一条语句对不同课程的执行归为一类
+    QString normalize(const QString &sql);
+
+    // 绑定参数只保留类型和长度，不输出参数值（可能包含密码哈希等敏感数据）
+    QString redact(const QVariantList &values);
+
+    // 单个语句模板的累计统计，时间单位为微秒
+    class Stats {
+    public:
+        QString Statement; // 语句模板
+        qint64 Count = 0; // 执行次数
+        qint64 TotalTime = 0; // 总耗时
+        qint64 MaxTime = 0; // 最大耗时
+    };
+
+    class profiler {
+    public:
+        static profiler &instance();
+
+        // 记录一次执行，超过阈值时写入慢查询日志
+        void record(const QString &sql, const QVariantList &boundValues, qint64 micros);
+
+        // 慢查询日志的去向，服务器交给访问日志的后台线程写入；未设置时用qInfo输出。
+        // 须在任何数据库连接开始执行语句前设置
+        void setSlowLog(std::function<void(const QString &)> sink);
+
+        // 按总耗时从高到低返回前n条
+        QVector<Stats> top(int n) const;
+
+    private:
+        profiler() = default;
+
+        class Shard {
+        public:
+            mutable QMutex mutex;
+            QHash<QString, Stats> statements;
+        };
+
+        Shard shards[QUERY_PROFILE_SHARDS];
+        std::atomic<int> statementCount{0};
+        std::function<void(const QString &)> slowLog;
+    };
+
+} // QueryProfile
+
+#endif //QUERYPROFILE_H
@@ -0,0 +1,130 @@
+#include "ratelimit.h"
+#include <QDateTime>
+#include <QRandomGenerator>
+#include <algorithm>
+#include <cmath>
+
+namespace RateLimit {
+
+    bool limiter::acquire(const QString &key, double rate, double burst, int &retryAfter) {
+        qint64 now = QDateTime::currentMSecsSinceEpoch();
+        Shard &shard = shards[qHash(key) % RATE_LIMIT_SHARDS];
+        QMutexLocker locker(&shard.mutex);
+
+        // 定期清理长时间未使用的令牌桶，防止扫描IP或账号时无限增长
+        if (now - shard.lastCleanup > RATE_LIMIT_IDLE_TIME) {
+            shard.lastCleanup = now;
+            for (auto it = shard.buckets.begin(); it != shard.buckets.end();) {
+                if (now - it->LastRefill > RATE_LIMIT_IDLE_TIME) {
+                    it = shard.buckets.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        auto it = shard.buckets.find(key);
+        if (it == shard.buckets.end()) {
+            it = shard.buckets.insert(key, Bucket{burst, now});
+        }
+        Bucket &bucket = *it;
+        bucket.Tokens = std::min(burst, bucket.Tokens + double(now - bucket.LastRefill) * rate / 1000.0);
+        bucket.LastRefill = now;
+        if (bucket.Tokens >= 1.0) {
+            bucket.Tokens -= 1.0;
+            return true;
+        }
+        retryAfter = std::max(1, int(std::ceil((1.0 - bucket.Tokens) / rate)));
+        return false;
+    }
+
+    void shedder::start() {
+        // 定时器实际触发时间比预定晚的部分即事件在队列中等待的时间
+        lagTimer.setTimerType(Qt::PreciseTimer);
+        lagTimer.setInterval(SHED_LAG_INTERVAL);
+        QObject::connect(&lagTimer, &QTimer::timeout, &lagTimer, [this]() {
+            qint64 sample = std::max<qint64>(lagClock.restart() - SHED_LAG_INTERVAL, 0);
+            qint64 smoothed = eventLoopLag.load(std::memory_order_relaxed);
+            eventLoopLag.store((smoothed * 3 + sample) / 4, std::memory_order_relaxed);
+        });
+        lagClock.start();
+        lagTimer.start();
+    }
+
+    bool shedder::overloaded() {
+        if (inFlightCount.load(std::memory_order_relaxed) >= SHED_MAX_IN_FLIGHT) {
+            return true;
+        }
+        // 请求较少时窗口可能长时间凑不满重新计算的样本数，过期后按时间重新计算
+        qint64 now = QDateTime::currentMSecsSinceEpoch();
+        if (p99.load(std::memory_order_relaxed) > SHED_P99_THRESHOLD &&
+            now - lastUpdate.load(std::memory_order_relaxed) > SHED_WINDOW_TIME) {
+            QMutexLocker locker(&mutex);
+            updateP99(now);
+        }
+        double drop = std::max(dropRate(eventLoopLag.load(std::memory_order_relaxed), SHED_LAG_TARGET, SHED_LAG_MAX),
+                               dropRate(p99.load(std::memory_order_relaxed), SHED_P99_THRESHOLD,
+                                        2 * SHED_P99_THRESHOLD));
+        return drop > 0 && QRandomGenerator::global()->generateDouble() < drop;
+    }
+
+    double shedder::dropRate(qint64 value, qint64 target, qint64 maximum) {
+        if (value <= target) {
+            return 0;
+        }
+        return std::min(double(value - target) / double(maximum - target), 1.0) * SHED_MAX_DROP;
+    }
+
+    void shedder::begin() {
+        inFlightCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void shedder::end(qint64 elapsed) {
+        inFlightCount.fetch_sub(1, std::memory_order_relaxed);
+        qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+        QMutexLocker locker(&mutex);
+        if (window.size() < SHED_WINDOW_SIZE) {
+            window.append({now, elapsed});
+        } else {
+            window[next] = {now, elapsed};
+            next = (next + 1) % SHED_WINDOW_SIZE;
+        }
+        // 每64个样本重新计算一次P99，避免每个请求都排序
+        if (++sinceUpdate >= 64) {
+            updateP99(now);
+        }
+    }
+
+    int shedder::inFlight() const {
+        return inFlightCount.load(std::memory_order_relaxed);
+    }
+
+    qint64 shedder::lag() const {
+        return eventLoopLag.load(std::memory_order_relaxed);
+    }
+
+    qint64 shedder::latencyP99() const {
+        return p99.load(std::memory_order_relaxed);
+    }
+
+    void shedder::updateP99(qint64 now) {
+        sinceUpdate = 0;
+        lastUpdate = now;
+        QVector<qint64> elapsed;
+        elapsed.reserve(window.size());
+        for (const auto &sample: window) {
+            if (now - sample.Time <= SHED_WINDOW_TIME) {
+                elapsed.append(sample.Elapsed);
+            }
+        }
+        if (elapsed.isEmpty()) {
+            p99 = 0;
+            return;
+        }
+        auto nth = elapsed.begin() + (elapsed.size() - 1) * 99 / 100;
+        std::nth_element(elapsed.begin(), nth, elapsed.end());
+        p99 = *nth;
+    }
+
+} // RateLimit
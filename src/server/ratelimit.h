@@ -0,0 +1,101 @@
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include <QHash>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QString>
+#include <QTimer>
+#include <QVector>
+#include <atomic>
+
+#define RATE_LIMIT_SHARDS 16 // 令牌桶分片数，不同账号落在不同分片上互不加锁
+#define RATE_LIMIT_ACCOUNT_RATE 10.0 // 每个账号每秒补充的令牌数
+#define RATE_LIMIT_ACCOUNT_BURST 20.0 // 每个账号的令牌桶容量
+#define RATE_LIMIT_IP_RATE 50.0 // 每个IP每秒补充的令牌数，同一IP下可能有多个账号
+#define RATE_LIMIT_IP_BURST 100.0 // 每个IP的令牌桶容量
+#define RATE_LIMIT_IDLE_TIME 60000 // 令牌桶空闲超过该时间（毫秒）后被清理
+
+#define SHED_MAX_IN_FLIGHT 256 // 同时未完成的请求数上限（包括等待密码哈希等异步任务的请求）
+#define SHED_LAG_INTERVAL 100 // 测量事件循环延迟的定时器间隔（毫秒）
+#define SHED_LAG_TARGET 50 // 事件循环延迟超过该值（毫秒）时开始按比例拒绝请求
+#define SHED_LAG_MAX 500 // 事件循环延迟达到该值（毫秒）时按最大比例拒绝
+#define SHED_P99_THRESHOLD 500 // 最近请求耗时的P99超过该值（毫秒）时开始按比例拒绝，达到两倍时按最大比例拒绝
+#define SHED_MAX_DROP 0.95 // 最大拒绝比例，其余请求作为探测放行，使统计在过载期间继续更新
+#define SHED_WINDOW_TIME 10000 // 统计P99的滑动窗口（毫秒）
+#define SHED_WINDOW_SIZE 1024 // 滑动窗口中最多保留的样本数
+#define SHED_RETRY_AFTER 1 // 过载时建议客户端等待的时间（秒）
+
+namespace RateLimit {
+
+    // 按键分片的令牌桶限流器
+    class limiter {
+    public:
+        // 取得一个令牌时返回true，否则通过retryAfter返回需要等待的秒数
+        bool acquire(const QString &key, double rate, double burst, int &retryAfter);
+
+    private:
+        class Bucket {
+        public:
+            double Tokens; // 当前令牌数
+            qint64 LastRefill; // 上次补充令牌的时间（毫秒）
+        };
+
+        class Shard {
+        public:
+            QMutex mutex;
+            QHash<QString, Bucket> buckets;
+            qint64 lastCleanup = 0;
+        };
+
+        Shard shards[RATE_LIMIT_SHARDS];
+    };
+
+    // 全局过载保护：按事件循环延迟（请求在队列中等待处理的时间）和最近请求的P99耗时按比例拒绝新请求，
+    // 始终放行一部分请求作为探测；同时未完成的请求数达到上限时全部拒绝
+    class shedder {
+    public:
+        // 在主线程中启动事件循环延迟的测量
+        void start();
+
+        bool overloaded();
+
+        void begin();
+
+        void end(qint64 elapsed);
+
+        int inFlight() const;
+
+        // 平滑后的事件循环延迟（毫秒）
+        qint64 lag() const;
+
+        // 最近请求耗时的P99（毫秒）
+        qint64 latencyP99() const;
+
+    private:
+        class Sample {
+        public:
+            qint64 Time; // 请求完成的时间（毫秒）
+            qint64 Elapsed; // 请求耗时（毫秒）
+        };
+
+        std::atomic<int> inFlightCount{0};
+        std::atomic<qint64> eventLoopLag{0};
+        std::atomic<qint64> p99{0};
+        std::atomic<qint64> lastUpdate{0};
+        QMutex mutex;
+        QVector<Sample> window;
+        int next = 0;
+        int sinceUpdate = 0;
+        QTimer lagTimer;
+        QElapsedTimer lagClock;
+
+        void updateP99(qint64 now);
+
+        // value从target增大到maximum时拒绝比例从0线性增大到SHED_MAX_DROP
+        static double dropRate(qint64 value, qint64 target, qint64 maximum);
+    };
+
+} // RateLimit
+
+#endif //RATELIMIT_H
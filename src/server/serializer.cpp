@@ -0,0 +1,335 @@
+#include "serializer.h"
+#include <QCborValue>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+namespace Serializer {
+
+    namespace {
+
+        // 超过该值的double不能精确表示所有整数，按浮点数输出
+        constexpr double MAX_EXACT_INTEGER = 9007199254740992.0;
+
+        const char HEX_DIGITS[] = "0123456789abcdef";
+
+        // 与QJsonDocument一致，没有小数部分的double按整数输出
+        bool isExactInteger(double value) {
+            return std::isfinite(value) && std::trunc(value) == value && std::fabs(value) <= MAX_EXACT_INTEGER;
+        }
+
+    }
+
+    jsonWriter::jsonWriter(qsizetype reserve) {
+        buffer.reserve(reserve);
+    }
+
+    void jsonWriter::separate() {
+        if (needComma) {
+            buffer.append(',');
+        }
+    }
+
+    void jsonWriter::beginObject() {
+        separate();
+        buffer.append('{');
+        needComma = false;
+    }
+
+    void jsonWriter::endObject() {
+        buffer.append('}');
+        needComma = true;
+    }
+
+    void jsonWriter::beginArray() {
+        separate();
+        buffer.append('[');
+        needComma = false;
+    }
+
+    void jsonWriter::endArray() {
+        buffer.append(']');
+        needComma = true;
+    }
+
+    void jsonWriter::key(const char *name) {
+        separate();
+        buffer.append('"');
+        buffer.append(name, qsizetype(std::strlen(name)));
+        buffer.append("\":", 2);
+        needComma = false;
+    }
+
+    void jsonWriter::key(QStringView name) {
+        separate();
+        appendString(name);
+        buffer.append(':');
+        needComma = false;
+    }
+
+    void jsonWriter::appendString(QStringView text) {
+        // 先按最坏情况（控制字符转义为\u00XX，每个UTF-16单元6字节）扩展，写完后再截断到实际长度，
+        // resize不会缩小已分配的容量
+        qsizetype start = buffer.size();
+        buffer.resize(start + text.size() * 6 + 2);
+        char *out = buffer.data() + start;
+        *out++ = '"';
+        const char16_t *p = text.utf16();
+        qsizetype n = text.size();
+        for (qsizetype i = 0; i < n; i++) {
+            char32_t c = p[i];
+            if (c < 0x80) {
+                if (c >= 0x20 && c != '"' && c != '\\') {
+                    *out++ = char(c);
+                    continue;
+                }
+                *out++ = '\\';
+                switch (c) {
+                    case '"':
+                        *out++ = '"';
+                        break;
+                    case '\\':
+                        *out++ = '\\';
+                        break;
+                    case '\b':
+                        *out++ = 'b';
+                        break;
+                    case '\f':
+                        *out++ = 'f';
+                        break;
+                    case '\n':
+                        *out++ = 'n';
+                        break;
+                    case '\r':
+                        *out++ = 'r';
+                        break;
+                    case '\t':
+                        *out++ = 't';
+                        break;
+                    default:
+                        *out++ = 'u';
+                        *out++ = '0';
+                        *out++ = '0';
+                        *out++ = HEX_DIGITS[c >> 4];
+                        *out++ = HEX_DIGITS[c & 0xF];
+                        break;
+                }
+                continue;
+            }
+            if (QChar::isHighSurrogate(c) && i + 1 < n && QChar::isLowSurrogate(p[i + 1])) {
+                c = QChar::surrogateToUcs4(char16_t(c), p[++i]);
+            } else if (QChar::isSurrogate(c)) {
+                // 不成对的代理项无法编码为UTF-8，与QString::toUtf8一样替换为U+FFFD
+                c = QChar::ReplacementCharacter;
+            }
+            if (c < 0x800) {
+                *out++ = char(0xC0 | (c >> 6));
+                *out++ = char(0x80 | (c & 0x3F));
+            } else if (c < 0x10000) {
+                *out++ = char(0xE0 | (c >> 12));
+                *out++ = char(0x80 | ((c >> 6) & 0x3F));
+                *out++ = char(0x80 | (c & 0x3F));
+            } else {
+                *out++ = char(0xF0 | (c >> 18));
+                *out++ = char(0x80 | ((c >> 12) & 0x3F));
+                *out++ = char(0x80 | ((c >> 6) & 0x3F));
+                *out++ = char(0x80 | (c & 0x3F));
+            }
+        }
+        *out++ = '"';
+        buffer.resize(out - buffer.constData());
+    }
+
+    void jsonWriter::value(const QString &value) {
+        separate();
+        appendString(value);
+        needComma = true;
+    }
+
+    void jsonWriter::value(const char *value) {
+        this->value(QString::fromUtf8(value));
+    }
+
+    void jsonWriter::value(bool value) {
+        separate();
+        if (value) {
+            buffer.append("true", 4);
+        } else {
+            buffer.append("false", 5);
+        }
+        needComma = true;
+    }
+
+    void jsonWriter::value(int value) {
+        this->value(qint64(value));
+    }
+
+    void jsonWriter::value(qint64 value) {
+        separate();
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        buffer.append(digits, result.ptr - digits);
+        needComma = true;
+    }
+
+    void jsonWriter::value(double value) {
+        if (isExactInteger(value)) {
+            this->value(qint64(value));
+            return;
+        }
+        separate();
+        if (!std::isfinite(value)) {
+            // JSON不能表示NaN和无穷大
+            buffer.append("null", 4);
+        } else {
+            char digits[32];
+            auto result = std::to_chars(digits, digits + sizeof(digits), value);
+            buffer.append(digits, result.ptr - digits);
+        }
+        needComma = true;
+    }
+
+    void jsonWriter::value(const QVector<QString> &values) {
+        beginArray();
+        for (const auto &item: values) {
+            value(item);
+        }
+        endArray();
+    }
+
+    void jsonWriter::value(const QMap<QString, QVector<QString>> &values) {
+        beginObject();
+        for (auto it = values.cbegin(); it != values.cend(); ++it) {
+            key(it.key());
+            value(it.value());
+        }
+        endObject();
+    }
+
+    void jsonWriter::value(const QJsonValue &value) {
+        switch (value.type()) {
+            case QJsonValue::Bool:
+                this->value(value.toBool());
+                break;
+            case QJsonValue::Double:
+                this->value(value.toDouble());
+                break;
+            case QJsonValue::String:
+                this->value(value.toString());
+                break;
+            case QJsonValue::Array: {
+                beginArray();
+                const QJsonArray array = value.toArray();
+                for (const auto &item: array) {
+                    this->value(QJsonValue(item));
+                }
+                endArray();
+                break;
+            }
+            case QJsonValue::Object: {
+                beginObject();
+                const QJsonObject object = value.toObject();
+                for (auto it = object.constBegin(); it != object.constEnd(); ++it) {
+                    key(it.key());
+                    this->value(QJsonValue(it.value()));
+                }
+                endObject();
+                break;
+            }
+            default:
+                separate();
+                buffer.append("null", 4);
+                needComma = true;
+                break;
+        }
+    }
+
+    QByteArray jsonWriter::data() const {
+        return buffer;
+    }
+
+    cborWriter::cborWriter(qsizetype reserve) : writer(&buffer) {
+        buffer.reserve(reserve);
+    }
+
+    void cborWriter::beginObject() {
+        writer.startMap();
+    }
+
+    void cborWriter::endObject() {
+        writer.endMap();
+    }
+
+    void cborWriter::beginArray() {
+        writer.startArray();
+    }
+
+    void cborWriter::endArray() {
+        writer.endArray();
+    }
+
+    void cborWriter::key(const char *name) {
+        writer.append(QLatin1StringView(name));
+    }
+
+    void cborWriter::key(QStringView name) {
+        writer.append(name);
+    }
+
+    void cborWriter::value(const QString &value) {
+        writer.append(QStringView(value));
+    }
+
+    void cborWriter::value(const char *value) {
+        writer.appendTextString(value, qsizetype(std::strlen(value)));
+    }
+
+    void cborWriter::value(bool value) {
+        writer.append(value);
+    }
+
+    void cborWriter::value(int value) {
+        writer.append(qint64(value));
+    }
+
+    void cborWriter::value(qint64 value) {
+        writer.append(value);
+    }
+
+    void cborWriter::value(double value) {
+        // 与 WireFormat::toCbor 一致，整数值编码为CBOR整数
+        if (isExactInteger(value)) {
+            writer.append(qint64(value));
+        } else {
+            writer.append(value);
+        }
+    }
+
+    void cborWriter::value(const QVector<QString> &values) {
+        writer.startArray(quint64(values.size()));
+        for (const auto &item: values) {
+            writer.append(QStringView(item));
+        }
+        writer.endArray();
+    }
+
+    void cborWriter::value(const QMap<QString, QVector<QString>> &values) {
+        writer.startMap(quint64(values.size()));
+        for (auto it = values.cbegin(); it != values.cend(); ++it) {
+            writer.append(QStringView(it.key()));
+            value(it.value());
+        }
+        writer.endMap();
+    }
+
+    void cborWriter::value(const QJsonValue &value) {
+        QCborValue::fromJsonValue(value).toCbor(writer);
+    }
+
+    QByteArray cborWriter::data() const {
+        return buffer;
+    }
+
+} // Serializer
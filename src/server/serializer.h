@@ -0,0 +1,140 @@
+#ifndef SERIALIZER_H
+#define SERIALIZER_H
+
+#include "entity.h"
+#include <QByteArray>
+#include <QCborStreamWriter>
+#include <QJsonValue>
+#include <QMap>
+#include <QString>
+#include <QStringView>
+
+#define SERIALIZER_RESERVE 1024 // 写入器初始预留的缓冲区大小（字节）
+#define SERIALIZER_ROW_RESERVE 256 // 列表中每行预估的字节数，按行数预留缓冲区，避免写入过程中反复扩容
+#define SERIALIZER_ID_RESERVE 16 // 编号数组中每项预估的字节数
+
+namespace Serializer {
+
+    // 直接向预留好的缓冲区写入UTF-8编码的JSON，不经过QJsonObject、QJsonDocument和QString
+    class jsonWriter {
+    public:
+        explicit jsonWriter(qsizetype reserve = SERIALIZER_RESERVE);
+
+        void beginObject();
+
+        void endObject();
+
+        void beginArray();
+
+        void endArray();
+
+        // 字段名为代码中的ASCII字面量，不需要转义
+        void key(const char *name);
+
+        void key(QStringView name);
+
+        void value(const QString &value);
+
+        void value(const char *value);
+
+        void value(bool value);
+
+        void value(int value);
+
+        void value(qint64 value);
+
+        void value(double value);
+
+        void value(const QVector<QString> &values);
+
+        void value(const QMap<QString, QVector<QString>> &values);
+
+        // 写入仍由QJsonObject构造的部分，如各处理函数中的简单消息
+        void value(const QJsonValue &value);
+
+        template<typename T>
+        void field(const char *name, const T &fieldValue) {
+            key(name);
+            value(fieldValue);
+        }
+
+        QByteArray data() const;
+
+    private:
+        QByteArray buffer;
+        bool needComma = false;
+
+        void separate();
+
+        void appendString(QStringView text);
+    };
+
+    // 与jsonWriter接口相同，输出CBOR，序列化函数对两种格式只需写一次
+    class cborWriter {
+    public:
+        explicit cborWriter(qsizetype reserve = SERIALIZER_RESERVE);
+
+        void beginObject();
+
+        void endObject();
+
+        void beginArray();
+
+        void endArray();
+
+        void key(const char *name);
+
+        void key(QStringView name);
+
+        void value(const QString &value);
+
+        void value(const char *value);
+
+        void value(bool value);
+
+        void value(int value);
+
+        void value(qint64 value);
+
+        void value(double value);
+
+        void value(const QVector<QString> &values);
+
+        void value(const QMap<QString, QVector<QString>> &values);
+
+        void value(const QJsonValue &value);
+
+        template<typename T>
+        void field(const char *name, const T &fieldValue) {
+            key(name);
+            value(fieldValue);
+        }
+
+        QByteArray data() const;
+
+    private:
+        QByteArray buffer;
+        QCborStreamWriter writer;
+    };
+
+    // 只写字段，不写外层的大括号，单条记录的响应中字段与success并列；
+    // 字段名和顺序来自 Entity::descriptor，在编译期展开，内部字段（如版本号）和mask未选中的字段不输出
+    template<typename Writer, typename Class>
+    void writeFields(Writer &writer, const Class &entity, Entity::FieldMask mask = FIELD_MASK_ALL) {
+        Entity::forEachField<Class>(mask, [&writer, &entity](const auto &field) {
+            if (!field.has(FIELD_INTERNAL)) {
+                writer.field(field.Name, entity.*(field.Member));
+            }
+        });
+    }
+
+    template<typename Writer, typename Class>
+    void writeObject(Writer &writer, const Class &entity, Entity::FieldMask mask = FIELD_MASK_ALL) {
+        writer.beginObject();
+        writeFields(writer, entity, mask);
+        writer.endObject();
+    }
+
+} // Serializer
+
+#endif //SERIALIZER_H
@@ -0,0 +1,53 @@
+#include "timetable.h"
+#include <QStringList>
+
+namespace Timetable {
+
+    QVector<TimeSlot> parseTimeAndLocations(const QMap<QString, QVector<QString>> &timeAndLocations) {
+        QVector<TimeSlot> timeSlots;
+        for (auto it = timeAndLocations.cbegin(); it != timeAndLocations.cend(); ++it) {
+            if (it.value().isEmpty() || it.value()[0].size() < 3) {
+                continue;
+            }
+            // 解析节次，如 "40809节" -> 星期四，第8、9节
+            QString details = it.value()[0];
+            int dayOfWeek = details.left(1).toInt();
+            QString classPeriods = details.mid(1);
+            classPeriods.chop(1);
+            quint32 periods = 0;
+            for (int i = 0; i + 1 < classPeriods.length(); i += 2) {
+                int period = classPeriods.mid(i, 2).toInt();
+                if (period > 0 && period < 32) {
+                    periods |= 1u << period;
+                }
+            }
+
+            // 解析周次，如 "1-6周"、"3周"、"1-8,10-12周"
+            QString weeks = it.key();
+            weeks.remove("周");
+            for (const auto &range: weeks.split(",", Qt::SkipEmptyParts)) {
+                QStringList bounds = range.split("-");
+                TimeSlot slot{};
+                slot.FirstWeek = bounds[0].toInt();
+                slot.LastWeek = bounds.size() > 1 ? bounds[1].toInt() : slot.FirstWeek;
+                slot.DayOfWeek = dayOfWeek;
+                slot.Periods = periods;
+                timeSlots.append(slot);
+            }
+        }
+        return timeSlots;
+    }
+
+    bool isConflict(const QVector<TimeSlot> &a, const QVector<TimeSlot> &b) {
+        for (const auto &x: a) {
+            for (const auto &y: b) {
+                if (x.DayOfWeek == y.DayOfWeek && (x.Periods & y.Periods) != 0 &&
+                    x.FirstWeek <= y.LastWeek && y.FirstWeek <= x.LastWeek) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+} // Timetable
@@ -0,0 +1,26 @@
+#ifndef TIMETABLE_H
+#define TIMETABLE_H
+
+#include <QString>
+#include <QVector>
+#include <QMap>
+
+namespace Timetable {
+
+    class TimeSlot {
+    public:
+        int FirstWeek; // 起始周
+        int LastWeek; // 结束周
+        int DayOfWeek; // 星期几，1-7
+        quint32 Periods; // 节次位图，第i位表示第i节
+    };
+
+    // 解析课程上课时间，格式如下：{"1-6周":["40809节","4501"],"7-10周":["30609节","4601"]}
+    QVector<TimeSlot> parseTimeAndLocations(const QMap<QString, QVector<QString>> &timeAndLocations);
+
+    // 判断两组上课时间是否存在冲突
+    bool isConflict(const QVector<TimeSlot> &a, const QVector<TimeSlot> &b);
+
+} // Timetable
+
+#endif //TIMETABLE_H
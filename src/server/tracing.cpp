@@ -0,0 +1,75 @@
+#include "tracing.h"
+#include <QDebug>
+#include <QString>
+#include <atomic>
+
+namespace Tracing {
+
+    namespace {
+
+        const char *const PHASE_NAMES[TRACE_PHASES] = {"auth", "db", "parse", "serialize"};
+
+        std::function<void(const QString &)> logSink;
+
+        QByteArray milliseconds(qint64 nanos) {
+            return QByteArray::number(double(nanos) / 1e6, 'f', 3);
+        }
+
+    }
+
+    context::context() {
+        Timer.start();
+    }
+
+    void context::add(int phase, qint64 nanos) {
+        Nanos[phase] += nanos;
+        Counts[phase]++;
+    }
+
+    QByteArray context::header() const {
+        QByteArray value;
+        for (int i = 0; i < TRACE_PHASES; i++) {
+            // 没有经过的阶段不输出
+            if (Counts[i] == 0) {
+                continue;
+            }
+            value.append(PHASE_NAMES[i]).append(";dur=").append(milliseconds(Nanos[i]));
+            if (Counts[i] > 1) {
+                value.append(";desc=\"x").append(QByteArray::number(Counts[i])).append('"');
+            }
+            value.append(", ");
+        }
+        value.append("total;dur=").append(milliseconds(Timer.nsecsElapsed()));
+        return value;
+    }
+
+    activation::activation(context *target) : previous(current) {
+        current = target;
+    }
+
+    activation::~activation() {
+        current = previous;
+    }
+
+    bool sampled() {
+        if (TRACE_SAMPLE_INTERVAL <= 0) {
+            return false;
+        }
+        static std::atomic<quint64> requestCount{0};
+        return requestCount.fetch_add(1, std::memory_order_relaxed) % TRACE_SAMPLE_INTERVAL == 0;
+    }
+
+    void log(const QString &path, int statusCode, const context &target) {
+        QString line = path + " " + QString::number(statusCode) + " " + QString::fromLatin1(target.header());
+        if (logSink) {
+            logSink(line);
+        } else {
+            qInfo().noquote() << "Trace |" << line;
+        }
+    }
+
+    void setLog(std::function<void(const QString &)> sink) {
+        logSink = std::move(sink);
+    }
+
+} // Tracing
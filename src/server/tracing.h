@@ -0,0 +1,90 @@
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QString>
+#include <functional>
+
+#define TRACE_ENABLED 1 // 为0时不记录阶段耗时，也不添加 Server-Timing 头
+#define TRACE_SAMPLE_INTERVAL 100 // 每多少个请求在日志中记录一次耗时明细，0表示不记录
+
+#define TRACE_AUTH 0 // 验证JWT
+#define TRACE_DB 1 // 执行SQL语句
+#define TRACE_PARSE 2 // 解析请求body和数据库中的JSON列（如选课名单）
+#define TRACE_SERIALIZE 3 // 序列化响应
+#define TRACE_PHASES 4
+
+namespace Tracing {
+
+    // 一个请求在各阶段的累计耗时
+    class context {
+    public:
+        context();
+
+        void add(int phase, qint64 nanos);
+
+        // Server-Timing 头的值，如 auth;dur=0.012, db;dur=1.305, ..., total;dur=1.9（毫秒）
+        QByteArray header() const;
+
+        qint64 Nanos[TRACE_PHASES] = {}; // 各阶段耗时（纳秒）
+        int Counts[TRACE_PHASES] = {}; // 各阶段的计时次数
+        QElapsedTimer Timer; // 从请求进入分发开始计时
+    };
+
+    // 当前线程正在处理的请求，未启用时为nullptr，计时器只做一次判断
+    inline thread_local context *current = nullptr;
+
+    // 在作用域内把context设为当前线程的请求，离开时恢复；target为nullptr时不计时
+    class activation {
+    public:
+        explicit activation(context *target);
+
+        ~activation();
+
+        activation(const activation &) = delete;
+
+        activation &operator=(const activation &) = delete;
+
+    private:
+        context *previous;
+    };
+
+    // 作用域计时器，把作用域内的耗时计入当前请求的某个阶段
+    class scope {
+    public:
+        explicit scope(int phase) : phase(phase), owner(current) {
+            if (owner != nullptr) {
+                timer.start();
+            }
+        }
+
+        ~scope() {
+            if (owner != nullptr) {
+                owner->add(phase, timer.nsecsElapsed());
+            }
+        }
+
+        scope(const scope &) = delete;
+
+        scope &operator=(const scope &) = delete;
+
+    private:
+        int phase;
+        context *owner;
+        QElapsedTimer timer;
+    };
+
+    // 按 TRACE_SAMPLE_INTERVAL 抽样，返回true时记录本次请求的耗时明细
+    bool sampled();
+
+    // 写入跟踪日志
+    void log(const QString &path, int statusCode, const context &target);
+
+    // 跟踪日志的去向，服务器交给访问日志的后台线程写入；未设置时用qInfo输出。
+    // 须在开始处理请求前设置
+    void setLog(std::function<void(const QString &)> sink);
+
+} // Tracing
+
+#endif //TRACING_H
@@ -0,0 +1,167 @@
+#include "waitlist.h"
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QDebug>
+
+namespace Waitlist {
+
+    promoter::promoter(const QString &path, Metrics &metrics) : path(path), metrics(metrics) {
+    }
+
+    promoter::~promoter() = default;
+
+    void promoter::start() {
+        // 数据库连接必须在使用它的线程中创建
+        database = std::make_unique<Database::database>(path, "waitlist");
+
+        batchTimer = new QTimer(this);
+        batchTimer->setSingleShot(true);
+        batchTimer->setInterval(WAITLIST_BATCH_INTERVAL);
+        QObject::connect(batchTimer, &QTimer::timeout, this, [this]() {
+            processBatch();
+        });
+
+        sweepTimer = new QTimer(this);
+        sweepTimer->setInterval(WAITLIST_SWEEP_INTERVAL);
+        QObject::connect(sweepTimer, &QTimer::timeout, this, [this]() {
+            sweep();
+        });
+        sweepTimer->start();
+
+        // 启动时处理一次，防止服务重启前遗留的空位无人递补
+        sweep();
+    }
+
+    void promoter::enqueue(const QString &lessonId) {
+        pendingLessons.insert(lessonId);
+        if (!batchTimer->isActive()) {
+            batchTimer->start();
+        }
+    }
+
+    void promoter::sweep() {
+        QVector<QString> lessonIds;
+        if (database->listWaitlistLessons(lessonIds) != Success) {
+            return;
+        }
+        for (const auto &lessonId: lessonIds) {
+            pendingLessons.insert(lessonId);
+        }
+        processBatch();
+    }
+
+    void promoter::processBatch() {
+        QElapsedTimer timer;
+        timer.start();
+
+        QSet<QString> lessonIds;
+        lessonIds.swap(pendingLessons);
+        for (const auto &lessonId: lessonIds) {
+            promoteLesson(lessonId);
+        }
+
+        metrics.LastBatchTime = timer.elapsed();
+        metrics.QueueDepth = database->getWaitlistCount();
+    }
+
+    void promoter::promoteLesson(const QString &lessonId) {
+        int capacity = 0;
+        int enrolled = 0;
+        if (database->getLessonSeat(lessonId, capacity, enrolled) != Success) {
+            return;
+        }
+        // 容量为0表示不限人数
+        int freeSeats = capacity > 0 ? capacity - enrolled : WAITLIST_BATCH_SIZE;
+        if (freeSeats <= 0) {
+            return;
+        }
+        freeSeats = qMin(freeSeats, WAITLIST_BATCH_SIZE);
+
+        QVector<WaitlistEntry> entries;
+        if (database->listWaitlist(lessonId, entries, -1) != Success) {
+            return;
+        }
+
+        for (const auto &entry: entries) {
+            if (freeSeats <= 0) {
+                // 本批名额已用完，剩余的留到下一批
+                pendingLessons.insert(lessonId);
+                if (!batchTimer->isActive()) {
+                    batchTimer->start();
+                }
+                break;
+            }
+
+            // 检查、选课和删除候补记录在同一个写事务中，学生同时在其他连接上选退课时不会按过期的选课列表递补
+            if (!database->transaction()) {
+                return;
+            }
+            // 递补前重新检查时间冲突和学分上限
+            Status status = database->checkChooseLesson(entry.StudentId, lessonId);
+            if (status == TIME_CONFLICT || status == CREDIT_EXCEEDED) {
+                // 学生仍保留候补位置，之后退掉其他课程时可再次递补
+                database->rollback();
+                metrics.Skipped++;
+                continue;
+            }
+            if (status != Success) {
+                // 已选上、学生或课程不存在，候补记录已无意义
+                if (database->deleteWaitlist(entry.StudentId, lessonId) != Success || !database->commit()) {
+                    database->rollback();
+                }
+                continue;
+            }
+
+            status = database->addChosenLesson(entry.StudentId, lessonId);
+            if (status == LESSON_FULL) {
+                database->rollback();
+                break;
+            }
+            if (status != Success) {
+                qDebug() << "Debug | waitlist.cpp: promoteLesson error:" << status;
+                database->rollback();
+                continue;
+            }
+            if (database->deleteWaitlist(entry.StudentId, lessonId) != Success || !database->commit()) {
+                database->rollback();
+                continue;
+            }
+            freeSeats--;
+
+            qint64 latency = QDateTime::currentMSecsSinceEpoch() - entry.EnqueueTime;
+            metrics.Promoted++;
+            metrics.LastLatency = latency;
+            metrics.TotalLatency += latency;
+            qint64 maxLatency = metrics.MaxLatency;
+            while (latency > maxLatency && !metrics.MaxLatency.compare_exchange_weak(maxLatency, latency)) {
+            }
+        }
+    }
+
+    service::service(const QString &path) {
+        worker = new promoter(path, waitlistMetrics);
+        worker->moveToThread(&thread);
+        QObject::connect(&thread, &QThread::finished, worker, &QObject::deleteLater);
+        thread.start();
+        QMetaObject::invokeMethod(worker, [this]() {
+            worker->start();
+        }, Qt::QueuedConnection);
+    }
+
+    service::~service() {
+        thread.quit();
+        thread.wait();
+    }
+
+    void service::notifySeatFreed(const QString &lessonId) {
+        // 投递到后台线程执行，请求线程立即返回
+        QMetaObject::invokeMethod(worker, [this, lessonId]() {
+            worker->enqueue(lessonId);
+        }, Qt::QueuedConnection);
+    }
+
+    const Metrics &service::metrics() const {
+        return waitlistMetrics;
+    }
+
+} // Waitlist
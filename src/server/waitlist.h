@@ -0,0 +1,75 @@
+#ifndef WAITLIST_H
+#define WAITLIST_H
+
+#include "database.h"
+#include <QObject>
+#include <QThread>
+#include <QTimer>
+#include <QSet>
+#include <atomic>
+#include <memory>
+
+#define WAITLIST_BATCH_INTERVAL 200 // 收到空位通知后合并处理的等待时间（毫秒）
+#define WAITLIST_SWEEP_INTERVAL 30000 // 定期全量检查候补队列的间隔（毫秒）
+#define WAITLIST_BATCH_SIZE 64 // 单门课程每批最多递补的人数
+
+namespace Waitlist {
+
+    // 候补递补的运行指标，由后台线程写入，请求线程只读
+    class Metrics {
+    public:
+        std::atomic<int> QueueDepth{0}; // 当前候补队列总长度
+        std::atomic<qint64> Promoted{0}; // 累计递补成功人数
+        std::atomic<qint64> Skipped{0}; // 累计因时间冲突、学分超限等原因跳过的次数
+        std::atomic<qint64> LastLatency{0}; // 最近一次递补的等待时间（毫秒）
+        std::atomic<qint64> TotalLatency{0}; // 累计递补等待时间（毫秒）
+        std::atomic<qint64> MaxLatency{0}; // 最大递补等待时间（毫秒）
+        std::atomic<qint64> LastBatchTime{0}; // 最近一批处理耗时（毫秒）
+    };
+
+    // 运行在后台线程中的递补执行者，使用独立的数据库连接
+    class promoter : public QObject {
+    public:
+        promoter(const QString &path, Metrics &metrics);
+
+        ~promoter() override;
+
+        void start();
+
+        void enqueue(const QString &lessonId);
+
+        void sweep();
+
+    private:
+        QString path;
+        Metrics &metrics;
+        std::unique_ptr<Database::database> database;
+        QTimer *batchTimer = nullptr;
+        QTimer *sweepTimer = nullptr;
+        QSet<QString> pendingLessons;
+
+        void processBatch();
+
+        void promoteLesson(const QString &lessonId);
+    };
+
+    // 请求线程使用的接口，只负责投递通知，不在请求线程中执行递补
+    class service {
+    public:
+        explicit service(const QString &path);
+
+        ~service();
+
+        void notifySeatFreed(const QString &lessonId);
+
+        const Metrics &metrics() const;
+
+    private:
+        Metrics waitlistMetrics;
+        QThread thread;
+        promoter *worker;
+    };
+
+} // Waitlist
+
+#endif //WAITLIST_H
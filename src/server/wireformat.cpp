@@ -0,0 +1,103 @@
+#include "wireformat.h"
+#include <QCborValue>
+#include <QCborMap>
+#include <QCborArray>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QList>
+
+namespace WireFormat {
+
+    namespace {
+
+        // 去掉参数部分，如 application/cbor; charset=utf-8
+        QByteArray mediaType(const QByteArray &value) {
+            return value.left(value.indexOf(';')).trimmed().toLower();
+        }
+
+        double quality(const QByteArray &item) {
+            QList<QByteArray> params = item.split(';');
+            for (qsizetype i = 1; i < params.size(); i++) {
+                QByteArray param = params[i].trimmed();
+                if (param.startsWith("q=")) {
+                    return param.mid(2).toDouble();
+                }
+            }
+            return 1.0;
+        }
+
+    }
+
+    int negotiate(const QByteArray &accept) {
+        if (!accept.contains("cbor")) {
+            return FORMAT_JSON;
+        }
+        // 同等权重时按客户端列出的先后顺序选择
+        double cborQuality = -1;
+        double jsonQuality = -1;
+        double wildcardQuality = -1;
+        bool cborFirst = false;
+        for (const auto &item: accept.split(',')) {
+            QByteArray type = mediaType(item);
+            if (type == MIME_CBOR) {
+                cborQuality = quality(item);
+                cborFirst = jsonQuality < 0;
+            } else if (type == MIME_JSON) {
+                jsonQuality = quality(item);
+            } else if (type == "application/*" || type == "*/*") {
+                wildcardQuality = qMax(wildcardQuality, quality(item));
+            }
+        }
+        if (jsonQuality < 0) {
+            jsonQuality = wildcardQuality;
+        }
+        if (cborQuality <= 0) {
+            return FORMAT_JSON;
+        }
+        if (cborQuality > jsonQuality || (cborQuality == jsonQuality && cborFirst)) {
+            return FORMAT_CBOR;
+        }
+        return FORMAT_JSON;
+    }
+
+    int contentFormat(const QByteArray &contentType) {
+        return mediaType(contentType) == MIME_CBOR ? FORMAT_CBOR : FORMAT_JSON;
+    }
+
+    QJsonDocument parse(const QByteArray &body, int format) {
+        if (format != FORMAT_CBOR) {
+            return QJsonDocument::fromJson(body);
+        }
+        QCborParserError error;
+        QCborValue value = QCborValue::fromCbor(body, &error);
+        if (error.error != QCborError::NoError) {
+            return {};
+        }
+        // 处理函数按JSON读取字段，CBOR中的整数、字符串等类型可以无损转换
+        if (value.isMap()) {
+            return QJsonDocument(value.toMap().toJsonObject());
+        }
+        if (value.isArray()) {
+            return QJsonDocument(value.toArray().toJsonArray());
+        }
+        return {};
+    }
+
+    QByteArray toCbor(const QByteArray &json) {
+        QJsonParseError error;
+        QJsonDocument doc = QJsonDocument::fromJson(json, &error);
+        if (error.error != QJsonParseError::NoError) {
+            return {};
+        }
+        // 整数值的double会编码为CBOR整数，比JSON文本和双精度浮点都更短
+        if (doc.isArray()) {
+            return QCborArray::fromJsonArray(doc.array()).toCborValue().toCbor();
+        }
+        return QCborMap::fromJsonObject(doc.object()).toCborValue().toCbor();
+    }
+
+    const char *mimeType(int format) {
+        return format == FORMAT_CBOR ? MIME_CBOR : MIME_JSON;
+    }
+
+} // WireFormat
@@ -0,0 +1,31 @@
+#ifndef WIREFORMAT_H
+#define WIREFORMAT_H
+
+#include <QByteArray>
+#include <QJsonDocument>
+
+#define FORMAT_JSON 0 // application/json
+#define FORMAT_CBOR 1 // application/cbor（RFC 8949）
+
+#define MIME_JSON "application/json"
+#define MIME_CBOR "application/cbor"
+
+namespace WireFormat {
+
+    // 根据 Accept 选择响应格式，只有客户端明确要求且优先于JSON时才使用CBOR
+    int negotiate(const QByteArray &accept);
+
+    // 根据 Content-Type 选择请求body的格式
+    int contentFormat(const QByteArray &contentType);
+
+    // 将请求body解析为与JSON相同的文档结构，解析失败时返回空文档
+    QJsonDocument parse(const QByteArray &body, int format);
+
+    // 将JSON编码的响应body转换为CBOR，转换失败时返回空
+    QByteArray toCbor(const QByteArray &json);
+
+    const char *mimeType(int format);
+
+} // WireFormat
+
+#endif //WIREFORMAT_H